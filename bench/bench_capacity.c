@@ -0,0 +1,173 @@
+/*
+Memory per idle connection, and what it costs the reactor to find one.
+
+Sets up the connection table of a server with N slots the way xnet_start() does and reports what each slot takes:
+the connection itself, its hot entry, its cold state and its rate buckets. Then accepts as many idle clients over
+unix socketpairs as the fd limit allows, and reports the resident memory each empty slot costs and what an idle
+client adds on top of its slot. Last, fills every slot and times finding a connection from the data epoll hands
+back, the way the reactor does, against scanning the hot array by fd and scanning the connections themselves.
+
+usage: bench_capacity [slots] [lookups]
+*/
+#include <sys/resource.h>
+
+#include "xnet_base.h"
+#include "xnet_utils.h"
+
+#define BENCH_SLOTS_DEFAULT     100000
+#define BENCH_LOOKUPS_DEFAULT   2000
+#define BENCH_FAKE_FD_BASE      (1 << 24) // Far above any fd the process could hold.
+
+static double now_us(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+static size_t resident_bytes(void)
+{
+    unsigned long pages = 0;
+    unsigned long resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (NULL == statm) {
+        return 0;
+    }
+    if (2 != fscanf(statm, "%lu %lu", &pages, &resident)) {
+        resident = 0;
+    }
+    fclose(statm);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static xnet_active_connection_t *scan_connections(xnet_box_t *xnet, int socket)
+{
+    for (size_t n = 0; n < xnet->general->max_connections; n++) {
+        if (socket == xnet->connections->clients[n].socket) {
+            return &xnet->connections->clients[n];
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    size_t slots = (1 < argc) ? strtoul(argv[1], NULL, 10) : BENCH_SLOTS_DEFAULT;
+    size_t lookups = (2 < argc) ? strtoul(argv[2], NULL, 10) : BENCH_LOOKUPS_DEFAULT;
+    if (0 == slots || 0 == lookups) {
+        slots = BENCH_SLOTS_DEFAULT;
+        lookups = BENCH_LOOKUPS_DEFAULT;
+    }
+
+    /* Every client costs three fds: its socket, its peer and its session timer. */
+    struct rlimit fd_limit = {0};
+    getrlimit(RLIMIT_NOFILE, &fd_limit);
+    fd_limit.rlim_cur = fd_limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &fd_limit);
+    size_t clients = (fd_limit.rlim_cur - 64) / 3;
+    clients = (slots < clients) ? slots : clients;
+
+    /* Just enough of a server to accept clients. */
+    xnet_box_t xnet = {0};
+    xnet_general_group_t general = {0};
+    xnet_network_group_t network = {0};
+    xnet_connection_group_t connections = {0};
+    xnet.general = &general;
+    xnet.network = &network;
+    xnet.connections = &connections;
+    general.max_connections = slots;
+    general.connection_timeout = XNET_TIMEOUT_DEFAULT;
+    general.rate_rule_count = 1;
+    network.epoll_fd = epoll_create1(0);
+
+    size_t before = resident_bytes();
+    if (0 != xnet_init_connections(&xnet)) {
+        return 1;
+    }
+    size_t table = resident_bytes() - before;
+
+    int *peers = calloc(clients, sizeof(int));
+    if (NULL == peers) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    before = resident_bytes();
+    for (size_t n = 0; n < clients; n++) {
+        int pair[2];
+        if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, pair)) {
+            perror("socketpair");
+            return 1;
+        }
+        if (NULL == xnet_create_connection(&xnet, pair[0])) {
+            return 1;
+        }
+        peers[n] = pair[1];
+    }
+    size_t accepted = resident_bytes() - before;
+
+    printf("[bench_capacity] slots=%zu clients=%zu lookups=%zu\n", slots, clients, lookups);
+    size_t rate_buckets = general.rate_rule_count * sizeof(xnet_rate_bucket_t);
+    printf("  per slot   connection: %zu B  hot entry: %zu B  cold: %zu B  rate buckets: %zu B  total: %zu B\n",
+           sizeof(xnet_active_connection_t), sizeof(xnet_conn_hot_t), sizeof(xnet_conn_cold_t), rate_buckets,
+           sizeof(xnet_active_connection_t) + sizeof(xnet_conn_hot_t) + sizeof(xnet_conn_cold_t) + rate_buckets);
+    printf("  resident per empty slot: %.1f B  per idle client on top: %.1f B\n",
+           (double)table / slots, (double)accepted / clients);
+
+    /* The rest of the slots get fds no client could have, so every scan walks a full table. */
+    for (size_t n = clients; n < slots; n++) {
+        connections.clients[n].socket = BENCH_FAKE_FD_BASE + n;
+        connections.hot[n].socket = BENCH_FAKE_FD_BASE + n;
+        connections.hot[n].is_active = true;
+        connections.hot[n].generation = 1;
+    }
+
+    int *wanted = calloc(lookups, sizeof(int));
+    uint64_t *wanted_data = calloc(lookups, sizeof(uint64_t));
+    if (NULL == wanted || NULL == wanted_data) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (size_t n = 0; n < lookups; n++) {
+        xnet_active_connection_t *conn = &connections.clients[rand() % slots];
+        wanted[n] = conn->socket;
+        wanted_data[n] = xnet_event_data(&xnet, conn, false);
+    }
+
+    size_t found = 0;
+    double start = now_us();
+    for (size_t n = 0; n < lookups; n++) {
+        found += NULL != xnet_conn_from_event(&xnet, wanted_data[n]);
+    }
+    double event_us = now_us() - start;
+
+    start = now_us();
+    for (size_t n = 0; n < lookups; n++) {
+        found += NULL != xnet_get_conn_by_socket(&xnet, wanted[n]);
+    }
+    double hot_us = now_us() - start;
+
+    start = now_us();
+    for (size_t n = 0; n < lookups; n++) {
+        found += NULL != scan_connections(&xnet, wanted[n]);
+    }
+    double full_us = now_us() - start;
+
+    printf("  lookup  epoll data: %9.3f us  hot scan: %9.2f us  connection scan: %9.2f us  found %zu of %zu\n",
+           event_us / lookups, hot_us / lookups, full_us / lookups, found, lookups * 3);
+
+    for (size_t n = 0; n < clients; n++) {
+        close(connections.clients[n].socket);
+        close(connections.clients[n].session.timer_fd);
+        close(peers[n]);
+    }
+    close(network.epoll_fd);
+    nfree((void **)&wanted);
+    nfree((void **)&wanted_data);
+    nfree((void **)&peers);
+    nfree((void **)&connections.clients);
+    nfree((void **)&connections.hot);
+    nfree((void **)&connections.cold);
+    nfree((void **)&connections.rate_buckets);
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+Checksum throughput per core, portable kernels against vector ones.
+
+Checksums the same random buffer over and over with CRC-32C and XXH3, once per kernel this CPU supports, at the
+buffer sizes transfers actually hand over: a small file, one read of a checksummed range and one status chunk.
+Every kernel has to agree with the portable one. Reports GB/s of CPU time, and how many cores it would take to
+keep up with a 10 Gbit link.
+
+usage: bench_checksum [MiB per run]
+*/
+#include "xnet_checksum.h"
+
+#include <time.h>
+#include <string.h>
+
+#define BENCH_MIB_DEFAULT   512
+#define BENCH_LINK_GBIT     10
+
+static const size_t bench_sizes[] = {4096, 65536, 1048576};
+
+static double cpu_us(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+static uint64_t run_crc32c(const unsigned char *buf, size_t size, size_t rounds)
+{
+    uint32_t crc = 0;
+    for (size_t n = 0; n < rounds; n++) {
+        crc = xnet_crc32c(crc, buf, size);
+    }
+    return crc;
+}
+
+static uint64_t run_xxh3(const unsigned char *buf, size_t size, size_t rounds)
+{
+    uint64_t hash = 0;
+    for (size_t n = 0; n < rounds; n++) {
+        hash ^= xnet_xxh3(buf, size);
+    }
+    return hash;
+}
+
+static void report(const char *name, const char *kernel, size_t size, size_t rounds, double us)
+{
+    double gbps = (double)size * rounds / (us * 1e3);
+    printf("    %-6s %-8s %8zu B  %7.2f GB/s per core  %4.2f cores for %d Gbit\n",
+           name, kernel, size, gbps, BENCH_LINK_GBIT / 8.0 / gbps, BENCH_LINK_GBIT);
+}
+
+int main(int argc, char **argv)
+{
+    size_t mib = (1 < argc) ? strtoul(argv[1], NULL, 10) : BENCH_MIB_DEFAULT;
+    size_t largest = bench_sizes[sizeof(bench_sizes) / sizeof(bench_sizes[0]) - 1];
+    unsigned int supported = xnet_checksum_supported();
+
+    printf("[bench_checksum] MiB=%zu sse4.2=%s avx2=%s\n", mib,
+           (supported & XNET_CHECKSUM_SSE42) ? "yes" : "no", (supported & XNET_CHECKSUM_AVX2) ? "yes" : "no");
+
+    unsigned char *buf = malloc(largest);
+    if (NULL == buf) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    unsigned int state = 1;
+    for (size_t n = 0; n < largest; n++) {
+        state = state * 1103515245u + 12345u;
+        buf[n] = state >> 16;
+    }
+
+    for (size_t s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++) {
+        size_t size = bench_sizes[s];
+        size_t rounds = (mib << 20) / size;
+
+        /* Portable first, so there is something to hold the vector kernels to. */
+        xnet_checksum_select(0);
+        uint64_t crc_expected = run_crc32c(buf, size, 1);
+        uint64_t xxh3_expected = run_xxh3(buf, size, 1);
+
+        double start = cpu_us();
+        run_crc32c(buf, size, rounds);
+        report("crc32c", "portable", size, rounds, cpu_us() - start);
+
+        if (supported & XNET_CHECKSUM_SSE42) {
+            xnet_checksum_select(XNET_CHECKSUM_SSE42);
+            if (crc_expected != run_crc32c(buf, size, 1)) {
+                fprintf(stderr, "sse4.2 CRC-32C disagrees at %zu bytes\n", size);
+                return 1;
+            }
+
+            start = cpu_us();
+            run_crc32c(buf, size, rounds);
+            report("crc32c", "sse4.2", size, rounds, cpu_us() - start);
+        }
+
+        xnet_checksum_select(0);
+        start = cpu_us();
+        run_xxh3(buf, size, rounds);
+        report("xxh3", "portable", size, rounds, cpu_us() - start);
+
+        if (supported & XNET_CHECKSUM_AVX2) {
+            xnet_checksum_select(XNET_CHECKSUM_AVX2);
+            if (xxh3_expected != run_xxh3(buf, size, 1)) {
+                fprintf(stderr, "avx2 XXH3 disagrees at %zu bytes\n", size);
+                return 1;
+            }
+
+            start = cpu_us();
+            run_xxh3(buf, size, rounds);
+            report("xxh3", "avx2", size, rounds, cpu_us() - start);
+        }
+    }
+
+    xnet_checksum_select(supported);
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,154 @@
+/*
+CPU cost of per-connection compression against the bytes it saves.
+
+Codes a stream of room messages, one block per message the way a member's connection sees them, with every
+codec in both wire formats. Messages are short chat lines drawn from a small vocabulary, which is what rooms
+actually carry. Every block is decoded again, in order, to check the round trip. Reports bytes per message before and
+after, CPU time spent coding and decoding, and what that buys on a bandwidth bound link.
+
+usage: bench_compress [messages]
+*/
+#include "xnet_addon_chat.h"
+
+#define BENCH_MESSAGES_DEFAULT 100000
+#define BENCH_LINK_MBIT        100 // Mobile edge uplink the saved bytes are weighed against.
+
+static const char *bench_users[] = {"alice", "bob", "carol", "dave", "erin", "frank", "grace", "heidi"};
+static const char *bench_words[] = {
+    "the", "a", "is", "to", "and", "of", "in", "it", "you", "that", "for", "on", "with", "this", "be", "at",
+    "have", "are", "not", "but", "we", "they", "what", "so", "can", "just", "now", "here", "there", "ok",
+    "server", "room", "message", "deploy", "build", "meeting", "lunch", "today", "tomorrow", "thanks",
+    "anyone", "seen", "logs", "restart", "fixed", "broken", "again", "please", "check", "ticket",
+};
+
+static double cpu_us(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+static unsigned int next_random(unsigned int *state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 16;
+}
+
+/* Same seed every run, so every codec and format sees the same conversation. */
+static void make_message(struct chat_message_tt *message, unsigned long long seq, unsigned int *state)
+{
+    memset(message, 0, sizeof(struct chat_message_tt));
+    const char *user = bench_users[next_random(state) % (sizeof(bench_users) / sizeof(bench_users[0]))];
+
+    int length = 0;
+    int words = 2 + next_random(state) % 12;
+    for (int n = 0; n < words; n++) {
+        const char *word = bench_words[next_random(state) % (sizeof(bench_words) / sizeof(bench_words[0]))];
+        length += snprintf(message->msg + length, MAX_MESSAGE_LENGTH - length, "%s%s", n ? " " : "", word);
+    }
+
+    message->opcode_relation = htons(CHAT_ROOM_MESSAGE);
+    message->seq = htobe64(seq);
+    memcpy(message->from_username, user, strlen(user));
+    message->from_username_length = htonl(strlen(user));
+    message->msg_length = htonl(length);
+}
+
+int main(int argc, char **argv)
+{
+    size_t messages = (1 < argc) ? strtoul(argv[1], NULL, 10) : BENCH_MESSAGES_DEFAULT;
+    const char *format_names[XNET_WIRE_FORMATS] = {"fixed", "compact"};
+    const char *codec_names[XNET_CODECS] = {"none", "lz", "zlib"};
+    unsigned int supported = xnet_supported_codecs();
+
+    printf("[bench_compress] messages=%zu window=%d min=%d\n", messages, XNET_LZ_WINDOW_SZ, XNET_COMPRESS_MIN_SZ);
+
+    for (int format = 0; format < XNET_WIRE_FORMATS; format++) {
+        printf("  format=%s\n", format_names[format]);
+
+        for (int codec = XNET_CODEC_LZ; codec < XNET_CODECS; codec++) {
+            if (0 == (supported & (1u << codec))) {
+                printf("    %-5s not built in\n", codec_names[codec]);
+                continue;
+            }
+
+            xnet_compress_ctx_t *compress = xnet_compress_create(codec);
+            xnet_decompress_ctx_t *decompress = xnet_decompress_create(codec);
+            if (NULL == compress || NULL == decompress) {
+                fprintf(stderr, "failed to set up %s\n", codec_names[codec]);
+                return 1;
+            }
+
+            /* Encode the conversation up front so only the codec is timed. */
+            unsigned int state = 1;
+            size_t raw_bytes = 0;
+            size_t sent_bytes = 0;
+            char *encoded = malloc(messages * sizeof(struct chat_message_tt));
+            size_t *lengths = malloc(messages * sizeof(size_t));
+            xnet_shared_buf_t **blocks = calloc(messages, sizeof(xnet_shared_buf_t *));
+            if (NULL == encoded || NULL == lengths || NULL == blocks) {
+                fprintf(stderr, "out of memory\n");
+                return 1;
+            }
+
+            for (size_t n = 0; n < messages; n++) {
+                struct chat_message_tt message;
+                make_message(&message, n + 1, &state);
+                lengths[n] = chat_encode_message(encoded + n * sizeof(struct chat_message_tt), format, &message);
+                raw_bytes += lengths[n];
+            }
+
+            /* Short sends skip the stream, as they do on a live connection. */
+            double start = cpu_us();
+            for (size_t n = 0; n < messages; n++) {
+                if (XNET_COMPRESS_MIN_SZ > lengths[n]) {
+                    continue;
+                }
+                blocks[n] = xnet_compress_block(compress, encoded + n * sizeof(struct chat_message_tt), lengths[n]);
+                if (NULL == blocks[n]) {
+                    fprintf(stderr, "%s failed to code message %zu\n", codec_names[codec], n);
+                    return 1;
+                }
+            }
+            double code_us = cpu_us() - start;
+
+            start = cpu_us();
+            char decoded[sizeof(struct chat_message_tt)];
+            for (size_t n = 0; n < messages; n++) {
+                if (NULL == blocks[n]) {
+                    sent_bytes += lengths[n];
+                    continue;
+                }
+                sent_bytes += blocks[n]->length;
+
+                ssize_t decoded_length = xnet_decompress_block(decompress, blocks[n]->data, blocks[n]->length, decoded, sizeof(decoded));
+                if ((ssize_t)lengths[n] != decoded_length || 0 != memcmp(encoded + n * sizeof(struct chat_message_tt), decoded, lengths[n])) {
+                    fprintf(stderr, "%s round trip broke at message %zu\n", codec_names[codec], n);
+                    return 1;
+                }
+            }
+            double decode_us = cpu_us() - start;
+
+            for (size_t n = 0; n < messages; n++) {
+                xnet_buf_release(blocks[n]);
+            }
+            free(encoded);
+            free(lengths);
+            free(blocks);
+
+            /* Link time is what the saved bytes are worth, CPU time is what they cost. */
+            double saved = (double)raw_bytes - (double)sent_bytes;
+            double link_saved_us = saved * 8 / BENCH_LINK_MBIT;
+            printf("    %-5s %6.1f -> %6.1f bytes/msg  %5.1f%% saved  code %6.2f us/msg  decode %6.2f us/msg"
+                   "  %6.2f us CPU per KB saved  %5.1fx link time saved per CPU time spent\n",
+                   codec_names[codec], (double)raw_bytes / messages, (double)sent_bytes / messages,
+                   100 * saved / raw_bytes, code_us / messages, decode_us / messages,
+                   (0 < saved) ? code_us / (saved / 1024) : 0, (0 < code_us) ? link_saved_us / code_us : 0);
+
+            xnet_compress_destroy(compress);
+            xnet_decompress_destroy(decompress);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,217 @@
+/*
+Tail latency of light clients next to heavy ones, with and without per-connection fair queuing.
+
+Heavy connections always have one expensive request queued, the way a pipelining client does once the reactor reads
+its next request as soon as the last one is done. Light connections send a cheap request now and then. The first run
+queues every task in one shared flow, which is what a single FIFO does. The second gives every connection its own
+flow, served by deficit round robin on worker time. Reports p50/p99/max from submit to start for light requests, and
+the share of worker time each group got.
+
+usage: bench_fair [seconds per run] [heavy us]
+*/
+#include "xnet_base.h"
+#include "xnet_threads.h"
+
+#define BENCH_SECONDS_DEFAULT   2
+#define BENCH_HEAVY_US_DEFAULT  500
+#define BENCH_LIGHT_US          10
+#define BENCH_HEAVY_CONNS       40
+#define BENCH_LIGHT_CONNS       40
+#define BENCH_THINK_US          2000
+#define BENCH_MAX_SAMPLES       1000000
+
+typedef struct bench_state {
+    xnet_box_t *xnet;
+    xnet_active_connection_t *conns;
+    bool is_fair;
+    bool stop;
+    double heavy_us;
+    uint64_t heavy_busy_us;
+    uint64_t light_busy_us;
+    size_t heavy_done;
+    size_t in_flight;
+    /* Written by workers for light connections, read by the driver once is_idle flips. */
+    bool is_idle[BENCH_LIGHT_CONNS];
+    double latency[BENCH_MAX_SAMPLES];
+    size_t samples;
+} bench_state_t ;
+
+typedef struct bench_job {
+    bench_state_t *state;
+    size_t conn;
+    double submitted;
+} bench_job_t ;
+
+static bench_state_t state = {0};
+
+static double now_us(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double lhs = *(const double *)a;
+    double rhs = *(const double *)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static bool submit(bench_state_t *bench, size_t conn);
+
+static int run_job(xnet_box_t *xnet, void *arg)
+{
+    (void)xnet;
+    bench_job_t *job = arg;
+    bench_state_t *bench = job->state;
+    bool is_heavy = BENCH_HEAVY_CONNS > job->conn;
+    double started = now_us();
+
+    if (false == is_heavy) {
+        size_t sample = __atomic_fetch_add(&bench->samples, 1, __ATOMIC_RELAXED);
+        if (BENCH_MAX_SAMPLES > sample) {
+            bench->latency[sample] = started - job->submitted;
+        }
+    }
+
+    /* Busy, not asleep, so the pool really is short of workers. */
+    double work_us = is_heavy ? bench->heavy_us : BENCH_LIGHT_US;
+    while (now_us() - started < work_us) {
+    }
+
+    /* Heavy clients have their next request queued as soon as this one is done. */
+    if (is_heavy) {
+        __atomic_fetch_add(&bench->heavy_done, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&bench->heavy_busy_us, (uint64_t)work_us, __ATOMIC_RELAXED);
+        if (false == __atomic_load_n(&bench->stop, __ATOMIC_ACQUIRE)) {
+            submit(bench, job->conn);
+        }
+    } else {
+        __atomic_fetch_add(&bench->light_busy_us, (uint64_t)work_us, __ATOMIC_RELAXED);
+        __atomic_store_n(&bench->is_idle[job->conn - BENCH_HEAVY_CONNS], true, __ATOMIC_RELEASE);
+    }
+
+    __atomic_fetch_sub(&bench->in_flight, 1, __ATOMIC_RELEASE);
+    free(job);
+    return 0;
+}
+
+static bool submit(bench_state_t *bench, size_t conn)
+{
+    bench_job_t *job = calloc(1, sizeof(bench_job_t));
+    xnet_task_t *task = calloc(1, sizeof(xnet_task_t));
+    if (NULL == job || NULL == task) {
+        free(job);
+        free(task);
+        return false;
+    }
+
+    job->state = bench;
+    job->conn = conn;
+    task->job_function = run_job;
+    task->arg = job;
+    task->xnet = bench->xnet;
+    task->priority = XNET_PRIORITY_NORMAL;
+    /* Tasks without a connection all share one flow. */
+    task->me = bench->is_fair ? &bench->conns[conn] : NULL;
+    pthread_mutex_init(&task->task_lock, NULL);
+
+    __atomic_fetch_add(&bench->in_flight, 1, __ATOMIC_RELAXED);
+    job->submitted = now_us();
+    if (false == xnet_work_try_push(bench->xnet, task)) {
+        __atomic_fetch_sub(&bench->in_flight, 1, __ATOMIC_RELEASE);
+        pthread_mutex_destroy(&task->task_lock);
+        free(job);
+        free(task);
+        return false;
+    }
+    return true;
+}
+
+static void run(const char *name, bool is_fair, double seconds, double heavy_us)
+{
+    /* Just enough of a server for the pool. */
+    xnet_box_t xnet = {0};
+    xnet_thread_group_t thread = {0};
+    xnet.thread = &thread;
+
+    state.xnet = &xnet;
+    state.conns = calloc(BENCH_HEAVY_CONNS + BENCH_LIGHT_CONNS, sizeof(xnet_active_connection_t));
+    state.is_fair = is_fair;
+    state.stop = false;
+    state.heavy_us = heavy_us;
+    state.heavy_busy_us = 0;
+    state.light_busy_us = 0;
+    state.heavy_done = 0;
+    state.in_flight = 0;
+    state.samples = 0;
+    if (NULL == state.conns) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    xnet_create_pool(&xnet);
+
+    for (size_t conn = 0; conn < BENCH_HEAVY_CONNS; conn++) {
+        submit(&state, conn);
+    }
+
+    /* Light clients think for a random while between requests, and never have more than one out. */
+    double next_at[BENCH_LIGHT_CONNS];
+    double started = now_us();
+    for (size_t n = 0; n < BENCH_LIGHT_CONNS; n++) {
+        state.is_idle[n] = true;
+        next_at[n] = started + rand() % BENCH_THINK_US;
+    }
+
+    while (now_us() - started < seconds * 1e6) {
+        double now = now_us();
+        for (size_t n = 0; n < BENCH_LIGHT_CONNS; n++) {
+            if (false == __atomic_load_n(&state.is_idle[n], __ATOMIC_ACQUIRE) || next_at[n] > now) {
+                continue;
+            }
+
+            state.is_idle[n] = false;
+            if (false == submit(&state, BENCH_HEAVY_CONNS + n)) {
+                state.is_idle[n] = true;
+            }
+            next_at[n] = now + rand() % BENCH_THINK_US;
+        }
+        sched_yield();
+    }
+
+    __atomic_store_n(&state.stop, true, __ATOMIC_RELEASE);
+    while (0 < __atomic_load_n(&state.in_flight, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+
+    size_t samples = (BENCH_MAX_SAMPLES < state.samples) ? BENCH_MAX_SAMPLES : state.samples;
+    if (0 == samples) {
+        fprintf(stderr, "No light requests went through\n");
+        exit(1);
+    }
+    double busy_us = (double)(state.heavy_busy_us + state.light_busy_us);
+    qsort(state.latency, samples, sizeof(double), compare_double);
+    printf("  %-5s light p50: %8.1f us  p99: %8.1f us  max: %8.1f us  requests: %zu\n", name,
+           state.latency[samples / 2], state.latency[(samples * 99) / 100], state.latency[samples - 1], samples);
+    printf("        heavy requests: %zu  worker time heavy: %.1f%%  light: %.1f%%\n", state.heavy_done,
+           100.0 * state.heavy_busy_us / busy_us, 100.0 * state.light_busy_us / busy_us);
+
+    xnet_destroy_pool(&xnet);
+    free(state.conns);
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = (1 < argc) ? strtod(argv[1], NULL) : BENCH_SECONDS_DEFAULT;
+    double heavy_us = (2 < argc) ? strtod(argv[2], NULL) : BENCH_HEAVY_US_DEFAULT;
+
+    printf("[bench_fair] heavy=%d x %.0fus light=%d x %dus think<%dus threads=%d seconds=%.1f\n",
+           BENCH_HEAVY_CONNS, heavy_us, BENCH_LIGHT_CONNS, BENCH_LIGHT_US, BENCH_THINK_US, XNET_THREAD_COUNT, seconds);
+
+    run("fifo", false, seconds, heavy_us);
+    run("fair", true, seconds, heavy_us);
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+Room broadcast fan-out benchmark.
+
+Builds a room of N members backed by unix socketpairs and compares the old shout path,
+one blocking send() per member from the worker, against xnet_broadcast(), which serialises once,
+queues a reference per member and leaves the writing to the reactor.
+
+usage: bench_fanout [members] [rounds]
+*/
+#include <sys/resource.h>
+
+#include "xnet_base.h"
+#include "xnet_buffer.h"
+
+#define BENCH_MEMBERS_DEFAULT 10000
+#define BENCH_ROUNDS_DEFAULT  50
+#define BENCH_PAYLOAD_SZ      306 // sizeof(struct chat_message_tt)
+
+static double now_us(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+static size_t drain_peers(int *peers, size_t count)
+{
+    char sink[XNET_MAX_PACKET_BUF_SZ];
+    size_t total = 0;
+    for (size_t n = 0; n < count; n++) {
+        ssize_t got = read(peers[n], sink, sizeof(sink));
+        while (0 < got) {
+            total += got;
+            got = read(peers[n], sink, sizeof(sink));
+        }
+    }
+    return total;
+}
+
+int main(int argc, char **argv)
+{
+    size_t members = (1 < argc) ? strtoul(argv[1], NULL, 10) : BENCH_MEMBERS_DEFAULT;
+    size_t rounds = (2 < argc) ? strtoul(argv[2], NULL, 10) : BENCH_ROUNDS_DEFAULT;
+
+    /* Every member costs two fds. Take what the hard limit allows. */
+    struct rlimit fd_limit = {0};
+    getrlimit(RLIMIT_NOFILE, &fd_limit);
+    fd_limit.rlim_cur = fd_limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &fd_limit);
+    if (members * 2 + 64 > fd_limit.rlim_cur) {
+        members = (fd_limit.rlim_cur - 64) / 2;
+        fprintf(stderr, "fd limit caps the room at %zu members\n", members);
+    }
+
+    /* Just enough of a server for the output path. */
+    xnet_box_t xnet = {0};
+    xnet_general_group_t general = {0};
+    xnet_network_group_t network = {0};
+    xnet_connection_group_t connections = {0};
+    xnet.general = &general;
+    xnet.network = &network;
+    xnet.connections = &connections;
+    general.max_connections = members;
+    network.epoll_fd = epoll_create1(0);
+
+    connections.clients = calloc(members, sizeof(xnet_active_connection_t));
+    connections.hot = calloc(members, sizeof(xnet_conn_hot_t));
+    xnet_conn_handle_t *room = calloc(members, sizeof(xnet_conn_handle_t));
+    int *peers = calloc(members, sizeof(int));
+    if (NULL == connections.clients || NULL == connections.hot || NULL == room || NULL == peers) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    for (size_t n = 0; n < members; n++) {
+        int pair[2];
+        if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, pair)) {
+            perror("socketpair");
+            return 1;
+        }
+        set_non_blocking(pair[0]);
+        set_non_blocking(pair[1]);
+        connections.clients[n].socket = pair[0];
+        connections.clients[n].hot = &connections.hot[n];
+        connections.hot[n].socket = pair[0];
+        connections.hot[n].is_active = true;
+        connections.hot[n].generation = 1;
+        struct epoll_event client_event = {0};
+        uint64_t client_data = xnet_event_data(&xnet, &connections.clients[n], false);
+        epoll_ctl_add_data(network.epoll_fd, &client_event, pair[0], client_data, EPOLLIN | EPOLLONESHOT);
+        room[n] = xnet_conn_handle(&xnet, &connections.clients[n]);
+        peers[n] = pair[1];
+    }
+    xnet_init_outbound(&xnet);
+
+    char payload[BENCH_PAYLOAD_SZ];
+    memset(payload, 'x', sizeof(payload));
+
+    /* Old path. The worker itself writes to every member. */
+    double loop_worker = 0;
+    for (size_t r = 0; r < rounds; r++) {
+        double start = now_us();
+        for (size_t n = 0; n < members; n++) {
+            send(connections.clients[n].socket, payload, sizeof(payload), MSG_NOSIGNAL);
+        }
+        loop_worker += now_us() - start;
+        drain_peers(peers, members);
+    }
+
+    /* Shared buffer path. Worker cost and reactor cost are measured separately. */
+    double fan_worker = 0;
+    double fan_reactor = 0;
+    size_t delivered = 0;
+    for (size_t r = 0; r < rounds; r++) {
+        double start = now_us();
+        xnet_shared_buf_t *buf = xnet_buf_alloc(sizeof(payload));
+        memcpy(buf->data, payload, sizeof(payload));
+        xnet_shared_buf_t *bufs[XNET_WIRE_FORMATS] = {buf, buf};
+        xnet_broadcast(&xnet, room, members, bufs, XNET_NO_HANDLE);
+        xnet_buf_release(buf);
+        double queued = now_us();
+        xnet_read_mailbox(&xnet);
+        fan_reactor += now_us() - queued;
+        fan_worker += queued - start;
+        delivered += drain_peers(peers, members);
+    }
+
+    printf("[bench_fanout] members=%zu rounds=%zu payload=%d bytes\n", members, rounds, BENCH_PAYLOAD_SZ);
+    printf("  send() loop     worker: %10.1f us/shout  %7.1f ns/member\n",
+           loop_worker / rounds, loop_worker * 1e3 / (rounds * members));
+    printf("  xnet_broadcast  worker: %10.1f us/shout  %7.1f ns/member\n",
+           fan_worker / rounds, fan_worker * 1e3 / (rounds * members));
+    printf("                 reactor: %10.1f us/shout  %7.1f ns/member\n",
+           fan_reactor / rounds, fan_reactor * 1e3 / (rounds * members));
+    printf("  delivered %zu of %zu bytes\n", delivered, rounds * members * BENCH_PAYLOAD_SZ);
+
+    xnet_destroy_outbound(&xnet);
+    for (size_t n = 0; n < members; n++) {
+        close(connections.clients[n].socket);
+        close(peers[n]);
+    }
+    close(network.epoll_fd);
+    nfree((void **)&connections.clients);
+    nfree((void **)&connections.hot);
+    nfree((void **)&room);
+    nfree((void **)&peers);
+    return 0;
+}
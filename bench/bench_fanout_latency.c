@@ -0,0 +1,217 @@
+/*
+Shout-to-delivery latency for very large rooms.
+
+Builds a room of N members backed by unix socketpairs and a reader thread that timestamps every
+message as it becomes readable on the member's end. Each round is one shout. Compares xnet_broadcast(),
+which leaves every write to the reactor, against xnet_broadcast_parallel() with write-through on, which splits
+the room across the thread pool and writes straight to the sockets. Reports p50/p99/max over every (shout, member) pair.
+
+usage: bench_fanout_latency [members] [rounds]
+*/
+#include <sys/resource.h>
+
+#include "xnet_base.h"
+#include "xnet_buffer.h"
+#include "xnet_threads.h"
+
+#define BENCH_MEMBERS_DEFAULT 10000
+#define BENCH_ROUNDS_DEFAULT  20
+#define BENCH_PAYLOAD_SZ      306 // sizeof(struct chat_message_tt)
+
+typedef struct bench_reader {
+    int epoll_fd;
+    int *peers;
+    size_t members;
+    size_t *received;
+    double *round_start;
+    double *latency;
+    size_t delivered;
+    bool stop;
+} bench_reader_t ;
+
+static double now_us(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double lhs = *(const double *)a;
+    double rhs = *(const double *)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static void *reader_thread(void *arg)
+{
+    bench_reader_t *reader = arg;
+    struct epoll_event events[256];
+    char sink[XNET_MAX_PACKET_BUF_SZ];
+
+    while (false == __atomic_load_n(&reader->stop, __ATOMIC_ACQUIRE)) {
+        int ready = epoll_wait(reader->epoll_fd, events, 256, 10);
+        double arrived = now_us();
+        for (int n = 0; n < ready; n++) {
+            size_t member = events[n].data.u64;
+            ssize_t got = read(reader->peers[member], sink, sizeof(sink));
+            while (0 < got) {
+                /* Messages arrive in order, so the k-th complete message belongs to shout k. */
+                size_t before = reader->received[member] / BENCH_PAYLOAD_SZ;
+                reader->received[member] += got;
+                size_t after = reader->received[member] / BENCH_PAYLOAD_SZ;
+                for (size_t shout = before; shout < after; shout++) {
+                    double start = reader->round_start[shout];
+                    reader->latency[shout * reader->members + member] = arrived - start;
+                    __atomic_add_fetch(&reader->delivered, 1, __ATOMIC_RELEASE);
+                }
+                got = read(reader->peers[member], sink, sizeof(sink));
+            }
+        }
+    }
+    return NULL;
+}
+
+static void report(const char *name, double *latency, size_t samples)
+{
+    qsort(latency, samples, sizeof(double), compare_double);
+    printf("  %-24s p50: %9.1f us  p99: %9.1f us  max: %9.1f us\n", name,
+           latency[samples / 2], latency[(samples * 99) / 100], latency[samples - 1]);
+}
+
+int main(int argc, char **argv)
+{
+    size_t members = (1 < argc) ? strtoul(argv[1], NULL, 10) : BENCH_MEMBERS_DEFAULT;
+    size_t rounds = (2 < argc) ? strtoul(argv[2], NULL, 10) : BENCH_ROUNDS_DEFAULT;
+
+    /* Every member costs two fds. Take what the hard limit allows. */
+    struct rlimit fd_limit = {0};
+    getrlimit(RLIMIT_NOFILE, &fd_limit);
+    fd_limit.rlim_cur = fd_limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &fd_limit);
+    if (members * 2 + 64 > fd_limit.rlim_cur) {
+        members = (fd_limit.rlim_cur - 64) / 2;
+        fprintf(stderr, "fd limit caps the room at %zu members\n", members);
+    }
+
+    /* Just enough of a server for the output path and the pool. */
+    xnet_box_t xnet = {0};
+    xnet_general_group_t general = {0};
+    xnet_network_group_t network = {0};
+    xnet_connection_group_t connections = {0};
+    xnet_thread_group_t thread = {0};
+    xnet.general = &general;
+    xnet.network = &network;
+    xnet.connections = &connections;
+    xnet.thread = &thread;
+    general.max_connections = members;
+    general.fanout_threshold = XNET_FANOUT_THRESHOLD_DEFAULT;
+    network.epoll_fd = epoll_create1(0);
+
+    bench_reader_t reader = {0};
+    reader.epoll_fd = epoll_create1(0);
+    reader.members = members;
+
+    connections.clients = calloc(members, sizeof(xnet_active_connection_t));
+    connections.hot = calloc(members, sizeof(xnet_conn_hot_t));
+    xnet_conn_handle_t *room = calloc(members, sizeof(xnet_conn_handle_t));
+    reader.peers = calloc(members, sizeof(int));
+    reader.received = calloc(members, sizeof(size_t));
+    reader.round_start = calloc(rounds, sizeof(double));
+    reader.latency = calloc(rounds * members, sizeof(double));
+    if (NULL == connections.clients || NULL == connections.hot || NULL == room || NULL == reader.peers || NULL == reader.received ||
+        NULL == reader.round_start || NULL == reader.latency) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    for (size_t n = 0; n < members; n++) {
+        int pair[2];
+        if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, pair)) {
+            perror("socketpair");
+            return 1;
+        }
+        set_non_blocking(pair[0]);
+        set_non_blocking(pair[1]);
+        connections.clients[n].socket = pair[0];
+        connections.clients[n].hot = &connections.hot[n];
+        connections.hot[n].socket = pair[0];
+        connections.hot[n].is_active = true;
+        connections.hot[n].generation = 1;
+        struct epoll_event client_event = {0};
+        uint64_t client_data = xnet_event_data(&xnet, &connections.clients[n], false);
+        epoll_ctl_add_data(network.epoll_fd, &client_event, pair[0], client_data, EPOLLIN | EPOLLONESHOT);
+        room[n] = xnet_conn_handle(&xnet, &connections.clients[n]);
+        reader.peers[n] = pair[1];
+
+        struct epoll_event peer_event = {0};
+        peer_event.events = EPOLLIN;
+        peer_event.data.u64 = n;
+        epoll_ctl(reader.epoll_fd, EPOLL_CTL_ADD, pair[1], &peer_event);
+    }
+    xnet_init_outbound(&xnet);
+    xnet_create_pool(&xnet);
+
+    pthread_t reader_id;
+    pthread_create(&reader_id, NULL, reader_thread, &reader);
+
+    char payload[BENCH_PAYLOAD_SZ];
+    memset(payload, 'x', sizeof(payload));
+
+    printf("[bench_fanout_latency] members=%zu rounds=%zu payload=%d bytes threads=%d\n",
+           members, rounds, BENCH_PAYLOAD_SZ, XNET_THREAD_COUNT);
+
+    for (int parallel = 0; parallel < 2; parallel++) {
+        general.write_through = parallel;
+        memset(reader.received, 0, members * sizeof(size_t));
+        __atomic_store_n(&reader.delivered, 0, __ATOMIC_RELEASE);
+
+        for (size_t r = 0; r < rounds; r++) {
+            xnet_shared_buf_t *buf = xnet_buf_alloc(sizeof(payload));
+            memcpy(buf->data, payload, sizeof(payload));
+            xnet_shared_buf_t *bufs[XNET_WIRE_FORMATS] = {buf, buf};
+
+            reader.round_start[r] = now_us();
+            if (parallel) {
+                xnet_broadcast_parallel(&xnet, room, members, bufs, XNET_NO_HANDLE);
+            } else {
+                xnet_broadcast(&xnet, room, members, bufs, XNET_NO_HANDLE);
+            }
+            xnet_buf_release(buf);
+
+            /* Play reactor until the whole room has this shout. */
+            xnet_read_mailbox(&xnet);
+            while (__atomic_load_n(&reader.delivered, __ATOMIC_ACQUIRE) < (r + 1) * members) {
+                for (size_t n = 0; n < members; n++) {
+                    pthread_mutex_lock(&connections.clients[n].io_lock);
+                    if (NULL != connections.clients[n].out_head) {
+                        xnet_flush_connection(&connections.clients[n]);
+                    }
+                    pthread_mutex_unlock(&connections.clients[n].io_lock);
+                }
+                sched_yield();
+            }
+        }
+
+        report(parallel ? "xnet_broadcast_parallel" : "xnet_broadcast", reader.latency, rounds * members);
+    }
+
+    __atomic_store_n(&reader.stop, true, __ATOMIC_RELEASE);
+    pthread_join(reader_id, NULL);
+    xnet_destroy_pool(&xnet);
+    xnet_destroy_outbound(&xnet);
+    for (size_t n = 0; n < members; n++) {
+        close(connections.clients[n].socket);
+        close(reader.peers[n]);
+    }
+    close(network.epoll_fd);
+    close(reader.epoll_fd);
+    nfree((void **)&connections.clients);
+    nfree((void **)&connections.hot);
+    nfree((void **)&room);
+    nfree((void **)&reader.peers);
+    nfree((void **)&reader.received);
+    nfree((void **)&reader.round_start);
+    nfree((void **)&reader.latency);
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+Latency of critical tasks behind a queue kept full of bulk work.
+
+Keeps the task queue topped up with bulk tasks that each burn a fixed slice of CPU, and slips a short critical task
+in every so often, standing in for logins and session work behind a burst of shouts. The first run queues every task
+in one class, which is what a single FIFO does. The second gives critical tasks the high class and splits bulk work
+between normal and low. Reports p50/p99/max from submit to start for the critical tasks, and how long the slowest
+task of each class waited, which aging keeps bounded.
+
+usage: bench_priority [critical tasks] [bulk us]
+*/
+#include "xnet_base.h"
+#include "xnet_threads.h"
+
+#define BENCH_CRITICAL_DEFAULT  2000
+#define BENCH_BULK_US_DEFAULT   50
+#define BENCH_CRITICAL_US       5
+#define BENCH_BULK_PER_CRITICAL 16
+
+typedef struct bench_job {
+    double submitted;
+    double *latency;
+    double work_us;
+    size_t *done;
+} bench_job_t ;
+
+static double now_us(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double lhs = *(const double *)a;
+    double rhs = *(const double *)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static int run_job(xnet_box_t *xnet, void *arg)
+{
+    (void)xnet;
+    bench_job_t *job = arg;
+    double started = now_us();
+    if (NULL != job->latency) {
+        *job->latency = started - job->submitted;
+    }
+
+    /* Busy, not asleep, so the pool really is short of workers. */
+    while (now_us() - started < job->work_us) {
+    }
+
+    __atomic_add_fetch(job->done, 1, __ATOMIC_RELEASE);
+    free(job);
+    return 0;
+}
+
+static bool submit(xnet_box_t *xnet, enum xnet_priority priority, double work_us, double *latency, size_t *done)
+{
+    bench_job_t *job = calloc(1, sizeof(bench_job_t));
+    xnet_task_t *task = calloc(1, sizeof(xnet_task_t));
+    if (NULL == job || NULL == task) {
+        free(job);
+        free(task);
+        return false;
+    }
+
+    job->latency = latency;
+    job->work_us = work_us;
+    job->done = done;
+    task->job_function = run_job;
+    task->arg = job;
+    task->xnet = xnet;
+    task->priority = priority;
+    pthread_mutex_init(&task->task_lock, NULL);
+
+    job->submitted = now_us();
+    if (false == xnet_work_try_push(xnet, task)) {
+        pthread_mutex_destroy(&task->task_lock);
+        free(job);
+        free(task);
+        return false;
+    }
+    return true;
+}
+
+static void run(const char *name, bool use_classes, size_t critical, double bulk_us, double *latency)
+{
+    /* Just enough of a server for the pool. */
+    xnet_box_t xnet = {0};
+    xnet_thread_group_t thread = {0};
+    xnet.thread = &thread;
+    xnet_create_pool(&xnet);
+
+    size_t done = 0;
+    size_t submitted = 0;
+    size_t bulk = 0;
+    for (size_t n = 0; n < critical; ) {
+        /* Keep the queue full. Critical tasks get the slot a worker frees up next. */
+        if (0 == xnet_work_room(&xnet)) {
+            sched_yield();
+            continue;
+        }
+
+        if (BENCH_BULK_PER_CRITICAL > bulk % (BENCH_BULK_PER_CRITICAL + 1)) {
+            enum xnet_priority priority = (use_classes && bulk % 2) ? XNET_PRIORITY_LOW : XNET_PRIORITY_NORMAL;
+            submitted += submit(&xnet, priority, bulk_us, NULL, &done);
+        } else {
+            enum xnet_priority priority = use_classes ? XNET_PRIORITY_HIGH : XNET_PRIORITY_NORMAL;
+            if (false == submit(&xnet, priority, BENCH_CRITICAL_US, &latency[n], &done)) {
+                continue;
+            }
+            submitted++;
+            n++;
+        }
+        bulk++;
+    }
+
+    while (__atomic_load_n(&done, __ATOMIC_ACQUIRE) < submitted) {
+        sched_yield();
+    }
+
+    qsort(latency, critical, sizeof(double), compare_double);
+    printf("  %-8s critical p50: %8.1f us  p99: %8.1f us  max: %8.1f us\n", name,
+           latency[critical / 2], latency[(critical * 99) / 100], latency[critical - 1]);
+
+    static const char *class_names[XNET_PRIORITY_CLASSES] = {"high", "normal", "low"};
+    for (int class = 0; class < XNET_PRIORITY_CLASSES; class++) {
+        xnet_sched_stats_t stats = {0};
+        xnet_get_sched_stats(&xnet, class, &stats);
+        if (0 == stats.dispatched) {
+            continue;
+        }
+        printf("           %-6s tasks: %7lu  mean wait: %8.1f us  max wait: %8.1f us  aged: %lu\n", class_names[class],
+               stats.dispatched, stats.wait_total_ns / 1e3 / stats.dispatched, stats.wait_max_ns / 1e3, stats.aged);
+    }
+
+    xnet_destroy_pool(&xnet);
+}
+
+int main(int argc, char **argv)
+{
+    size_t critical = (1 < argc) ? strtoul(argv[1], NULL, 10) : BENCH_CRITICAL_DEFAULT;
+    double bulk_us = (2 < argc) ? strtod(argv[2], NULL) : BENCH_BULK_US_DEFAULT;
+    if (0 == critical) {
+        critical = BENCH_CRITICAL_DEFAULT;
+    }
+
+    double *latency = calloc(critical, sizeof(double));
+    if (NULL == latency) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    printf("[bench_priority] critical=%zu bulk=%.0fus queue=%d threads=%d\n",
+           critical, bulk_us, XNET_THREAD_MAX_TASKS, XNET_THREAD_COUNT);
+
+    run("fifo", false, critical, bulk_us, latency);
+    run("classes", true, critical, bulk_us, latency);
+
+    free(latency);
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+Fixed vs compact wire format for room messages.
+
+Encodes room messages of a few typical lengths in both formats and pushes them through a unix socketpair
+to a reader thread in batches, the way a member's connection would see them. Reports bytes per message and the
+packets and megabytes per second that made it through, and what a bandwidth bound link would carry.
+
+usage: bench_wire [messages]
+*/
+#include "xnet_addon_chat.h"
+
+#define BENCH_MESSAGES_DEFAULT 200000
+#define BENCH_USERNAME        "alice"
+#define BENCH_BATCH           64  // Messages per write, about what one reactor flush gathers.
+#define BENCH_LINK_MBIT       100 // A socketpair never runs out of bandwidth. This is what a real uplink allows.
+
+typedef struct bench_sink {
+    int fd;
+    size_t expected;
+    size_t received;
+} bench_sink_t ;
+
+static double now_us(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+static void *sink_thread(void *arg)
+{
+    bench_sink_t *sink = arg;
+    char drain[XNET_MAX_PACKET_BUF_SZ];
+
+    while (sink->received < sink->expected) {
+        ssize_t got = read(sink->fd, drain, sizeof(drain));
+        if (0 >= got) {
+            break;
+        }
+        sink->received += got;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    size_t messages = (1 < argc) ? strtoul(argv[1], NULL, 10) : BENCH_MESSAGES_DEFAULT;
+    const int lengths[] = {5, 32, 128, MAX_MESSAGE_LENGTH};
+    const char *format_names[XNET_WIRE_FORMATS] = {"fixed", "compact"};
+
+    printf("[bench_wire] messages=%zu username=%zu bytes\n", messages, strlen(BENCH_USERNAME));
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        struct chat_message_tt message = {0};
+        message.opcode_relation = htons(CHAT_ROOM_MESSAGE);
+        strncpy(message.from_username, BENCH_USERNAME, XNET_MAX_USERNAME_LEN);
+        message.from_username_length = htonl(strlen(BENCH_USERNAME));
+        memset(message.msg, 'x', lengths[l]);
+        message.msg_length = htonl(lengths[l]);
+
+        printf("  message=%3d bytes\n", lengths[l]);
+
+        double fixed_rate = 0;
+        for (int format = 0; format < XNET_WIRE_FORMATS; format++) {
+            int pair[2];
+            if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, pair)) {
+                perror("socketpair");
+                return 1;
+            }
+
+            struct chat_message_tt batch[BENCH_BATCH];
+            size_t per_message = chat_encode_message(batch, format, &message);
+            bench_sink_t sink = {0};
+            sink.fd = pair[1];
+            sink.expected = per_message * messages;
+
+            pthread_t sink_id;
+            pthread_create(&sink_id, NULL, sink_thread, &sink);
+
+            /* Encoding is part of the cost, as it is on the shout path. Writes are batched like the reactor's. */
+            double start = now_us();
+            for (size_t n = 0; n < messages; n += BENCH_BATCH) {
+                size_t length = 0;
+                for (size_t b = n; b < n + BENCH_BATCH && b < messages; b++) {
+                    message.seq = htobe64(b + 1);
+                    length += chat_encode_message((char *)batch + length, format, &message);
+                }
+
+                size_t written = 0;
+                while (written < length) {
+                    ssize_t sent = send(pair[0], (char *)batch + written, length - written, MSG_NOSIGNAL);
+                    if (0 >= sent) {
+                        perror("send");
+                        return 1;
+                    }
+                    written += sent;
+                }
+            }
+            pthread_join(sink_id, NULL);
+            double elapsed = now_us() - start;
+
+            double rate = messages * 1e6 / elapsed;
+            if (XNET_WIRE_FIXED == format) {
+                fixed_rate = rate;
+            }
+            printf("    %-8s %4zu bytes/msg  %10.0f msgs/s  %8.1f MB/s  %5.2fx msgs/s  %9.0f msgs/s on a %d Mbit/s link\n",
+                   format_names[format], per_message, rate, sink.received / elapsed, rate / fixed_rate,
+                   BENCH_LINK_MBIT * 1e6 / 8 / per_message, BENCH_LINK_MBIT);
+
+            close(pair[0]);
+            close(pair[1]);
+        }
+    }
+
+    return 0;
+}
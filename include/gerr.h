@@ -44,6 +44,11 @@ enum GERR_XNet {
     E_SRV_CLIENT_MAX_REACHED = 2514,
     E_SRV_USER_EXISTS = 2515,
     E_SRV_USER_NOT_EXIST = 2516,
+    E_SRV_FAIL_RANDOM = 2517,
+    E_SRV_TOKEN_INVALID = 2518,
+    E_SRV_TOKEN_EXPIRED = 2519,
+    E_SRV_FAIL_LOG_IO = 2520,
+    E_SRV_FAIL_FILE_IO = 2521,
 };
 
 // Perror style support for GErrors.
@@ -15,23 +15,25 @@
 extern "C" {
 #endif
 
+#include <endian.h>
+
 #include "xnet_base.h"
 #include "xnet_utils.h"
 #include "xnet_threads.h"
 #include "xnet_userbase.h"
+#include "xnet_buffer.h"
+#include "xnet_frame.h"
+#include "xnet_addon_chat_log.h"
+#include "xnet_addon_chat_packets.h"
 
-/* Addon Feature Opcodes */
-#define CHAT_LOGIN_OP 200
-#define CHAT_WHISPER_OP 201
-#define CHAT_JOIN_OP 202
-#define CHAT_SHOUT_OP 203
-#define CHAT_WHISPER_TARGET 299
+/* Opcodes, packet layouts and their limits come from schema/chat_packets.schema. */
 
 /* Addon Configuration */
-#define MAX_USERS_IN_ROOM 5
-#define MAX_ROOM_COUNT 5
-#define MAX_ROOM_NAME_LEN 32
-#define MAX_MESSAGE_LENGTH 256
+#define CHAT_ROOM_BUCKETS_DEFAULT 64 // Initial size of the room name index. Always a power of two.
+#define CHAT_ROOM_SEATS_DEFAULT 8    // Initial member capacity of a room. Grows on demand.
+#define CHAT_ROOM_ADMIN_PERM 2       // Permission level required to create or delete rooms.
+#define CHAT_HISTORY_DEPTH 64        // Recent messages each room keeps for catch-up. Always a power of two.
+#define CHAT_WHISPER_LOG_NAME "@whispers" // Log stream holding every whisper. Room streams are '#' and the room name.
 
 /* Return Codes */
 #define RC_ACTION_SUCCESS 0
@@ -39,59 +41,67 @@ extern "C" {
 #define RC_FAILED_JOIN_ROOM 2
 #define RC_FAILED_WHISPER 3
 #define RC_FAILED_SHOUT 4
-
-typedef struct chat_data_room {
-    const char *name;
-    xnet_active_connection_t *users[MAX_USERS_IN_ROOM];
-} chat_room_t ;
-
-typedef struct chat_data_main {
-    chat_room_t rooms[MAX_ROOM_COUNT];
-} chat_main_t ;
-
-struct __attribute__((__packed__)) chat_shout_tc {
+#define RC_FAILED_RESUME 5
+#define RC_FAILED_ROOM_ACTION 6
+#define RC_FAILED_HISTORY 7
+#define RC_FAILED_PROTOCOL 8
+#define RC_FAILED_CAPS 9
+
+/*
+Compact wire format, see CHAT_PROTOCOL_OP. Opcodes stay the same, fields are big-endian and
+only the bytes in use are sent. Everything not listed here looks the same in both formats.
+    CHAT_ROOM_MESSAGE    [u16 opcode][u64 seq][u8 username length][username][u16 message length][message]
+    CHAT_WHISPER_TARGET  [u16 opcode][u8 username length][username][u16 message length][message]
+*/
+/* Room message as it goes out on the wire. The history ring stores these as-is. */
+struct __attribute__((__packed__)) chat_message_tt {
     short opcode_relation;
-    short return_code;
-};
-
-struct __attribute__((__packed__)) chat_shout_fc {
+    unsigned long long seq;
+    int from_username_length;
+    char from_username[XNET_MAX_USERNAME_LEN];
     int msg_length;
     char msg[MAX_MESSAGE_LENGTH];
 };
 
-typedef struct chat_shout_packet {
-    struct chat_shout_tc to_client;
-    struct chat_shout_fc from_client;
-} chat_shout_packet_t ;
-
-struct __attribute__((__packed__)) chat_join_room_tc {
-    short opcode_relation;
-    short return_code;
-};
-
-struct __attribute__((__packed__)) chat_join_room_fc {
-    int room_name_length;
-    char room_name[MAX_ROOM_NAME_LEN];
-};
-
-typedef struct chat_join_room_packet {
-    struct chat_join_room_tc to_client;
-    struct chat_join_room_fc from_client;
-} chat_join_room_packet_t ;
-
+typedef struct chat_data_room {
+    char name[MAX_ROOM_NAME_LEN + 1];
+    size_t name_hash;
+    /* Guards the member set. */
+    pthread_mutex_t lock;
+    size_t member_count;
+    size_t member_capacity;
+    /* Handles of the members. Unordered, removal swaps the last member into the hole. */
+    xnet_conn_handle_t *members;
+    /* Next room in the same index bucket. */
+    struct chat_data_room *next;
+    /* Sequence number of the newest message. The first message is 1. Guarded by lock. */
+    unsigned long long last_seq;
+    /* Message seq lives at history[seq % CHAT_HISTORY_DEPTH]. Guarded by lock. */
+    struct chat_message_tt history[CHAT_HISTORY_DEPTH];
+    /* Durable copy of every message. NULL unless the message log is enabled. */
+    chat_log_stream_t *log;
+} chat_room_t ;
 
-struct __attribute__((__packed__)) chat_whisper_tc {
-    short opcode_relation;
-    short return_code;
-};
+/* Chat state kept on every connection through its addon data slot. */
+typedef struct chat_data_seat {
+    chat_room_t *room;
+    /* Position in room->members. */
+    size_t index;
+} chat_seat_t ;
 
-struct __attribute__((__packed__)) chat_whisper_fc {
-    int to_username_length;
-    char to_username[XNET_MAX_USERNAME_LEN];
-    int msg_length;
-    char msg[MAX_MESSAGE_LENGTH];
-};
+typedef struct chat_data_main {
+    /* Readers may join, leave and shout. Writers create, delete and resize. */
+    pthread_rwlock_t lock;
+    size_t room_count;
+    size_t bucket_count;
+    chat_room_t **buckets;
+    /* Index into xnet_active_connection_t.addon_data where each connection's chat_seat_t lives. */
+    int slot;
+    /* NULL unless the message log is enabled. */
+    chat_log_stream_t *whisper_log;
+} chat_main_t ;
 
+/* Whisper as it goes out on the wire. */
 struct __attribute__((__packed__)) chat_whisper_tt {
     short opcode_relation;
     int from_username_length;
@@ -100,29 +110,12 @@ struct __attribute__((__packed__)) chat_whisper_tt {
     char msg[MAX_MESSAGE_LENGTH];
 };
 
-typedef struct chat_whisper_packet {
-    struct chat_whisper_tc to_client;
-    struct chat_whisper_fc from_client;
-    struct chat_whisper_tt to_target;
-} chat_whisper_packet_t ;
-
-struct __attribute__((__packed__)) chat_login_tc {
-    short opcode_relation;
-    short return_code;
-};
-
-struct __attribute__((__packed__)) chat_login_fc {
-    int username_length;
-    char username[XNET_MAX_USERNAME_LEN];
-    int password_length;
-    char password[XNET_MAX_PASSWD_LEN];
+/* Whisper as kept in the message log. */
+struct __attribute__((__packed__)) chat_whisper_record {
+    char to_username[XNET_MAX_USERNAME_LEN];
+    struct chat_whisper_tt message;
 };
 
-typedef struct chat_login_packet {
-    struct chat_login_tc to_client;
-    struct chat_login_fc from_client;
-} chat_login_packet_t ;
-
 /**
  * @brief Responsible for integrating the chat addon into a XNet server.
  *        This must be called in order for the chat addon to be recognized by XNet.
@@ -147,8 +140,105 @@ int chat_perform_join_room(xnet_box_t *xnet, xnet_active_connection_t *client);
 
 int chat_perform_shout(xnet_box_t *xnet, xnet_active_connection_t *client);
 
+/**
+ * @brief Feature that lets a reconnecting client present the token it received at login.
+ *        On success the client is logged back in and placed back in the room it was in, in one round trip.
+ * 
+ * @param xnet 
+ * @param client 
+ * @return int 
+ */
+int chat_perform_resume(xnet_box_t *xnet, xnet_active_connection_t *client);
+
+/**
+ * @brief Feature that lets a privileged client create or delete a room at runtime.
+ * 
+ * @param xnet 
+ * @param client 
+ * @return int 
+ */
+int chat_perform_room_action(xnet_box_t *xnet, xnet_active_connection_t *client);
+
+/**
+ * @brief Feature that replays the messages of the client's room newer than a given sequence number.
+ *        The reply is followed by its entries, oldest first. Anything older than the ring holds is gone.
+ * 
+ * @param xnet 
+ * @param client 
+ * @return int 
+ */
+int chat_perform_history(xnet_box_t *xnet, xnet_active_connection_t *client);
+
+/**
+ * @brief Feature that switches the wire format of everything the server sends the client from now on.
+ *        The reply is the last packet in the old format. Unknown formats leave the connection as it was.
+ * 
+ * @param xnet 
+ * @param client 
+ * @return int 
+ */
+int chat_perform_protocol(xnet_box_t *xnet, xnet_active_connection_t *client);
+
+/**
+ * @brief Capability handshake. The client offers the codecs it can decode and the server compresses
+ *        everything it sends the client from now on with the cheapest one both support.
+ *        The reply is the last packet coded the old way and lists what the server supports.
+ * 
+ * @param xnet 
+ * @param client 
+ * @return int 
+ */
+int chat_perform_capabilities(xnet_box_t *xnet, xnet_active_connection_t *client);
+
+/**
+ * @brief Writes the room message @param message, as kept in the history ring, to @param out in @param wire_format.
+ * 
+ * @param out Room for at least sizeof(struct chat_message_tt) bytes.
+ * @param wire_format One of the XNET_WIRE_* formats.
+ * @return size_t Bytes written.
+ */
+size_t chat_encode_message(void *out, int wire_format, const struct chat_message_tt *message);
+
+/**
+ * @brief Writes the whisper @param message to @param out in @param wire_format.
+ * 
+ * @param out Room for at least sizeof(struct chat_whisper_tt) bytes.
+ * @param wire_format One of the XNET_WIRE_* formats.
+ * @return size_t Bytes written.
+ */
+size_t chat_encode_whisper(void *out, int wire_format, const struct chat_whisper_tt *message);
+
+/**
+ * @brief Turns on the durable message log under @param dir. Rooms that already exist get their
+ *        history back from the log right away, rooms created later as they are created.
+ *        Call before the server starts.
+ * 
+ * @return int Returns 0 on success. Returns non-zero on failure.
+ */
+int chat_enable_log(const char *dir);
+
+/**
+ * @brief Commits and closes the message log. Call once the server has stopped.
+ */
+void chat_disable_log(void);
+
+/**
+ * @brief Adds a room to the room registry. The name is copied.
+ * 
+ * @param room_name Name of the new room. At most MAX_ROOM_NAME_LEN characters.
+ * @return int Returns 0 on success. Returns non-zero on failure.
+ */
 int chat_create_room(char *room_name);
 
+/**
+ * @brief Removes a room from the room registry. Anyone inside is removed from it.
+ * 
+ * @param xnet Server the members are connected to.
+ * @param room_name Name of the room.
+ * @return int Returns 0 on success. Returns non-zero on failure.
+ */
+int chat_delete_room(xnet_box_t *xnet, char *room_name);
+
 #ifdef __cplusplus
 }
 #endif
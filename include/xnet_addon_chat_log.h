@@ -0,0 +1,140 @@
+/**
+ * @file        xnet_addon_chat_log.h
+ * @author      Kameryn Gaige Knight
+ * @brief       Durable, append-only message log for the chat addon. Every stream is a directory of
+ *              memory mapped segments, each named after the first sequence number it holds.
+ * @version     1.0
+ * @date        2026-10-19
+ *
+ * @copyright   Copyright (c) 2022 Kameryn Gaige Knight
+ * License      MIT
+ */
+#ifndef XNET_ADDON_CHAT_LOG_H
+#define XNET_ADDON_CHAT_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "xnet_utils.h"
+
+/* Log Configuration */
+#define CHAT_LOG_SEGMENT_SZ (1 << 22) // Bytes per segment file. A full segment rotates to a new one.
+#define CHAT_LOG_KEEP_SEGMENTS 16     // Segments kept per stream. Older ones are deleted on rotation.
+#define CHAT_LOG_COMMIT_MS 5          // Interval at which appended records are group committed to disk.
+#define CHAT_LOG_NAME_MAX 64
+#define CHAT_LOG_SPARE_NAME "next.spare"
+
+/* On-disk record header. A zero length marks the end of a segment's data. */
+typedef struct __attribute__((__packed__)) chat_log_record {
+    uint32_t length;
+    uint32_t checksum;
+    uint64_t seq;
+    char data[];
+} chat_log_record_t ;
+
+typedef struct chat_log_segment {
+    unsigned long long first_seq;
+    int fd;
+    char *map;
+    /* Bytes handed to msync() so far. Only the flusher touches this. */
+    size_t synced;
+    /* Spares are created before their first sequence number is known and renamed by the flusher once it is. */
+    bool is_named;
+    struct chat_log_segment *next;
+} chat_log_segment_t ;
+
+typedef struct chat_log_stream {
+    char name[CHAT_LOG_NAME_MAX + 1];
+    char path[PATH_MAX];
+    /* Guards everything below. Appenders hold it only for the memcpy. */
+    pthread_mutex_t lock;
+    chat_log_segment_t *active;
+    size_t write_offset;
+    /* Created ahead of time by the flusher so rotation doesn't touch the filesystem. */
+    chat_log_segment_t *spare;
+    /* Full segments waiting for their last msync(). */
+    chat_log_segment_t *retired;
+    /* First sequence numbers of the closed segments still on disk, oldest first. Only the flusher touches this. */
+    unsigned long long kept[CHAT_LOG_KEEP_SEGMENTS];
+    size_t kept_count;
+    unsigned long long last_seq;
+    unsigned long long durable_seq;
+    struct chat_log_stream *next;
+} chat_log_stream_t ;
+
+typedef struct chat_log_main {
+    char dir[PATH_MAX];
+    bool is_open;
+    bool is_running;
+    /* Guards the stream list and wakes the flusher. */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t flusher;
+    chat_log_stream_t *streams;
+} chat_log_main_t ;
+
+/**
+ * @brief Called once per record, oldest first, while a stream is replayed.
+ */
+typedef void (*chat_log_replay_fn)(unsigned long long seq, const void *data, size_t length, void *arg);
+
+/**
+ * @brief Opens the message log rooted at @param dir, creating the directory if needed,
+ *        and starts the thread that commits appended records to disk.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int chat_log_open(const char *dir);
+
+/**
+ * @brief Commits everything appended so far, stops the flusher and unmaps every stream.
+ */
+void chat_log_close(void);
+
+/**
+ * @brief Returns true once chat_log_open() has succeeded.
+ */
+bool chat_log_is_open(void);
+
+/**
+ * @brief Opens the stream called @param name. The first open of a stream replays every record
+ *        still on disk through @param replay, oldest first. Later opens return the same stream without replaying.
+ *
+ * @param replay May be NULL.
+ * @return chat_log_stream_t* NULL on failure.
+ */
+chat_log_stream_t *chat_log_stream(const char *name, chat_log_replay_fn replay, void *arg);
+
+/**
+ * @brief Appends a record to @param stream. This is only a copy into mapped memory. The flusher makes it durable later.
+ *
+ * @param seq Sequence number of the record. Must be above every earlier one. 0 takes the next one.
+ * @return unsigned long long Sequence number the record was stored under. 0 on failure.
+ */
+unsigned long long chat_log_append(chat_log_stream_t *stream, unsigned long long seq, const void *data, size_t length);
+
+/**
+ * @brief Highest sequence number of @param stream known to be on disk.
+ */
+unsigned long long chat_log_durable_seq(chat_log_stream_t *stream);
+
+/**
+ * @brief Highest sequence number appended to @param stream.
+ */
+unsigned long long chat_log_last_seq(chat_log_stream_t *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KAMERYN GAIGE KNIGHT
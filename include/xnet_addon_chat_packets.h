@@ -0,0 +1,378 @@
+/**
+ * @file        xnet_addon_chat_packets.h
+ * @author      Kameryn Gaige Knight
+ * @brief       Generated from schema/chat_packets.schema by tools/packetgen.py. Do not edit, run 'make packets'.
+ * @version     1.0
+ * @date        2026-10-19
+ *
+ * @copyright   Copyright (c) 2022 Kameryn Gaige Knight
+ * License      MIT
+ */
+#ifndef XNET_ADDON_CHAT_PACKETS_H
+#define XNET_ADDON_CHAT_PACKETS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <endian.h>
+
+#include "xnet_base.h"
+#include "xnet_frame.h"
+
+/* Constants */
+#define MAX_ROOM_NAME_LEN 32
+#define MAX_MESSAGE_LENGTH 256
+#define CHAT_ROOM_MESSAGE 298
+#define CHAT_WHISPER_TARGET 299
+
+/* Opcodes */
+#define CHAT_LOGIN_OP 200
+#define CHAT_WHISPER_OP 201
+#define CHAT_JOIN_OP 202
+#define CHAT_SHOUT_OP 203
+#define CHAT_RESUME_OP 204
+#define CHAT_ROOM_OP 205
+#define CHAT_HISTORY_OP 206
+#define CHAT_PROTOCOL_OP 207
+#define CHAT_CAPS_OP 208
+
+/* Enumerated field values */
+#define CHAT_ROOM_CREATE 1
+#define CHAT_ROOM_DELETE 2
+#define CHAT_PROTOCOL_FIXED 0
+#define CHAT_PROTOCOL_COMPACT 1
+#define CHAT_CAPS_NONE 0
+#define CHAT_CAPS_LZ 1
+#define CHAT_CAPS_ZLIB 2
+
+/* Points into the buffer a packet was parsed from. Not NUL terminated. */
+typedef struct chat_view {
+    const char *data;
+    size_t length;
+} chat_view_t ;
+
+typedef struct chat_login_request {
+    chat_view_t username;
+    chat_view_t password;
+} chat_login_request_t ;
+#define CHAT_LOGIN_REQUEST_MAX_SZ (4 + XNET_MAX_USERNAME_LEN + 4 + XNET_MAX_PASSWD_LEN)
+
+typedef struct chat_login_reply {
+    int16_t return_code;
+    chat_view_t token;
+} chat_login_reply_t ;
+#define CHAT_LOGIN_REPLY_MAX_SZ (2 + 2 + XNET_TOKEN_LEN)
+
+typedef struct chat_whisper_request {
+    chat_view_t to_username;
+    chat_view_t msg;
+} chat_whisper_request_t ;
+#define CHAT_WHISPER_REQUEST_MAX_SZ (4 + XNET_MAX_USERNAME_LEN + 4 + MAX_MESSAGE_LENGTH)
+
+typedef struct chat_whisper_reply {
+    int16_t return_code;
+} chat_whisper_reply_t ;
+#define CHAT_WHISPER_REPLY_MAX_SZ (2 + 2)
+
+typedef struct chat_join_request {
+    chat_view_t room_name;
+} chat_join_request_t ;
+#define CHAT_JOIN_REQUEST_MAX_SZ (4 + MAX_ROOM_NAME_LEN)
+
+typedef struct chat_join_reply {
+    int16_t return_code;
+} chat_join_reply_t ;
+#define CHAT_JOIN_REPLY_MAX_SZ (2 + 2)
+
+typedef struct chat_shout_request {
+    chat_view_t msg;
+} chat_shout_request_t ;
+#define CHAT_SHOUT_REQUEST_MAX_SZ (4 + MAX_MESSAGE_LENGTH)
+
+typedef struct chat_shout_reply {
+    int16_t return_code;
+} chat_shout_reply_t ;
+#define CHAT_SHOUT_REPLY_MAX_SZ (2 + 2)
+
+typedef struct chat_resume_request {
+    chat_view_t token;
+} chat_resume_request_t ;
+#define CHAT_RESUME_REQUEST_MAX_SZ (XNET_TOKEN_LEN)
+
+typedef struct chat_resume_reply {
+    int16_t return_code;
+    chat_view_t token;
+    chat_view_t room_name;
+} chat_resume_reply_t ;
+#define CHAT_RESUME_REPLY_MAX_SZ (2 + 2 + XNET_TOKEN_LEN + 4 + MAX_ROOM_NAME_LEN)
+
+typedef struct chat_room_request {
+    int32_t action;
+    chat_view_t room_name;
+} chat_room_request_t ;
+#define CHAT_ROOM_REQUEST_MAX_SZ (4 + 4 + MAX_ROOM_NAME_LEN)
+
+typedef struct chat_room_reply {
+    int16_t return_code;
+} chat_room_reply_t ;
+#define CHAT_ROOM_REPLY_MAX_SZ (2 + 2)
+
+typedef struct chat_history_request {
+    uint64_t since_seq;
+} chat_history_request_t ;
+#define CHAT_HISTORY_REQUEST_MAX_SZ (8)
+
+typedef struct chat_history_reply {
+    int16_t return_code;
+    uint64_t last_seq;
+    uint64_t durable_seq;
+    int32_t entry_count;
+} chat_history_reply_t ;
+#define CHAT_HISTORY_REPLY_MAX_SZ (2 + 2 + 8 + 8 + 4)
+
+typedef struct chat_protocol_request {
+    uint16_t wire_format;
+} chat_protocol_request_t ;
+#define CHAT_PROTOCOL_REQUEST_MAX_SZ (2)
+
+typedef struct chat_protocol_reply {
+    int16_t return_code;
+    int16_t wire_format;
+} chat_protocol_reply_t ;
+#define CHAT_PROTOCOL_REPLY_MAX_SZ (2 + 2 + 2)
+
+typedef struct chat_caps_request {
+    uint32_t offered;
+} chat_caps_request_t ;
+#define CHAT_CAPS_REQUEST_MAX_SZ (4)
+
+typedef struct chat_caps_reply {
+    int16_t return_code;
+    uint16_t codec;
+    uint32_t supported;
+} chat_caps_reply_t ;
+#define CHAT_CAPS_REPLY_MAX_SZ (2 + 2 + 2 + 4)
+
+/**
+ * @brief Validates a login request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int chat_login_parse_request(const char *buf, size_t length, chat_login_request_t *out);
+
+/**
+ * @brief Takes the login request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for CHAT_LOGIN_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int chat_login_recv_request(xnet_active_connection_t *conn, char *scratch, chat_login_request_t *out);
+
+/**
+ * @brief Writes a login reply to @param out.
+ *
+ * @param out Room for CHAT_LOGIN_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t chat_login_write_reply(char *out, const chat_login_reply_t *in);
+
+/**
+ * @brief Validates a whisper request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int chat_whisper_parse_request(const char *buf, size_t length, chat_whisper_request_t *out);
+
+/**
+ * @brief Takes the whisper request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for CHAT_WHISPER_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int chat_whisper_recv_request(xnet_active_connection_t *conn, char *scratch, chat_whisper_request_t *out);
+
+/**
+ * @brief Writes a whisper reply to @param out.
+ *
+ * @param out Room for CHAT_WHISPER_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t chat_whisper_write_reply(char *out, const chat_whisper_reply_t *in);
+
+/**
+ * @brief Validates a join request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int chat_join_parse_request(const char *buf, size_t length, chat_join_request_t *out);
+
+/**
+ * @brief Takes the join request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for CHAT_JOIN_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int chat_join_recv_request(xnet_active_connection_t *conn, char *scratch, chat_join_request_t *out);
+
+/**
+ * @brief Writes a join reply to @param out.
+ *
+ * @param out Room for CHAT_JOIN_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t chat_join_write_reply(char *out, const chat_join_reply_t *in);
+
+/**
+ * @brief Validates a shout request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int chat_shout_parse_request(const char *buf, size_t length, chat_shout_request_t *out);
+
+/**
+ * @brief Takes the shout request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for CHAT_SHOUT_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int chat_shout_recv_request(xnet_active_connection_t *conn, char *scratch, chat_shout_request_t *out);
+
+/**
+ * @brief Writes a shout reply to @param out.
+ *
+ * @param out Room for CHAT_SHOUT_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t chat_shout_write_reply(char *out, const chat_shout_reply_t *in);
+
+/**
+ * @brief Validates a resume request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int chat_resume_parse_request(const char *buf, size_t length, chat_resume_request_t *out);
+
+/**
+ * @brief Takes the resume request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for CHAT_RESUME_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int chat_resume_recv_request(xnet_active_connection_t *conn, char *scratch, chat_resume_request_t *out);
+
+/**
+ * @brief Writes a resume reply to @param out.
+ *
+ * @param out Room for CHAT_RESUME_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t chat_resume_write_reply(char *out, const chat_resume_reply_t *in);
+
+/**
+ * @brief Validates a room request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int chat_room_parse_request(const char *buf, size_t length, chat_room_request_t *out);
+
+/**
+ * @brief Takes the room request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for CHAT_ROOM_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int chat_room_recv_request(xnet_active_connection_t *conn, char *scratch, chat_room_request_t *out);
+
+/**
+ * @brief Writes a room reply to @param out.
+ *
+ * @param out Room for CHAT_ROOM_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t chat_room_write_reply(char *out, const chat_room_reply_t *in);
+
+/**
+ * @brief Validates a history request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int chat_history_parse_request(const char *buf, size_t length, chat_history_request_t *out);
+
+/**
+ * @brief Takes the history request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for CHAT_HISTORY_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int chat_history_recv_request(xnet_active_connection_t *conn, char *scratch, chat_history_request_t *out);
+
+/**
+ * @brief Writes a history reply to @param out.
+ *
+ * @param out Room for CHAT_HISTORY_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t chat_history_write_reply(char *out, const chat_history_reply_t *in);
+
+/**
+ * @brief Validates a protocol request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int chat_protocol_parse_request(const char *buf, size_t length, chat_protocol_request_t *out);
+
+/**
+ * @brief Takes the protocol request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for CHAT_PROTOCOL_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int chat_protocol_recv_request(xnet_active_connection_t *conn, char *scratch, chat_protocol_request_t *out);
+
+/**
+ * @brief Writes a protocol reply to @param out.
+ *
+ * @param out Room for CHAT_PROTOCOL_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t chat_protocol_write_reply(char *out, const chat_protocol_reply_t *in);
+
+/**
+ * @brief Validates a caps request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int chat_caps_parse_request(const char *buf, size_t length, chat_caps_request_t *out);
+
+/**
+ * @brief Takes the caps request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for CHAT_CAPS_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int chat_caps_recv_request(xnet_active_connection_t *conn, char *scratch, chat_caps_request_t *out);
+
+/**
+ * @brief Writes a caps reply to @param out.
+ *
+ * @param out Room for CHAT_CAPS_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t chat_caps_write_reply(char *out, const chat_caps_reply_t *in);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KAMERYN GAIGE KNIGHT
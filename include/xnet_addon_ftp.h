@@ -0,0 +1,191 @@
+/**
+ * @file        xnet_addon_ftp.h
+ * @author      Kameryn Gaige Knight
+ * @brief       Addon library for a XNet server. Adds file distribution out of a single served directory.
+ *              File data moves between sockets and files with sendfile() and splice(), driven by the reactor.
+ * @version     1.0
+ * @date        2026-10-19
+ *
+ * @copyright   Copyright (c) 2022 Kameryn Gaige Knight
+ * License      MIT
+ */
+#ifndef XNET_ADDON_FTP_H
+#define XNET_ADDON_FTP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "xnet_base.h"
+#include "xnet_utils.h"
+#include "xnet_userbase.h"
+#include "xnet_buffer.h"
+#include "xnet_frame.h"
+#include "xnet_checksum.h"
+#include "xnet_addon_ftp_packets.h"
+#include "xnet_addon_ftp_index.h"
+
+/* Opcodes, packet layouts and their limits come from schema/ftp_packets.schema. */
+
+/* Addon Configuration */
+#define FTP_ROOT_DEFAULT "ftp_root" // Directory served when none is given. Created if missing.
+#define FTP_WRITE_PERM 2            // Permission level required to change anything in the served directory.
+#define FTP_PART_SUFFIX ".part"     // Puts land in a file named like this first and are renamed once complete.
+#define FTP_SEARCH_BATCH 64         // Match packets a search hands to the socket at once.
+
+/* Return Codes */
+#define FTP_RC_SUCCESS 0
+#define FTP_RC_DENIED 1
+#define FTP_RC_BAD_PATH 2
+#define FTP_RC_NOT_FOUND 3
+#define FTP_RC_EXISTS 4
+#define FTP_RC_IO 5
+#define FTP_RC_BAD_RANGE 6
+#define FTP_RC_BUSY 7
+#define FTP_RC_CORRUPT 8
+#define FTP_RC_CANCELLED 9
+
+/* A file with puts writing into its partial file, or a commit checking it. */
+typedef struct ftp_upload {
+    char path[FTP_MAX_PATH_LEN + 1];
+    /* Puts currently receiving a slice. The partial file can't be committed before this is 0. */
+    size_t streams;
+    /* Set while a commit checksums the partial file. No put may start meanwhile. */
+    bool is_committing;
+    struct ftp_upload *next;
+} ftp_upload_t ;
+
+typedef struct ftp_main {
+    /* Every path a client names is resolved below this directory. -1 until the addon is integrated. */
+    int root_fd;
+    /* Guards uploads, and orders commits against puts starting on the same file. */
+    pthread_mutex_t lock;
+    ftp_upload_t *uploads;
+} ftp_main_t ;
+
+/* A put in flight. Lives until the reactor is done receiving its slice. */
+typedef struct ftp_put {
+    char path[FTP_MAX_PATH_LEN + 1];
+    char part_path[FTP_MAX_PATH_LEN + sizeof(FTP_PART_SUFFIX)];
+    uint64_t size;
+    uint64_t offset;
+    uint64_t length;
+} ftp_put_t ;
+
+/**
+ * @brief Responsible for integrating the ftp addon into a XNet server.
+ *        This must be called in order for the ftp addon to be recognized by XNet.
+ *
+ * @param xnet A pointer to an XNet server.
+ * @param root Directory to serve. FTP_ROOT_DEFAULT when NULL.
+ * @param index_cache Where the directory index is kept between runs. FTP_INDEX_CACHE_DEFAULT when NULL.
+ * @return int Returns 0 on success. Returns non-zero on failure.
+ */
+int xnet_integrate_ftp_addon(xnet_box_t *xnet, const char *root, const char *index_cache);
+
+/**
+ * @brief Saves the directory index, then lets go of the served directory and any upload bookkeeping.
+ *        Call once the server has stopped.
+ */
+void ftp_close_root(void);
+
+/**
+ * @brief Feature that creates an empty file. Fails if anything already has the name.
+ *
+ * @param xnet
+ * @param client
+ * @return int
+ */
+int ftp_perform_create_file(xnet_box_t *xnet, xnet_active_connection_t *client);
+
+/**
+ * @brief Feature that creates a directory.
+ *
+ * @param xnet
+ * @param client
+ * @return int
+ */
+int ftp_perform_mkdir(xnet_box_t *xnet, xnet_active_connection_t *client);
+
+/**
+ * @brief Feature that looks up names containing, or starting with, a pattern in the directory index. An empty
+ *        pattern matches everything. The reply is followed by one page of match packets, sent in batches of
+ *        FTP_SEARCH_BATCH, then a search_end packet telling whether another page follows.
+ *
+ * @param xnet
+ * @param client
+ * @return int
+ */
+int ftp_perform_search(xnet_box_t *xnet, xnet_active_connection_t *client);
+
+/**
+ * @brief Feature that sends a byte range of a file. The reply is followed by the range, which the reactor sends
+ *        with sendfile() as the client's socket makes room. The worker is done once the reply is queued.
+ *
+ * @param xnet
+ * @param client
+ * @return int
+ */
+int ftp_perform_get(xnet_box_t *xnet, xnet_active_connection_t *client);
+
+/**
+ * @brief Feature that stores a byte range of a file in its FTP_PART_SUFFIX file. Once the client is told it may
+ *        go ahead, the reactor splices the range from the socket into place as it arrives, then replies again.
+ *        Any number of connections may fill slices of the same file at once. A put covering the whole file
+ *        commits it when done. A broken put keeps what arrived, so the client can resume it.
+ *
+ * @param xnet
+ * @param client
+ * @return int
+ */
+int ftp_perform_put(xnet_box_t *xnet, xnet_active_connection_t *client);
+
+/**
+ * @brief Feature that checksums a run of FTP_CHUNK_SZ chunks of a file, its partial file if it has one.
+ *        The reply is followed by one chunk packet per chunk, so the client can resume from the last intact one.
+ *
+ * @param xnet
+ * @param client
+ * @return int
+ */
+int ftp_perform_status(xnet_box_t *xnet, xnet_active_connection_t *client);
+
+/**
+ * @brief Feature that renames a partial file into place once every slice is in. Refused while puts are still
+ *        writing into it, or when its size isn't the one the client expects. When the client names a checksum,
+ *        a partial file that doesn't match it stays where it is, for status to find the bad chunks.
+ *
+ * @param xnet
+ * @param client
+ * @return int
+ */
+int ftp_perform_commit(xnet_box_t *xnet, xnet_active_connection_t *client);
+
+/**
+ * @brief Feature that checksums a byte range of a file with CRC-32C or XXH3.
+ *
+ * @param xnet
+ * @param client
+ * @return int
+ */
+int ftp_perform_checksum(xnet_box_t *xnet, xnet_active_connection_t *client);
+
+/**
+ * @brief Feature that deletes a file or an empty directory, and abandons any partial upload of it.
+ *
+ * @param xnet
+ * @param client
+ * @return int
+ */
+int ftp_perform_delete(xnet_box_t *xnet, xnet_active_connection_t *client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KAMERYN GAIGE KNIGHT
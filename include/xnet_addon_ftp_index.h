@@ -0,0 +1,133 @@
+/**
+ * @file        xnet_addon_ftp_index.h
+ * @author      Kameryn Gaige Knight
+ * @brief       In-memory index of the FTP addon's served directory, so searches never walk the disk.
+ *              Kept current through inotify and saved between runs, so a restart only rereads what changed.
+ * @version     1.0
+ * @date        2026-10-19
+ *
+ * @copyright   Copyright (c) 2022 Kameryn Gaige Knight
+ * License      MIT
+ */
+#ifndef XNET_ADDON_FTP_INDEX_H
+#define XNET_ADDON_FTP_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "xnet_utils.h"
+#include "xnet_checksum.h"
+#include "xnet_addon_ftp_packets.h"
+
+/* Index Configuration */
+#define FTP_INDEX_CACHE_DEFAULT "ftp_index.cache" // Where the index is kept between runs. Keep it out of the served directory.
+#define FTP_INDEX_SAVE_S 300                      // Interval at which a changed index is saved while the server runs.
+#define FTP_INDEX_EVENT_BUF_SZ 65536
+#define FTP_INDEX_MAGIC "XFTPIDX1"
+
+/*
+Cache layout, in native byte order since it never leaves the machine:
+    [FTP_INDEX_MAGIC][i64 root mtime ns][u64 entry count]
+    entry count times: [u16 type][u16 path length][u64 size][i64 mtime ns][path]
+Only directories carry an mtime. On load, a directory whose mtime still matches is trusted as it is, so sizes
+of files rewritten in place while the server was down stay stale until they are written again.
+*/
+
+typedef struct ftp_index_entry {
+    uint64_t hash;
+    uint64_t size;
+    /* Directories only. When it was last read, which is what a restart compares against. */
+    int64_t mtime_ns;
+    uint16_t type;
+    uint16_t path_length;
+    /* Where the last component of the path starts. That's the name searches match. */
+    uint16_t name_offset;
+    /* Set once gone from disk. Freed once no sorted view holds it anymore. */
+    bool is_deleted;
+    char path[];
+} ftp_index_entry_t ;
+
+typedef struct ftp_index_main {
+    bool is_open;
+    bool is_running;
+    int root_fd;
+    char root[PATH_MAX];
+    char cache_path[PATH_MAX];
+    int inotify_fd;
+    /* Wakes the watcher when it is time to stop. */
+    int stop_fd;
+    pthread_t watcher;
+    /* Guards everything below. Searches hold it for one page. */
+    pthread_mutex_t lock;
+    int64_t root_mtime_ns;
+    /* Path to entry. Open addressing, a power of two in size, kept at most half full. */
+    ftp_index_entry_t **table;
+    size_t table_size;
+    size_t table_count;
+    /* Every entry, ordered by path and by name then path. Deleted ones stay until the next merge. */
+    ftp_index_entry_t **by_path;
+    ftp_index_entry_t **by_name;
+    size_t sorted_count;
+    /* Entries added since the sorted views were last merged. */
+    ftp_index_entry_t **pending;
+    size_t pending_count;
+    size_t pending_capacity;
+    size_t deleted_count;
+    /* Relative path of each watched directory, by watch descriptor. */
+    char **watches;
+    size_t watch_capacity;
+    size_t watch_failures;
+    bool is_dirty;
+} ftp_index_main_t ;
+
+/* A page of search results. */
+typedef struct ftp_index_query {
+    const char *pattern;
+    /* FTP_SEARCH_SUBSTRING or FTP_SEARCH_PREFIX. Either way it is matched against names only. */
+    uint16_t mode;
+    /* Last path of the previous page. Empty for the first. */
+    const char *after;
+    size_t limit;
+} ftp_index_query_t ;
+
+/**
+ * @brief Called once per match, in page order, with the index locked.
+ */
+typedef void (*ftp_index_visit_fn)(const ftp_index_entry_t *entry, void *arg);
+
+/**
+ * @brief Builds the index of the directory @param root, open as @param root_fd, from @param cache_path when it
+ *        holds a usable copy and from disk otherwise, then starts the thread that follows changes to it.
+ *
+ * @param cache_path FTP_INDEX_CACHE_DEFAULT when NULL.
+ * @return int 0 on success, non-zero on failure.
+ */
+int ftp_index_open(int root_fd, const char *root, const char *cache_path);
+
+/**
+ * @brief Stops following changes, saves the index and frees it.
+ */
+void ftp_index_close(void);
+
+/**
+ * @brief Visits one page of entries whose names match @param query, at most @param query->limit of them.
+ *
+ * @param has_more Set when there are matches past this page.
+ * @return size_t Matches visited.
+ */
+size_t ftp_index_search(const ftp_index_query_t *query, ftp_index_visit_fn visit, void *arg, bool *has_more);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KAMERYN GAIGE KNIGHT
@@ -0,0 +1,450 @@
+/**
+ * @file        xnet_addon_ftp_packets.h
+ * @author      Kameryn Gaige Knight
+ * @brief       Generated from schema/ftp_packets.schema by tools/packetgen.py. Do not edit, run 'make packets'.
+ * @version     1.0
+ * @date        2026-10-19
+ *
+ * @copyright   Copyright (c) 2022 Kameryn Gaige Knight
+ * License      MIT
+ */
+#ifndef XNET_ADDON_FTP_PACKETS_H
+#define XNET_ADDON_FTP_PACKETS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <endian.h>
+
+#include "xnet_base.h"
+#include "xnet_frame.h"
+
+/* Constants */
+#define FTP_MAX_PATH_LEN 255
+#define FTP_MAX_SEARCH_RESULTS 1000
+#define FTP_CHUNK_SZ 1048576
+#define FTP_MAX_STATUS_CHUNKS 256
+
+/* Opcodes */
+#define FTP_CREATE_OP 301
+#define FTP_MKDIR_OP 302
+#define FTP_SEARCH_OP 303
+#define FTP_GET_OP 304
+#define FTP_PUT_OP 305
+#define FTP_DELETE_OP 306
+#define FTP_STATUS_OP 307
+#define FTP_COMMIT_OP 308
+#define FTP_CHECKSUM_OP 309
+#define FTP_SEARCH_END_OP 397
+#define FTP_CHUNK_OP 398
+#define FTP_MATCH_OP 399
+
+/* Enumerated field values */
+#define FTP_SEARCH_SUBSTRING 1
+#define FTP_SEARCH_PREFIX 2
+#define FTP_PUT_READY 1
+#define FTP_PUT_DONE 2
+#define FTP_STATUS_PARTIAL 1
+#define FTP_STATUS_COMPLETE 2
+#define FTP_COMMIT_NONE 0
+#define FTP_COMMIT_CRC32C 1
+#define FTP_COMMIT_XXH3 2
+#define FTP_CHECKSUM_CRC32C 1
+#define FTP_CHECKSUM_XXH3 2
+#define FTP_SEARCH_END_LAST 1
+#define FTP_SEARCH_END_MORE 2
+#define FTP_MATCH_FILE 1
+#define FTP_MATCH_DIR 2
+
+/* Points into the buffer a packet was parsed from. Not NUL terminated. */
+typedef struct ftp_view {
+    const char *data;
+    size_t length;
+} ftp_view_t ;
+
+typedef struct ftp_create_request {
+    ftp_view_t path;
+} ftp_create_request_t ;
+#define FTP_CREATE_REQUEST_MAX_SZ (2 + FTP_MAX_PATH_LEN)
+
+typedef struct ftp_create_reply {
+    int16_t return_code;
+} ftp_create_reply_t ;
+#define FTP_CREATE_REPLY_MAX_SZ (2 + 2)
+
+typedef struct ftp_mkdir_request {
+    ftp_view_t path;
+} ftp_mkdir_request_t ;
+#define FTP_MKDIR_REQUEST_MAX_SZ (2 + FTP_MAX_PATH_LEN)
+
+typedef struct ftp_mkdir_reply {
+    int16_t return_code;
+} ftp_mkdir_reply_t ;
+#define FTP_MKDIR_REPLY_MAX_SZ (2 + 2)
+
+typedef struct ftp_search_request {
+    ftp_view_t pattern;
+    uint16_t mode;
+    ftp_view_t after;
+    uint16_t limit;
+} ftp_search_request_t ;
+#define FTP_SEARCH_REQUEST_MAX_SZ (2 + FTP_MAX_PATH_LEN + 2 + 2 + FTP_MAX_PATH_LEN + 2)
+
+typedef struct ftp_search_reply {
+    int16_t return_code;
+} ftp_search_reply_t ;
+#define FTP_SEARCH_REPLY_MAX_SZ (2 + 2)
+
+typedef struct ftp_get_request {
+    ftp_view_t path;
+    uint64_t offset;
+    uint64_t length;
+} ftp_get_request_t ;
+#define FTP_GET_REQUEST_MAX_SZ (2 + FTP_MAX_PATH_LEN + 8 + 8)
+
+typedef struct ftp_get_reply {
+    int16_t return_code;
+    uint64_t size;
+    uint64_t offset;
+    uint64_t length;
+} ftp_get_reply_t ;
+#define FTP_GET_REPLY_MAX_SZ (2 + 2 + 8 + 8 + 8)
+
+typedef struct ftp_put_request {
+    ftp_view_t path;
+    uint64_t size;
+    uint64_t offset;
+    uint64_t length;
+} ftp_put_request_t ;
+#define FTP_PUT_REQUEST_MAX_SZ (2 + FTP_MAX_PATH_LEN + 8 + 8 + 8)
+
+typedef struct ftp_put_reply {
+    int16_t return_code;
+    uint16_t stage;
+    uint64_t offset;
+    uint64_t length;
+} ftp_put_reply_t ;
+#define FTP_PUT_REPLY_MAX_SZ (2 + 2 + 2 + 8 + 8)
+
+typedef struct ftp_delete_request {
+    ftp_view_t path;
+} ftp_delete_request_t ;
+#define FTP_DELETE_REQUEST_MAX_SZ (2 + FTP_MAX_PATH_LEN)
+
+typedef struct ftp_delete_reply {
+    int16_t return_code;
+} ftp_delete_reply_t ;
+#define FTP_DELETE_REPLY_MAX_SZ (2 + 2)
+
+typedef struct ftp_status_request {
+    ftp_view_t path;
+    uint32_t first_chunk;
+    uint32_t chunk_count;
+} ftp_status_request_t ;
+#define FTP_STATUS_REQUEST_MAX_SZ (2 + FTP_MAX_PATH_LEN + 4 + 4)
+
+typedef struct ftp_status_reply {
+    int16_t return_code;
+    uint16_t state;
+    uint64_t size;
+    uint32_t chunk_size;
+    uint32_t first_chunk;
+    uint32_t chunk_count;
+} ftp_status_reply_t ;
+#define FTP_STATUS_REPLY_MAX_SZ (2 + 2 + 2 + 8 + 4 + 4 + 4)
+
+typedef struct ftp_commit_request {
+    ftp_view_t path;
+    uint64_t size;
+    uint16_t algorithm;
+    uint64_t digest;
+} ftp_commit_request_t ;
+#define FTP_COMMIT_REQUEST_MAX_SZ (2 + FTP_MAX_PATH_LEN + 8 + 2 + 8)
+
+typedef struct ftp_commit_reply {
+    int16_t return_code;
+} ftp_commit_reply_t ;
+#define FTP_COMMIT_REPLY_MAX_SZ (2 + 2)
+
+typedef struct ftp_checksum_request {
+    ftp_view_t path;
+    uint16_t algorithm;
+    uint64_t offset;
+    uint64_t length;
+} ftp_checksum_request_t ;
+#define FTP_CHECKSUM_REQUEST_MAX_SZ (2 + FTP_MAX_PATH_LEN + 2 + 8 + 8)
+
+typedef struct ftp_checksum_reply {
+    int16_t return_code;
+    uint64_t offset;
+    uint64_t length;
+    uint64_t digest;
+} ftp_checksum_reply_t ;
+#define FTP_CHECKSUM_REPLY_MAX_SZ (2 + 2 + 8 + 8 + 8)
+
+typedef struct ftp_search_end_reply {
+    uint16_t page;
+    uint32_t match_count;
+} ftp_search_end_reply_t ;
+#define FTP_SEARCH_END_REPLY_MAX_SZ (2 + 2 + 4)
+
+typedef struct ftp_chunk_reply {
+    uint32_t index;
+    uint32_t crc32c;
+} ftp_chunk_reply_t ;
+#define FTP_CHUNK_REPLY_MAX_SZ (2 + 4 + 4)
+
+typedef struct ftp_match_reply {
+    uint16_t type;
+    uint64_t size;
+    ftp_view_t path;
+} ftp_match_reply_t ;
+#define FTP_MATCH_REPLY_MAX_SZ (2 + 2 + 8 + 2 + FTP_MAX_PATH_LEN)
+
+/**
+ * @brief Validates a create request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int ftp_create_parse_request(const char *buf, size_t length, ftp_create_request_t *out);
+
+/**
+ * @brief Takes the create request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for FTP_CREATE_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int ftp_create_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_create_request_t *out);
+
+/**
+ * @brief Writes a create reply to @param out.
+ *
+ * @param out Room for FTP_CREATE_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t ftp_create_write_reply(char *out, const ftp_create_reply_t *in);
+
+/**
+ * @brief Validates a mkdir request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int ftp_mkdir_parse_request(const char *buf, size_t length, ftp_mkdir_request_t *out);
+
+/**
+ * @brief Takes the mkdir request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for FTP_MKDIR_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int ftp_mkdir_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_mkdir_request_t *out);
+
+/**
+ * @brief Writes a mkdir reply to @param out.
+ *
+ * @param out Room for FTP_MKDIR_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t ftp_mkdir_write_reply(char *out, const ftp_mkdir_reply_t *in);
+
+/**
+ * @brief Validates a search request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int ftp_search_parse_request(const char *buf, size_t length, ftp_search_request_t *out);
+
+/**
+ * @brief Takes the search request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for FTP_SEARCH_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int ftp_search_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_search_request_t *out);
+
+/**
+ * @brief Writes a search reply to @param out.
+ *
+ * @param out Room for FTP_SEARCH_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t ftp_search_write_reply(char *out, const ftp_search_reply_t *in);
+
+/**
+ * @brief Validates a get request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int ftp_get_parse_request(const char *buf, size_t length, ftp_get_request_t *out);
+
+/**
+ * @brief Takes the get request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for FTP_GET_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int ftp_get_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_get_request_t *out);
+
+/**
+ * @brief Writes a get reply to @param out.
+ *
+ * @param out Room for FTP_GET_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t ftp_get_write_reply(char *out, const ftp_get_reply_t *in);
+
+/**
+ * @brief Validates a put request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int ftp_put_parse_request(const char *buf, size_t length, ftp_put_request_t *out);
+
+/**
+ * @brief Takes the put request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for FTP_PUT_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int ftp_put_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_put_request_t *out);
+
+/**
+ * @brief Writes a put reply to @param out.
+ *
+ * @param out Room for FTP_PUT_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t ftp_put_write_reply(char *out, const ftp_put_reply_t *in);
+
+/**
+ * @brief Validates a delete request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int ftp_delete_parse_request(const char *buf, size_t length, ftp_delete_request_t *out);
+
+/**
+ * @brief Takes the delete request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for FTP_DELETE_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int ftp_delete_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_delete_request_t *out);
+
+/**
+ * @brief Writes a delete reply to @param out.
+ *
+ * @param out Room for FTP_DELETE_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t ftp_delete_write_reply(char *out, const ftp_delete_reply_t *in);
+
+/**
+ * @brief Validates a status request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int ftp_status_parse_request(const char *buf, size_t length, ftp_status_request_t *out);
+
+/**
+ * @brief Takes the status request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for FTP_STATUS_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int ftp_status_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_status_request_t *out);
+
+/**
+ * @brief Writes a status reply to @param out.
+ *
+ * @param out Room for FTP_STATUS_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t ftp_status_write_reply(char *out, const ftp_status_reply_t *in);
+
+/**
+ * @brief Validates a commit request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int ftp_commit_parse_request(const char *buf, size_t length, ftp_commit_request_t *out);
+
+/**
+ * @brief Takes the commit request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for FTP_COMMIT_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int ftp_commit_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_commit_request_t *out);
+
+/**
+ * @brief Writes a commit reply to @param out.
+ *
+ * @param out Room for FTP_COMMIT_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t ftp_commit_write_reply(char *out, const ftp_commit_reply_t *in);
+
+/**
+ * @brief Validates a checksum request in @param buf in one pass. Views in @param out point into @param buf.
+ *
+ * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.
+ */
+int ftp_checksum_parse_request(const char *buf, size_t length, ftp_checksum_request_t *out);
+
+/**
+ * @brief Takes the checksum request @param conn is being served for and parses it.
+ *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.
+ *
+ * @param scratch Room for FTP_CHECKSUM_REQUEST_MAX_SZ bytes. Views may point into it.
+ * @return int 0 on success. Non-zero when the request is malformed or incomplete.
+ */
+int ftp_checksum_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_checksum_request_t *out);
+
+/**
+ * @brief Writes a checksum reply to @param out.
+ *
+ * @param out Room for FTP_CHECKSUM_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t ftp_checksum_write_reply(char *out, const ftp_checksum_reply_t *in);
+
+/**
+ * @brief Writes a search_end reply to @param out.
+ *
+ * @param out Room for FTP_SEARCH_END_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t ftp_search_end_write_reply(char *out, const ftp_search_end_reply_t *in);
+
+/**
+ * @brief Writes a chunk reply to @param out.
+ *
+ * @param out Room for FTP_CHUNK_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t ftp_chunk_write_reply(char *out, const ftp_chunk_reply_t *in);
+
+/**
+ * @brief Writes a match reply to @param out.
+ *
+ * @param out Room for FTP_MATCH_REPLY_MAX_SZ bytes.
+ * @return size_t Bytes written.
+ */
+size_t ftp_match_write_reply(char *out, const ftp_match_reply_t *in);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KAMERYN GAIGE KNIGHT
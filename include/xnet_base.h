@@ -24,6 +24,7 @@ extern "C" {
 #include <sys/signalfd.h>
 #include <sys/timerfd.h>
 #include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <string.h>
@@ -31,6 +32,7 @@ extern "C" {
 #include <errno.h>
 #include <time.h>
 #include <signal.h>
+#include <stdint.h>
 
 #include "gerr.h"
 
@@ -50,14 +52,81 @@ extern "C" {
 #define XNET_EPOLL_MAX_EVENTS        10   // Number of max events that epoll will yield to in epoll_wait() 
 #define XNET_MAX_FEATURES            4096
 #define XNET_MAX_CALLBACKS           512
+#define XNET_MAX_ADDON_SLOTS         8    // Number of addons that may keep their own data on every connection.
 
 #define XNET_MAX_PACKET_BUF_SZ       8192
+#define XNET_FLUSH_IOV_MAX           16   // Queued buffers handed to a single sendmsg() when flushing a connection.
+#define XNET_MAIL_FLUSH              0x1  // Mail for the reactor. Output was queued for it to write.
+#define XNET_MAIL_DONE               0x2  // Mail for the reactor. A worker is done with its request, the read side goes back.
+#define XNET_MAIL_CLOSE              0x4  // Mail for the reactor. The connection was evicted, hang up on it.
+#define XNET_FANOUT_THRESHOLD_DEFAULT 2048 // Broadcasts to at least this many connections are split across the pool.
+#define XNET_FANOUT_CHUNK_SZ         512  // Connections handled per chunk of a parallel broadcast.
+#define XNET_FILE_CHUNK_SZ           65536   // Most file data moved by one sendfile() or splice(). Also the pipe's default size.
+#define XNET_FILE_BUDGET_SZ          1048576 // File data the reactor moves for one connection before serving the others.
+#define XNET_SLOW_MAX_BYTES_DEFAULT  16777216 // Unsent bytes, files aside, a connection may queue before its slow consumer policy applies.
+#define XNET_SLOW_TIMEOUT_MS_DEFAULT 30000    // Queued output that makes no progress for this long gets its connection dropped. 0 never.
+
+#define XNET_FRAME_FLAG              0x8000 // Set in the opcode of a framed request. Legacy opcodes never reach it.
+#define XNET_FRAME_HEADER_SZ         6      // [u16 opcode | XNET_FRAME_FLAG][u32 payload length]
+#define XNET_MAX_FRAME_SZ            65536  // Largest payload a framed request may carry.
+#define XNET_RX_INLINE_SZ            64     // Framed payloads this small are read into the connection itself.
+#define XNET_RX_POOL_MIN_SZ          256    // Smallest pooled receive buffer. Every class holds 4 times the one before.
+#define XNET_RX_POOL_CLASSES         5      // Up to XNET_MAX_FRAME_SZ.
+#define XNET_RX_POOL_KEEP_SZ         1048576 // Idle bytes each class keeps for reuse. Buffers past that are freed.
+
+#define XNET_WIRE_FIXED              0    // Fixed-size packet layouts. What every client understands.
+#define XNET_WIRE_COMPACT            1    // Length-prefixed fields carrying only the bytes in use.
+#define XNET_WIRE_FORMATS            2
 
 #define XNET_THREAD_COUNT            10  // Number of tasks that can run concurrently.
 #define XNET_THREAD_MAX_TASKS        256 // Number of tasks that can be stored in a queue at once.
+#define XNET_PRIORITY_CLASSES        3   // See enum xnet_priority.
+#define XNET_PRIORITY_AGING_MS       50  // A task queued longer than this goes next, whatever its class.
+#define XNET_FAIR_QUANTUM_US         100 // Worker time a connection earns per round of fair queuing.
+#define XNET_FAIR_MAX_DEBT           32  // Rounds' worth of worker time a connection can owe after one task.
+#define XNET_DEADLINE_MS_DEFAULT     10000 // Time a handler may run before it is asked to stop. 0 never.
+#define XNET_WATCHDOG_MS             100   // Period of the watchdog looking for handlers past their deadline.
+#define XNET_BUDGET_BANDS            4     // Under half, under three quarters, under all, and over a deadline.
+
+#define XNET_NO_HANDLE               0   // Names no connection. Generations of live clients are odd, so no handle is 0.
+
+#define XNET_RATE_MAX_RULES          16  // Rate limits a server can hold, the one covering every opcode included.
+#define XNET_RATE_ANY_OP             XNET_MAX_FEATURES // Names every opcode at once when setting a rate limit.
+
+#define XNET_MAX_USERNAME_LEN        32
+#define XNET_MAX_PASSWD_LEN          32
+
+#define XNET_TOKEN_LEN               16  // Size in bytes of a resumable session token.
+#define XNET_TOKEN_TTL_DEFAULT       120 // In seconds, how long a token stays redeemable after its connection drops.
+#define XNET_TOKEN_TABLE_MIN         64  // Smallest token table capacity. Always a power of two.
+#define XNET_TOKEN_RESUME_DATA_LEN   32  // Bytes of addon data a token can carry across a reconnect.
 
 enum xnet_callbacks { ON_ADDON_LOAD, ON_ADDON_UNLOAD, ON_CLIENT_CONNECT, ON_CLIENT_DISCONNECT };
 
+/* Scheduling class of a task. Workers take from higher classes more often, and shedding drops lower ones first. */
+enum xnet_priority { XNET_PRIORITY_HIGH, XNET_PRIORITY_NORMAL, XNET_PRIORITY_LOW };
+
+/* What the reactor does with a request when the task queue is full. It never waits for room itself. */
+enum xnet_overload_policy {
+    XNET_OVERLOAD_PAUSE,  // Hold the request and stop reading its connection until a worker frees a slot.
+    XNET_OVERLOAD_REJECT, // Drop the request and send a busy packet.
+    XNET_OVERLOAD_SHED    // Make room by dropping the least important queued request, if it matters less.
+};
+
+/* What becomes of a connection whose unsent output passes the cap. */
+enum xnet_slow_policy {
+    XNET_SLOW_DISCONNECT,  // Hang up on it.
+    XNET_SLOW_DROP_OLDEST, // Drop the oldest broadcasts it hasn't started on until it fits.
+    XNET_SLOW_COALESCE     // Drop every broadcast it hasn't started on, and queue one lagged packet counting them.
+};
+
+/* Why a connection is closing. Disconnect callbacks can tell a slow consumer from a client that left. */
+enum xnet_close_reason {
+    XNET_CLOSE_PEER,         // The client hung up, or the server closed it.
+    XNET_CLOSE_SLOW_BACKLOG, // More unsent output than the slow consumer cap allows.
+    XNET_CLOSE_SLOW_STALL    // Its output made no progress for the slow consumer timeout.
+};
+
 typedef struct xnet_box {
     struct xnet_general_group *general;
     struct xnet_network_group *network;
@@ -67,11 +136,14 @@ typedef struct xnet_box {
 } xnet_box_t ; 
 
 typedef struct xnet_user {
-    char *username;
-    char *password;
-    char *hashed_pass;
+    char username[XNET_MAX_USERNAME_LEN + 1];
+    char password[XNET_MAX_PASSWD_LEN + 1];
+    char hashed_pass[XNET_MAX_PASSWD_LEN + 1];
     int perm_level;
     bool is_logged_in;
+    /* Most recent resumable session token issued to this user. */
+    bool has_token;
+    unsigned char token[XNET_TOKEN_LEN];
     struct xnet_user *prev;
     struct xnet_user *next;
 } xnet_user_t ;
@@ -79,20 +151,217 @@ typedef struct xnet_user {
 typedef struct xnet_user_session {
     int id;
     int timer_fd;
-    struct epoll_event session_event;
-    struct itimerspec t_content;
-    struct timespec t_data;
 } xnet_user_session_t ;
 
-typedef struct xnet_active_connection {
+typedef struct xnet_shared_buf {
+    /* Changed only through __atomic builtins. The buffer is freed when this reaches 0. */
+    int ref_count;
+    size_t length;
+    /* Immutable once the buffer has been handed to more than one owner. */
+    char data[];
+} xnet_shared_buf_t ;
+
+typedef struct xnet_outbound {
+    /* NULL for a file queued with xnet_send_file(). */
+    xnet_shared_buf_t *buf;
+    /* Bytes of buf already written to the socket. For a file, the position sendfile() continues from. */
+    size_t offset;
+    /* File sent from offset up to file_end, straight from the page cache. -1 for buffers. */
+    int file_fd;
+    size_t file_end;
+    /* A whole broadcast. Slow consumer policies may drop it until its first byte is written. */
+    bool is_droppable;
+    struct xnet_outbound *next;
+} xnet_outbound_t ;
+
+struct xnet_active_connection;
+
+typedef struct xnet_slow_stats {
+    /* Broadcasts dropped, lagged packets queued and connections hung up on by the slow consumer policy. */
+    uint64_t dropped;
+    uint64_t lagged;
+    uint64_t evicted;
+} xnet_slow_stats_t ;
+
+typedef struct xnet_deadline_stats {
+    /* Requests of an opcode served, how long they ran, and how many the watchdog had to stop. Cancelled ones were
+       asked to give up past their deadline. Abandoned ones still ran at twice it and got their client hung up on. */
+    uint64_t runs;
+    uint64_t run_total_ns;
+    uint64_t run_max_ns;
+    uint64_t cancelled;
+    uint64_t abandoned;
+    /* Runs by the share of their deadline they used, see XNET_BUDGET_BANDS. Empty without a deadline. */
+    uint64_t budget_used[XNET_BUDGET_BANDS];
+} xnet_deadline_stats_t ;
+
+typedef struct xnet_rx_pool_stats {
+    /* Framed payloads read into their connection, into a buffer the pool had idle, and into a fresh allocation. */
+    uint64_t inline_frames;
+    uint64_t reused;
+    uint64_t allocated;
+    /* Buffers lent out right now, and bytes idling in the pool. */
+    uint64_t lent;
+    uint64_t idle_bytes;
+} xnet_rx_pool_stats_t ;
+
+/* Receive buffers for framed payloads too large to read inline. A connection borrows one once a frame header says
+   how much is coming, and gives it back when the frame is released. */
+typedef struct xnet_rx_pool {
+    pthread_mutex_t lock;
+    /* Idle buffers of each class, linked through their first bytes. */
+    void *idle[XNET_RX_POOL_CLASSES];
+    size_t idle_count[XNET_RX_POOL_CLASSES];
+    /* Guarded by lock, but inline_frames, which goes through __atomic builtins. */
+    xnet_rx_pool_stats_t stats;
+} xnet_rx_pool_t ;
+
+typedef struct xnet_rate_stats {
+    /* Requests a rate rule let through, turned away, and held back until they fit its budget. */
+    uint64_t admitted;
+    uint64_t rejected;
+    uint64_t delayed;
+} xnet_rate_stats_t ;
+
+typedef struct xnet_rate_rule {
+    /* Requests per second each connection earns, and how many it may save up. A rate of 0 means no limit. */
+    uint32_t rate;
+    uint32_t burst;
+    /* XNET_RATE_REJECT or XNET_RATE_DELAY, what becomes of a request once the budget is spent. */
+    unsigned char policy;
+    /* Counted by the reactor through __atomic builtins. Read them with xnet_get_rate_stats(). */
+    xnet_rate_stats_t stats;
+} xnet_rate_rule_t ;
+
+typedef struct xnet_rate_bucket {
+    /* Budget left, in millionths of a request. */
+    uint64_t tokens;
+    /* Monotonic nanosecond of the last refill. 0 for a bucket that hasn't been used, which starts out full. */
+    uint64_t refilled_ns;
+} xnet_rate_bucket_t ;
+
+typedef struct xnet_file_sink {
+    /* Where the data goes, and the pipe splice() moves it through on the way. */
+    int fd;
+    int pipe_fds[2];
+    /* Position in fd the next byte is written to. fd's own file offset is left alone. */
+    size_t offset;
+    /* Bytes still to be taken off the socket. */
+    size_t left;
+    /* Bytes taken off the socket that haven't reached fd yet. */
+    size_t in_pipe;
+    /* Run by the reactor once the sink closes. status is 0 once every byte reached fd. */
+    void (*on_done)(xnet_box_t *xnet, struct xnet_active_connection *conn, int status, void *arg);
+    void *arg;
+} xnet_file_sink_t ;
+
+/* A connection's slot in the low 32 bits and its generation at the time in the high ones. See xnet_conn_handle(). */
+typedef uint64_t xnet_conn_handle_t;
+
+/* One connection's tasks in one priority class. Workers serve the flows of a class by deficit round robin. */
+typedef struct xnet_task_flow {
+    struct xnet_task *head;
+    struct xnet_task *tail;
+    /* Next flow in its class's round. Flows stay in it until found empty at its head. */
+    struct xnet_task_flow *next;
+    bool is_listed;
+    /* Worker time, in ns, the flow may still use. Charged after each task, so it goes negative on long ones. */
+    int64_t deficit_ns;
+} xnet_task_flow_t ;
+
+/* What the reactor reads to dispatch an event. Kept in a dense array beside the connections, and found straight from
+   the slot epoll hands back, see xnet_event_data(). socket and timer_fd are -1 while the slot is free. */
+typedef struct xnet_conn_hot {
+    int socket;
+    int timer_fd;
+    /* Bumped when a client takes the slot and again when it leaves. Odd while a client holds it, so a handle of
+       a client that left never matches the next one. Goes through __atomic builtins. */
+    uint32_t generation;
     /* Indicator that represents if the connection object is actively containing a connections data. */
     bool is_active;
-    /* State of client, are they in the middle of an action? */
+    /* State of client, are they in the middle of an action? Only the reactor touches it, workers post XNET_MAIL_DONE. */
     bool is_working;
+    /* Set while a XNET_RATE_DELAY rule or a full task queue holds a request back, see xnet_conn_cold_t.
+       Nothing more is read from the connection meanwhile. */
+    bool rx_held;
+} xnet_conn_hot_t ;
+
+/* Connection state that is only needed now and then. Kept in its own array, out of the way of the rest. */
+typedef struct xnet_conn_cold {
+    /* Request held back while rx_held is set, and the monotonic nanosecond it may go ahead at. */
+    short rx_held_op;
+    unsigned char rx_held_status;
+    /* Set when the request was held for want of a task slot. It already passed the rate limits. */
+    bool rx_held_admitted;
+    uint64_t rx_resume_ns;
+    /* 1 + the connection's index in the network group's held heap while a rate limit holds its request. 0 otherwise. */
+    size_t rx_held_slot;
+    /* Neighbours in the network group's paused line while the request waits for a task slot. */
+    bool rx_is_paused;
+    struct xnet_active_connection *rx_paused_prev;
+    struct xnet_active_connection *rx_paused_next;
+    /* Backs rx_sink while a file is being received. */
+    xnet_file_sink_t rx_sink;
+    /* Addon owned per-connection storage. Indexed by the slot returned from xnet_reserve_addon_slot(). */
+    void *addon_data[XNET_MAX_ADDON_SLOTS];
+} xnet_conn_cold_t ;
+
+/* Laid out for the reactor's per-event path: hot entry, flags, fd and mail first, then the inbound frame, then output. */
+typedef struct xnet_active_connection {
+    /* This slot's entry in the connection group's hot array. Where is_active, is_working, rx_held and the
+       generation live. */
+    xnet_conn_hot_t *hot;
+    /* Set while a handler serves a framed request and reads from rx_payload instead of the socket. */
+    bool rx_framed;
+    /* Asks the handler serving this connection to give up. Cleared when a worker picks up its next request.
+       Read it through xnet_is_cancelled(). */
+    bool cancel_requested;
+    /* XNET_WIRE_* layout this connection negotiated for packets sent to it. */
+    unsigned char wire_format;
+    /* XNET_CODEC_* this connection negotiated, and the stream coding everything sent to it. NULL when uncompressed.
+       Both change under io_lock, see xnet_switch_codec(). */
+    unsigned char codec;
     int socket;
-    struct epoll_event client_event;
-    xnet_user_t *account;
+    /* XNET_MAIL_* bits the reactor hasn't read yet. Non-zero while the connection sits in the network group's
+       mailbox. Goes through __atomic builtins. */
+    uint32_t mail;
+    /* Set once the connection is on its way out. Anything but XNET_CLOSE_PEER stops further output. */
+    enum xnet_close_reason close_reason;
     xnet_user_session_t session;
+    struct xnet_active_connection *mail_next;
+    xnet_user_t *account;
+    struct xnet_compress_ctx *compress;
+    /* Inbound frame the reactor is assembling. Owned by whoever owns the read side, see hot->is_working. */
+    unsigned char rx_header[XNET_FRAME_HEADER_SZ];
+    /* Bytes of the current frame, header included, received so far. */
+    size_t rx_have;
+    size_t rx_length;
+    /* Points at rx_inline, or at a buffer borrowed from the rx pool, from the frame's header until its release. */
+    char *rx_payload;
+    /* Payload bytes already handed to the handler through xnet_conn_read(). */
+    size_t rx_offset;
+    /* Bytes of a rejected frame still to be discarded. */
+    size_t rx_skip;
+    char rx_inline[XNET_RX_INLINE_SZ];
+    /* File the reactor is receiving straight from the socket, see xnet_receive_file(). Goes before any request.
+       NULL while there is none. */
+    xnet_file_sink_t *rx_sink;
+    /* Budget under each of the server's rate rules, one per rule in use. Only the reactor touches these. */
+    xnet_rate_bucket_t *rate_buckets;
+    /* This slot's entry in the connection group's cold array. */
+    xnet_conn_cold_t *cold;
+    /* Guards the output queue. The reactor holds it too while it sets the epoll interest, which follows the queue. */
+    pthread_mutex_t io_lock;
+    /* Data waiting for the reactor to write it. */
+    xnet_outbound_t *out_head;
+    xnet_outbound_t *out_tail;
+    size_t out_bytes;
+    /* CLOCK_MONOTONIC time the output queue was last written to the socket, or last became non-empty. */
+    uint64_t out_progress_ns;
+    /* The lagged packet queued by XNET_SLOW_COALESCE. Its count grows until its first byte is written. */
+    xnet_outbound_t *lag_marker;
+    /* Where this connection's tasks wait, one flow per priority class. Guarded by the thread group's main_lock. */
+    xnet_task_flow_t flows[XNET_PRIORITY_CLASSES];
 } xnet_active_connection_t ;
 
 typedef struct xnet_general_group {
@@ -102,6 +371,28 @@ typedef struct xnet_general_group {
     size_t backlog;
     size_t connection_timeout;
     size_t max_connections;
+    size_t addon_slot_count;
+    size_t fanout_threshold;
+    /* Let workers write to sockets with nothing queued themselves instead of leaving every write to the reactor. */
+    bool write_through;
+    /* Accept requests without a frame header, which is what clients predating framing send. */
+    bool legacy_framing;
+    /* rate_rules[0] covers every request. The others cover the opcodes whose rate_rule_of points at them. */
+    xnet_rate_rule_t rate_rules[XNET_RATE_MAX_RULES];
+    size_t rate_rule_count;
+    unsigned char rate_rule_of[XNET_MAX_FEATURES];
+    /* What the reactor does with requests the task queue has no room for, and which of them go first. */
+    enum xnet_overload_policy overload_policy;
+    unsigned char priority_of[XNET_MAX_FEATURES];
+    /* How much unsent output a connection may pile up, and what happens past that. */
+    enum xnet_slow_policy slow_policy;
+    size_t slow_max_bytes;
+    size_t slow_timeout_ms;
+    /* Counted through __atomic builtins. Read them with xnet_get_slow_stats(). */
+    xnet_slow_stats_t slow_stats;
+    /* How long a handler may run for each opcode, and how close they come. Stats go through __atomic builtins. */
+    uint32_t deadline_ms_of[XNET_MAX_FEATURES];
+    xnet_deadline_stats_t deadline_stats[XNET_MAX_FEATURES];
     void (*on_connection_attempt)(xnet_box_t *xnet);
     void (*on_terminate_signal)(xnet_box_t *xnet);
     void (*on_client_send)(xnet_box_t *xnet, xnet_active_connection_t *me);
@@ -121,34 +412,149 @@ typedef struct xnet_network_group {
     struct epoll_event sfd_event;
     struct signalfd_siginfo fdsi;
     sigset_t mask;
+    /* Connections with mail for the reactor, pushed by any thread and taken whole by the reactor. Whoever finds it
+       empty pokes mail_fd. */
+    int mail_fd;
+    struct epoll_event mail_event;
+    struct xnet_active_connection *mailbox;
+    /* Fires every so often to look for connections whose output stalled. -1 without a slow consumer timeout. */
+    int slow_fd;
+    struct epoll_event slow_event;
+    /* Fires when the earliest request held back by a rate limit may go ahead. rate_wake_ns is 0 while disarmed. */
+    int rate_fd;
+    struct epoll_event rate_event;
+    uint64_t rate_wake_ns;
+    /* Connections a rate limit holds a request of, as a min-heap on their rx_resume_ns. One slot per connection. */
+    struct xnet_active_connection **held_heap;
+    size_t held_count;
+    /* Workers poke this when they free a task slot while requests wait for one. */
+    int room_fd;
+    struct epoll_event room_event;
+    /* Connections whose request waits for a task slot, in the order they were paused. */
+    struct xnet_active_connection *paused_head;
+    struct xnet_active_connection *paused_tail;
+    /* Fires every XNET_WATCHDOG_MS to look for handlers past their deadline. */
+    int watchdog_fd;
+    struct epoll_event watchdog_event;
 } xnet_network_group_t ;
 
 typedef struct xnet_task {
     int task_count;
+    /* True when the task serves a client request, in which case the worker owns the connection's read side. */
+    bool is_request;
+    short opcode;
+    unsigned char priority;
+    /* CLOCK_MONOTONIC time the task was queued at. Drives aging and the wait stats. */
+    uint64_t queued_ns;
+    /* The flow the task waits in, and its neighbours there and in its class's arrival order. */
+    xnet_task_flow_t *flow;
+    struct xnet_task *flow_next;
+    struct xnet_task *older;
+    struct xnet_task *newer;
     pthread_mutex_t task_lock;
     xnet_box_t *xnet;
     xnet_active_connection_t *me;
+    /* Who me was when the task was made. A task whose client left by the time it runs is dropped. */
+    xnet_conn_handle_t handle;
     int (*task_function)(xnet_box_t *xnet, xnet_active_connection_t *me);
+    /* Internal work that isn't tied to a connection runs through here instead of task_function. */
+    int (*job_function)(xnet_box_t *xnet, void *arg);
+    void *arg;
 } xnet_task_t ;
 
+typedef struct xnet_overload_stats {
+    /* Requests turned away, held back and dropped from the queue for want of a task slot. */
+    uint64_t rejected;
+    uint64_t paused;
+    uint64_t shed;
+    /* Connections refused because the queue had no room for their connect callbacks. */
+    uint64_t refused;
+} xnet_overload_stats_t ;
+
+typedef struct xnet_running_task {
+    /* Request a worker is serving. conn is NULL while the worker is idle or runs a job. */
+    xnet_active_connection_t *conn;
+    short opcode;
+    uint64_t started_ns;
+    /* CLOCK_MONOTONIC time it should be done by. 0 without a deadline. */
+    uint64_t deadline_ns;
+    bool is_cancelled;
+    bool is_abandoned;
+} xnet_running_task_t ;
+
+typedef struct xnet_sched_stats {
+    uint64_t dispatched;
+    /* Tasks that went ahead of their turn because they had waited XNET_PRIORITY_AGING_MS. */
+    uint64_t aged;
+    uint64_t wait_total_ns;
+    uint64_t wait_max_ns;
+} xnet_sched_stats_t ;
+
 typedef struct xnet_thread_group {
-    int queue_head;
+    /* Tasks queued across every class. XNET_THREAD_MAX_TASKS caps the total, not each class. */
     int queue_size;
     pthread_t threads[XNET_THREAD_COUNT];
     pthread_mutex_t main_lock;
     pthread_cond_t main_condition;
-    xnet_task_t *task_queue[XNET_THREAD_MAX_TASKS];
+    /* Classes are picked by smooth weighted round robin, then a flow within the class by deficit round robin. */
+    xnet_task_flow_t *flow_head[XNET_PRIORITY_CLASSES];
+    xnet_task_flow_t *flow_tail[XNET_PRIORITY_CLASSES];
+    /* Every queued task of a class in arrival order, for aging and shedding. */
+    xnet_task_t *oldest[XNET_PRIORITY_CLASSES];
+    xnet_task_t *newest[XNET_PRIORITY_CLASSES];
+    int class_size[XNET_PRIORITY_CLASSES];
+    int class_credit[XNET_PRIORITY_CLASSES];
+    /* Tasks with no connection, like fanout jobs, share one flow per class. */
+    xnet_task_flow_t shared_flow[XNET_PRIORITY_CLASSES];
+    /* Counted through __atomic builtins. Read them with xnet_get_sched_stats(). */
+    xnet_sched_stats_t sched[XNET_PRIORITY_CLASSES];
     bool shutdown;
+    /* Non-zero while requests wait for a task slot. Workers wake the reactor through room_fd when they free one. */
+    size_t paused_count;
+    /* Counted through __atomic builtins. Read them with xnet_get_overload_stats(). */
+    xnet_overload_stats_t overload;
+    /* What each worker is serving, under main_lock. Workers take their index from worker_count as they start. */
+    xnet_running_task_t running[XNET_THREAD_COUNT];
+    size_t worker_count;
+    /* Tasks dropped because their client left while they waited. Counted through __atomic builtins. */
+    uint64_t stale;
 } xnet_thread_group_t ;
 
 typedef struct xnet_connection_group {
     size_t connection_count;
+    /* One entry per slot in each. See xnet_init_connections(). */
     xnet_active_connection_t *clients;
+    xnet_conn_hot_t *hot;
+    xnet_conn_cold_t *cold;
+    xnet_rate_bucket_t *rate_buckets;
+    xnet_rx_pool_t rx_pool;
 } xnet_connection_group_t ;
 
+typedef struct xnet_session_token {
+    unsigned char token[XNET_TOKEN_LEN];
+    unsigned char state;
+    unsigned char resume_data_len;
+    /* 0 while the owning connection is alive. Otherwise, the monotonic second the token stops being redeemable. */
+    time_t expires;
+    struct xnet_user *account;
+    char resume_data[XNET_TOKEN_RESUME_DATA_LEN];
+} xnet_session_token_t ;
+
+typedef struct xnet_token_table {
+    pthread_mutex_t lock;
+    size_t capacity;
+    /* Number of live tokens. */
+    size_t count;
+    /* Number of live tokens plus tombstones. Drives rebuilds. */
+    size_t used;
+    size_t ttl;
+    xnet_session_token_t *entries;
+} xnet_token_table_t ;
+
 typedef struct xnet_userbase_group {
     size_t count;
     xnet_user_t *head;
+    xnet_token_table_t tokens;
 } xnet_userbase_group_t ;
 
 /**
@@ -0,0 +1,210 @@
+/**
+ * @file        xnet_buffer.h
+ * @author      Kameryn Gaige Knight
+ * @brief       Reference counted output buffers and the per-connection output queues
+ *              that the reactor flushes on behalf of workers.
+ * @version     1.0
+ * @date        2026-10-19
+ *
+ * @copyright   Copyright (c) 2022 Kameryn Gaige Knight
+ * License      MIT
+ */
+#ifndef XNET_BUFFER_H
+#define XNET_BUFFER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+
+#include "xnet_base.h"
+#include "xnet_utils.h"
+#include "xnet_threads.h"
+#include "xnet_compress.h"
+
+#define XNET_LAGGED_OP             0xFFFC  // Tells a slow client broadcasts were dropped. Never a real opcode.
+#define XNET_LAGGED_SZ             6       // [u16 XNET_LAGGED_OP][u32 broadcasts dropped]
+#define XNET_SLOW_SWEEP_MIN_MS     100     // Shortest period between looks for stalled output.
+
+/**
+ * @brief Allocates a shared buffer of @param length bytes with a reference count of 1.
+ *        Fill buf->data before handing the buffer out. It must not change afterwards.
+ *
+ * @return xnet_shared_buf_t* NULL on failure.
+ */
+xnet_shared_buf_t *xnet_buf_alloc(size_t length);
+
+/**
+ * @brief Adds a reference to @param buf.
+ */
+void xnet_buf_ref(xnet_shared_buf_t *buf);
+
+/**
+ * @brief Drops a reference to @param buf. The last reference frees it.
+ */
+void xnet_buf_release(xnet_shared_buf_t *buf);
+
+/**
+ * @brief Sets up the output machinery of a server: the mailbox, its eventfd, and every connection's io lock.
+ *        Connections must already be allocated.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_init_outbound(xnet_box_t *xnet);
+
+/**
+ * @brief Releases everything xnet_init_outbound() set up, along with any output still queued.
+ */
+void xnet_destroy_outbound(xnet_box_t *xnet);
+
+/**
+ * @brief Sends @param length bytes to @param conn, preserving order with anything already queued.
+ *        The data is copied and left for the reactor to write. With xnet_set_write_through() on and nothing
+ *        queued, it goes straight to the socket and only what doesn't fit is copied.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_send(xnet_box_t *xnet, xnet_active_connection_t *conn, const void *data, size_t length);
+
+/**
+ * @brief Sends @param header to @param conn, followed by @param length bytes of the file @param fd starting at
+ *        @param offset. Nothing sent to @param conn can land between the two. The reactor sends the file with
+ *        sendfile() as the socket makes room, so its data never passes through user space and the caller doesn't
+ *        wait for it. Files bypass compression. @param fd belongs to the queue from here on, it is closed once sent,
+ *        dropped, or when this fails.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_send_file(xnet_box_t *xnet, xnet_active_connection_t *conn, const void *header, size_t header_length,
+                   int fd, size_t offset, size_t length);
+
+/**
+ * @brief Sends @param ack to @param conn and switches it to @param wire_format in one step.
+ *        Everything queued before the ack keeps the old format, everything after it uses the new one.
+ *
+ * @param wire_format One of the XNET_WIRE_* formats.
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_switch_wire_format(xnet_box_t *xnet, xnet_active_connection_t *conn, int wire_format,
+                            const void *ack, size_t length);
+
+/**
+ * @brief Sends @param ack to @param conn and switches it to @param codec in one step.
+ *        The ack is coded the old way, everything after it starts a new stream in @param codec.
+ *
+ * @param codec One of the XNET_CODEC_* codecs this build supports.
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_switch_codec(xnet_box_t *xnet, xnet_active_connection_t *conn, int codec, const void *ack, size_t length);
+
+/**
+ * @brief Queues a reference to one of @param bufs on every connection in @param targets except @param skip,
+ *        then wakes the reactor once to write them out. No socket is touched by the caller.
+ *        The caller keeps its own references to @param bufs.
+ *
+ * @param targets Handles of the clients to send to. Those that left since are passed over, even if their slot
+ *                holds another client now.
+ * @param bufs The same message in every wire format. A connection gets bufs[conn->wire_format].
+ *             Entries may point at the same buffer. Compressed connections get their own coded copy instead.
+ * @param skip Client to leave out, usually the sender. May be XNET_NO_HANDLE.
+ * @return size_t Number of connections the buffer was queued on.
+ */
+size_t xnet_broadcast(xnet_box_t *xnet, const xnet_conn_handle_t *targets, size_t count,
+                      xnet_shared_buf_t *const bufs[XNET_WIRE_FORMATS], xnet_conn_handle_t skip);
+
+/**
+ * @brief xnet_broadcast() for rooms of at least xnet->general->fanout_threshold connections.
+ *        The member list is split into chunks that the calling worker and idle pool workers deliver in
+ *        parallel, queueing like xnet_broadcast() does, or writing straight to sockets with nothing queued when
+ *        xnet_set_write_through() is on. Returns once every chunk is done, so
+ *        per-connection order is the same as with xnet_broadcast(). Smaller rooms go to xnet_broadcast().
+ *        @param bufs works the same as in xnet_broadcast().
+ *        Must not be called from the reactor.
+ *
+ * @return size_t Number of connections the buffer was written or queued to.
+ */
+size_t xnet_broadcast_parallel(xnet_box_t *xnet, const xnet_conn_handle_t *targets, size_t count,
+                               xnet_shared_buf_t *const bufs[XNET_WIRE_FORMATS], xnet_conn_handle_t skip);
+
+/**
+ * @brief Leaves @param mail, a set of XNET_MAIL_* bits, for the reactor to act on for @param conn, and wakes it.
+ *        Mail left before the reactor gets to it is merged, so it is handled once. Never blocks. Safe from any thread.
+ */
+void xnet_post_mail(xnet_box_t *xnet, xnet_active_connection_t *conn, uint32_t mail);
+
+/**
+ * @brief Reactor side. Acts on the mail of every connection in the mailbox: writes queued output, takes back read
+ *        sides workers are done with, hangs up on evicted clients. Registers each connection with epoll once for all
+ *        of it.
+ */
+void xnet_read_mailbox(xnet_box_t *xnet);
+
+/**
+ * @brief Reactor side. Writes as much of @param conn's output queue as the socket accepts, and at most
+ *        XNET_FILE_BUDGET_SZ bytes of queued files. Caller must hold conn->io_lock.
+ */
+void xnet_flush_connection(xnet_active_connection_t *conn);
+
+/**
+ * @brief Drops everything queued on @param conn. Caller must hold conn->io_lock.
+ */
+void xnet_drop_output(xnet_active_connection_t *conn);
+
+/**
+ * @brief Reactor side. Re-registers @param conn with epoll for whatever it currently needs:
+ *        EPOLLIN unless a worker is busy with it or a rate limit holds a request back, EPOLLOUT while output is queued.
+ *        Caller must hold conn->io_lock.
+ *
+ * @return int 0 on success, -1 on failure.
+ */
+int xnet_arm_connection(xnet_box_t *xnet, xnet_active_connection_t *conn);
+
+/**
+ * @brief Lets workers write to a socket with nothing queued on it themselves, queueing only what it doesn't take.
+ *        Off by default, every write is left to the reactor. Saves a reactor wakeup per reply, at the cost of
+ *        workers making syscalls on sockets the reactor owns. Call before xnet_start().
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_set_write_through(xnet_box_t *xnet, bool write_through);
+
+/**
+ * @brief Sets what happens to connections that don't keep up with their output. Once more than @param max_bytes
+ *        of buffers are queued on one, @param policy applies. Output that makes no progress for @param timeout_ms
+ *        gets its connection dropped whatever the policy. Either limit is off at 0. Call before xnet_start().
+ *        Compressed connections are always dropped, their stream can't lose a block.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_set_slow_consumer_policy(xnet_box_t *xnet, enum xnet_slow_policy policy, size_t max_bytes, size_t timeout_ms);
+
+/**
+ * @brief Copies the slow consumer counters into @param stats. Safe from any thread while the server runs.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_get_slow_stats(xnet_box_t *xnet, xnet_slow_stats_t *stats);
+
+/**
+ * @brief Sets up the timer that looks for stalled output, unless there is no slow consumer timeout.
+ *        Needs the epoll instance.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_init_slow_sweep(xnet_box_t *xnet);
+
+/**
+ * @brief Reactor side. Drops every connection whose output made no progress for the slow consumer timeout.
+ */
+void xnet_sweep_slow(xnet_box_t *xnet);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KAMERYN GAIGE KNIGHT
@@ -0,0 +1,87 @@
+/**
+ * @file        xnet_checksum.h
+ * @author      Kameryn Gaige Knight
+ * @brief       Checksums for data that crosses the wire, so both ends can tell which parts of a transfer arrived intact.
+ *              Each has a portable kernel and a vector one, picked at runtime by what the CPU supports.
+ * @version     1.0
+ * @date        2026-10-19
+ *
+ * @copyright   Copyright (c) 2022 Kameryn Gaige Knight
+ * License      MIT
+ */
+#ifndef XNET_CHECKSUM_H
+#define XNET_CHECKSUM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Vector kernels. The portable ones are always there. */
+#define XNET_CHECKSUM_SSE42     (1u << 0) // CRC-32C with the crc32 instruction.
+#define XNET_CHECKSUM_AVX2      (1u << 1) // XXH3 stripes, 256 bits at a time.
+
+#define XNET_XXH3_STRIPE_SZ     64
+#define XNET_XXH3_BUFFER_SZ     256       // Input held back by a running XXH3 until more of it arrives.
+
+/* A running XXH3, for data that arrives in pieces. */
+typedef struct xnet_xxh3_state {
+    uint64_t acc[8];
+    unsigned char buffer[XNET_XXH3_BUFFER_SZ];
+    size_t buffered;
+    /* Stripes accumulated into the current block. The accumulators are scrambled once a block fills. */
+    size_t block_stripes;
+    uint64_t total_length;
+} xnet_xxh3_state_t ;
+
+/**
+ * @brief Vector kernels this CPU can run.
+ *
+ * @return unsigned int XNET_CHECKSUM_* bits.
+ */
+unsigned int xnet_checksum_supported(void);
+
+/**
+ * @brief Restricts the checksums to the vector kernels in @param kernels, out of those supported. Every kernel is
+ *        used by default. Results never depend on the kernel, only speed does. Not safe while checksums are running.
+ */
+void xnet_checksum_select(unsigned int kernels);
+
+/**
+ * @brief CRC-32C (Castagnoli) of @param length bytes of @param data, continuing from @param crc.
+ *        Start a new checksum with a @param crc of 0. Feeding data in pieces gives the same result as all at once.
+ *
+ * @return uint32_t The checksum so far.
+ */
+uint32_t xnet_crc32c(uint32_t crc, const void *data, size_t length);
+
+/**
+ * @brief 64-bit XXH3 of @param length bytes of @param data, unseeded, with the default secret.
+ *        Matches XXH3_64bits() of the reference implementation. Not cryptographic.
+ */
+uint64_t xnet_xxh3(const void *data, size_t length);
+
+/**
+ * @brief Starts a running XXH3 in @param state.
+ */
+void xnet_xxh3_reset(xnet_xxh3_state_t *state);
+
+/**
+ * @brief Feeds @param length bytes of @param data to @param state.
+ */
+void xnet_xxh3_update(xnet_xxh3_state_t *state, const void *data, size_t length);
+
+/**
+ * @brief XXH3 of everything fed to @param state so far. More may be fed afterwards.
+ */
+uint64_t xnet_xxh3_digest(const xnet_xxh3_state_t *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KAMERYN GAIGE KNIGHT
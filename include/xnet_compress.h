@@ -0,0 +1,130 @@
+/**
+ * @file        xnet_compress.h
+ * @author      Kameryn Gaige Knight
+ * @brief       Per-connection stream compression of outbound data. Every block is coded against what the
+ *              connection was sent before it, so repetitive traffic shrinks the longer a connection lives.
+ * @version     1.0
+ * @date        2026-10-19
+ *
+ * @copyright   Copyright (c) 2022 Kameryn Gaige Knight
+ * License      MIT
+ */
+#ifndef XNET_COMPRESS_H
+#define XNET_COMPRESS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "xnet_base.h"
+
+#ifdef XNET_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#define XNET_CODEC_NONE            0
+#define XNET_CODEC_LZ              1      // Bundled byte-oriented LZ77, in the spirit of LZ4. Cheap on CPU.
+#define XNET_CODEC_ZLIB            2      // Raw deflate. Smaller output for more CPU. Only with XNET_WITH_ZLIB.
+#define XNET_CODECS                3
+
+#define XNET_COMPRESSED_OP         0xFFFF // Opcode of a compressed block. Never a real opcode, framed or not.
+#define XNET_COMPRESSED_HEADER_SZ  10     // [u16 XNET_COMPRESSED_OP][u32 coded length][u32 raw length]
+#define XNET_COMPRESS_MIN_SZ       32     // Sends shorter than this go out as they are, outside the stream.
+
+#define XNET_LZ_WINDOW_SZ          16384  // How far back a match may reach. A power of two, at most 16384.
+#define XNET_LZ_HASH_BITS          12
+#define XNET_LZ_MIN_MATCH          4
+
+#define XNET_ZLIB_LEVEL            3
+#define XNET_ZLIB_WINDOW_BITS      12     // 4 KiB window, about 24 KiB of deflate state per connection.
+#define XNET_ZLIB_MEM_LEVEL        4
+
+/*
+LZ block layout, a run of sequences:
+    [token][literal length bytes][literals][u16 offset][match length bytes]
+The token's high nibble is the literal length, its low nibble the match length minus XNET_LZ_MIN_MATCH.
+A nibble of 15 continues in the bytes that follow, each adding up to 255, until one is below 255.
+Offsets are big-endian and count back from the current output position, possibly into earlier blocks.
+The last sequence of a block may stop after its literals. An offset of 0 carries no match, it only
+breaks up a literal run too long to keep in the window.
+*/
+
+typedef struct xnet_compress_ctx {
+    int codec;
+    /* LZ: the last XNET_LZ_WINDOW_SZ bytes sent, followed by the block being coded. */
+    unsigned char *window;
+    size_t window_fill;
+    /* LZ: window position + 1 of the last 4 bytes hashing to each slot. 0 is empty. */
+    uint16_t *table;
+    /* Set once a failure left the stream unusable. Nothing more can be coded. */
+    bool is_broken;
+#ifdef XNET_WITH_ZLIB
+    z_stream zlib;
+#endif
+} xnet_compress_ctx_t ;
+
+typedef struct xnet_decompress_ctx {
+    int codec;
+    /* LZ: ring of the last XNET_LZ_WINDOW_SZ bytes decoded. */
+    unsigned char *history;
+    unsigned long long total_out;
+#ifdef XNET_WITH_ZLIB
+    z_stream zlib;
+#endif
+} xnet_decompress_ctx_t ;
+
+/**
+ * @brief Codecs this build can offer.
+ *
+ * @return unsigned int Bit n is set when codec n is available. XNET_CODEC_NONE always is.
+ */
+unsigned int xnet_supported_codecs(void);
+
+/**
+ * @brief Starts a compression stream coded with @param codec.
+ *
+ * @return xnet_compress_ctx_t* NULL on failure, or for XNET_CODEC_NONE.
+ */
+xnet_compress_ctx_t *xnet_compress_create(int codec);
+
+/**
+ * @brief Ends a compression stream. NULL is ignored.
+ */
+void xnet_compress_destroy(xnet_compress_ctx_t *ctx);
+
+/**
+ * @brief Codes @param length bytes of @param data as the next block of @param ctx's stream.
+ *
+ * @return xnet_shared_buf_t* The block, header included, with a reference count of 1. NULL on failure.
+ */
+xnet_shared_buf_t *xnet_compress_block(xnet_compress_ctx_t *ctx, const void *data, size_t length);
+
+/**
+ * @brief Starts the receiving end of a stream coded with @param codec.
+ *
+ * @return xnet_decompress_ctx_t* NULL on failure, or for XNET_CODEC_NONE.
+ */
+xnet_decompress_ctx_t *xnet_decompress_create(int codec);
+
+/**
+ * @brief Ends a decompression stream. NULL is ignored.
+ */
+void xnet_decompress_destroy(xnet_decompress_ctx_t *ctx);
+
+/**
+ * @brief Decodes the block @param block, header included, into @param out. Blocks must arrive in the order they were coded.
+ *
+ * @param capacity Size of @param out. The header's raw length says how much is needed.
+ * @return ssize_t Bytes written to @param out. -1 when the block is malformed or doesn't fit.
+ */
+ssize_t xnet_decompress_block(xnet_decompress_ctx_t *ctx, const void *block, size_t length, void *out, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KAMERYN GAIGE KNIGHT
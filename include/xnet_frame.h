@@ -0,0 +1,105 @@
+/**
+ * @file        xnet_frame.h
+ * @author      Kameryn Gaige Knight
+ * @brief       Inbound request framing. A framed request carries its payload length next to the opcode,
+ *              so the reactor can check it, read it whole and skip exactly what it rejects.
+ * @version     1.0
+ * @date        2026-10-19
+ *
+ * @copyright   Copyright (c) 2022 Kameryn Gaige Knight
+ * License      MIT
+ */
+#ifndef XNET_FRAME_H
+#define XNET_FRAME_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+
+#include "xnet_base.h"
+#include "xnet_utils.h"
+
+enum xnet_frame_status {
+    XNET_FRAME_PENDING, // Nothing to dispatch yet. The connection may have been closed on EOF.
+    XNET_FRAME_READY,   // A whole framed request sits in rx_payload. Release it with xnet_release_frame().
+    XNET_FRAME_LEGACY   // An unframed request. Its handler reads the payload straight from the socket.
+};
+
+/**
+ * @brief Reads as much of @param conn's next request as the socket has without blocking.
+ *        Frames that are too large or name an unsupported opcode are skipped exactly, leaving
+ *        whatever the client pipelined after them intact. Only the reactor calls this.
+ *
+ * @param opcode Set to the request's opcode, without XNET_FRAME_FLAG, unless XNET_FRAME_PENDING is returned.
+ * @return enum xnet_frame_status
+ */
+enum xnet_frame_status xnet_read_frame(xnet_box_t *xnet, xnet_active_connection_t *conn, short *opcode);
+
+/**
+ * @brief Has the reactor move the next @param length bytes @param conn sends into @param fd at @param offset
+ *        with splice(), through a pipe, so they never pass through user space. Writes are positioned like pwrite(),
+ *        so several connections can fill different ranges of one file at once. The reactor does it as data arrives, ahead
+ *        of any further request, and runs @param on_done once the sink closes. No worker waits for it.
+ *        A sink that fails on @param fd skips the rest of the data. Only the handler serving @param conn calls this.
+ *        @param fd belongs to the sink from here on, it is closed before @param on_done runs, and when this fails.
+ *
+ * @param length At least 1. The reactor only looks at the sink when data arrives.
+ * @param on_done Gets 0 once every byte reached @param fd. E_SRV_FAIL_FILE_IO when writing failed.
+ *                E_SRV_BAD_SOCKET when the connection is closing, in which case nothing may be sent to it.
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_receive_file(xnet_box_t *xnet, xnet_active_connection_t *conn, int fd, size_t offset, size_t length,
+                      void (*on_done)(xnet_box_t *xnet, xnet_active_connection_t *conn, int status, void *arg),
+                      void *arg);
+
+/**
+ * @brief Closes @param conn's file sink, if it has one, and runs its on_done with @param status.
+ */
+void xnet_close_file_sink(xnet_box_t *xnet, xnet_active_connection_t *conn, int status);
+
+/**
+ * @brief Reads up to @param length bytes of the request @param conn is being served for.
+ *        Handlers use this instead of read() so they work the same for framed and legacy requests.
+ *
+ * @return ssize_t Bytes read. 0 once a framed payload is used up. -1 on failure, see read().
+ */
+ssize_t xnet_conn_read(xnet_active_connection_t *conn, void *buf, size_t length);
+
+/**
+ * @brief Hands out the unread part of the framed request @param conn is being served for, without copying it.
+ *        The bytes stay valid until the handler returns. Whatever is handed out counts as read.
+ *
+ * @param length Set to the number of bytes handed out.
+ * @return const char* NULL when the request isn't framed.
+ */
+const char *xnet_conn_payload(xnet_active_connection_t *conn, size_t *length);
+
+/**
+ * @brief Drops the framed request @param conn was served for. Whatever the handler didn't read goes with it,
+ *        and its buffer goes back to the rx pool. Also drops a frame the reactor was still assembling.
+ */
+void xnet_release_frame(xnet_box_t *xnet, xnet_active_connection_t *conn);
+
+/**
+ * @brief Copies the rx pool counters into @param stats. Safe from any thread while the server runs.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_get_rx_pool_stats(xnet_box_t *xnet, xnet_rx_pool_stats_t *stats);
+
+/**
+ * @brief Takes back the buffers connections still hold and frees every buffer in the rx pool.
+ *        Only once the reactor and workers are gone, see xnet_destroy().
+ */
+void xnet_destroy_rx_pool(xnet_box_t *xnet);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KAMERYN GAIGE KNIGHT
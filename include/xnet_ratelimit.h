@@ -0,0 +1,118 @@
+/**
+ * @file        xnet_ratelimit.h
+ * @author      Kameryn Gaige Knight
+ * @brief       Token bucket rate limits on inbound requests, per connection and per opcode. The reactor checks them
+ *              before a request becomes a task, so a client flooding the server costs a bucket check, not a worker.
+ * @version     1.0
+ * @date        2026-10-19
+ *
+ * @copyright   Copyright (c) 2022 Kameryn Gaige Knight
+ * License      MIT
+ */
+#ifndef XNET_RATELIMIT_H
+#define XNET_RATELIMIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "xnet_base.h"
+#include "xnet_utils.h"
+#include "xnet_frame.h"
+
+#define XNET_THROTTLE_OP           0xFFFE  // Reply to a request a rate limit turned away. Never a real opcode.
+#define XNET_THROTTLE_SZ           8       // [u16 XNET_THROTTLE_OP][u16 opcode][u32 ms until it would fit]
+#define XNET_RATE_TOKEN            1000000 // One request's worth of a bucket.
+
+enum xnet_rate_policy {
+    XNET_RATE_REJECT = 1, // Drop the request and send a throttle packet saying when to try again.
+    XNET_RATE_DELAY = 2   // Hold the request, and stop reading the connection, until the budget allows it.
+};
+
+/**
+ * @brief Limits each connection to @param rate requests per second of @param opcode, with room for bursts of
+ *        @param burst. A request has to fit both the limit of its opcode and the one of XNET_RATE_ANY_OP.
+ *        Setting a limit again replaces it. Call before xnet_start().
+ *
+ * @param opcode An opcode, or XNET_RATE_ANY_OP to count every request together.
+ * @param rate 0 lifts the limit.
+ * @param burst At least 1 unless the limit is lifted.
+ * @param policy What becomes of requests over the limit.
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_set_rate_limit(xnet_box_t *xnet, size_t opcode, uint32_t rate, uint32_t burst, enum xnet_rate_policy policy);
+
+/**
+ * @brief Copies the counters of the limit on @param opcode, or of XNET_RATE_ANY_OP, into @param stats.
+ *        Safe from any thread while the server runs.
+ *
+ * @return int 0 on success, non-zero when @param opcode has no limit.
+ */
+int xnet_get_rate_stats(xnet_box_t *xnet, size_t opcode, xnet_rate_stats_t *stats);
+
+/**
+ * @brief Sets up the timer that wakes the reactor for requests held back by a limit. Needs the epoll instance.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_init_rate_limits(xnet_box_t *xnet);
+
+/**
+ * @brief Releases what xnet_init_rate_limits() set up.
+ */
+void xnet_destroy_rate_limits(xnet_box_t *xnet);
+
+/**
+ * @brief Reactor side. Charges @param opcode's request to @param conn's buckets. A request over a limit is dealt
+ *        with here, according to the limit's policy. Rejected ones are dropped along with their payload.
+ *
+ * @param status What xnet_read_frame() said about the request.
+ * @return bool true when the request may be dispatched.
+ */
+bool xnet_rate_admit(xnet_box_t *xnet, xnet_active_connection_t *conn, short opcode, enum xnet_frame_status status);
+
+/**
+ * @brief Reactor side. Hands back the request @param conn had held back, once its time has come.
+ *
+ * @param opcode Set to the held request's opcode.
+ * @param is_admitted Set when the request already got past its limits and only waited on a worker.
+ * @return enum xnet_frame_status XNET_FRAME_PENDING while it has to wait longer.
+ */
+enum xnet_frame_status xnet_rate_take_held(xnet_box_t *xnet, xnet_active_connection_t *conn, short *opcode,
+                                           bool *is_admitted);
+
+/**
+ * @brief Reactor side. Forgets the request @param conn held back, if any. Called as the connection closes.
+ */
+void xnet_drop_held(xnet_box_t *xnet, xnet_active_connection_t *conn);
+
+/**
+ * @brief Reactor side. Dispatches the held requests whose time has come, once the rate timer fires.
+ *        Only those are looked at, however many connections there are.
+ */
+void xnet_rate_resume(xnet_box_t *xnet);
+
+/**
+ * @brief Reactor side. Holds @param conn's request back until a task slot frees up. Held requests line up in the
+ *        order they came in.
+ *
+ * @param status What xnet_read_frame() said about the request.
+ */
+void xnet_pause_request(xnet_box_t *xnet, xnet_active_connection_t *conn, short opcode, enum xnet_frame_status status);
+
+/**
+ * @brief Reactor side. Dispatches up to @param count requests waiting for a task slot, first paused first.
+ *
+ * @return bool true when requests are still waiting.
+ */
+bool xnet_resume_paused(xnet_box_t *xnet, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KAMERYN GAIGE KNIGHT
@@ -22,15 +22,146 @@ extern "C" {
 
 #include "xnet_base.h"
 #include "xnet_utils.h"
+#include "xnet_frame.h"
+
+#define XNET_BUSY_OP    0xFFFD // Reply to a request the task queue had no room for. Never a real opcode.
+#define XNET_BUSY_SZ    4      // [u16 XNET_BUSY_OP][u16 opcode]
 
 void xnet_create_pool(xnet_box_t *xnet);
 
 void *xnet_thread_worker(void *arg);
 
-void xnet_work_push(xnet_box_t *xnet, xnet_task_t *task);
+/**
+ * @brief Queues @param task, giving up instead of waiting when the queue is full.
+ * 
+ * @return bool true if the task was queued.
+ */
+bool xnet_work_try_push(xnet_box_t *xnet, xnet_task_t *task);
+
+/**
+ * @brief Queues @param job_function to run on the pool with @param arg. Never blocks.
+ * 
+ * @return int 0 if the job was queued. Non-zero if the queue is full or memory ran out.
+ */
+int xnet_submit_job(xnet_box_t *xnet, int (*job_function)(xnet_box_t *xnet, void *arg), void *arg);
+
+/**
+ * @brief Free slots in the task queue right now.
+ */
+size_t xnet_work_room(xnet_box_t *xnet);
+
+/**
+ * @brief Reactor side. Queues the request @param conn sent for @param opcode without ever waiting for room.
+ *        When the queue is full, xnet->general->overload_policy decides what becomes of it.
+ *
+ * @param status What xnet_read_frame() said about the request.
+ */
+void xnet_submit_request(xnet_box_t *xnet, xnet_active_connection_t *conn, short opcode, enum xnet_frame_status status);
+
+/**
+ * @brief Sets what the reactor does with requests once the task queue is full. XNET_OVERLOAD_PAUSE by default.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_set_overload_policy(xnet_box_t *xnet, enum xnet_overload_policy policy);
+
+/**
+ * @brief Moves @param opcode to another class than the one xnet_insert_feature() gave it. Call before xnet_start().
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_set_priority(xnet_box_t *xnet, size_t opcode, enum xnet_priority priority);
+
+/**
+ * @brief Asks handlers for @param opcode to be done within @param deadline_ms. Past it they are cancelled, see
+ *        xnet_is_cancelled(). At twice it their client is hung up on. 0 lets them run for as long as they like.
+ *        XNET_DEADLINE_MS_DEFAULT until set. Call before xnet_start().
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_set_deadline(xnet_box_t *xnet, size_t opcode, uint32_t deadline_ms);
+
+/**
+ * @brief Copies how long handlers for @param opcode ran, against their deadline, into @param stats. Safe from any
+ *        thread while the server runs.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_get_deadline_stats(xnet_box_t *xnet, size_t opcode, xnet_deadline_stats_t *stats);
+
+/**
+ * @brief Handler side. True once the request being served for @param conn should be given up on: it overran its
+ *        deadline, its session expired, or the server is shutting down. Long handlers check it between steps and
+ *        return early. Nothing is stopped for them.
+ */
+bool xnet_is_cancelled(const xnet_active_connection_t *conn);
+
+/**
+ * @brief Asks the handler serving @param conn, if any, to give up. Safe from any thread.
+ */
+void xnet_cancel_request(xnet_active_connection_t *conn);
+
+/**
+ * @brief Sets up the timer the reactor checks running handlers against their deadline on. Needs the epoll instance.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_init_watchdog(xnet_box_t *xnet);
+
+/**
+ * @brief Releases what xnet_init_watchdog() set up.
+ */
+void xnet_destroy_watchdog(xnet_box_t *xnet);
+
+/**
+ * @brief Reactor side. Cancels handlers past their deadline, and hangs up on the clients of those still running at
+ *        twice it.
+ */
+void xnet_watchdog_sweep(xnet_box_t *xnet);
+
+/**
+ * @brief Tasks dropped unrun because their client left while they waited. Safe from any thread while the server
+ *        runs.
+ */
+uint64_t xnet_get_stale_tasks(xnet_box_t *xnet);
+
+/**
+ * @brief Copies the overload counters into @param stats. Safe from any thread while the server runs.
+ */
+void xnet_get_overload_stats(xnet_box_t *xnet, xnet_overload_stats_t *stats);
+
+/**
+ * @brief Copies how long tasks of class @param priority waited in the queue into @param stats. Safe from any thread
+ *        while the server runs.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_get_sched_stats(xnet_box_t *xnet, enum xnet_priority priority, xnet_sched_stats_t *stats);
+
+/**
+ * @brief Sets up the eventfd workers wake the reactor through once a slot frees up. Needs the epoll instance.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_init_overload(xnet_box_t *xnet);
+
+/**
+ * @brief Releases what xnet_init_overload() set up.
+ */
+void xnet_destroy_overload(xnet_box_t *xnet);
+
+/**
+ * @brief Reactor side. Gives requests held for a task slot another try once a worker freed one.
+ */
+void xnet_overload_resume(xnet_box_t *xnet);
 
 xnet_task_t *xnet_work_pop(xnet_box_t *xnet);
 
+/**
+ * @brief Clears the worker time @param conn owes the fair queue, so the next client in its slot starts even.
+ */
+void xnet_reset_flows(xnet_box_t *xnet, xnet_active_connection_t *conn);
+
 void xnet_destroy_pool(xnet_box_t *xnet);
 
 #ifdef __cplusplus
@@ -16,19 +16,29 @@ extern "C" {
 #endif
 
 #include "limits.h"
+#include <pthread.h>
 #include "xnet_base.h"
 #include "xnet_utils.h"
 
-#define XNET_MAX_USERNAME_LEN 32
-#define XNET_MAX_PASSWD_LEN 32
-
 int xnet_create_user(xnet_userbase_group_t *base, char *user, char *pass, int new_perm);
 
 int xnet_delete_user(xnet_userbase_group_t *base, char *user);
 
 int xnet_login_user(xnet_userbase_group_t *base, char *user, char *pass, xnet_active_connection_t *conn);
 
-int xnet_logout_user(xnet_active_connection_t *conn);
+/**
+ * @brief Logs @param conn's user out for good. Their session token is revoked, so it can't resume the session.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_logout_user(xnet_userbase_group_t *base, xnet_active_connection_t *conn);
+
+/**
+ * @brief Logs @param conn's user out when their connection drops, parking their token so they can resume.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_suspend_user(xnet_userbase_group_t *base, xnet_active_connection_t *conn);
 
 xnet_user_t *xnet_user_exists(xnet_userbase_group_t *base, char *user);
 
@@ -38,6 +48,55 @@ xnet_active_connection_t *xnet_get_conn_by_user(xnet_box_t *xnet, char *user);
 
 void xnet_print_userbase(xnet_userbase_group_t *base);
 
+/**
+ * @brief Prepares the resumable session token table of a userbase.
+ * 
+ * @param base Userbase that will own the table.
+ * @param capacity Initial slot count. Rounded up to a power of two.
+ * @param ttl Seconds a token stays redeemable once its connection is gone.
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_init_tokens(xnet_userbase_group_t *base, size_t capacity, size_t ttl);
+
+/**
+ * @brief Issues a fresh random session token for @param user, revoking any previous one.
+ *        The token is stored in user->token.
+ * 
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_issue_token(xnet_userbase_group_t *base, xnet_user_t *user);
+
+/**
+ * @brief Removes any token that belongs to @param user.
+ */
+void xnet_revoke_token(xnet_userbase_group_t *base, xnet_user_t *user);
+
+/**
+ * @brief Starts the expiry countdown of @param user's token. Called when their connection drops.
+ * 
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_park_token(xnet_userbase_group_t *base, xnet_user_t *user);
+
+/**
+ * @brief Attaches addon data to @param user's token so it can be handed back on resume.
+ * 
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_set_token_resume_data(xnet_userbase_group_t *base, xnet_user_t *user, const char *data, size_t length);
+
+/**
+ * @brief Logs the owner of @param token into @param conn without checking their password.
+ *        On success the token is rotated, the new token is in conn->account->token, and any resume data
+ *        attached to the old token is copied into @param resume_data.
+ * 
+ * @param resume_data Buffer of at least XNET_TOKEN_RESUME_DATA_LEN bytes. May be NULL.
+ * @param resume_length Receives the number of bytes written to @param resume_data. May be NULL.
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_resume_user(xnet_userbase_group_t *base, const unsigned char *token, xnet_active_connection_t *conn,
+                     char *resume_data, size_t *resume_length);
+
 void xnet_destroy_userbase(xnet_userbase_group_t *base);
 
 #ifdef __cplusplus
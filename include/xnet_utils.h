@@ -23,6 +23,8 @@ extern "C" {
 #include "xnet_base.h"
 #include "xnet_userbase.h"
 
+#define XNET_EVENT_SESSION 0x80000000u // Marks a session timer in the slot half of a connection's epoll data.
+
 /**
  * @brief Set @param sockfd to non-blocking.
  * 
@@ -38,12 +40,60 @@ int set_non_blocking(int sockfd);
  */
 void nfree(void **ptr);
 
+/**
+ * @brief Fills @param buf with @param len bytes from the kernel's CSPRNG.
+ * 
+ * @param buf Destination buffer.
+ * @param len Number of random bytes wanted.
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_random_bytes(void *buf, size_t len);
+
+/**
+ * @brief Allocates xnet->general->max_connections slots: the connections, the hot array the reactor dispatches from,
+ *        the cold state and a rate bucket per rule in use. Rate rules must be final. Freed by xnet_destroy().
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+int xnet_init_connections(xnet_box_t *xnet);
+
 xnet_active_connection_t *xnet_get_conn_by_session(xnet_box_t *xnet, int timer_fd);
 
 xnet_active_connection_t *xnet_get_conn_by_socket(xnet_box_t *xnet, int socket);
 
 xnet_active_connection_t *xnet_create_connection(xnet_box_t *xnet, int socket);
 
+/**
+ * @brief Names the client in @param conn by its slot and generation. Unlike the pointer, it can be kept past the
+ *        client's connection and tells when the slot has gone to somebody else.
+ */
+xnet_conn_handle_t xnet_conn_handle(xnet_box_t *xnet, const xnet_active_connection_t *conn);
+
+/**
+ * @brief The connection of the client @param handle names. NULL once that client left, even if its slot went to
+ *        another one. Nothing keeps the client from leaving right after, see xnet_handle_is_live().
+ */
+xnet_active_connection_t *xnet_conn_from_handle(xnet_box_t *xnet, xnet_conn_handle_t handle);
+
+/**
+ * @brief True while @param conn still holds the client @param handle names. One atomic load. Holding conn->io_lock
+ *        keeps the answer from changing, since clients only leave under it.
+ */
+bool xnet_handle_is_live(const xnet_active_connection_t *conn, xnet_conn_handle_t handle);
+
+/**
+ * @brief What epoll hands back for @param conn's socket, or for its session timer with @param is_session set.
+ *        The client's handle, with XNET_EVENT_SESSION added for the timer. The generation keeps the high 32 bits
+ *        from ever being 0, which sets it apart from the server's own fds.
+ */
+uint64_t xnet_event_data(xnet_box_t *xnet, const xnet_active_connection_t *conn, bool is_session);
+
+/**
+ * @brief The connection an event with @param data from xnet_event_data() is for. Reads nothing but the slot's entry
+ *        in the hot array. NULL when the client left after the event was queued, even if its slot went to another one.
+ */
+xnet_active_connection_t *xnet_conn_from_event(xnet_box_t *xnet, uint64_t data);
+
 /**
  * @brief Closes a connection gracefully. Handles closing client socket along with their session.
  * 
@@ -55,23 +105,40 @@ int xnet_close_connection(xnet_box_t *xnet, xnet_active_connection_t *client);
 
 void xnet_debug_connections(xnet_box_t *xnet);
 
-/**
- * @brief Extracts the opcode from a inbound packet.
- * 
- * @return unsigned short 
- */
-short xnet_get_opcode(xnet_box_t *xnet, int client_fd);
-
 int epoll_ctl_add(int epoll_fd, struct epoll_event *an_event, int fd, uint32_t event_list);
 
 int epoll_ctl_mod(int epoll_fd, struct epoll_event *an_event, int fd, uint32_t event_list);
 
-int xnet_insert_feature(xnet_box_t *xnet, size_t opcode, int (*new_perform)(xnet_box_t *xnet, xnet_active_connection_t *client));
+/**
+ * @brief epoll_ctl_add() and epoll_ctl_mod() for a connection's fds, which carry @param data from xnet_event_data()
+ *        instead of the fd.
+ */
+int epoll_ctl_add_data(int epoll_fd, struct epoll_event *an_event, int fd, uint64_t data, uint32_t event_list);
+
+int epoll_ctl_mod_data(int epoll_fd, struct epoll_event *an_event, int fd, uint64_t data, uint32_t event_list);
+
+/**
+ * @brief Serves requests for @param opcode with @param new_perform. Workers take them from @param priority's class:
+ *        high for what a client waits on to get going, low for bulk work that can trail behind.
+ *
+ * @return int 0 on success, non-zero when @param opcode is out of range or taken.
+ */
+int xnet_insert_feature(xnet_box_t *xnet, size_t opcode, enum xnet_priority priority, int (*new_perform)(xnet_box_t *xnet, xnet_active_connection_t *client));
 
 int xnet_blacklist_feature(xnet_box_t *xnet, size_t opcode);
 
 int xnet_addon_callback(xnet_box_t *xnet, enum xnet_callbacks callback_event, int (*new_perform)(xnet_box_t *xnet, xnet_active_connection_t *client));
 
+/**
+ * @brief Reserves a slot in every connection's addon_data array for the calling addon.
+ *        The addon owns whatever it stores there and must release it in an ON_CLIENT_DISCONNECT callback.
+ *        XNet only resets the slot to NULL once the connection is closed.
+ * 
+ * @param xnet Pointer to an XNet server.
+ * @return int Slot index on success. -1 on failure.
+ */
+int xnet_reserve_addon_slot(xnet_box_t *xnet);
+
 void flush_buffer(int fd);
 
 #ifdef __cplusplus
@@ -3,7 +3,7 @@ import sys
 import socket
 import threading
 import array
-from packet_info import WhisperOP, LoginOP, JoinRoomOP, ShoutOP
+from packet_info import WhisperOP, LoginOP, JoinRoomOP, ShoutOP, ResumeOP, RoomOP, HistoryOP, ProtocolOP, CapsOP, frame_packet
 from client_utils import get_return_codes, unpack_server_response, fixed_print
 
 
@@ -25,6 +25,11 @@ class Client(cmd.Cmd):
         self.sock = None
         self.is_connected = False
         self.is_logged_in = False
+        self.token = None
+        self.last_seq = 0
+        self.wire_format = ProtocolOP.wire_formats["fixed"]
+        self.use_frames = False
+        self.decoder = None
         self.recv_thread = None
         self.codes = get_return_codes()
         self.use_rawinput = False
@@ -32,6 +37,18 @@ class Client(cmd.Cmd):
     def emptyline(self):
         pass
 
+    def send_packet(self, packet):
+        if self.use_frames:
+            packet = frame_packet(packet)
+        self.sock.sendall(packet)
+
+    def do_frames(self, args):
+        if args not in ("on", "off"):
+            print("Usage Message: frames <on|off>")
+            return
+        self.use_frames = "on" == args
+        fixed_print(f"Framed requests {args}")
+
     def do_connect(self, args):
         if self.is_connected:
             fixed_print("Already connected.")
@@ -79,7 +96,7 @@ class Client(cmd.Cmd):
             if send_obj is None:
                 fixed_print("Invalid input detected.")
                 return
-            self.sock.sendall(send_obj)
+            self.send_packet(send_obj)
         else:
             fixed_print('Not connected to any server')
 
@@ -89,7 +106,22 @@ class Client(cmd.Cmd):
             if send_obj is None:
                 fixed_print("Invalid input detected.")
                 return
-            self.sock.sendall(send_obj)
+            self.send_packet(send_obj)
+        else:
+            fixed_print("You must be connected to a server and logged in to perform this action.")
+
+    def do_room(self, args):
+        try:
+            action, room_name = args.split()
+        except ValueError:
+            print("Usage Message: room <create|delete> <room_name>")
+            return
+        if self.sock and self.is_logged_in and self.is_connected:
+            send_obj = RoomOP(action, room_name).construct()
+            if send_obj is None:
+                fixed_print("Invalid input detected.")
+                return
+            self.send_packet(send_obj)
         else:
             fixed_print("You must be connected to a server and logged in to perform this action.")
 
@@ -99,10 +131,53 @@ class Client(cmd.Cmd):
             if send_obj is None:
                 fixed_print("Invalid input detected.")
                 return
-            self.sock.sendall(send_obj)
+            self.send_packet(send_obj)
+        else:
+            fixed_print("You must be connected to a server and logged in to perform this action.")
+
+    def do_history(self, args):
+        try:
+            since_seq = int(args) if args else self.last_seq
+        except ValueError:
+            print("Usage Message: history [since_seq]")
+            return
+        if self.sock and self.is_logged_in and self.is_connected:
+            send_obj = HistoryOP(since_seq).construct()
+            if send_obj is None:
+                fixed_print("Invalid input detected.")
+                return
+            self.send_packet(send_obj)
         else:
             fixed_print("You must be connected to a server and logged in to perform this action.")
 
+    def do_protocol(self, wire_format):
+        if self.sock and self.is_connected:
+            send_obj = ProtocolOP(wire_format).construct()
+            if send_obj is None:
+                print("Usage Message: protocol <fixed|compact>")
+                return
+            self.send_packet(send_obj)
+        else:
+            fixed_print('Not connected to any server')
+
+    def do_compress(self, args):
+        # Offer every codec named. 'none' alone turns compression off.
+        names = args.split()
+        if not names or any(name not in CapsOP.codecs for name in names):
+            print(f"Usage Message: compress <{'|'.join(CapsOP.codecs)}>...")
+            return
+        if self.sock and self.is_connected:
+            offered = 0
+            for name in names:
+                offered |= 1 << CapsOP.codecs[name]
+            send_obj = CapsOP(offered).construct()
+            if send_obj is None:
+                fixed_print("Invalid input detected.")
+                return
+            self.send_packet(send_obj)
+        else:
+            fixed_print('Not connected to any server')
+
     def do_login(self, creds):
         if self.is_logged_in:
             fixed_print("Already logged in.")
@@ -119,7 +194,25 @@ class Client(cmd.Cmd):
             if send_obj is None:
                 fixed_print("Invalid input detected.")
                 return
-            self.sock.sendall(send_obj)
+            self.send_packet(send_obj)
+        else:
+            fixed_print('Not connected to any server')
+
+    def do_resume(self, _):
+        if self.is_logged_in:
+            fixed_print("Already logged in.")
+            return False
+
+        if self.token is None:
+            fixed_print("No session to resume. Login first.")
+            return False
+
+        if self.sock:
+            send_obj = ResumeOP(self.token).construct()
+            if send_obj is None:
+                fixed_print("Invalid input detected.")
+                return
+            self.send_packet(send_obj)
         else:
             fixed_print('Not connected to any server')
 
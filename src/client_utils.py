@@ -1,5 +1,7 @@
 import struct
-from packet_info import LoginOP, WhisperOP, JoinRoomOP, ShoutOP
+import zlib
+from packet_info import LoginOP, WhisperOP, JoinRoomOP, ShoutOP, ResumeOP, RoomOP, HistoryOP, ProtocolOP, CapsOP
+from packet_info import XNET_MAX_USERNAME_LEN, MAX_MESSAGE_LENGTH
 
 def fixed_print(message):
     print(f"{message}\n$ ", end="")
@@ -11,15 +13,110 @@ def get_return_codes():
         2: "Failed to join room",
         3: "Failed to whisper",
         4: "Failed to shout",
+        5: "Failed to resume session",
+        6: "Failed to modify room",
+        7: "Failed to fetch history",
+        8: "Failed to switch protocol",
+        9: "Failed to negotiate capabilities",
     }
     return codes
 
+COMPRESSED_OP = 0xFFFF
+COMPRESSED_HEADER = "!HII"
+LZ_WINDOW_SZ = 16384
+
+
 def unpack_server_response(client, data):
+    if COMPRESSED_OP == struct.unpack("!H", data[:2])[0]:
+        unpack_compressed_block(client, data)
+        return
+
     format = "!h"
     format_size = struct.calcsize(format)
     opcode = struct.unpack(format, data[:format_size])[0]
     notify_deconstructor(client, opcode, data)
 
+
+def unpack_compressed_block(client, data):
+    # [opcode][coded length][raw length], then the coded bytes. Decoded data is handled like anything else.
+    header_size = struct.calcsize(COMPRESSED_HEADER)
+    _, coded_length, raw_length = struct.unpack(COMPRESSED_HEADER, data[:header_size])
+    coded = data[header_size:header_size + coded_length]
+    rest = data[header_size + coded_length:]
+
+    if client.decoder is None:
+        fixed_print("Compressed data without a codec. Dropping it.")
+        return
+
+    decoded = client.decoder.decode(coded, raw_length)
+    if decoded:
+        unpack_server_response(client, decoded)
+    if rest:
+        unpack_server_response(client, rest)
+
+
+def read_lz_length(data, pos, length):
+    # A nibble of 15 continues in the following bytes until one is below 255.
+    if 15 != length:
+        return length, pos
+    while True:
+        byte = data[pos]
+        pos += 1
+        length += byte
+        if 255 != byte:
+            return length, pos
+
+
+class LzDecoder:
+    # Mirrors xnet_compress.c. Matches may reach into earlier blocks, so the tail of the stream is kept.
+    def __init__(self):
+        self.history = bytearray()
+
+    def decode(self, data, raw_length):
+        out = bytearray(self.history)
+        start = len(out)
+        pos = 0
+        while pos < len(data):
+            token = data[pos]
+            pos += 1
+            literal_length, pos = read_lz_length(data, pos, token >> 4)
+            out += data[pos:pos + literal_length]
+            pos += literal_length
+            if pos >= len(data):
+                break
+
+            offset = (data[pos] << 8) | data[pos + 1]
+            pos += 2
+            if 0 == offset:
+                continue
+
+            match_length, pos = read_lz_length(data, pos, token & 15)
+            for _ in range(match_length + 4):
+                out.append(out[-offset])
+
+        self.history = out[-LZ_WINDOW_SZ:]
+        decoded = bytes(out[start:])
+        if raw_length != len(decoded):
+            fixed_print("Compressed block decoded to the wrong length.")
+        return decoded
+
+
+class ZlibDecoder:
+    def __init__(self):
+        self.stream = zlib.decompressobj(-15)
+
+    def decode(self, data, raw_length):
+        return self.stream.decompress(data)
+
+
+def new_decoder(codec):
+    decoders = {
+        CapsOP.codecs["lz"]: LzDecoder,
+        CapsOP.codecs["zlib"]: ZlibDecoder,
+    }
+    decoder = decoders.get(codec)
+    return decoder() if decoder else None
+
 def notify_deconstructor(client, opcode, data):
     features = {
         LoginOP.opcode: deconstruct_login,
@@ -27,6 +124,12 @@ def notify_deconstructor(client, opcode, data):
         WhisperOP.im_target: deconstruct_whisper_target,
         JoinRoomOP.opcode: deconstruct_join_op,
         ShoutOP.opcode: deconstruct_shout_op,
+        ResumeOP.opcode: deconstruct_resume_op,
+        RoomOP.opcode: deconstruct_room_op,
+        HistoryOP.opcode: deconstruct_history_op,
+        ProtocolOP.opcode: deconstruct_protocol_op,
+        CapsOP.opcode: deconstruct_caps_op,
+        ShoutOP.room_message: deconstruct_room_message,
     }
 
     deconstructor_idx = list(features.keys()).index(opcode)
@@ -34,16 +137,17 @@ def notify_deconstructor(client, opcode, data):
     list(features.values())[deconstructor_idx](client, data)
 
 def deconstruct_login(client, data):
-    format = "!hh"
+    format = LoginOP.reply_format
     format_size = struct.calcsize(format)
-    return_code = struct.unpack(format, data[:format_size])[1]
+    _, return_code, token = struct.unpack(format, data[:format_size])
     if 0 == return_code:
         client.is_logged_in = True
+        client.token = token
 
     fixed_print(get_return_codes()[return_code])
 
 def deconstruct_whisper(client, data):
-    format = "!hh"
+    format = WhisperOP.reply_format
     format_size = struct.calcsize(format)
     return_code = struct.unpack(format, data[:format_size])[1]
 
@@ -51,7 +155,15 @@ def deconstruct_whisper(client, data):
 
 
 def deconstruct_whisper_target(client, data):
-    format = f"!hi{WhisperOP.max_user_length}si{WhisperOP.max_msg_length}s"
+    if ProtocolOP.wire_formats["compact"] == client.wire_format:
+        _, from_user, data = unpack_compact_field(data[struct.calcsize("!h"):], "!B")
+        _, message, data = unpack_compact_field(data, "!H")
+        fixed_print(f"[From {from_user.decode('utf-8')}] : {message.decode('utf-8')}")
+        if data:
+            unpack_server_response(client, data)
+        return
+
+    format = f"!hi{XNET_MAX_USERNAME_LEN}si{MAX_MESSAGE_LENGTH}s"
     format_size = struct.calcsize(format)
     whisper_info = struct.unpack(format, data[:format_size])
 
@@ -62,15 +174,126 @@ def deconstruct_whisper_target(client, data):
 
 
 def deconstruct_join_op(client, data):
-    format = "!hh"
+    format = JoinRoomOP.reply_format
     format_size = struct.calcsize(format)
     return_code = struct.unpack(format, data[:format_size])[1]
 
     fixed_print(get_return_codes()[return_code])
 
 def deconstruct_shout_op(client, data):
-    format = "!hh"
+    format = ShoutOP.reply_format
+    format_size = struct.calcsize(format)
+    return_code = struct.unpack(format, data[:format_size])[1]
+
+    fixed_print(get_return_codes()[return_code])
+
+
+def deconstruct_resume_op(client, data):
+    format = ResumeOP.reply_format
+    format_size = struct.calcsize(format)
+    _, return_code, token, room_name_len, room_name = struct.unpack(format, data[:format_size])
+    if 0 == return_code:
+        client.is_logged_in = True
+        client.token = token
+        if 0 < room_name_len:
+            fixed_print(f"Rejoined {room_name[:room_name_len].decode('utf-8')}")
+
+    fixed_print(get_return_codes()[return_code])
+
+
+def deconstruct_room_op(client, data):
+    format = RoomOP.reply_format
     format_size = struct.calcsize(format)
     return_code = struct.unpack(format, data[:format_size])[1]
 
     fixed_print(get_return_codes()[return_code])
+
+
+def deconstruct_history_op(client, data):
+    format = HistoryOP.reply_format
+    format_size = struct.calcsize(format)
+    _, return_code, last_seq, durable_seq, entry_count = struct.unpack(format, data[:format_size])
+    if 0 != return_code:
+        fixed_print(get_return_codes()[return_code])
+        return
+
+    fixed_print(f"{entry_count} message(s) up to #{last_seq}, saved up to #{durable_seq}")
+
+    # Entries follow the reply, often in the same read.
+    if len(data) > format_size:
+        unpack_server_response(client, data[format_size:])
+
+
+def deconstruct_protocol_op(client, data):
+    format = ProtocolOP.reply_format
+    format_size = struct.calcsize(format)
+    _, return_code, wire_format = struct.unpack(format, data[:format_size])
+    client.wire_format = wire_format
+
+    fixed_print(get_return_codes()[return_code])
+
+    if len(data) > format_size:
+        unpack_server_response(client, data[format_size:])
+
+
+def deconstruct_caps_op(client, data):
+    format = CapsOP.reply_format
+    format_size = struct.calcsize(format)
+    _, return_code, codec, supported = struct.unpack(format, data[:format_size])
+
+    # Everything after the reply belongs to the new stream.
+    client.decoder = new_decoder(codec)
+    names = [name for name, value in CapsOP.codecs.items() if supported & (1 << value)]
+    codec_name = [name for name, value in CapsOP.codecs.items() if codec == value]
+
+    fixed_print(get_return_codes()[return_code])
+    fixed_print(f"Compression {codec_name[0] if codec_name else codec}, server supports {', '.join(names)}")
+
+    if len(data) > format_size:
+        unpack_server_response(client, data[format_size:])
+
+
+def unpack_compact_field(data, prefix):
+    # Compact fields are a length prefix followed by exactly that many bytes.
+    prefix_size = struct.calcsize(prefix)
+    length = struct.unpack(prefix, data[:prefix_size])[0]
+    return length, data[prefix_size:prefix_size + length], data[prefix_size + length:]
+
+
+def deconstruct_compact_room_message(client, data):
+    header = "!hQ"
+    header_size = struct.calcsize(header)
+
+    while len(data) >= header_size:
+        opcode, seq = struct.unpack(header, data[:header_size])
+        if ShoutOP.room_message != opcode:
+            break
+        _, from_user, rest = unpack_compact_field(data[header_size:], "!B")
+        _, message, rest = unpack_compact_field(rest, "!H")
+        client.last_seq = max(client.last_seq, seq)
+        fixed_print(f"[#{seq} {from_user.decode('utf-8')}] : {message.decode('utf-8')}")
+        data = rest
+
+    if data:
+        unpack_server_response(client, data)
+
+
+def deconstruct_room_message(client, data):
+    if ProtocolOP.wire_formats["compact"] == client.wire_format:
+        deconstruct_compact_room_message(client, data)
+        return
+
+    format = f"!hQi{XNET_MAX_USERNAME_LEN}si{MAX_MESSAGE_LENGTH}s"
+    format_size = struct.calcsize(format)
+
+    # Catch-up arrives as a run of records back to back.
+    while len(data) >= format_size:
+        opcode, seq, user_len, from_user, msg_len, message = struct.unpack(format, data[:format_size])
+        if ShoutOP.room_message != opcode:
+            break
+        client.last_seq = max(client.last_seq, seq)
+        fixed_print(f"[#{seq} {from_user[:user_len].decode('utf-8')}] : {message[:msg_len].decode('utf-8')}")
+        data = data[format_size:]
+
+    if data:
+        unpack_server_response(client, data)
@@ -0,0 +1,282 @@
+# Generated from schema/ftp_packets.schema by tools/packetgen.py. Do not edit, run 'make packets'.
+import struct
+from abc import ABC, abstractmethod
+
+FTP_MAX_PATH_LEN = 255
+FTP_MAX_SEARCH_RESULTS = 1000
+FTP_CHUNK_SZ = 1048576
+FTP_MAX_STATUS_CHUNKS = 256
+
+FRAME_FLAG = 0x8000
+
+def frame_packet(packet):
+    # Framed requests carry [opcode | FRAME_FLAG][payload length] ahead of the same payload.
+    opcode = struct.unpack("!H", packet[:2])[0]
+    return struct.pack("!HI", opcode | FRAME_FLAG, len(packet) - 2) + packet[2:]
+
+class BasePacket(ABC):
+    opcode : int
+    
+    @abstractmethod
+    def construct(self):
+        raise NotImplementedError
+
+
+class CreateFileOP(BasePacket):
+    opcode = 301
+    max_path_len = FTP_MAX_PATH_LEN
+    reply_format = "!hh"
+
+    def __init__(self, path):
+        self.path = path
+
+    def construct(self):
+        path = self.path.encode("utf-8")
+        if len(path) > CreateFileOP.max_path_len:
+            return
+
+        format = f"!HH{len(path)}s"
+        packet = struct.pack(format, CreateFileOP.opcode, len(path), path)
+        return packet
+
+
+class MakeDirOP(BasePacket):
+    opcode = 302
+    max_path_len = FTP_MAX_PATH_LEN
+    reply_format = "!hh"
+
+    def __init__(self, path):
+        self.path = path
+
+    def construct(self):
+        path = self.path.encode("utf-8")
+        if len(path) > MakeDirOP.max_path_len:
+            return
+
+        format = f"!HH{len(path)}s"
+        packet = struct.pack(format, MakeDirOP.opcode, len(path), path)
+        return packet
+
+
+class SearchOP(BasePacket):
+    opcode = 303
+    max_pattern_len = FTP_MAX_PATH_LEN
+    modes = {"substring": 1, "prefix": 2}
+    max_after_len = FTP_MAX_PATH_LEN
+    reply_format = "!hh"
+
+    def __init__(self, pattern, mode, after, limit):
+        self.pattern = pattern
+        self.mode = SearchOP.modes.get(mode, mode)
+        self.after = after
+        self.limit = limit
+
+    def construct(self):
+        pattern = self.pattern.encode("utf-8")
+        if len(pattern) > SearchOP.max_pattern_len:
+            return
+        if self.mode not in SearchOP.modes.values():
+            return
+        after = self.after.encode("utf-8")
+        if len(after) > SearchOP.max_after_len:
+            return
+        if not 0 <= self.limit <= 65535:
+            return
+
+        format = f"!HH{len(pattern)}sHH{len(after)}sH"
+        packet = struct.pack(format, SearchOP.opcode, len(pattern), pattern, self.mode, len(after), after, self.limit)
+        return packet
+
+
+class GetFileOP(BasePacket):
+    opcode = 304
+    max_path_len = FTP_MAX_PATH_LEN
+    reply_format = "!hhQQQ"
+
+    def __init__(self, path, offset, length):
+        self.path = path
+        self.offset = offset
+        self.length = length
+
+    def construct(self):
+        path = self.path.encode("utf-8")
+        if len(path) > GetFileOP.max_path_len:
+            return
+        if not 0 <= self.offset <= 18446744073709551615:
+            return
+        if not 0 <= self.length <= 18446744073709551615:
+            return
+
+        format = f"!HH{len(path)}sQQ"
+        packet = struct.pack(format, GetFileOP.opcode, len(path), path, self.offset, self.length)
+        return packet
+
+
+class PutFileOP(BasePacket):
+    opcode = 305
+    stages = {"ready": 1, "done": 2}
+    max_path_len = FTP_MAX_PATH_LEN
+    reply_format = "!hhHQQ"
+
+    def __init__(self, path, size, offset, length):
+        self.path = path
+        self.size = size
+        self.offset = offset
+        self.length = length
+
+    def construct(self):
+        path = self.path.encode("utf-8")
+        if len(path) > PutFileOP.max_path_len:
+            return
+        if not 0 <= self.size <= 18446744073709551615:
+            return
+        if not 0 <= self.offset <= 18446744073709551615:
+            return
+        if not 0 <= self.length <= 18446744073709551615:
+            return
+
+        format = f"!HH{len(path)}sQQQ"
+        packet = struct.pack(format, PutFileOP.opcode, len(path), path, self.size, self.offset, self.length)
+        return packet
+
+
+class DeleteOP(BasePacket):
+    opcode = 306
+    max_path_len = FTP_MAX_PATH_LEN
+    reply_format = "!hh"
+
+    def __init__(self, path):
+        self.path = path
+
+    def construct(self):
+        path = self.path.encode("utf-8")
+        if len(path) > DeleteOP.max_path_len:
+            return
+
+        format = f"!HH{len(path)}s"
+        packet = struct.pack(format, DeleteOP.opcode, len(path), path)
+        return packet
+
+
+class StatusOP(BasePacket):
+    opcode = 307
+    states = {"partial": 1, "complete": 2}
+    max_path_len = FTP_MAX_PATH_LEN
+    reply_format = "!hhHQIII"
+
+    def __init__(self, path, first_chunk, chunk_count):
+        self.path = path
+        self.first_chunk = first_chunk
+        self.chunk_count = chunk_count
+
+    def construct(self):
+        path = self.path.encode("utf-8")
+        if len(path) > StatusOP.max_path_len:
+            return
+        if not 0 <= self.first_chunk <= 4294967295:
+            return
+        if not 0 <= self.chunk_count <= 4294967295:
+            return
+
+        format = f"!HH{len(path)}sII"
+        packet = struct.pack(format, StatusOP.opcode, len(path), path, self.first_chunk, self.chunk_count)
+        return packet
+
+
+class CommitOP(BasePacket):
+    opcode = 308
+    max_path_len = FTP_MAX_PATH_LEN
+    algorithms = {"none": 0, "crc32c": 1, "xxh3": 2}
+    reply_format = "!hh"
+
+    def __init__(self, path, size, algorithm, digest):
+        self.path = path
+        self.size = size
+        self.algorithm = CommitOP.algorithms.get(algorithm, algorithm)
+        self.digest = digest
+
+    def construct(self):
+        path = self.path.encode("utf-8")
+        if len(path) > CommitOP.max_path_len:
+            return
+        if not 0 <= self.size <= 18446744073709551615:
+            return
+        if self.algorithm not in CommitOP.algorithms.values():
+            return
+        if not 0 <= self.digest <= 18446744073709551615:
+            return
+
+        format = f"!HH{len(path)}sQHQ"
+        packet = struct.pack(format, CommitOP.opcode, len(path), path, self.size, self.algorithm, self.digest)
+        return packet
+
+
+class ChecksumOP(BasePacket):
+    opcode = 309
+    max_path_len = FTP_MAX_PATH_LEN
+    algorithms = {"crc32c": 1, "xxh3": 2}
+    reply_format = "!hhQQQ"
+
+    def __init__(self, path, algorithm, offset, length):
+        self.path = path
+        self.algorithm = ChecksumOP.algorithms.get(algorithm, algorithm)
+        self.offset = offset
+        self.length = length
+
+    def construct(self):
+        path = self.path.encode("utf-8")
+        if len(path) > ChecksumOP.max_path_len:
+            return
+        if self.algorithm not in ChecksumOP.algorithms.values():
+            return
+        if not 0 <= self.offset <= 18446744073709551615:
+            return
+        if not 0 <= self.length <= 18446744073709551615:
+            return
+
+        format = f"!HH{len(path)}sHQQ"
+        packet = struct.pack(format, ChecksumOP.opcode, len(path), path, self.algorithm, self.offset, self.length)
+        return packet
+
+
+class SearchEndOP(BasePacket):
+    opcode = 397
+    pages = {"last": 1, "more": 2}
+    reply_format = "!hHI"
+
+    def __init__(self):
+        pass
+
+    def construct(self):
+
+        format = f"!H"
+        packet = struct.pack(format, SearchEndOP.opcode)
+        return packet
+
+
+class ChunkOP(BasePacket):
+    opcode = 398
+    reply_format = "!hII"
+
+    def __init__(self):
+        pass
+
+    def construct(self):
+
+        format = f"!H"
+        packet = struct.pack(format, ChunkOP.opcode)
+        return packet
+
+
+class SearchMatchOP(BasePacket):
+    opcode = 399
+    types = {"file": 1, "dir": 2}
+
+    def __init__(self):
+        pass
+
+    def construct(self):
+
+        format = f"!H"
+        packet = struct.pack(format, SearchMatchOP.opcode)
+        return packet
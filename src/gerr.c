@@ -28,6 +28,11 @@ static const char *const _gerr_desc[] = {
     [E_SRV_CLIENT_MAX_REACHED] = "Max clients reached",
     [E_SRV_USER_EXISTS] = "User already exists.",
     [E_SRV_USER_NOT_EXIST] = "User does not exist.",
+    [E_SRV_FAIL_RANDOM] = "Failed to gather random bytes",
+    [E_SRV_TOKEN_INVALID] = "Session token is not recognized",
+    [E_SRV_TOKEN_EXPIRED] = "Session token has expired",
+    [E_SRV_FAIL_LOG_IO] = "Message log I/O failed",
+    [E_SRV_FAIL_FILE_IO] = "File transfer I/O failed",
 };
 
 static const char *
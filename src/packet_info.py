@@ -1,6 +1,22 @@
+# Generated from schema/chat_packets.schema by tools/packetgen.py. Do not edit, run 'make packets'.
 import struct
 from abc import ABC, abstractmethod
 
+XNET_MAX_USERNAME_LEN = 32
+XNET_MAX_PASSWD_LEN = 32
+XNET_TOKEN_LEN = 16
+MAX_ROOM_NAME_LEN = 32
+MAX_MESSAGE_LENGTH = 256
+CHAT_ROOM_MESSAGE = 298
+CHAT_WHISPER_TARGET = 299
+
+FRAME_FLAG = 0x8000
+
+def frame_packet(packet):
+    # Framed requests carry [opcode | FRAME_FLAG][payload length] ahead of the same payload.
+    opcode = struct.unpack("!H", packet[:2])[0]
+    return struct.pack("!HI", opcode | FRAME_FLAG, len(packet) - 2) + packet[2:]
+
 class BasePacket(ABC):
     opcode : int
     
@@ -8,78 +24,175 @@ class BasePacket(ABC):
     def construct(self):
         raise NotImplementedError
 
+
 class LoginOP(BasePacket):
     opcode = 200
-    max_user_length = 32
-    max_pass_length = 32
+    max_username_len = XNET_MAX_USERNAME_LEN
+    max_password_len = XNET_MAX_PASSWD_LEN
+    reply_format = "!hh16s"
 
     def __init__(self, username, password):
         self.username = username
-        self.username_len = len(self.username)
         self.password = password
-        self.password_len = len(self.password)
 
     def construct(self):
-        if self.username_len > LoginOP.max_user_length:
+        username = self.username.encode("utf-8")
+        if len(username) > LoginOP.max_username_len:
             return
-        if self.password_len > LoginOP.max_pass_length:
+        password = self.password.encode("utf-8")
+        if len(password) > LoginOP.max_password_len:
             return
 
-        format = f'!Hi{self.username_len}si{self.password_len}s'
-        packet = struct.pack(format, LoginOP.opcode, self.username_len, self.username.encode('utf-8'), self.password_len, self.password.encode('utf-8'))
+        format = f"!Hi{len(username)}si{len(password)}s"
+        packet = struct.pack(format, LoginOP.opcode, len(username), username, len(password), password)
         return packet
 
+
 class WhisperOP(BasePacket):
     opcode = 201
-    im_target = 299
-    max_msg_length = 256
-    max_user_length = 32
+    im_target = CHAT_WHISPER_TARGET
+    max_to_username_len = XNET_MAX_USERNAME_LEN
+    max_msg_len = MAX_MESSAGE_LENGTH
+    reply_format = "!hh"
 
-    def __init__(self, to_user, data):
-        self.to_user = to_user
-        self.to_user_len = len(self.to_user)
-        self.msg = data
-        self.msg_len = len(self.msg)
+    def __init__(self, to_username, msg):
+        self.to_username = to_username
+        self.msg = msg
 
     def construct(self):
-        if self.msg_len > WhisperOP.max_msg_length:
+        to_username = self.to_username.encode("utf-8")
+        if len(to_username) > WhisperOP.max_to_username_len:
+            return
+        msg = self.msg.encode("utf-8")
+        if len(msg) > WhisperOP.max_msg_len:
             return
 
-        format = f'!Hi{self.to_user_len}si{self.msg_len}s'
-        packet = struct.pack(format, WhisperOP.opcode,
-                             self.to_user_len, self.to_user.encode('utf-8'), self.msg_len, self.msg.encode('utf-8'))
+        format = f"!Hi{len(to_username)}si{len(msg)}s"
+        packet = struct.pack(format, WhisperOP.opcode, len(to_username), to_username, len(msg), msg)
         return packet
 
 
 class JoinRoomOP(BasePacket):
     opcode = 202
-    max_room_name_len = 32
+    max_room_name_len = MAX_ROOM_NAME_LEN
+    reply_format = "!hh"
 
-    def __init__(self, data):
-        self.room_name = data
-        self.room_name_len = len(self.room_name)
+    def __init__(self, room_name):
+        self.room_name = room_name
 
     def construct(self):
-        if self.room_name_len > JoinRoomOP.max_room_name_len:
+        room_name = self.room_name.encode("utf-8")
+        if len(room_name) > JoinRoomOP.max_room_name_len:
             return
 
-        format = f"!Hi{self.room_name_len}s"
-        packet = struct.pack(format, JoinRoomOP.opcode, self.room_name_len, self.room_name.encode("utf-8"))
+        format = f"!Hi{len(room_name)}s"
+        packet = struct.pack(format, JoinRoomOP.opcode, len(room_name), room_name)
         return packet
 
 
 class ShoutOP(BasePacket):
     opcode = 203
+    room_message = CHAT_ROOM_MESSAGE
+    max_msg_len = MAX_MESSAGE_LENGTH
+    reply_format = "!hh"
+
+    def __init__(self, msg):
+        self.msg = msg
+
+    def construct(self):
+        msg = self.msg.encode("utf-8")
+        if len(msg) > ShoutOP.max_msg_len:
+            return
+
+        format = f"!Hi{len(msg)}s"
+        packet = struct.pack(format, ShoutOP.opcode, len(msg), msg)
+        return packet
+
+
+class ResumeOP(BasePacket):
+    opcode = 204
+    token_len = XNET_TOKEN_LEN
+    reply_format = "!hh16si32s"
+
+    def __init__(self, token):
+        self.token = token
+
+    def construct(self):
+        if self.token is None or len(self.token) != ResumeOP.token_len:
+            return
+
+        format = f"!H{ResumeOP.token_len}s"
+        packet = struct.pack(format, ResumeOP.opcode, self.token)
+        return packet
+
+
+class RoomOP(BasePacket):
+    opcode = 205
+    actions = {"create": 1, "delete": 2}
+    max_room_name_len = MAX_ROOM_NAME_LEN
+    reply_format = "!hh"
+
+    def __init__(self, action, room_name):
+        self.action = RoomOP.actions.get(action, action)
+        self.room_name = room_name
+
+    def construct(self):
+        if self.action not in RoomOP.actions.values():
+            return
+        room_name = self.room_name.encode("utf-8")
+        if len(room_name) > RoomOP.max_room_name_len:
+            return
+
+        format = f"!Hii{len(room_name)}s"
+        packet = struct.pack(format, RoomOP.opcode, self.action, len(room_name), room_name)
+        return packet
+
+
+class HistoryOP(BasePacket):
+    opcode = 206
+    reply_format = "!hhQQi"
+
+    def __init__(self, since_seq):
+        self.since_seq = since_seq
+
+    def construct(self):
+        if not 0 <= self.since_seq <= 18446744073709551615:
+            return
+
+        format = f"!HQ"
+        packet = struct.pack(format, HistoryOP.opcode, self.since_seq)
+        return packet
+
+
+class ProtocolOP(BasePacket):
+    opcode = 207
+    wire_formats = {"fixed": 0, "compact": 1}
+    reply_format = "!hhh"
+
+    def __init__(self, wire_format):
+        self.wire_format = ProtocolOP.wire_formats.get(wire_format, wire_format)
+
+    def construct(self):
+        if self.wire_format not in ProtocolOP.wire_formats.values():
+            return
+
+        format = f"!HH"
+        packet = struct.pack(format, ProtocolOP.opcode, self.wire_format)
+        return packet
+
+
+class CapsOP(BasePacket):
+    opcode = 208
+    codecs = {"none": 0, "lz": 1, "zlib": 2}
+    reply_format = "!hhHI"
 
-    def __init__(self, data):
-        self.msg = data
-        self.msg_len = len(self.msg)
+    def __init__(self, offered):
+        self.offered = offered
 
     def construct(self):
-        if self.msg_len > WhisperOP.max_msg_length:
+        if not 0 <= self.offered <= 4294967295:
             return
 
-        format = f"!Hi{self.msg_len}s"
-        packet = struct.pack(format, ShoutOP.opcode,
-                             self.msg_len, self.msg.encode("utf-8"))
+        format = f"!HI"
+        packet = struct.pack(format, CapsOP.opcode, self.offered)
         return packet
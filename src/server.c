@@ -1,5 +1,10 @@
 #include "xnet_base.h"
 #include "xnet_addon_chat.h"
+#include "xnet_addon_ftp.h"
+#include "xnet_ratelimit.h"
+#include "xnet_threads.h"
+#include "xnet_buffer.h"
+#include "xnet_frame.h"
 
 int main(void)
 {
@@ -8,12 +13,112 @@ int main(void)
 		return -1;
 	}
 	xnet_integrate_chat_addon(xnet);
+
+	/* Serve files out of XNET_FTP_ROOT, or FTP_ROOT_DEFAULT when unset. Its index is kept in XNET_FTP_INDEX. */
+	if (0 != xnet_integrate_ftp_addon(xnet, getenv("XNET_FTP_ROOT"), getenv("XNET_FTP_INDEX"))) {
+		xnet_destroy(xnet);
+		return -1;
+	}
+
+	/* Cap every connection's request rate when asked to, as "<per second>/<burst>", or "<per second>/<burst>/delay"
+	   to hold requests back instead of turning them away. */
+	char *rate_limit = getenv("XNET_RATE_LIMIT");
+	unsigned int rate = 0;
+	unsigned int burst = 0;
+	char policy[8] = {0};
+	if (NULL != rate_limit && 2 <= sscanf(rate_limit, "%u/%u/%7s", &rate, &burst, policy)) {
+		xnet_set_rate_limit(xnet, XNET_RATE_ANY_OP, rate, burst, (0 == strcmp(policy, "delay")) ? XNET_RATE_DELAY : XNET_RATE_REJECT);
+	}
+
+	/* When the task queue fills up, pause reading (the default), or turn requests away with "reject" or "shed". Shedding
+	   drops queued bulk work, like searches, to make room for logins. */
+	char *overload = getenv("XNET_OVERLOAD");
+	if (NULL != overload && 0 == strcmp(overload, "reject")) {
+		xnet_set_overload_policy(xnet, XNET_OVERLOAD_REJECT);
+	} else if (NULL != overload && 0 == strcmp(overload, "shed")) {
+		xnet_set_overload_policy(xnet, XNET_OVERLOAD_SHED);
+	}
+
+	/* Deal with clients that stop reading, as "<policy>/<max KiB>/<timeout s>". The policy is "disconnect", "drop" to
+	   drop their oldest broadcasts, or "coalesce" to replace them with one lagged packet. */
+	char *slow = getenv("XNET_SLOW_CONSUMER");
+	unsigned int slow_kib = 0;
+	unsigned int slow_seconds = 0;
+	char slow_policy[12] = {0};
+	if (NULL != slow && 3 == sscanf(slow, "%11[a-z]/%u/%u", slow_policy, &slow_kib, &slow_seconds)) {
+		enum xnet_slow_policy policy = XNET_SLOW_DISCONNECT;
+		if (0 == strcmp(slow_policy, "drop")) {
+			policy = XNET_SLOW_DROP_OLDEST;
+		} else if (0 == strcmp(slow_policy, "coalesce")) {
+			policy = XNET_SLOW_COALESCE;
+		}
+		xnet_set_slow_consumer_policy(xnet, policy, (size_t)slow_kib * 1024, (size_t)slow_seconds * 1000);
+	}
+
+	/* Let workers write replies to idle sockets themselves when XNET_WRITE_THROUGH is set to 1. */
+	char *write_through = getenv("XNET_WRITE_THROUGH");
+	if (NULL != write_through && 0 == strcmp(write_through, "1")) {
+		xnet_set_write_through(xnet, true);
+	}
+
+	/* Give every handler XNET_DEADLINE_MS instead of the default time to run, 0 for no limit. */
+	char *deadline = getenv("XNET_DEADLINE_MS");
+	if (NULL != deadline) {
+		uint32_t deadline_ms = strtoul(deadline, NULL, 10);
+		for (size_t opcode = 0; opcode < XNET_MAX_FEATURES; opcode++) {
+			xnet_set_deadline(xnet, opcode, deadline_ms);
+		}
+	}
+
 	xnet_create_user(xnet->userbase, (char *)"admin", (char *)"password", 3);
 	xnet_create_user(xnet->userbase, (char *)"bob", (char *)"1234", 2);
 	xnet_create_user(xnet->userbase, (char *)"tim", (char *)"spaces:(", 1);
 	chat_create_room((char *)"Hub1");
 	chat_create_room((char *)"Hub2");
 	chat_create_room((char *)"Hub3");
+
+	/* Keep a durable copy of every message when asked to. */
+	char *log_dir = getenv("XNET_CHAT_LOG");
+	if (NULL != log_dir) {
+		chat_enable_log(log_dir);
+	}
+
 	xnet_start(xnet);
+
+	xnet_rate_stats_t rate_stats = {0};
+	if (0 < rate && 0 == xnet_get_rate_stats(xnet, XNET_RATE_ANY_OP, &rate_stats)) {
+		printf("Rate limit admitted %lu, rejected %lu and delayed %lu requests\n",
+		       rate_stats.admitted, rate_stats.rejected, rate_stats.delayed);
+	}
+
+	xnet_overload_stats_t overload_stats = {0};
+	xnet_get_overload_stats(xnet, &overload_stats);
+	printf("Overload paused %lu, rejected %lu and shed %lu requests, and refused %lu connections\n",
+	       overload_stats.paused, overload_stats.rejected, overload_stats.shed, overload_stats.refused);
+
+	xnet_slow_stats_t slow_stats = {0};
+	xnet_get_slow_stats(xnet, &slow_stats);
+	printf("Slow consumers had %lu broadcasts dropped and %lu lagged packets queued, and %lu were disconnected\n",
+	       slow_stats.dropped, slow_stats.lagged, slow_stats.evicted);
+
+	/* How close each handler came to its deadline. */
+	for (size_t opcode = 0; opcode < XNET_MAX_FEATURES; opcode++) {
+		xnet_deadline_stats_t deadline_stats = {0};
+		if (0 != xnet_get_deadline_stats(xnet, opcode, &deadline_stats) || 0 == deadline_stats.runs) {
+			continue;
+		}
+		printf("Opcode %zu ran %lu times, %.2f ms at most. Budget used <50%% %lu, <75%% %lu, <100%% %lu, over %lu. "
+		       "Cancelled %lu, abandoned %lu\n", opcode, deadline_stats.runs, deadline_stats.run_max_ns / 1e6,
+		       deadline_stats.budget_used[0], deadline_stats.budget_used[1], deadline_stats.budget_used[2],
+		       deadline_stats.budget_used[3], deadline_stats.cancelled, deadline_stats.abandoned);
+	}
+	printf("Dropped %lu tasks whose connection had gone\n", xnet_get_stale_tasks(xnet));
+
+	xnet_rx_pool_stats_t rx_stats = {0};
+	xnet_get_rx_pool_stats(xnet, &rx_stats);
+	printf("Framed requests were read inline %lu times, into a reused buffer %lu times and a new one %lu times\n",
+	       rx_stats.inline_frames, rx_stats.reused, rx_stats.allocated);
 	xnet_destroy(xnet);
+	chat_disable_log();
+	ftp_close_root();
 }
\ No newline at end of file
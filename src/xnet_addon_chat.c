@@ -1,13 +1,26 @@
 #include "xnet_addon_chat.h"
 
-chat_main_t chat_base;
-
-static int assign_user_to_room(xnet_active_connection_t *client, int room_number, int seat_number);
-static int remove_user_from_room(xnet_active_connection_t *client);
-static bool is_room_name_taken(char *room_name);
-static int find_room_with_name(char *room_name);
-static int check_for_available_slot(int room_number);
-static int get_my_room_number(xnet_active_connection_t *client);
+chat_main_t chat_base = { .lock = PTHREAD_RWLOCK_INITIALIZER, .slot = -1 };
+
+/* The schema's wire_format values are handed to xnet_switch_wire_format() as they are. */
+typedef char chat_check_wire_formats[(XNET_WIRE_FIXED == CHAT_PROTOCOL_FIXED && XNET_WIRE_COMPACT == CHAT_PROTOCOL_COMPACT) ? 1 : -1];
+/* Likewise the codec values, handed to xnet_switch_codec(). */
+typedef char chat_check_codecs[(XNET_CODEC_NONE == CHAT_CAPS_NONE && XNET_CODEC_LZ == CHAT_CAPS_LZ && XNET_CODEC_ZLIB == CHAT_CAPS_ZLIB) ? 1 : -1];
+
+static int assign_user_to_room(xnet_box_t *xnet, xnet_active_connection_t *client, chat_room_t *room);
+static int remove_user_from_room(xnet_box_t *xnet, xnet_active_connection_t *client);
+static size_t hash_room_name(const char *room_name);
+static chat_room_t *find_room_with_name(const char *room_name);
+static int grow_room_index(void);
+static chat_seat_t *get_my_seat(xnet_active_connection_t *client);
+static chat_room_t *get_my_room(xnet_active_connection_t *client);
+static int move_user_to_room(xnet_box_t *xnet, xnet_active_connection_t *client, char *room_name);
+static unsigned long long first_history_seq(chat_room_t *room, unsigned long long since_seq);
+static size_t send_history_locked(xnet_box_t *xnet, xnet_active_connection_t *client, chat_room_t *room, unsigned long long since_seq);
+static int attach_room_log(chat_room_t *room);
+static void replay_room_message(unsigned long long seq, const void *data, size_t length, void *arg);
+static size_t put_compact_field(char *out, size_t prefix_size, const char *field, int length, int max_length);
+static void view_to_string(char *out, const chat_view_t *view);
 
 int test_connect(xnet_box_t *xnet, xnet_active_connection_t *client)
 {
@@ -19,20 +32,66 @@ int test_connect(xnet_box_t *xnet, xnet_active_connection_t *client)
 
 int test_disconnect(xnet_box_t *xnet, xnet_active_connection_t *client)
 {
-    (void)xnet;
-    remove_user_from_room(client);
+    if (XNET_CLOSE_PEER != client->close_reason) {
+        printf("Dropped slow consumer on socket %d (%s)\n", client->socket,
+               (XNET_CLOSE_SLOW_STALL == client->close_reason) ? "stalled" : "backlog");
+    }
+
+    pthread_rwlock_rdlock(&chat_base.lock);
+
+    /* Remember the room on the user's session token so a resume can put them back. */
+    chat_room_t *room = get_my_room(client);
+    if (NULL != room && NULL != client->account) {
+        xnet_set_token_resume_data(xnet->userbase, client->account, room->name, strnlen(room->name, MAX_ROOM_NAME_LEN));
+    }
+
+    if (NULL != room) {
+        remove_user_from_room(xnet, client);
+    }
+
+    pthread_rwlock_unlock(&chat_base.lock);
+
+    /* Seat record dies with the connection. */
+    if (-1 != chat_base.slot) {
+        nfree(&client->cold->addon_data[chat_base.slot]);
+    }
     return 0;
 }
 
 int xnet_integrate_chat_addon(xnet_box_t *xnet)
 {
-    xnet_insert_feature(xnet, CHAT_LOGIN_OP, chat_perform_login);
-    xnet_insert_feature(xnet, CHAT_WHISPER_OP, chat_perform_whisper);
-    xnet_insert_feature(xnet, CHAT_JOIN_OP, chat_perform_join_room);
-    xnet_insert_feature(xnet, CHAT_SHOUT_OP, chat_perform_shout);
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    /* Every connection carries its own seat record. */
+    chat_base.slot = xnet_reserve_addon_slot(xnet);
+    if (-1 == chat_base.slot) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    xnet_insert_feature(xnet, CHAT_LOGIN_OP, XNET_PRIORITY_HIGH, chat_perform_login);
+    xnet_insert_feature(xnet, CHAT_WHISPER_OP, XNET_PRIORITY_NORMAL, chat_perform_whisper);
+    xnet_insert_feature(xnet, CHAT_JOIN_OP, XNET_PRIORITY_NORMAL, chat_perform_join_room);
+    xnet_insert_feature(xnet, CHAT_SHOUT_OP, XNET_PRIORITY_NORMAL, chat_perform_shout);
+    xnet_insert_feature(xnet, CHAT_RESUME_OP, XNET_PRIORITY_HIGH, chat_perform_resume);
+    xnet_insert_feature(xnet, CHAT_ROOM_OP, XNET_PRIORITY_NORMAL, chat_perform_room_action);
+    xnet_insert_feature(xnet, CHAT_HISTORY_OP, XNET_PRIORITY_LOW, chat_perform_history);
+    xnet_insert_feature(xnet, CHAT_PROTOCOL_OP, XNET_PRIORITY_HIGH, chat_perform_protocol);
+    xnet_insert_feature(xnet, CHAT_CAPS_OP, XNET_PRIORITY_HIGH, chat_perform_capabilities);
     xnet_addon_callback(xnet, ON_CLIENT_CONNECT, test_connect);
     xnet_addon_callback(xnet, ON_CLIENT_DISCONNECT, test_disconnect);
     return 0;
+
+    /* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_integrate_chat_addon()");
+    return err;
 }
 
 int chat_perform_login(xnet_box_t *xnet, xnet_active_connection_t *client)
@@ -41,41 +100,39 @@ int chat_perform_login(xnet_box_t *xnet, xnet_active_connection_t *client)
 
     printf("Socket [%d] is performing 'chat_perform_login()'\n", client->socket);
 
-    chat_login_packet_t packets = {0};
-    read(client->socket, &packets.from_client.username_length, sizeof(int));
-
-    /* Ensure username is proper length. */
-    packets.from_client.username_length = ntohl(packets.from_client.username_length);
-    if (XNET_MAX_USERNAME_LEN < packets.from_client.username_length) {
-        return_code = RC_FAILED_LOGIN;
-        goto return_packet;
-    }
-
-    read(client->socket, &packets.from_client.username, packets.from_client.username_length);
-
-    read(client->socket, &packets.from_client.password_length, sizeof(int));
+    char scratch[CHAT_LOGIN_REQUEST_MAX_SZ];
+    chat_login_request_t request = {0};
+    chat_login_reply_t reply = {0};
 
-    /* Ensure password is proper length. */
-    packets.from_client.password_length = ntohl(packets.from_client.password_length);
-    if (XNET_MAX_PASSWD_LEN < packets.from_client.password_length) {
+    /* Lengths are checked by the parser. */
+    if (0 != chat_login_recv_request(client, scratch, &request)) {
         return_code = RC_FAILED_LOGIN;
         goto return_packet;
     }
 
-    read(client->socket, &packets.from_client.password, packets.from_client.password_length);
+    char username[XNET_MAX_USERNAME_LEN + 1] = {0};
+    char password[XNET_MAX_PASSWD_LEN + 1] = {0};
+    view_to_string(username, &request.username);
+    view_to_string(password, &request.password);
 
     /* Attempt to login to account. */
-    int login_attempt = xnet_login_user(xnet->userbase, packets.from_client.username, packets.from_client.password, client);
+    int login_attempt = xnet_login_user(xnet->userbase, username, password, client);
     if (0 != login_attempt) {
         return_code = RC_FAILED_LOGIN;
         goto return_packet;
     }
 
+    /* Hand the client its token so it can resume after a disconnect. */
+    if (client->account->has_token) {
+        reply.token.data = (const char *)client->account->token;
+        reply.token.length = XNET_TOKEN_LEN;
+    }
+
 /* Send feedback to client. */
 return_packet:
-    packets.to_client.opcode_relation = htons(CHAT_LOGIN_OP);
-    packets.to_client.return_code = htons(return_code);
-    send(client->socket, &packets.to_client, sizeof(packets.to_client), 0);
+    reply.return_code = return_code;
+    char out[CHAT_LOGIN_REPLY_MAX_SZ];
+    xnet_send(xnet, client, out, chat_login_write_reply(out, &reply));
 
     printf("Socket [%d] finished performing 'chat_perform_login()' with code [%d]\n", client->socket, return_code);
     return 0;
@@ -87,65 +144,96 @@ int chat_perform_whisper(xnet_box_t *xnet, xnet_active_connection_t *client)
 
     printf("Socket [%d] is performing 'chat_perform_whisper()'\n", client->socket);
 
-    chat_whisper_packet_t packets = {0};
+    char scratch[CHAT_WHISPER_REQUEST_MAX_SZ];
+    chat_whisper_request_t request = {0};
+    chat_whisper_reply_t reply = {0};
 
-    if (false == client->account->is_logged_in) {
+    if (NULL == client->account || false == client->account->is_logged_in) {
         return_code = RC_FAILED_WHISPER;
         goto return_packet;
     }
 
     /* ----- CAPTURE WHISPER DATA FROM THE INITIATING CLIENT ----- */
-    read(client->socket, &packets.from_client.to_username_length, sizeof(int));
-
-    /* Ensure username is proper length. */
-    packets.from_client.to_username_length = ntohl(packets.from_client.to_username_length);
-    if (XNET_MAX_USERNAME_LEN < packets.from_client.to_username_length) {
+    if (0 != chat_whisper_recv_request(client, scratch, &request)) {
         return_code = RC_FAILED_WHISPER;
         goto return_packet;
     }
 
-    read(client->socket, &packets.from_client.to_username, packets.from_client.to_username_length);
+    char to_username[XNET_MAX_USERNAME_LEN + 1] = {0};
+    view_to_string(to_username, &request.to_username);
+    /* ----------------------------------------------------------- */
 
-    /* Ensure message length is within the limit. */
-    read(client->socket, &packets.from_client.msg_length, sizeof(int));
-    packets.from_client.msg_length = ntohl(packets.from_client.msg_length);
-    if (MAX_MESSAGE_LENGTH < packets.from_client.msg_length) {
+    /* ----- TRY TO SEND MESSAGE TO DESIRED USER ----- */
+    xnet_active_connection_t *desired_user = xnet_get_conn_by_user(xnet, to_username);
+    if (NULL == desired_user) {
         return_code = RC_FAILED_WHISPER;
         goto return_packet;
     }
 
-    read(client->socket, &packets.from_client.msg, packets.from_client.msg_length);
-    /* ----------------------------------------------------------- */
+    /* The slot can change hands as soon as the lookup returns, so only pin it down while it still holds the user.
+       Whatever happens to it after that, the handle check drops the whisper. */
+    pthread_mutex_lock(&desired_user->io_lock);
+    xnet_user_t *target_account = desired_user->account;
+    bool is_target = desired_user->hot->is_active && NULL != target_account &&
+                     0 == strncmp(target_account->username, to_username, XNET_MAX_USERNAME_LEN);
+    xnet_conn_handle_t target = xnet_conn_handle(xnet, desired_user);
+    pthread_mutex_unlock(&desired_user->io_lock);
 
-    /* ----- TRY TO SEND MESSAGE TO DESIRED USER ----- */
-    xnet_active_connection_t *desired_user = xnet_get_conn_by_user(xnet, packets.from_client.to_username);
-    if (NULL == desired_user) {
+    if (false == is_target) {
         return_code = RC_FAILED_WHISPER;
         goto return_packet;
     }
 
     /* Make sure message is not being sent to self. */
-    if (client->account->username == desired_user->account->username) {
+    if (client->account == target_account) {
         return_code = RC_FAILED_WHISPER;
         goto return_packet;
     }
 
     /* Create packet details */
-    packets.to_target.opcode_relation = htons(CHAT_WHISPER_TARGET);
-    strncpy(packets.to_target.from_username, client->account->username, XNET_MAX_USERNAME_LEN);
-    packets.to_target.from_username_length = htonl(strnlen(packets.to_target.from_username, XNET_MAX_USERNAME_LEN));
-    strncpy(packets.to_target.msg, packets.from_client.msg, MAX_MESSAGE_LENGTH);
-    packets.to_target.msg_length = htonl(packets.from_client.msg_length);
+    struct chat_whisper_tt to_target = {0};
+    to_target.opcode_relation = htons(CHAT_WHISPER_TARGET);
+    size_t from_length = strnlen(client->account->username, XNET_MAX_USERNAME_LEN);
+    memcpy(to_target.from_username, client->account->username, from_length);
+    to_target.from_username_length = htonl(from_length);
+    memcpy(to_target.msg, request.msg.data, request.msg.length);
+    to_target.msg_length = htonl(request.msg.length);
+
+    /* The target may switch formats at any time, so let the output path pick the encoding under its lock. */
+    xnet_shared_buf_t *target_bufs[XNET_WIRE_FORMATS] = {0};
+    for (int format = 0; format < XNET_WIRE_FORMATS; format++) {
+        target_bufs[format] = xnet_buf_alloc(sizeof(to_target));
+        if (NULL != target_bufs[format]) {
+            target_bufs[format]->length = chat_encode_whisper(target_bufs[format]->data, format, &to_target);
+        }
+    }
+
+    if (NULL == target_bufs[XNET_WIRE_FIXED] || NULL == target_bufs[XNET_WIRE_COMPACT]) {
+        xnet_buf_release(target_bufs[XNET_WIRE_FIXED]);
+        xnet_buf_release(target_bufs[XNET_WIRE_COMPACT]);
+        return_code = RC_FAILED_WHISPER;
+        goto return_packet;
+    }
 
-    send(desired_user->socket, &packets.to_target, sizeof(packets.to_target), 0);
+    xnet_broadcast(xnet, &target, 1, target_bufs, XNET_NO_HANDLE);
+    xnet_buf_release(target_bufs[XNET_WIRE_FIXED]);
+    xnet_buf_release(target_bufs[XNET_WIRE_COMPACT]);
+
+    /* Only a copy into the log's mapped memory. It reaches the disk with the next group commit. */
+    if (NULL != chat_base.whisper_log) {
+        struct chat_whisper_record record = {0};
+        memcpy(record.to_username, to_username, request.to_username.length);
+        record.message = to_target;
+        chat_log_append(chat_base.whisper_log, 0, &record, sizeof(record));
+    }
 
     /* ----------------------------------------------- */
 
     /* Send feedback to client. */
 return_packet:
-    packets.to_client.opcode_relation = htons(CHAT_WHISPER_OP);
-    packets.to_client.return_code = htons(return_code);
-    send(client->socket, &packets.to_client, sizeof(packets.to_client), 0);
+    reply.return_code = return_code;
+    char out[CHAT_WHISPER_REPLY_MAX_SZ];
+    xnet_send(xnet, client, out, chat_whisper_write_reply(out, &reply));
 
     printf("Socket [%d] finished performing 'chat_perform_whisper()' with code [%d]\n", client->socket, return_code);
     return 0;
@@ -157,6 +245,10 @@ int chat_perform_join_room(xnet_box_t *xnet, xnet_active_connection_t *client)
 
     printf("Socket [%d] is performing 'chat_perform_join_room()'\n", client->socket);
 
+    char scratch[CHAT_JOIN_REQUEST_MAX_SZ];
+    chat_join_request_t request = {0};
+    chat_join_reply_t reply = {0};
+
     if (NULL == xnet) {
         return_code = RC_FAILED_JOIN_ROOM;
         goto return_packet;
@@ -167,49 +259,27 @@ int chat_perform_join_room(xnet_box_t *xnet, xnet_active_connection_t *client)
         goto return_packet;
     }
 
-    chat_join_room_packet_t packets = {0};
-
-    read(client->socket, &packets.from_client.room_name_length, sizeof(int));
-    packets.from_client.room_name_length = ntohl(packets.from_client.room_name_length);
-
-    read(client->socket, &packets.from_client.room_name, MAX_ROOM_NAME_LEN);
-
-    int room_number = find_room_with_name((char *)packets.from_client.room_name);
-    if (-1 == room_number) {
+    if (0 != chat_join_recv_request(client, scratch, &request)) {
         return_code = RC_FAILED_JOIN_ROOM;
         goto return_packet;
     }
 
-    int seat_number = check_for_available_slot(room_number);
-    if (-1 == seat_number) {
-        return_code = RC_FAILED_JOIN_ROOM;
-        goto return_packet;
-    }
+    char room_name[MAX_ROOM_NAME_LEN + 1] = {0};
+    view_to_string(room_name, &request.room_name);
 
-    /* Is user in room? */
-    int in_room = get_my_room_number(client);
-    if (-1 != in_room) {
-        /* Attempts to remove user from their current room. */
-        int try_remove = remove_user_from_room(client);
-        if (0 != try_remove) {
-            return_code = RC_FAILED_JOIN_ROOM;
-            goto return_packet;
-        }
-    }
-
-    int try_join = assign_user_to_room(client, room_number, seat_number);
+    int try_join = move_user_to_room(xnet, client, room_name);
     if (0 != try_join) {
         return_code = RC_FAILED_JOIN_ROOM;
         goto return_packet;
     }
 
-    printf("%s got assigned to room %s\n", client->account->username, packets.from_client.room_name);
+    printf("%s got assigned to room %s\n", client->account->username, room_name);
 
     /* Send feedback to client. */
 return_packet:
-    packets.to_client.opcode_relation = htons(CHAT_JOIN_OP);
-    packets.to_client.return_code = htons(return_code);
-    send(client->socket, &packets.to_client, sizeof(packets.to_client), 0);
+    reply.return_code = return_code;
+    char out[CHAT_JOIN_REPLY_MAX_SZ];
+    xnet_send(xnet, client, out, chat_join_write_reply(out, &reply));
 
     printf("Socket [%d] finished performing 'chat_perform_join_room()' with code [%d]\n", client->socket, return_code);
     return 0;
@@ -221,6 +291,10 @@ int chat_perform_shout(xnet_box_t *xnet, xnet_active_connection_t *client)
 
     printf("Socket [%d] is performing 'chat_perform_shout()'\n", client->socket);
 
+    char scratch[CHAT_SHOUT_REQUEST_MAX_SZ];
+    chat_shout_request_t request = {0};
+    chat_shout_reply_t reply = {0};
+
     if (NULL == xnet) {
         return_code = RC_FAILED_SHOUT;
         goto return_packet;
@@ -231,231 +305,702 @@ int chat_perform_shout(xnet_box_t *xnet, xnet_active_connection_t *client)
         goto return_packet;
     }
 
-    chat_shout_packet_t packets = {0};
-
-    // parse_packet(
-    //     .in = client->socket;
-    //     .out = &packets;
-    //     .formula = ""
-    // );
-
-    read(client->socket, &packets.from_client.msg_length, sizeof(int));
-    packets.from_client.msg_length = ntohl(packets.from_client.msg_length);
+    /* Framed shouts are read in place. The message is copied once, straight into the history ring. */
+    if (0 != chat_shout_recv_request(client, scratch, &request)) {
+        return_code = RC_FAILED_SHOUT;
+        goto return_packet;
+    }
 
-    read(client->socket, &packets.from_client.msg, packets.from_client.msg_length);
+    /* Hold the registry so the room can't be deleted under us. */
+    pthread_rwlock_rdlock(&chat_base.lock);
 
-    int room_number = get_my_room_number(client);
-    if (-1 == room_number) {
+    chat_room_t *room = get_my_room(client);
+    if (NULL == room) {
+        pthread_rwlock_unlock(&chat_base.lock);
         return_code = RC_FAILED_SHOUT;
         goto return_packet;
     }
 
-    /* Create whisper packet details */
-    chat_whisper_packet_t dupe_whisper = {0};
-    dupe_whisper.to_target.opcode_relation = htons(CHAT_WHISPER_TARGET);
-    strncpy(dupe_whisper.to_target.from_username, client->account->username, XNET_MAX_USERNAME_LEN);
-    dupe_whisper.to_target.from_username_length = htonl(strnlen(dupe_whisper.to_target.from_username, XNET_MAX_USERNAME_LEN));
-    strncpy(dupe_whisper.to_target.msg, packets.from_client.msg, packets.from_client.msg_length);
-    dupe_whisper.to_target.msg_length = htonl(packets.from_client.msg_length);
+    /* Serialise the message once per wire format. Every member gets a reference to the same bytes. */
+    xnet_shared_buf_t *shout_bufs[XNET_WIRE_FORMATS] = {0};
+    shout_bufs[XNET_WIRE_FIXED] = xnet_buf_alloc(sizeof(struct chat_message_tt));
+    shout_bufs[XNET_WIRE_COMPACT] = xnet_buf_alloc(sizeof(struct chat_message_tt));
+    if (NULL == shout_bufs[XNET_WIRE_FIXED] || NULL == shout_bufs[XNET_WIRE_COMPACT]) {
+        xnet_buf_release(shout_bufs[XNET_WIRE_FIXED]);
+        xnet_buf_release(shout_bufs[XNET_WIRE_COMPACT]);
+        pthread_rwlock_unlock(&chat_base.lock);
+        return_code = RC_FAILED_SHOUT;
+        goto return_packet;
+    }
 
-    /* Send message packet to every user in room. */
-    for (size_t n = 0; n < MAX_USERS_IN_ROOM; n++) {
-        xnet_active_connection_t *current_user = chat_base.rooms[room_number].users[n];
-        /* Don't shout at yourself!! */
-        if (client == current_user) {
-            continue;
-        }
+    pthread_mutex_lock(&room->lock);
+
+    /* Sequence numbers are handed out under the room lock, so members see them in order. */
+    room->last_seq++;
+    struct chat_message_tt *entry = &room->history[room->last_seq & (CHAT_HISTORY_DEPTH - 1)];
+    memset(entry, 0, sizeof(struct chat_message_tt));
+    entry->opcode_relation = htons(CHAT_ROOM_MESSAGE);
+    entry->seq = htobe64(room->last_seq);
+    size_t from_length = strnlen(client->account->username, XNET_MAX_USERNAME_LEN);
+    memcpy(entry->from_username, client->account->username, from_length);
+    entry->from_username_length = htonl(from_length);
+    memcpy(entry->msg, request.msg.data, request.msg.length);
+    entry->msg_length = htonl(request.msg.length);
+    for (int format = 0; format < XNET_WIRE_FORMATS; format++) {
+        shout_bufs[format]->length = chat_encode_message(shout_bufs[format]->data, format, entry);
+    }
 
-        /* Shout at everyone else!! */
-        if (NULL != current_user) {
-            send(current_user->socket, &dupe_whisper.to_target, sizeof(dupe_whisper.to_target), 0);
-        }
+    /* Only a copy into the log's mapped memory. It reaches the disk with the next group commit. */
+    if (NULL != room->log) {
+        chat_log_append(room->log, room->last_seq, entry, sizeof(struct chat_message_tt));
     }
 
-    printf("%s shouted %s in room %s\n", client->account->username, packets.from_client.msg, chat_base.rooms[room_number].name);
+    /* Hand it to everyone else in the room. Very large rooms are split across the pool. */
+    xnet_broadcast_parallel(xnet, room->members, room->member_count, shout_bufs, xnet_conn_handle(xnet, client));
+    pthread_mutex_unlock(&room->lock);
+
+    xnet_buf_release(shout_bufs[XNET_WIRE_FIXED]);
+    xnet_buf_release(shout_bufs[XNET_WIRE_COMPACT]);
+
+    printf("%s shouted %.*s in room %s\n", client->account->username, (int)request.msg.length, request.msg.data, room->name);
+
+    pthread_rwlock_unlock(&chat_base.lock);
 
     /* Send feedback to client. */
 return_packet:
-    packets.to_client.opcode_relation = htons(CHAT_SHOUT_OP);
-    packets.to_client.return_code = htons(return_code);
-    send(client->socket, &packets.to_client, sizeof(packets.to_client), 0);
+    reply.return_code = return_code;
+    char out[CHAT_SHOUT_REPLY_MAX_SZ];
+    xnet_send(xnet, client, out, chat_shout_write_reply(out, &reply));
 
     printf("Socket [%d] finished performing 'chat_perform_shout()' with code [%d]\n", client->socket, return_code);
     return 0;
 }
 
-int chat_create_room(char *room_name)
+int chat_perform_resume(xnet_box_t *xnet, xnet_active_connection_t *client)
 {
-    int err = 0;
+    int return_code = RC_ACTION_SUCCESS;
 
-    /* NULL Check */
-    if (NULL == room_name) {
-        err = E_GEN_NULL_PTR;
-        goto handle_err;
+    printf("Socket [%d] is performing 'chat_perform_resume()'\n", client->socket);
+
+    char scratch[CHAT_RESUME_REQUEST_MAX_SZ];
+    chat_resume_request_t request = {0};
+    chat_resume_reply_t reply = {0};
+
+    if (0 != chat_resume_recv_request(client, scratch, &request)) {
+        return_code = RC_FAILED_RESUME;
+        goto return_packet;
     }
 
-    /* Ensure room name isn't already used. */
-    bool room_taken = is_room_name_taken(room_name);
-    if (room_taken) {
-        err = E_GEN_OUT_RANGE;
-        goto handle_err;
+    /* Swap the token for the account it belongs to, skipping the password check. */
+    char room_name[MAX_ROOM_NAME_LEN + 1] = {0};
+    size_t room_name_length = 0;
+    int resume_attempt = xnet_resume_user(xnet->userbase, (const unsigned char *)request.token.data, client, room_name, &room_name_length);
+    if (0 != resume_attempt) {
+        return_code = RC_FAILED_RESUME;
+        goto return_packet;
     }
 
-    /* Assume room is not available. */
-    int avail_room = -1;
+    /* Put them back where they were. The room may have filled up or vanished, which doesn't undo the resume. */
+    if (0 < room_name_length && 0 == move_user_to_room(xnet, client, room_name)) {
+        reply.room_name.data = room_name;
+        reply.room_name.length = room_name_length;
+    }
 
-    /* Find a room index. */
-    for (size_t n = 0; n < MAX_ROOM_COUNT; n++) {
-        /* Room found. */
-        if (NULL == chat_base.rooms[n].name) {
-            avail_room = n;
-            break;
-        }
+    if (client->account->has_token) {
+        reply.token.data = (const char *)client->account->token;
+        reply.token.length = XNET_TOKEN_LEN;
     }
 
-    /* Check if room was created. */
-    if (-1 == avail_room) {
-        err = E_GEN_NEGATIVE_NUM;
-        goto handle_err;
+/* Send feedback to client. */
+return_packet:
+    reply.return_code = return_code;
+    char out[CHAT_RESUME_REPLY_MAX_SZ];
+    xnet_send(xnet, client, out, chat_resume_write_reply(out, &reply));
+
+    printf("Socket [%d] finished performing 'chat_perform_resume()' with code [%d]\n", client->socket, return_code);
+    return 0;
+}
+
+int chat_perform_room_action(xnet_box_t *xnet, xnet_active_connection_t *client)
+{
+    int return_code = RC_ACTION_SUCCESS;
+
+    printf("Socket [%d] is performing 'chat_perform_room_action()'\n", client->socket);
+
+    char scratch[CHAT_ROOM_REQUEST_MAX_SZ];
+    chat_room_request_t request = {0};
+    chat_room_reply_t reply = {0};
+
+    if (NULL == xnet) {
+        return_code = RC_FAILED_ROOM_ACTION;
+        goto return_packet;
     }
 
-    /* Assign name. */
-    chat_base.rooms[avail_room].name = room_name;
+    /* Unknown actions are rejected by the parser. */
+    if (0 != chat_room_recv_request(client, scratch, &request)) {
+        return_code = RC_FAILED_ROOM_ACTION;
+        goto return_packet;
+    }
+
+    /* Ensure room name isn't empty. */
+    if (0 == request.room_name.length) {
+        return_code = RC_FAILED_ROOM_ACTION;
+        goto return_packet;
+    }
+
+    char room_name[MAX_ROOM_NAME_LEN + 1] = {0};
+    view_to_string(room_name, &request.room_name);
 
+    /* Only logged in users with enough privilege may reshape the room list. */
+    if (NULL == client->account || CHAT_ROOM_ADMIN_PERM > client->account->perm_level) {
+        return_code = RC_FAILED_ROOM_ACTION;
+        goto return_packet;
+    }
+
+    int try_action = -1;
+    switch (request.action)
+    {
+    case CHAT_ROOM_CREATE:
+        try_action = chat_create_room(room_name);
+        break;
+    case CHAT_ROOM_DELETE:
+        try_action = chat_delete_room(xnet, room_name);
+        break;
+    default:
+        break;
+    }
+
+    if (0 != try_action) {
+        return_code = RC_FAILED_ROOM_ACTION;
+        goto return_packet;
+    }
+
+    /* Send feedback to client. */
+return_packet:
+    reply.return_code = return_code;
+    char out[CHAT_ROOM_REPLY_MAX_SZ];
+    xnet_send(xnet, client, out, chat_room_write_reply(out, &reply));
+
+    printf("Socket [%d] finished performing 'chat_perform_room_action()' with code [%d]\n", client->socket, return_code);
     return 0;
+}
 
-    /* Unreachable unless error is triggered. */
-handle_err:
-    g_show_err(err, "chat_create_room()");
-    return err;
+int chat_perform_history(xnet_box_t *xnet, xnet_active_connection_t *client)
+{
+    int return_code = RC_ACTION_SUCCESS;
+
+    printf("Socket [%d] is performing 'chat_perform_history()'\n", client->socket);
+
+    char scratch[CHAT_HISTORY_REQUEST_MAX_SZ];
+    chat_history_request_t request = {0};
+    chat_history_reply_t reply = {0};
+    char out[CHAT_HISTORY_REPLY_MAX_SZ];
+
+    if (0 != chat_history_recv_request(client, scratch, &request)) {
+        return_code = RC_FAILED_HISTORY;
+        goto return_packet;
+    }
+
+    if (NULL == client->account || false == client->account->is_logged_in) {
+        return_code = RC_FAILED_HISTORY;
+        goto return_packet;
+    }
+
+    pthread_rwlock_rdlock(&chat_base.lock);
+
+    chat_room_t *room = get_my_room(client);
+    if (NULL == room) {
+        pthread_rwlock_unlock(&chat_base.lock);
+        return_code = RC_FAILED_HISTORY;
+        goto return_packet;
+    }
+
+    /* Reply and entries go out under the room lock so no live message lands between them. */
+    pthread_mutex_lock(&room->lock);
+
+    unsigned long long first_seq = first_history_seq(room, request.since_seq);
+    int entry_count = (first_seq <= room->last_seq) ? (int)(room->last_seq - first_seq + 1) : 0;
+
+    reply.return_code = return_code;
+    reply.last_seq = room->last_seq;
+    reply.durable_seq = chat_log_durable_seq(room->log);
+    reply.entry_count = entry_count;
+    xnet_send(xnet, client, out, chat_history_write_reply(out, &reply));
+    send_history_locked(xnet, client, room, request.since_seq);
+
+    pthread_mutex_unlock(&room->lock);
+    pthread_rwlock_unlock(&chat_base.lock);
+
+    printf("Socket [%d] finished performing 'chat_perform_history()' with code [%d]\n", client->socket, return_code);
+    return 0;
+
+    /* Send feedback to client. */
+return_packet:
+    reply.return_code = return_code;
+    xnet_send(xnet, client, out, chat_history_write_reply(out, &reply));
+
+    printf("Socket [%d] finished performing 'chat_perform_history()' with code [%d]\n", client->socket, return_code);
+    return 0;
+}
+
+int chat_perform_protocol(xnet_box_t *xnet, xnet_active_connection_t *client)
+{
+    int return_code = RC_ACTION_SUCCESS;
+
+    printf("Socket [%d] is performing 'chat_perform_protocol()'\n", client->socket);
+
+    char scratch[CHAT_PROTOCOL_REQUEST_MAX_SZ];
+    chat_protocol_request_t request = {0};
+    chat_protocol_reply_t reply = {0};
+    char out[CHAT_PROTOCOL_REPLY_MAX_SZ];
+
+    /* Unknown formats are rejected by the parser. */
+    if (0 != chat_protocol_recv_request(client, scratch, &request)) {
+        return_code = RC_FAILED_PROTOCOL;
+        goto return_packet;
+    }
+
+    /* The reply itself looks the same in every format. */
+    reply.return_code = return_code;
+    reply.wire_format = request.wire_format;
+    size_t length = chat_protocol_write_reply(out, &reply);
+    if (0 != xnet_switch_wire_format(xnet, client, request.wire_format, out, length)) {
+        return_code = RC_FAILED_PROTOCOL;
+        goto return_packet;
+    }
+
+    printf("Socket [%d] finished performing 'chat_perform_protocol()' with code [%d]\n", client->socket, return_code);
+    return 0;
+
+    /* Send feedback to client. */
+return_packet:
+    reply.return_code = return_code;
+    reply.wire_format = client->wire_format;
+    xnet_send(xnet, client, out, chat_protocol_write_reply(out, &reply));
+
+    printf("Socket [%d] finished performing 'chat_perform_protocol()' with code [%d]\n", client->socket, return_code);
+    return 0;
+}
+
+int chat_perform_capabilities(xnet_box_t *xnet, xnet_active_connection_t *client)
+{
+    int return_code = RC_ACTION_SUCCESS;
+
+    printf("Socket [%d] is performing 'chat_perform_capabilities()'\n", client->socket);
+
+    char scratch[CHAT_CAPS_REQUEST_MAX_SZ];
+    chat_caps_request_t request = {0};
+    chat_caps_reply_t reply = {0};
+    char out[CHAT_CAPS_REPLY_MAX_SZ];
+
+    reply.supported = xnet_supported_codecs();
+
+    if (0 != chat_caps_recv_request(client, scratch, &request)) {
+        return_code = RC_FAILED_CAPS;
+        goto return_packet;
+    }
+
+    /* Cheapest codec both sides have. Offering none of them turns compression off. */
+    int codec = XNET_CODEC_NONE;
+    unsigned int common = request.offered & reply.supported;
+    if (common & (1u << XNET_CODEC_LZ)) {
+        codec = XNET_CODEC_LZ;
+    } else if (common & (1u << XNET_CODEC_ZLIB)) {
+        codec = XNET_CODEC_ZLIB;
+    }
+
+    reply.return_code = return_code;
+    reply.codec = codec;
+    size_t length = chat_caps_write_reply(out, &reply);
+    if (0 != xnet_switch_codec(xnet, client, codec, out, length)) {
+        return_code = RC_FAILED_CAPS;
+        goto return_packet;
+    }
+
+    printf("Socket [%d] finished performing 'chat_perform_capabilities()' with code [%d]\n", client->socket, return_code);
+    return 0;
+
+    /* Send feedback to client. */
+return_packet:
+    reply.return_code = return_code;
+    reply.codec = client->codec;
+    xnet_send(xnet, client, out, chat_caps_write_reply(out, &reply));
+
+    printf("Socket [%d] finished performing 'chat_perform_capabilities()' with code [%d]\n", client->socket, return_code);
+    return 0;
 }
 
-static int get_my_room_number(xnet_active_connection_t *client)
+size_t chat_encode_message(void *out, int wire_format, const struct chat_message_tt *message)
+{
+    if (XNET_WIRE_COMPACT != wire_format) {
+        memcpy(out, message, sizeof(struct chat_message_tt));
+        return sizeof(struct chat_message_tt);
+    }
+
+    /* Opcode and seq are already in network order. */
+    char *cursor = out;
+    memcpy(cursor, &message->opcode_relation, sizeof(message->opcode_relation));
+    cursor += sizeof(message->opcode_relation);
+    memcpy(cursor, &message->seq, sizeof(message->seq));
+    cursor += sizeof(message->seq);
+    cursor += put_compact_field(cursor, sizeof(uint8_t), message->from_username, ntohl(message->from_username_length), XNET_MAX_USERNAME_LEN);
+    cursor += put_compact_field(cursor, sizeof(uint16_t), message->msg, ntohl(message->msg_length), MAX_MESSAGE_LENGTH);
+
+    return cursor - (char *)out;
+}
+
+size_t chat_encode_whisper(void *out, int wire_format, const struct chat_whisper_tt *message)
+{
+    if (XNET_WIRE_COMPACT != wire_format) {
+        memcpy(out, message, sizeof(struct chat_whisper_tt));
+        return sizeof(struct chat_whisper_tt);
+    }
+
+    char *cursor = out;
+    memcpy(cursor, &message->opcode_relation, sizeof(message->opcode_relation));
+    cursor += sizeof(message->opcode_relation);
+    cursor += put_compact_field(cursor, sizeof(uint8_t), message->from_username, ntohl(message->from_username_length), XNET_MAX_USERNAME_LEN);
+    cursor += put_compact_field(cursor, sizeof(uint16_t), message->msg, ntohl(message->msg_length), MAX_MESSAGE_LENGTH);
+
+    return cursor - (char *)out;
+}
+
+int chat_enable_log(const char *dir)
 {
     int err = 0;
 
     /* NULL Check */
-    if (NULL == client) {
+    if (NULL == dir) {
         err = E_GEN_NULL_PTR;
         goto handle_err;
     }
 
-    int found_rm_index = -1;
+    err = chat_log_open(dir);
+    if (0 != err) {
+        goto handle_err;
+    }
+
+    chat_log_stream_t *whisper_log = chat_log_stream(CHAT_WHISPER_LOG_NAME, NULL, NULL);
+    if (NULL == whisper_log) {
+        err = E_SRV_FAIL_LOG_IO;
+        goto handle_err;
+    }
 
-    for (size_t rm_idx = 0; (rm_idx < MAX_ROOM_COUNT && -1 == found_rm_index); rm_idx++) {
-        for (size_t usr_idx = 0; (usr_idx < MAX_USERS_IN_ROOM && -1 == found_rm_index); usr_idx++) {
-            if (client == chat_base.rooms[rm_idx].users[usr_idx]) {
-                // This assignment makes the above conditionals no longer valid, causing the parent loop to break.
-                found_rm_index = rm_idx;
-            }
+    /* Bring back the history of every room that already exists. */
+    pthread_rwlock_wrlock(&chat_base.lock);
+    chat_base.whisper_log = whisper_log;
+    for (size_t n = 0; n < chat_base.bucket_count; n++) {
+        for (chat_room_t *room = chat_base.buckets[n]; NULL != room; room = room->next) {
+            attach_room_log(room);
         }
     }
+    pthread_rwlock_unlock(&chat_base.lock);
 
-    return found_rm_index;
+    return 0;
 
     /* Unreachable unless error is triggered. */
 handle_err:
-    g_show_err(err, "get_my_room_number()");
-    return -1; 
+    g_show_err(err, "chat_enable_log()");
+    return err;
 }
 
-static bool is_room_name_taken(char *room_name)
+void chat_disable_log(void)
+{
+    if (false == chat_log_is_open()) {
+        return;
+    }
+
+    pthread_rwlock_wrlock(&chat_base.lock);
+    chat_base.whisper_log = NULL;
+    for (size_t n = 0; n < chat_base.bucket_count; n++) {
+        for (chat_room_t *room = chat_base.buckets[n]; NULL != room; room = room->next) {
+            room->log = NULL;
+        }
+    }
+    pthread_rwlock_unlock(&chat_base.lock);
+
+    chat_log_close();
+}
+
+int chat_create_room(char *room_name)
 {
     int err = 0;
-    bool taken = false;
 
+    /* NULL Check */
     if (NULL == room_name) {
         err = E_GEN_NULL_PTR;
         goto handle_err;
     }
 
-    /* Loop through every room, if room name matches, break out and notify return. */
-    for (size_t n = 0; n < MAX_ROOM_COUNT; n++) {
-        if (NULL != chat_base.rooms[n].name && 0 == strncmp(chat_base.rooms[n].name, room_name, MAX_ROOM_NAME_LEN)) {
-           taken = true;
-           break;
+    size_t name_length = strnlen(room_name, MAX_ROOM_NAME_LEN + 1);
+    if (0 == name_length || MAX_ROOM_NAME_LEN < name_length) {
+        err = E_GEN_FAIL_STR_LENGTH;
+        goto handle_err;
+    }
+
+    /* Build the room before taking the registry lock. */
+    chat_room_t *new_room = calloc(1, sizeof(chat_room_t));
+    if (NULL == new_room) {
+        err = E_GEN_FAIL_ALLOC;
+        goto handle_err;
+    }
+    memcpy(new_room->name, room_name, name_length);
+    new_room->name_hash = hash_room_name(new_room->name);
+    pthread_mutex_init(&new_room->lock, NULL);
+
+    /* Nobody else can see the room yet, so its history can be replayed without any locks. */
+    if (chat_log_is_open()) {
+        attach_room_log(new_room);
+    }
+
+    pthread_rwlock_wrlock(&chat_base.lock);
+
+    /* Ensure room name isn't already used. */
+    if (NULL != find_room_with_name(new_room->name)) {
+        pthread_rwlock_unlock(&chat_base.lock);
+        pthread_mutex_destroy(&new_room->lock);
+        nfree((void **)&new_room);
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    /* Keep chains short by growing once there's a room per bucket. */
+    if (chat_base.room_count >= chat_base.bucket_count) {
+        err = grow_room_index();
+        if (0 != err) {
+            pthread_rwlock_unlock(&chat_base.lock);
+            pthread_mutex_destroy(&new_room->lock);
+            nfree((void **)&new_room);
+            goto handle_err;
         }
     }
 
-    return taken;
+    /* Link room into its bucket. */
+    size_t bucket = new_room->name_hash & (chat_base.bucket_count - 1);
+    new_room->next = chat_base.buckets[bucket];
+    chat_base.buckets[bucket] = new_room;
+    chat_base.room_count++;
+
+    pthread_rwlock_unlock(&chat_base.lock);
+
+    return 0;
 
     /* Unreachable unless error is triggered. */
 handle_err:
-    g_show_err(err, "is_room_name_taken()");
-    return true;
+    g_show_err(err, "chat_create_room()");
+    return err;
 }
 
-static int find_room_with_name(char *room_name)
+int chat_delete_room(xnet_box_t *xnet, char *room_name)
 {
     int err = 0;
 
-    if (NULL == room_name) {
+    /* NULL Check */
+    if (NULL == xnet || NULL == room_name) {
         err = E_GEN_NULL_PTR;
         goto handle_err;
     }
 
-    /* Start off assuming room is not found. */
-    int room_number = -1;
+    pthread_rwlock_wrlock(&chat_base.lock);
+
+    if (0 == chat_base.bucket_count) {
+        pthread_rwlock_unlock(&chat_base.lock);
+        err = E_GEN_NEGATIVE_NUM;
+        goto handle_err;
+    }
+
+    /* Walk the bucket while remembering the link that points at the current room. */
+    size_t name_hash = hash_room_name(room_name);
+    chat_room_t **link = &chat_base.buckets[name_hash & (chat_base.bucket_count - 1)];
+    while (NULL != *link) {
+        if (name_hash == (*link)->name_hash && 0 == strncmp((*link)->name, room_name, MAX_ROOM_NAME_LEN)) {
+            break;
+        }
+        link = &(*link)->next;
+    }
 
-    /* Get index of room with match. */
-    for (size_t n = 0; n < MAX_ROOM_COUNT; n++) {
-        if (NULL == chat_base.rooms[n].name) {
+    chat_room_t *doomed = *link;
+    if (NULL == doomed) {
+        pthread_rwlock_unlock(&chat_base.lock);
+        err = E_GEN_NEGATIVE_NUM;
+        goto handle_err;
+    }
+
+    /* Unlink room and evict everyone in it. The write lock keeps every other reader out. */
+    *link = doomed->next;
+    chat_base.room_count--;
+    for (size_t n = 0; n < doomed->member_count; n++) {
+        chat_seat_t *seat = get_my_seat(xnet_conn_from_handle(xnet, doomed->members[n]));
+        if (NULL == seat) {
             continue;
         }
+        seat->room = NULL;
+        seat->index = 0;
+    }
+
+    pthread_rwlock_unlock(&chat_base.lock);
+
+    printf("Room %s has been deleted\n", doomed->name);
+    pthread_mutex_destroy(&doomed->lock);
+    nfree((void **)&doomed->members);
+    nfree((void **)&doomed);
+
+    return 0;
+
+    /* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "chat_delete_room()");
+    return err;
+}
+
+static size_t hash_room_name(const char *room_name)
+{
+    /* FNV-1a */
+    size_t hash = 14695981039346656037ULL;
+    for (size_t n = 0; n < MAX_ROOM_NAME_LEN && '\0' != room_name[n]; n++) {
+        hash ^= (unsigned char)room_name[n];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static chat_room_t *find_room_with_name(const char *room_name)
+{
+    /* Caller must hold the registry lock. */
+    if (NULL == room_name || 0 == chat_base.bucket_count) {
+        return NULL;
+    }
+
+    size_t name_hash = hash_room_name(room_name);
+    chat_room_t *current = chat_base.buckets[name_hash & (chat_base.bucket_count - 1)];
+    while (NULL != current) {
         /* Room found if true. */
-        if (0 == strncmp(chat_base.rooms[n].name, room_name, MAX_ROOM_NAME_LEN)) {
-            room_number = n;
+        if (name_hash == current->name_hash && 0 == strncmp(current->name, room_name, MAX_ROOM_NAME_LEN)) {
             break;
         }
+        current = current->next;
     }
 
-    /* Check if room was found. */
-    if (-1 == room_number) {
-        err = E_GEN_NEGATIVE_NUM;
+    return current;
+}
+
+static int grow_room_index(void)
+{
+    int err = 0;
+
+    /* Caller must hold the registry write lock. */
+    size_t new_count = (0 == chat_base.bucket_count) ? CHAT_ROOM_BUCKETS_DEFAULT : chat_base.bucket_count * 2;
+    chat_room_t **new_buckets = calloc(new_count, sizeof(chat_room_t *));
+    if (NULL == new_buckets) {
+        err = E_GEN_FAIL_ALLOC;
         goto handle_err;
     }
 
-    return room_number;
+    /* Rehash every room into the bigger index. Hashes are cached so no names are touched. */
+    for (size_t n = 0; n < chat_base.bucket_count; n++) {
+        chat_room_t *current = chat_base.buckets[n];
+        while (NULL != current) {
+            chat_room_t *next = current->next;
+            size_t bucket = current->name_hash & (new_count - 1);
+            current->next = new_buckets[bucket];
+            new_buckets[bucket] = current;
+            current = next;
+        }
+    }
+
+    nfree((void **)&chat_base.buckets);
+    chat_base.buckets = new_buckets;
+    chat_base.bucket_count = new_count;
+
+    return 0;
 
     /* Unreachable unless error is triggered. */
 handle_err:
-    g_show_err(err, "find_room_with_name()");
-    return -1;
+    g_show_err(err, "grow_room_index()");
+    return err;
+}
+
+static chat_seat_t *get_my_seat(xnet_active_connection_t *client)
+{
+    /* NULL until the connection first joins a room. */
+    if (NULL == client || -1 == chat_base.slot) {
+        return NULL;
+    }
+
+    return client->cold->addon_data[chat_base.slot];
 }
 
-static int check_for_available_slot(int room_number)
+static chat_room_t *get_my_room(xnet_active_connection_t *client)
+{
+    /* Caller must hold the registry lock. */
+    chat_seat_t *seat = get_my_seat(client);
+    if (NULL == seat) {
+        return NULL;
+    }
+
+    return seat->room;
+}
+
+static int move_user_to_room(xnet_box_t *xnet, xnet_active_connection_t *client, char *room_name)
 {
     int err = 0;
-    int avail_slot = -1;
 
-    /* Find available spot in room. */
-    for (size_t n = 0; n < MAX_USERS_IN_ROOM; n++) {
-        if (NULL == chat_base.rooms[room_number].users[n]) {
-            avail_slot = n;
-            break;
-        }
+    /* NULL Check */
+    if (NULL == client) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == room_name) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
     }
 
-    /* Check if slot was found. */
-    if (-1 == avail_slot) {
+    pthread_rwlock_rdlock(&chat_base.lock);
+
+    chat_room_t *room = find_room_with_name(room_name);
+    if (NULL == room) {
+        pthread_rwlock_unlock(&chat_base.lock);
         err = E_GEN_NEGATIVE_NUM;
         goto handle_err;
     }
 
-    return avail_slot;
+    /* Already there. */
+    if (room == get_my_room(client)) {
+        pthread_rwlock_unlock(&chat_base.lock);
+        return 0;
+    }
+
+    /* Is user in room? */
+    if (NULL != get_my_room(client)) {
+        /* Attempts to remove user from their current room. */
+        err = remove_user_from_room(xnet, client);
+        if (0 != err) {
+            pthread_rwlock_unlock(&chat_base.lock);
+            goto handle_err;
+        }
+    }
+
+    err = assign_user_to_room(xnet, client, room);
+    pthread_rwlock_unlock(&chat_base.lock);
+    if (0 != err) {
+        goto handle_err;
+    }
+
+    return 0;
 
     /* Unreachable unless error is triggered. */
 handle_err:
-    g_show_err(err, "check_for_available_slot()");
-    return -1;
+    g_show_err(err, "move_user_to_room()");
+    return err;
 }
 
-static int remove_user_from_room(xnet_active_connection_t *client)
+static int remove_user_from_room(xnet_box_t *xnet, xnet_active_connection_t *client)
 {
     int err = 0;
 
     /* NULL Check */
-    if (NULL == client) {
+    if (NULL == xnet || NULL == client) {
         err = E_GEN_NULL_PTR;
         goto handle_err;
     }
@@ -471,22 +1016,31 @@ static int remove_user_from_room(xnet_active_connection_t *client)
         goto handle_err;
     }
 
-    /* Get the current room that user resides in. */
-    int room_number = get_my_room_number(client);
-    if (-1 == room_number) {
+    /* Get the current room that user resides in. Caller holds the registry lock. */
+    chat_seat_t *seat = get_my_seat(client);
+    chat_room_t *room = (NULL == seat) ? NULL : seat->room;
+    if (NULL == room) {
         err = E_GEN_NEGATIVE_NUM;
         goto handle_err;
     }
 
-    /* Search for them in the room, and remove them. */
-    for (size_t n = 0; n < MAX_USERS_IN_ROOM; n++) {
-        if (client == chat_base.rooms[room_number].users[n]) {
-            // Removes user from room
-            chat_base.rooms[room_number].users[n] = NULL;
-            printf("%s got removed from room %s\n", client->account->username, chat_base.rooms[room_number].name);
-            break;
+    /* Fill the hole with the last member so removal stays O(1). */
+    pthread_mutex_lock(&room->lock);
+    room->member_count--;
+    if (seat->index != room->member_count) {
+        xnet_conn_handle_t moved = room->members[room->member_count];
+        room->members[seat->index] = moved;
+        chat_seat_t *moved_seat = get_my_seat(xnet_conn_from_handle(xnet, moved));
+        if (NULL != moved_seat) {
+            moved_seat->index = seat->index;
         }
     }
+    room->members[room->member_count] = XNET_NO_HANDLE;
+    pthread_mutex_unlock(&room->lock);
+
+    seat->room = NULL;
+    seat->index = 0;
+    printf("%s got removed from room %s\n", client->account->username, room->name);
 
     return 0;
 
@@ -496,7 +1050,7 @@ handle_err:
     return err;
 }
 
-static int assign_user_to_room(xnet_active_connection_t *client, int room_number, int seat_number)
+static int assign_user_to_room(xnet_box_t *xnet, xnet_active_connection_t *client, chat_room_t *room)
 {
     int err = 0;
 
@@ -506,14 +1060,52 @@ static int assign_user_to_room(xnet_active_connection_t *client, int room_number
         goto handle_err;
     }
 
+    if (NULL == room) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
     /* Require client to be logged in. */
-    if (false == client->account->is_logged_in) {
+    if (NULL == client->account || false == client->account->is_logged_in) {
         err = E_GEN_OUT_RANGE;
         goto handle_err;
     }
 
+    /* First room this connection joins, give it a seat record. */
+    chat_seat_t *seat = get_my_seat(client);
+    if (NULL == seat) {
+        seat = calloc(1, sizeof(chat_seat_t));
+        if (NULL == seat) {
+            err = E_GEN_FAIL_ALLOC;
+            goto handle_err;
+        }
+        client->cold->addon_data[chat_base.slot] = seat;
+    }
+
+    pthread_mutex_lock(&room->lock);
+
+    /* Member set grows by doubling. */
+    if (room->member_count == room->member_capacity) {
+        size_t new_capacity = (0 == room->member_capacity) ? CHAT_ROOM_SEATS_DEFAULT : room->member_capacity * 2;
+        xnet_conn_handle_t *new_members = realloc(room->members, new_capacity * sizeof(xnet_conn_handle_t));
+        if (NULL == new_members) {
+            pthread_mutex_unlock(&room->lock);
+            err = E_GEN_FAIL_ALLOC;
+            goto handle_err;
+        }
+        room->members = new_members;
+        room->member_capacity = new_capacity;
+    }
+
     /* Assign user. */
-    chat_base.rooms[room_number].users[seat_number] = client;
+    seat->room = room;
+    seat->index = room->member_count;
+    room->members[room->member_count++] = xnet_conn_handle(xnet, client);
+
+    /* Catch up on what was said before they arrived. Live messages can't overtake it while we hold the lock. */
+    send_history_locked(xnet, client, room, 0);
+
+    pthread_mutex_unlock(&room->lock);
 
     return 0;
 
@@ -521,4 +1113,123 @@ static int assign_user_to_room(xnet_active_connection_t *client, int room_number
 handle_err:
     g_show_err(err, "assign_user_to_room()");
     return err;
-}
\ No newline at end of file
+}
+
+static unsigned long long first_history_seq(chat_room_t *room, unsigned long long since_seq)
+{
+    /* Caller must hold room->lock. Only the last CHAT_HISTORY_DEPTH messages are still around. */
+    unsigned long long first_seq = (CHAT_HISTORY_DEPTH < room->last_seq) ? room->last_seq - CHAT_HISTORY_DEPTH + 1 : 1;
+    if (since_seq >= first_seq) {
+        first_seq = since_seq + 1;
+    }
+
+    return first_seq;
+}
+
+static size_t send_history_locked(xnet_box_t *xnet, xnet_active_connection_t *client, chat_room_t *room, unsigned long long since_seq)
+{
+    /* Caller must hold room->lock. */
+    unsigned long long first_seq = first_history_seq(room, since_seq);
+    if (first_seq > room->last_seq) {
+        return 0;
+    }
+
+    size_t count = room->last_seq - first_seq + 1;
+
+    /* Only the client's own worker switches its format, and that worker is busy here. */
+    if (XNET_WIRE_COMPACT == client->wire_format) {
+        char *backlog = malloc(count * sizeof(struct chat_message_tt));
+        if (NULL == backlog) {
+            return 0;
+        }
+
+        size_t length = 0;
+        for (unsigned long long seq = first_seq; seq <= room->last_seq; seq++) {
+            length += chat_encode_message(backlog + length, XNET_WIRE_COMPACT, &room->history[seq & (CHAT_HISTORY_DEPTH - 1)]);
+        }
+
+        xnet_send(xnet, client, backlog, length);
+        nfree((void **)&backlog);
+        return count;
+    }
+
+    /* Entries are wire records back to back, so the backlog goes out in at most two writes. */
+    size_t start = first_seq & (CHAT_HISTORY_DEPTH - 1);
+    size_t head = CHAT_HISTORY_DEPTH - start;
+    if (head > count) {
+        head = count;
+    }
+
+    xnet_send(xnet, client, &room->history[start], head * sizeof(struct chat_message_tt));
+    if (count > head) {
+        xnet_send(xnet, client, &room->history[0], (count - head) * sizeof(struct chat_message_tt));
+    }
+
+    return count;
+}
+
+static int attach_room_log(chat_room_t *room)
+{
+    char stream_name[MAX_ROOM_NAME_LEN + 2] = {0};
+    snprintf(stream_name, sizeof(stream_name), "#%s", room->name);
+
+    room->log = chat_log_stream(stream_name, replay_room_message, room);
+    if (NULL == room->log) {
+        return E_SRV_FAIL_LOG_IO;
+    }
+
+    /* A room recreated under an old name carries on from where the log left off. */
+    unsigned long long last_seq = chat_log_last_seq(room->log);
+    if (last_seq > room->last_seq) {
+        room->last_seq = last_seq;
+    }
+
+    return 0;
+}
+
+static void replay_room_message(unsigned long long seq, const void *data, size_t length, void *arg)
+{
+    chat_room_t *room = arg;
+    if (sizeof(struct chat_message_tt) != length) {
+        return;
+    }
+
+    /* Messages that never made it to the log leave holes. Replay them as empty rather than letting older entries stand in. */
+    for (unsigned long long missing = room->last_seq + 1; missing < seq && missing + CHAT_HISTORY_DEPTH > seq; missing++) {
+        struct chat_message_tt *hole = &room->history[missing & (CHAT_HISTORY_DEPTH - 1)];
+        memset(hole, 0, sizeof(struct chat_message_tt));
+        hole->opcode_relation = htons(CHAT_ROOM_MESSAGE);
+        hole->seq = htobe64(missing);
+    }
+
+    memcpy(&room->history[seq & (CHAT_HISTORY_DEPTH - 1)], data, length);
+    room->last_seq = seq;
+}
+
+static size_t put_compact_field(char *out, size_t prefix_size, const char *field, int length, int max_length)
+{
+    /* Lengths come from our own records, but a bad one must not walk off the end of the field. */
+    if (0 > length) {
+        length = 0;
+    }
+    if (max_length < length) {
+        length = max_length;
+    }
+
+    if (sizeof(uint8_t) == prefix_size) {
+        out[0] = (char)length;
+    } else {
+        uint16_t prefix = htons(length);
+        memcpy(out, &prefix, sizeof(prefix));
+    }
+
+    memcpy(out + prefix_size, field, length);
+    return prefix_size + length;
+}
+
+static void view_to_string(char *out, const chat_view_t *view)
+{
+    /* Views are bounds checked by the parser. @param out only needs room for the terminator on top. */
+    memcpy(out, view->data, view->length);
+    out[view->length] = '\0';
+}
@@ -0,0 +1,639 @@
+#include "xnet_addon_chat_log.h"
+
+chat_log_main_t chat_log = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+typedef struct chat_log_found {
+    chat_log_segment_t *segment;
+    size_t end;
+} chat_log_found_t ;
+
+static void *flusher_thread(void *arg);
+static void commit_stream(chat_log_stream_t *stream);
+static void finish_segment(chat_log_stream_t *stream, chat_log_segment_t *segment);
+static int name_segment(chat_log_stream_t *stream, chat_log_segment_t *segment);
+static void keep_segment(chat_log_stream_t *stream, unsigned long long first_seq);
+static bool segment_path(char *path, chat_log_stream_t *stream, unsigned long long first_seq, bool is_spare);
+static chat_log_segment_t *create_segment(chat_log_stream_t *stream, unsigned long long first_seq, bool is_spare);
+static chat_log_segment_t *map_segment(const char *path);
+static void release_segment(chat_log_segment_t *segment);
+static int replay_stream(chat_log_stream_t *stream, chat_log_replay_fn replay, void *arg);
+static size_t scan_segment(chat_log_segment_t *segment, unsigned long long *last_seq, chat_log_replay_fn replay, void *arg);
+static int compare_found(const void *lhs, const void *rhs);
+static uint32_t record_checksum(uint64_t seq, const void *data, size_t length);
+static size_t record_size(size_t length);
+
+int chat_log_open(const char *dir)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == dir) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (chat_log.is_open) {
+        return 0;
+    }
+
+    if (PATH_MAX <= strnlen(dir, PATH_MAX)) {
+        err = E_GEN_FAIL_STR_LENGTH;
+        goto handle_err;
+    }
+
+    if (0 != mkdir(dir, 0755) && EEXIST != errno) {
+        err = E_SRV_FAIL_LOG_IO;
+        goto handle_err;
+    }
+
+    strncpy(chat_log.dir, dir, PATH_MAX - 1);
+    chat_log.is_running = true;
+
+    /* The flusher may start before the server sets up its signalfd. Keep it from catching SIGINT and SIGQUIT. */
+    sigset_t all_signals;
+    sigset_t old_signals;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+    int try_create = pthread_create(&chat_log.flusher, NULL, flusher_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    if (0 != try_create) {
+        chat_log.is_running = false;
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    chat_log.is_open = true;
+    return 0;
+
+    /* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "chat_log_open()");
+    return err;
+}
+
+void chat_log_close(void)
+{
+    if (false == chat_log.is_open) {
+        return;
+    }
+
+    pthread_mutex_lock(&chat_log.lock);
+    chat_log.is_running = false;
+    pthread_cond_signal(&chat_log.wake);
+    pthread_mutex_unlock(&chat_log.lock);
+    pthread_join(chat_log.flusher, NULL);
+
+    /* Nobody appends anymore. One last commit and everything can go. */
+    chat_log_stream_t *stream = chat_log.streams;
+    while (NULL != stream) {
+        chat_log_stream_t *next = stream->next;
+        commit_stream(stream);
+        release_segment(stream->active);
+        release_segment(stream->spare);
+        pthread_mutex_destroy(&stream->lock);
+        nfree((void **)&stream);
+        stream = next;
+    }
+
+    chat_log.streams = NULL;
+    chat_log.is_open = false;
+}
+
+bool chat_log_is_open(void)
+{
+    return chat_log.is_open;
+}
+
+chat_log_stream_t *chat_log_stream(const char *name, chat_log_replay_fn replay, void *arg)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == name) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (false == chat_log.is_open) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    size_t name_length = strnlen(name, CHAT_LOG_NAME_MAX + 1);
+    if (0 == name_length || CHAT_LOG_NAME_MAX < name_length) {
+        err = E_GEN_FAIL_STR_LENGTH;
+        goto handle_err;
+    }
+
+    pthread_mutex_lock(&chat_log.lock);
+
+    /* Already open, hand back the same stream. */
+    for (chat_log_stream_t *current = chat_log.streams; NULL != current; current = current->next) {
+        if (0 == strncmp(current->name, name, CHAT_LOG_NAME_MAX)) {
+            pthread_mutex_unlock(&chat_log.lock);
+            return current;
+        }
+    }
+
+    chat_log_stream_t *stream = calloc(1, sizeof(chat_log_stream_t));
+    if (NULL == stream) {
+        pthread_mutex_unlock(&chat_log.lock);
+        err = E_GEN_FAIL_ALLOC;
+        goto handle_err;
+    }
+    memcpy(stream->name, name, name_length);
+    pthread_mutex_init(&stream->lock, NULL);
+
+    /* Names come from users. Hex keeps slashes and dots out of the path. */
+    int path_length = snprintf(stream->path, PATH_MAX, "%s/", chat_log.dir);
+    for (size_t n = 0; n < name_length && path_length + 3 < PATH_MAX; n++) {
+        path_length += snprintf(stream->path + path_length, PATH_MAX - path_length, "%02x", (unsigned char)name[n]);
+    }
+
+    err = replay_stream(stream, replay, arg);
+    if (0 != err) {
+        pthread_mutex_unlock(&chat_log.lock);
+        pthread_mutex_destroy(&stream->lock);
+        nfree((void **)&stream);
+        goto handle_err;
+    }
+
+    stream->next = chat_log.streams;
+    chat_log.streams = stream;
+
+    pthread_mutex_unlock(&chat_log.lock);
+
+    return stream;
+
+    /* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "chat_log_stream()");
+    return NULL;
+}
+
+unsigned long long chat_log_append(chat_log_stream_t *stream, unsigned long long seq, const void *data, size_t length)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == stream || NULL == data) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    size_t size = record_size(length);
+    if (CHAT_LOG_SEGMENT_SZ < size) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    pthread_mutex_lock(&stream->lock);
+
+    if (0 == seq) {
+        seq = stream->last_seq + 1;
+    }
+
+    if (seq <= stream->last_seq) {
+        pthread_mutex_unlock(&stream->lock);
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    /* Rotate. Normally the flusher has a spare ready and this is just a pointer swap. */
+    if (NULL == stream->active || CHAT_LOG_SEGMENT_SZ < stream->write_offset + size) {
+        chat_log_segment_t *next = stream->spare;
+        stream->spare = NULL;
+        if (NULL == next) {
+            next = create_segment(stream, seq, false);
+            if (NULL == next) {
+                pthread_mutex_unlock(&stream->lock);
+                err = E_SRV_FAIL_LOG_IO;
+                goto handle_err;
+            }
+        }
+        next->first_seq = seq;
+
+        if (NULL != stream->active) {
+            stream->active->next = stream->retired;
+            stream->retired = stream->active;
+        }
+        stream->active = next;
+        stream->write_offset = 0;
+    }
+
+    /* Payload first, header last. A torn record never has a valid checksum. */
+    chat_log_record_t *record = (chat_log_record_t *)(stream->active->map + stream->write_offset);
+    memcpy(record->data, data, length);
+    record->seq = seq;
+    record->checksum = record_checksum(seq, data, length);
+    record->length = length;
+
+    stream->write_offset += size;
+    stream->last_seq = seq;
+
+    pthread_mutex_unlock(&stream->lock);
+
+    return seq;
+
+    /* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "chat_log_append()");
+    return 0;
+}
+
+unsigned long long chat_log_durable_seq(chat_log_stream_t *stream)
+{
+    if (NULL == stream) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&stream->lock);
+    unsigned long long durable_seq = stream->durable_seq;
+    pthread_mutex_unlock(&stream->lock);
+
+    return durable_seq;
+}
+
+unsigned long long chat_log_last_seq(chat_log_stream_t *stream)
+{
+    if (NULL == stream) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&stream->lock);
+    unsigned long long last_seq = stream->last_seq;
+    pthread_mutex_unlock(&stream->lock);
+
+    return last_seq;
+}
+
+static void *flusher_thread(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&chat_log.lock);
+    while (chat_log.is_running) {
+        struct timespec deadline = {0};
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += CHAT_LOG_COMMIT_MS * 1000000L;
+        if (1000000000L <= deadline.tv_nsec) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&chat_log.wake, &chat_log.lock, &deadline);
+
+        /* Streams are never removed while the log is open, so the list can be walked without the lock. */
+        chat_log_stream_t *stream = chat_log.streams;
+        pthread_mutex_unlock(&chat_log.lock);
+
+        for (; NULL != stream; stream = stream->next) {
+            commit_stream(stream);
+        }
+
+        pthread_mutex_lock(&chat_log.lock);
+    }
+    pthread_mutex_unlock(&chat_log.lock);
+
+    return NULL;
+}
+
+static void commit_stream(chat_log_stream_t *stream)
+{
+    /* Everything appended up to here gets committed in one go. */
+    pthread_mutex_lock(&stream->lock);
+    chat_log_segment_t *active = stream->active;
+    size_t end = stream->write_offset;
+    unsigned long long last_seq = stream->last_seq;
+    chat_log_segment_t *retired = stream->retired;
+    stream->retired = NULL;
+    bool needs_spare = (NULL == stream->spare);
+    pthread_mutex_unlock(&stream->lock);
+
+    /* Only this thread unmaps segments, so they stay valid after the lock is dropped. */
+    bool is_durable = true;
+    while (NULL != retired) {
+        chat_log_segment_t *next = retired->next;
+        if (0 != msync(retired->map, CHAT_LOG_SEGMENT_SZ, MS_SYNC)) {
+            is_durable = false;
+        }
+        finish_segment(stream, retired);
+        retired = next;
+    }
+
+    if (NULL != active) {
+        if (false == active->is_named) {
+            name_segment(stream, active);
+        }
+
+        if (end > active->synced) {
+            /* msync() wants a page aligned start. */
+            size_t page = sysconf(_SC_PAGESIZE);
+            size_t start = active->synced & ~(page - 1);
+            if (0 == msync(active->map + start, end - start, MS_SYNC)) {
+                active->synced = end;
+            } else {
+                is_durable = false;
+            }
+        }
+    }
+
+    if (is_durable) {
+        pthread_mutex_lock(&stream->lock);
+        if (last_seq > stream->durable_seq) {
+            stream->durable_seq = last_seq;
+        }
+        pthread_mutex_unlock(&stream->lock);
+    } else {
+        g_show_err(E_SRV_FAIL_LOG_IO, "commit_stream()");
+    }
+
+    /* Keep a spare around so the next rotation stays off the filesystem. */
+    if (needs_spare && chat_log.is_running) {
+        chat_log_segment_t *spare = create_segment(stream, 0, true);
+        if (NULL != spare) {
+            pthread_mutex_lock(&stream->lock);
+            stream->spare = spare;
+            pthread_mutex_unlock(&stream->lock);
+        }
+    }
+}
+
+static void finish_segment(chat_log_stream_t *stream, chat_log_segment_t *segment)
+{
+    if (false == segment->is_named) {
+        name_segment(stream, segment);
+    }
+
+    keep_segment(stream, segment->first_seq);
+    release_segment(segment);
+}
+
+static void keep_segment(chat_log_stream_t *stream, unsigned long long first_seq)
+{
+    /* Oldest segment goes once there are too many. */
+    if (CHAT_LOG_KEEP_SEGMENTS == stream->kept_count) {
+        char path[PATH_MAX];
+        if (segment_path(path, stream, stream->kept[0], false)) {
+            unlink(path);
+        }
+        memmove(stream->kept, stream->kept + 1, (CHAT_LOG_KEEP_SEGMENTS - 1) * sizeof(unsigned long long));
+        stream->kept_count--;
+    }
+    stream->kept[stream->kept_count++] = first_seq;
+}
+
+static int name_segment(chat_log_stream_t *stream, chat_log_segment_t *segment)
+{
+    char from[PATH_MAX];
+    char to[PATH_MAX];
+    if (false == segment_path(from, stream, 0, true) || false == segment_path(to, stream, segment->first_seq, false) ||
+        0 != rename(from, to)) {
+        g_show_err(E_SRV_FAIL_LOG_IO, "name_segment()");
+        return E_SRV_FAIL_LOG_IO;
+    }
+
+    segment->is_named = true;
+    return 0;
+}
+
+static bool segment_path(char *path, chat_log_stream_t *stream, unsigned long long first_seq, bool is_spare)
+{
+    int path_length = 0;
+    if (is_spare) {
+        path_length = snprintf(path, PATH_MAX, "%s/" CHAT_LOG_SPARE_NAME, stream->path);
+    } else {
+        path_length = snprintf(path, PATH_MAX, "%s/%020llu.log", stream->path, first_seq);
+    }
+
+    return PATH_MAX > path_length;
+}
+
+static chat_log_segment_t *create_segment(chat_log_stream_t *stream, unsigned long long first_seq, bool is_spare)
+{
+    char path[PATH_MAX];
+    if (false == segment_path(path, stream, first_seq, is_spare)) {
+        return NULL;
+    }
+
+    chat_log_segment_t *segment = map_segment(path);
+    if (NULL == segment) {
+        return NULL;
+    }
+
+    segment->first_seq = first_seq;
+    segment->is_named = !is_spare;
+    return segment;
+}
+
+static chat_log_segment_t *map_segment(const char *path)
+{
+    int err = 0;
+
+    chat_log_segment_t *segment = calloc(1, sizeof(chat_log_segment_t));
+    if (NULL == segment) {
+        err = E_GEN_FAIL_ALLOC;
+        goto handle_err;
+    }
+
+    /* Segments always span the full size. Unwritten space reads back as zeroes, which ends the data. */
+    segment->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (-1 == segment->fd) {
+        nfree((void **)&segment);
+        err = E_SRV_FAIL_LOG_IO;
+        goto handle_err;
+    }
+
+    if (0 != ftruncate(segment->fd, CHAT_LOG_SEGMENT_SZ)) {
+        close(segment->fd);
+        nfree((void **)&segment);
+        err = E_SRV_FAIL_LOG_IO;
+        goto handle_err;
+    }
+
+    segment->map = mmap(NULL, CHAT_LOG_SEGMENT_SZ, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+    if (MAP_FAILED == segment->map) {
+        close(segment->fd);
+        nfree((void **)&segment);
+        err = E_SRV_FAIL_LOG_IO;
+        goto handle_err;
+    }
+
+    return segment;
+
+    /* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "map_segment()");
+    return NULL;
+}
+
+static void release_segment(chat_log_segment_t *segment)
+{
+    if (NULL == segment) {
+        return;
+    }
+
+    munmap(segment->map, CHAT_LOG_SEGMENT_SZ);
+    close(segment->fd);
+    nfree((void **)&segment);
+}
+
+static int replay_stream(chat_log_stream_t *stream, chat_log_replay_fn replay, void *arg)
+{
+    int err = 0;
+
+    if (0 != mkdir(stream->path, 0755) && EEXIST != errno) {
+        err = E_SRV_FAIL_LOG_IO;
+        goto handle_err;
+    }
+
+    DIR *dir = opendir(stream->path);
+    if (NULL == dir) {
+        err = E_SRV_FAIL_LOG_IO;
+        goto handle_err;
+    }
+
+    /* Map every segment and order them by their first record. A spare may hold data if we died mid rotation. */
+    chat_log_found_t *found = NULL;
+    size_t found_count = 0;
+    size_t found_capacity = 0;
+    struct dirent *entry = NULL;
+    while (NULL != (entry = readdir(dir))) {
+        size_t entry_length = strnlen(entry->d_name, NAME_MAX);
+        bool is_segment = (4 < entry_length && 0 == strcmp(entry->d_name + entry_length - 4, ".log"));
+        bool is_spare = (0 == strcmp(entry->d_name, CHAT_LOG_SPARE_NAME));
+        if (false == is_segment && false == is_spare) {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        if (PATH_MAX <= snprintf(path, PATH_MAX, "%s/%s", stream->path, entry->d_name)) {
+            continue;
+        }
+
+        chat_log_segment_t *segment = map_segment(path);
+        if (NULL == segment) {
+            continue;
+        }
+        segment->is_named = is_segment;
+
+        chat_log_record_t *first = (chat_log_record_t *)segment->map;
+        if (0 == first->length || first->checksum != record_checksum(first->seq, first->data, first->length)) {
+            /* Nothing in it. The flusher makes a fresh spare. */
+            release_segment(segment);
+            unlink(path);
+            continue;
+        }
+        segment->first_seq = first->seq;
+
+        if (found_count == found_capacity) {
+            size_t new_capacity = (0 == found_capacity) ? CHAT_LOG_KEEP_SEGMENTS : found_capacity * 2;
+            chat_log_found_t *new_found = realloc(found, new_capacity * sizeof(chat_log_found_t));
+            if (NULL == new_found) {
+                release_segment(segment);
+                break;
+            }
+            found = new_found;
+            found_capacity = new_capacity;
+        }
+        found[found_count].segment = segment;
+        found[found_count].end = 0;
+        found_count++;
+    }
+    closedir(dir);
+
+    qsort(found, found_count, sizeof(chat_log_found_t), compare_found);
+
+    for (size_t n = 0; n < found_count; n++) {
+        chat_log_segment_t *segment = found[n].segment;
+        found[n].end = scan_segment(segment, &stream->last_seq, replay, arg);
+
+        if (false == segment->is_named) {
+            name_segment(stream, segment);
+        }
+
+        /* Everything but the newest segment is closed. */
+        if (n + 1 < found_count) {
+            keep_segment(stream, segment->first_seq);
+            release_segment(segment);
+        }
+    }
+
+    /*
+    Keep appending to the newest segment. Anything a crash left past its last good record is simply overwritten,
+    its checksums won't match if it is ever read again.
+    */
+    if (0 < found_count) {
+        stream->active = found[found_count - 1].segment;
+        stream->write_offset = found[found_count - 1].end;
+        stream->active->synced = stream->write_offset;
+    }
+
+    stream->durable_seq = stream->last_seq;
+    nfree((void **)&found);
+
+    return 0;
+
+    /* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "replay_stream()");
+    return err;
+}
+
+static size_t scan_segment(chat_log_segment_t *segment, unsigned long long *last_seq, chat_log_replay_fn replay, void *arg)
+{
+    size_t offset = 0;
+    while (offset + sizeof(chat_log_record_t) <= CHAT_LOG_SEGMENT_SZ) {
+        chat_log_record_t *record = (chat_log_record_t *)(segment->map + offset);
+        size_t size = record_size(record->length);
+
+        /* End of data, a torn write, or something out of order. Nothing past it is trusted. */
+        if (0 == record->length || CHAT_LOG_SEGMENT_SZ < offset + size) {
+            break;
+        }
+        if (record->checksum != record_checksum(record->seq, record->data, record->length) || record->seq <= *last_seq) {
+            break;
+        }
+
+        if (NULL != replay) {
+            replay(record->seq, record->data, record->length, arg);
+        }
+        *last_seq = record->seq;
+        offset += size;
+    }
+
+    return offset;
+}
+
+static int compare_found(const void *lhs, const void *rhs)
+{
+    unsigned long long left = ((const chat_log_found_t *)lhs)->segment->first_seq;
+    unsigned long long right = ((const chat_log_found_t *)rhs)->segment->first_seq;
+    return (left > right) - (left < right);
+}
+
+static uint32_t record_checksum(uint64_t seq, const void *data, size_t length)
+{
+    /* FNV-1a over the sequence number and payload. */
+    uint32_t hash = 2166136261U;
+    const unsigned char *bytes = (const unsigned char *)&seq;
+    for (size_t n = 0; n < sizeof(seq); n++) {
+        hash ^= bytes[n];
+        hash *= 16777619U;
+    }
+
+    bytes = data;
+    for (size_t n = 0; n < length; n++) {
+        hash ^= bytes[n];
+        hash *= 16777619U;
+    }
+
+    /* Zero is reserved for empty space. */
+    return (0 == hash) ? 1 : hash;
+}
+
+static size_t record_size(size_t length)
+{
+    /* Keep every header 8 byte aligned. */
+    return (sizeof(chat_log_record_t) + length + 7) & ~(size_t)7;
+}
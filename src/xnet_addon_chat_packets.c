@@ -0,0 +1,706 @@
+#include "xnet_addon_chat_packets.h"
+
+/* Generated by tools/packetgen.py. Do not edit, run 'make packets'. */
+
+/* The client was generated with these values. Fails to compile if XNet disagrees. */
+typedef char chat_check_xnet_max_username_len[(XNET_MAX_USERNAME_LEN == 32) ? 1 : -1];
+typedef char chat_check_xnet_max_passwd_len[(XNET_MAX_PASSWD_LEN == 32) ? 1 : -1];
+typedef char chat_check_xnet_token_len[(XNET_TOKEN_LEN == 16) ? 1 : -1];
+
+/* Inline, so schemas that don't need every helper compile without warnings. */
+static inline uint16_t get_be16(const char *src)
+{
+    uint16_t value = 0;
+    memcpy(&value, src, sizeof(value));
+    return ntohs(value);
+}
+
+static inline uint32_t get_be32(const char *src)
+{
+    uint32_t value = 0;
+    memcpy(&value, src, sizeof(value));
+    return ntohl(value);
+}
+
+static inline uint64_t get_be64(const char *src)
+{
+    uint64_t value = 0;
+    memcpy(&value, src, sizeof(value));
+    return be64toh(value);
+}
+
+static inline void put_be16(char *dst, uint16_t value)
+{
+    value = htons(value);
+    memcpy(dst, &value, sizeof(value));
+}
+
+static inline void put_be32(char *dst, uint32_t value)
+{
+    value = htonl(value);
+    memcpy(dst, &value, sizeof(value));
+}
+
+static inline void put_be64(char *dst, uint64_t value)
+{
+    value = htobe64(value);
+    memcpy(dst, &value, sizeof(value));
+}
+
+/* Views longer than their field are cut short. Empty views may have no data at all. */
+static inline size_t clamp_view(const chat_view_t *view, size_t max_length)
+{
+    if (NULL == view->data) {
+        return 0;
+    }
+    return (max_length < view->length) ? max_length : view->length;
+}
+
+static inline void put_padded(char *dst, const chat_view_t *view, size_t size)
+{
+    size_t length = clamp_view(view, size);
+    if (0 < length) {
+        memcpy(dst, view->data, length);
+    }
+    memset(dst + length, 0, size - length);
+}
+
+static inline int read_exact(xnet_active_connection_t *conn, char *dst, size_t length)
+{
+    while (0 < length) {
+        ssize_t bytes_read = xnet_conn_read(conn, dst, length);
+        if (-1 == bytes_read && EINTR == errno) {
+            continue;
+        }
+        if (0 >= bytes_read) {
+            return E_GEN_OUT_RANGE;
+        }
+        dst += bytes_read;
+        length -= bytes_read;
+    }
+    return 0;
+}
+
+int chat_login_parse_request(const char *buf, size_t length, chat_login_request_t *out)
+{
+    size_t offset = 0;
+
+    /* username */
+    if (4 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    int32_t username_length = (int32_t)get_be32(buf + offset);
+    offset += 4;
+    if (0 > username_length || XNET_MAX_USERNAME_LEN < username_length || (size_t)username_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->username.data = buf + offset;
+    out->username.length = username_length;
+    offset += username_length;
+
+    /* password */
+    if (4 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    int32_t password_length = (int32_t)get_be32(buf + offset);
+    offset += 4;
+    if (0 > password_length || XNET_MAX_PASSWD_LEN < password_length || (size_t)password_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->password.data = buf + offset;
+    out->password.length = password_length;
+    offset += password_length;
+
+    return 0;
+}
+
+int chat_login_recv_request(xnet_active_connection_t *conn, char *scratch, chat_login_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return chat_login_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* username */
+    if (0 != read_exact(conn, scratch + offset, 4)) {
+        return E_GEN_OUT_RANGE;
+    }
+    int32_t username_length = (int32_t)get_be32(scratch + offset);
+    offset += 4;
+    if (0 > username_length || XNET_MAX_USERNAME_LEN < username_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, username_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += username_length;
+
+    /* password */
+    if (0 != read_exact(conn, scratch + offset, 4)) {
+        return E_GEN_OUT_RANGE;
+    }
+    int32_t password_length = (int32_t)get_be32(scratch + offset);
+    offset += 4;
+    if (0 > password_length || XNET_MAX_PASSWD_LEN < password_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, password_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += password_length;
+
+    return chat_login_parse_request(scratch, offset, out);
+}
+
+size_t chat_login_write_reply(char *out, const chat_login_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, CHAT_LOGIN_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    /* token */
+    put_padded(out + offset, &in->token, XNET_TOKEN_LEN);
+    offset += XNET_TOKEN_LEN;
+
+    return offset;
+}
+
+int chat_whisper_parse_request(const char *buf, size_t length, chat_whisper_request_t *out)
+{
+    size_t offset = 0;
+
+    /* to_username */
+    if (4 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    int32_t to_username_length = (int32_t)get_be32(buf + offset);
+    offset += 4;
+    if (0 > to_username_length || XNET_MAX_USERNAME_LEN < to_username_length || (size_t)to_username_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->to_username.data = buf + offset;
+    out->to_username.length = to_username_length;
+    offset += to_username_length;
+
+    /* msg */
+    if (4 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    int32_t msg_length = (int32_t)get_be32(buf + offset);
+    offset += 4;
+    if (0 > msg_length || MAX_MESSAGE_LENGTH < msg_length || (size_t)msg_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->msg.data = buf + offset;
+    out->msg.length = msg_length;
+    offset += msg_length;
+
+    return 0;
+}
+
+int chat_whisper_recv_request(xnet_active_connection_t *conn, char *scratch, chat_whisper_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return chat_whisper_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* to_username */
+    if (0 != read_exact(conn, scratch + offset, 4)) {
+        return E_GEN_OUT_RANGE;
+    }
+    int32_t to_username_length = (int32_t)get_be32(scratch + offset);
+    offset += 4;
+    if (0 > to_username_length || XNET_MAX_USERNAME_LEN < to_username_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, to_username_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += to_username_length;
+
+    /* msg */
+    if (0 != read_exact(conn, scratch + offset, 4)) {
+        return E_GEN_OUT_RANGE;
+    }
+    int32_t msg_length = (int32_t)get_be32(scratch + offset);
+    offset += 4;
+    if (0 > msg_length || MAX_MESSAGE_LENGTH < msg_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, msg_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += msg_length;
+
+    return chat_whisper_parse_request(scratch, offset, out);
+}
+
+size_t chat_whisper_write_reply(char *out, const chat_whisper_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, CHAT_WHISPER_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    return offset;
+}
+
+int chat_join_parse_request(const char *buf, size_t length, chat_join_request_t *out)
+{
+    size_t offset = 0;
+
+    /* room_name */
+    if (4 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    int32_t room_name_length = (int32_t)get_be32(buf + offset);
+    offset += 4;
+    if (0 > room_name_length || MAX_ROOM_NAME_LEN < room_name_length || (size_t)room_name_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->room_name.data = buf + offset;
+    out->room_name.length = room_name_length;
+    offset += room_name_length;
+
+    return 0;
+}
+
+int chat_join_recv_request(xnet_active_connection_t *conn, char *scratch, chat_join_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return chat_join_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* room_name */
+    if (0 != read_exact(conn, scratch + offset, 4)) {
+        return E_GEN_OUT_RANGE;
+    }
+    int32_t room_name_length = (int32_t)get_be32(scratch + offset);
+    offset += 4;
+    if (0 > room_name_length || MAX_ROOM_NAME_LEN < room_name_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, room_name_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += room_name_length;
+
+    return chat_join_parse_request(scratch, offset, out);
+}
+
+size_t chat_join_write_reply(char *out, const chat_join_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, CHAT_JOIN_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    return offset;
+}
+
+int chat_shout_parse_request(const char *buf, size_t length, chat_shout_request_t *out)
+{
+    size_t offset = 0;
+
+    /* msg */
+    if (4 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    int32_t msg_length = (int32_t)get_be32(buf + offset);
+    offset += 4;
+    if (0 > msg_length || MAX_MESSAGE_LENGTH < msg_length || (size_t)msg_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->msg.data = buf + offset;
+    out->msg.length = msg_length;
+    offset += msg_length;
+
+    return 0;
+}
+
+int chat_shout_recv_request(xnet_active_connection_t *conn, char *scratch, chat_shout_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return chat_shout_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* msg */
+    if (0 != read_exact(conn, scratch + offset, 4)) {
+        return E_GEN_OUT_RANGE;
+    }
+    int32_t msg_length = (int32_t)get_be32(scratch + offset);
+    offset += 4;
+    if (0 > msg_length || MAX_MESSAGE_LENGTH < msg_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, msg_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += msg_length;
+
+    return chat_shout_parse_request(scratch, offset, out);
+}
+
+size_t chat_shout_write_reply(char *out, const chat_shout_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, CHAT_SHOUT_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    return offset;
+}
+
+int chat_resume_parse_request(const char *buf, size_t length, chat_resume_request_t *out)
+{
+    size_t offset = 0;
+
+    /* token */
+    if (XNET_TOKEN_LEN > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->token.data = buf + offset;
+    out->token.length = XNET_TOKEN_LEN;
+    offset += XNET_TOKEN_LEN;
+
+    return 0;
+}
+
+int chat_resume_recv_request(xnet_active_connection_t *conn, char *scratch, chat_resume_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return chat_resume_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* token */
+    if (0 != read_exact(conn, scratch + offset, XNET_TOKEN_LEN)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += XNET_TOKEN_LEN;
+
+    return chat_resume_parse_request(scratch, offset, out);
+}
+
+size_t chat_resume_write_reply(char *out, const chat_resume_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, CHAT_RESUME_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    /* token */
+    put_padded(out + offset, &in->token, XNET_TOKEN_LEN);
+    offset += XNET_TOKEN_LEN;
+
+    /* room_name */
+    size_t room_name_length = clamp_view(&in->room_name, MAX_ROOM_NAME_LEN);
+    put_be32(out + offset, (uint32_t)room_name_length);
+    offset += 4;
+    put_padded(out + offset, &in->room_name, MAX_ROOM_NAME_LEN);
+    offset += MAX_ROOM_NAME_LEN;
+
+    return offset;
+}
+
+int chat_room_parse_request(const char *buf, size_t length, chat_room_request_t *out)
+{
+    size_t offset = 0;
+
+    /* action */
+    if (4 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->action = (int32_t)get_be32(buf + offset);
+    offset += 4;
+    if (1 != out->action && 2 != out->action) {
+        return E_GEN_OUT_RANGE;
+    }
+
+    /* room_name */
+    if (4 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    int32_t room_name_length = (int32_t)get_be32(buf + offset);
+    offset += 4;
+    if (0 > room_name_length || MAX_ROOM_NAME_LEN < room_name_length || (size_t)room_name_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->room_name.data = buf + offset;
+    out->room_name.length = room_name_length;
+    offset += room_name_length;
+
+    return 0;
+}
+
+int chat_room_recv_request(xnet_active_connection_t *conn, char *scratch, chat_room_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return chat_room_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* action */
+    if (0 != read_exact(conn, scratch + offset, 4)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 4;
+
+    /* room_name */
+    if (0 != read_exact(conn, scratch + offset, 4)) {
+        return E_GEN_OUT_RANGE;
+    }
+    int32_t room_name_length = (int32_t)get_be32(scratch + offset);
+    offset += 4;
+    if (0 > room_name_length || MAX_ROOM_NAME_LEN < room_name_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, room_name_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += room_name_length;
+
+    return chat_room_parse_request(scratch, offset, out);
+}
+
+size_t chat_room_write_reply(char *out, const chat_room_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, CHAT_ROOM_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    return offset;
+}
+
+int chat_history_parse_request(const char *buf, size_t length, chat_history_request_t *out)
+{
+    size_t offset = 0;
+
+    /* since_seq */
+    if (8 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->since_seq = (uint64_t)get_be64(buf + offset);
+    offset += 8;
+
+    return 0;
+}
+
+int chat_history_recv_request(xnet_active_connection_t *conn, char *scratch, chat_history_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return chat_history_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* since_seq */
+    if (0 != read_exact(conn, scratch + offset, 8)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 8;
+
+    return chat_history_parse_request(scratch, offset, out);
+}
+
+size_t chat_history_write_reply(char *out, const chat_history_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, CHAT_HISTORY_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    /* last_seq */
+    put_be64(out + offset, (uint64_t)in->last_seq);
+    offset += 8;
+
+    /* durable_seq */
+    put_be64(out + offset, (uint64_t)in->durable_seq);
+    offset += 8;
+
+    /* entry_count */
+    put_be32(out + offset, (uint32_t)in->entry_count);
+    offset += 4;
+
+    return offset;
+}
+
+int chat_protocol_parse_request(const char *buf, size_t length, chat_protocol_request_t *out)
+{
+    size_t offset = 0;
+
+    /* wire_format */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->wire_format = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+    if (0 != out->wire_format && 1 != out->wire_format) {
+        return E_GEN_OUT_RANGE;
+    }
+
+    return 0;
+}
+
+int chat_protocol_recv_request(xnet_active_connection_t *conn, char *scratch, chat_protocol_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return chat_protocol_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* wire_format */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 2;
+
+    return chat_protocol_parse_request(scratch, offset, out);
+}
+
+size_t chat_protocol_write_reply(char *out, const chat_protocol_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, CHAT_PROTOCOL_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    /* wire_format */
+    put_be16(out + offset, (uint16_t)in->wire_format);
+    offset += 2;
+
+    return offset;
+}
+
+int chat_caps_parse_request(const char *buf, size_t length, chat_caps_request_t *out)
+{
+    size_t offset = 0;
+
+    /* offered */
+    if (4 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->offered = (uint32_t)get_be32(buf + offset);
+    offset += 4;
+
+    return 0;
+}
+
+int chat_caps_recv_request(xnet_active_connection_t *conn, char *scratch, chat_caps_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return chat_caps_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* offered */
+    if (0 != read_exact(conn, scratch + offset, 4)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 4;
+
+    return chat_caps_parse_request(scratch, offset, out);
+}
+
+size_t chat_caps_write_reply(char *out, const chat_caps_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, CHAT_CAPS_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    /* codec */
+    put_be16(out + offset, (uint16_t)in->codec);
+    offset += 2;
+
+    /* supported */
+    put_be32(out + offset, (uint32_t)in->supported);
+    offset += 4;
+
+    return offset;
+}
@@ -1,17 +1,934 @@
-/* 
-Contains all necessary structs and functions related to adding ftp server capabilities to a xnet server.
-
-addon identifier:
-    #define XNET_FTP_ID 200
-
-enum values:
-    create file: 201
-    make directory: 202
-    search directory: 203
-    get file: 204
-    put file: 205
-    delete file: 206
-
-sdf
-*/
-typedef int make_iso_compilers_happy;
\ No newline at end of file
+#include "xnet_addon_ftp.h"
+
+ftp_main_t ftp_base = { .root_fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* Match packets queued for one search, sent a batch at a time. */
+typedef struct ftp_search_batch {
+    xnet_box_t *xnet;
+    xnet_active_connection_t *client;
+    size_t length;
+    char out[FTP_SEARCH_BATCH * FTP_MATCH_REPLY_MAX_SZ + FTP_SEARCH_END_REPLY_MAX_SZ];
+} ftp_search_batch_t ;
+
+static bool is_logged_in(xnet_active_connection_t *client);
+static bool may_write(xnet_active_connection_t *client);
+static bool view_to_path(char *out, const ftp_view_t *view);
+static int errno_to_return_code(int error);
+static void send_match(const ftp_index_entry_t *entry, void *arg);
+static void finish_put(xnet_box_t *xnet, xnet_active_connection_t *client, int status, void *arg);
+static ftp_upload_t *find_upload_locked(const char *path);
+static int begin_upload(const char *path, bool is_commit);
+static void end_upload(const char *path);
+static int commit_part(const char *path, const char *part_path, uint64_t size);
+static int checksum_range(const xnet_active_connection_t *client, int fd, uint16_t algorithm, uint64_t offset, uint64_t length,
+                          uint64_t *digest);
+static int open_part_file(ftp_put_t *put);
+
+int xnet_integrate_ftp_addon(xnet_box_t *xnet, const char *root, const char *index_cache)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == root) {
+        root = FTP_ROOT_DEFAULT;
+    }
+
+    /* Served directory is opened once. Every path is resolved relative to it. */
+    if (0 != mkdir(root, 0755) && EEXIST != errno) {
+        err = E_SRV_FAIL_FILE_IO;
+        goto handle_err;
+    }
+
+    ftp_base.root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (-1 == ftp_base.root_fd) {
+        err = E_SRV_FAIL_FILE_IO;
+        goto handle_err;
+    }
+
+    /* Searches are answered from the index, so it has to be complete before any client gets in. */
+    err = ftp_index_open(ftp_base.root_fd, root, index_cache);
+    if (0 != err) {
+        goto handle_err;
+    }
+
+    xnet_insert_feature(xnet, FTP_CREATE_OP, XNET_PRIORITY_NORMAL, ftp_perform_create_file);
+    xnet_insert_feature(xnet, FTP_MKDIR_OP, XNET_PRIORITY_NORMAL, ftp_perform_mkdir);
+    xnet_insert_feature(xnet, FTP_SEARCH_OP, XNET_PRIORITY_LOW, ftp_perform_search);
+    xnet_insert_feature(xnet, FTP_GET_OP, XNET_PRIORITY_LOW, ftp_perform_get);
+    xnet_insert_feature(xnet, FTP_PUT_OP, XNET_PRIORITY_LOW, ftp_perform_put);
+    xnet_insert_feature(xnet, FTP_DELETE_OP, XNET_PRIORITY_NORMAL, ftp_perform_delete);
+    xnet_insert_feature(xnet, FTP_STATUS_OP, XNET_PRIORITY_NORMAL, ftp_perform_status);
+    xnet_insert_feature(xnet, FTP_COMMIT_OP, XNET_PRIORITY_NORMAL, ftp_perform_commit);
+    xnet_insert_feature(xnet, FTP_CHECKSUM_OP, XNET_PRIORITY_LOW, ftp_perform_checksum);
+    return 0;
+
+    /* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_integrate_ftp_addon()");
+    return err;
+}
+
+void ftp_close_root(void)
+{
+    ftp_index_close();
+
+    if (-1 != ftp_base.root_fd) {
+        close(ftp_base.root_fd);
+        ftp_base.root_fd = -1;
+    }
+
+    pthread_mutex_lock(&ftp_base.lock);
+    while (NULL != ftp_base.uploads) {
+        ftp_upload_t *next = ftp_base.uploads->next;
+        nfree((void **)&ftp_base.uploads);
+        ftp_base.uploads = next;
+    }
+    pthread_mutex_unlock(&ftp_base.lock);
+}
+
+int ftp_perform_create_file(xnet_box_t *xnet, xnet_active_connection_t *client)
+{
+    int return_code = FTP_RC_SUCCESS;
+
+    printf("Socket [%d] is performing 'ftp_perform_create_file()'\n", client->socket);
+
+    char scratch[FTP_CREATE_REQUEST_MAX_SZ];
+    ftp_create_request_t request = {0};
+    ftp_create_reply_t reply = {0};
+    char path[FTP_MAX_PATH_LEN + 1] = {0};
+
+    if (0 != ftp_create_recv_request(client, scratch, &request) || false == view_to_path(path, &request.path)) {
+        return_code = FTP_RC_BAD_PATH;
+        goto return_packet;
+    }
+
+    if (false == may_write(client)) {
+        return_code = FTP_RC_DENIED;
+        goto return_packet;
+    }
+
+    int fd = openat(ftp_base.root_fd, path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644);
+    if (-1 == fd) {
+        return_code = errno_to_return_code(errno);
+        goto return_packet;
+    }
+    close(fd);
+
+/* Send feedback to client. */
+return_packet:
+    reply.return_code = return_code;
+    char out[FTP_CREATE_REPLY_MAX_SZ];
+    xnet_send(xnet, client, out, ftp_create_write_reply(out, &reply));
+
+    printf("Socket [%d] finished performing 'ftp_perform_create_file()' with code [%d]\n", client->socket, return_code);
+    return 0;
+}
+
+int ftp_perform_mkdir(xnet_box_t *xnet, xnet_active_connection_t *client)
+{
+    int return_code = FTP_RC_SUCCESS;
+
+    printf("Socket [%d] is performing 'ftp_perform_mkdir()'\n", client->socket);
+
+    char scratch[FTP_MKDIR_REQUEST_MAX_SZ];
+    ftp_mkdir_request_t request = {0};
+    ftp_mkdir_reply_t reply = {0};
+    char path[FTP_MAX_PATH_LEN + 1] = {0};
+
+    if (0 != ftp_mkdir_recv_request(client, scratch, &request) || false == view_to_path(path, &request.path)) {
+        return_code = FTP_RC_BAD_PATH;
+        goto return_packet;
+    }
+
+    if (false == may_write(client)) {
+        return_code = FTP_RC_DENIED;
+        goto return_packet;
+    }
+
+    if (0 != mkdirat(ftp_base.root_fd, path, 0755)) {
+        return_code = errno_to_return_code(errno);
+        goto return_packet;
+    }
+
+/* Send feedback to client. */
+return_packet:
+    reply.return_code = return_code;
+    char out[FTP_MKDIR_REPLY_MAX_SZ];
+    xnet_send(xnet, client, out, ftp_mkdir_write_reply(out, &reply));
+
+    printf("Socket [%d] finished performing 'ftp_perform_mkdir()' with code [%d]\n", client->socket, return_code);
+    return 0;
+}
+
+int ftp_perform_search(xnet_box_t *xnet, xnet_active_connection_t *client)
+{
+    int return_code = FTP_RC_SUCCESS;
+
+    printf("Socket [%d] is performing 'ftp_perform_search()'\n", client->socket);
+
+    char scratch[FTP_SEARCH_REQUEST_MAX_SZ];
+    ftp_search_request_t request = {0};
+    ftp_search_reply_t reply = {0};
+    ftp_search_end_reply_t end = {0};
+    ftp_search_batch_t *batch = NULL;
+    char pattern[FTP_MAX_PATH_LEN + 1] = {0};
+    char after[FTP_MAX_PATH_LEN + 1] = {0};
+
+    if (0 != ftp_search_recv_request(client, scratch, &request) || NULL != memchr(request.pattern.data, '\0', request.pattern.length) ||
+        NULL != memchr(request.after.data, '\0', request.after.length)) {
+        return_code = FTP_RC_BAD_PATH;
+        goto return_packet;
+    }
+    memcpy(pattern, request.pattern.data, request.pattern.length);
+    memcpy(after, request.after.data, request.after.length);
+
+    if (false == is_logged_in(client)) {
+        return_code = FTP_RC_DENIED;
+        goto return_packet;
+    }
+
+    if (FTP_MAX_SEARCH_RESULTS < request.limit) {
+        return_code = FTP_RC_BAD_RANGE;
+        goto return_packet;
+    }
+
+    batch = malloc(sizeof(ftp_search_batch_t));
+    if (NULL == batch) {
+        return_code = FTP_RC_IO;
+        goto return_packet;
+    }
+
+/* Send feedback to client. Matches follow it as the index hands them out. */
+return_packet:
+    reply.return_code = return_code;
+    char out[FTP_SEARCH_REPLY_MAX_SZ];
+    xnet_send(xnet, client, out, ftp_search_write_reply(out, &reply));
+
+    if (FTP_RC_SUCCESS == return_code) {
+        ftp_index_query_t query = {
+            .pattern = pattern,
+            .mode = request.mode,
+            .after = after,
+            .limit = (0 == request.limit) ? FTP_MAX_SEARCH_RESULTS : request.limit,
+        };
+        bool has_more = false;
+
+        batch->xnet = xnet;
+        batch->client = client;
+        batch->length = 0;
+        end.match_count = ftp_index_search(&query, send_match, batch, &has_more);
+        end.page = has_more ? FTP_SEARCH_END_MORE : FTP_SEARCH_END_LAST;
+
+        batch->length += ftp_search_end_write_reply(batch->out + batch->length, &end);
+        xnet_send(xnet, client, batch->out, batch->length);
+    }
+    nfree((void **)&batch);
+
+    printf("Socket [%d] finished performing 'ftp_perform_search()' with code [%d]\n", client->socket, return_code);
+    return 0;
+}
+
+int ftp_perform_get(xnet_box_t *xnet, xnet_active_connection_t *client)
+{
+    int return_code = FTP_RC_SUCCESS;
+
+    printf("Socket [%d] is performing 'ftp_perform_get()'\n", client->socket);
+
+    char scratch[FTP_GET_REQUEST_MAX_SZ];
+    ftp_get_request_t request = {0};
+    ftp_get_reply_t reply = {0};
+    char path[FTP_MAX_PATH_LEN + 1] = {0};
+    int fd = -1;
+
+    if (0 != ftp_get_recv_request(client, scratch, &request) || false == view_to_path(path, &request.path)) {
+        return_code = FTP_RC_BAD_PATH;
+        goto return_packet;
+    }
+
+    if (false == is_logged_in(client)) {
+        return_code = FTP_RC_DENIED;
+        goto return_packet;
+    }
+
+    fd = openat(ftp_base.root_fd, path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (-1 == fd) {
+        return_code = errno_to_return_code(errno);
+        goto return_packet;
+    }
+
+    /* Size is fixed here. A file that shrinks before it is sent costs the client its connection. */
+    struct stat info = {0};
+    if (0 != fstat(fd, &info) || false == S_ISREG(info.st_mode)) {
+        close(fd);
+        fd = -1;
+        return_code = FTP_RC_NOT_FOUND;
+        goto return_packet;
+    }
+    reply.size = info.st_size;
+
+    /* A length of 0 asks for the rest of the file. */
+    uint64_t length = (0 == request.length && request.offset <= reply.size) ? reply.size - request.offset : request.length;
+    if (request.offset > reply.size || length > reply.size - request.offset) {
+        close(fd);
+        fd = -1;
+        return_code = FTP_RC_BAD_RANGE;
+        goto return_packet;
+    }
+    reply.offset = request.offset;
+    reply.length = length;
+
+/* Send feedback to client. The range follows it, sent by the reactor as the socket makes room. */
+return_packet:
+    reply.return_code = return_code;
+    char out[FTP_GET_REPLY_MAX_SZ];
+    size_t reply_length = ftp_get_write_reply(out, &reply);
+    if (-1 == fd) {
+        xnet_send(xnet, client, out, reply_length);
+    } else {
+        xnet_send_file(xnet, client, out, reply_length, fd, reply.offset, reply.length);
+    }
+
+    printf("Socket [%d] finished performing 'ftp_perform_get()' with code [%d]\n", client->socket, return_code);
+    return 0;
+}
+
+int ftp_perform_put(xnet_box_t *xnet, xnet_active_connection_t *client)
+{
+    int return_code = FTP_RC_SUCCESS;
+
+    printf("Socket [%d] is performing 'ftp_perform_put()'\n", client->socket);
+
+    char scratch[FTP_PUT_REQUEST_MAX_SZ];
+    ftp_put_request_t request = {0};
+    ftp_put_reply_t reply = {0};
+    ftp_put_t *put = NULL;
+    bool is_streaming = false;
+
+    put = calloc(1, sizeof(ftp_put_t));
+    if (NULL == put) {
+        return_code = FTP_RC_IO;
+        goto return_packet;
+    }
+
+    if (0 != ftp_put_recv_request(client, scratch, &request) || false == view_to_path(put->path, &request.path)) {
+        return_code = FTP_RC_BAD_PATH;
+        goto return_packet;
+    }
+
+    if (false == may_write(client)) {
+        return_code = FTP_RC_DENIED;
+        goto return_packet;
+    }
+
+    if (request.offset > request.size || request.length > request.size - request.offset) {
+        return_code = FTP_RC_BAD_RANGE;
+        goto return_packet;
+    }
+
+    /* Readers never see a file half written. It appears under its name once committed. */
+    snprintf(put->part_path, sizeof(put->part_path), "%s%s", put->path, FTP_PART_SUFFIX);
+    put->size = request.size;
+    put->offset = request.offset;
+    put->length = request.length;
+
+    /* Counted before the partial file is opened, so a commit can't rename it out from under this put. */
+    return_code = begin_upload(put->path, false);
+    if (FTP_RC_SUCCESS != return_code) {
+        goto return_packet;
+    }
+    is_streaming = true;
+
+    int fd = open_part_file(put);
+    if (-1 == fd) {
+        return_code = errno_to_return_code(errno);
+        goto return_packet;
+    }
+
+    /* The reactor takes it from here, before it reads anything else from the client. */
+    if (0 < put->length) {
+        if (0 != xnet_receive_file(xnet, client, fd, put->offset, put->length, finish_put, put)) {
+            return_code = FTP_RC_IO;
+            goto return_packet;
+        }
+    } else {
+        close(fd);
+    }
+
+/* Send feedback to client. On success, the client may send the slice now. */
+return_packet:
+    reply.return_code = return_code;
+    reply.stage = FTP_PUT_READY;
+    reply.offset = (NULL != put) ? put->offset : 0;
+    reply.length = (NULL != put) ? put->length : 0;
+    char out[FTP_PUT_REPLY_MAX_SZ];
+    xnet_send(xnet, client, out, ftp_put_write_reply(out, &reply));
+
+    /* Nothing to wait for. */
+    if (FTP_RC_SUCCESS == return_code && 0 == put->length) {
+        finish_put(xnet, client, 0, put);
+        put = NULL;
+    }
+
+    if (FTP_RC_SUCCESS != return_code) {
+        if (is_streaming) {
+            end_upload(put->path);
+        }
+        nfree((void **)&put);
+    }
+
+    printf("Socket [%d] finished performing 'ftp_perform_put()' with code [%d]\n", client->socket, return_code);
+    return 0;
+}
+
+int ftp_perform_status(xnet_box_t *xnet, xnet_active_connection_t *client)
+{
+    int return_code = FTP_RC_SUCCESS;
+
+    printf("Socket [%d] is performing 'ftp_perform_status()'\n", client->socket);
+
+    char scratch[FTP_STATUS_REQUEST_MAX_SZ];
+    ftp_status_request_t request = {0};
+    ftp_status_reply_t reply = {0};
+    char path[FTP_MAX_PATH_LEN + 1] = {0};
+    char part_path[FTP_MAX_PATH_LEN + sizeof(FTP_PART_SUFFIX)] = {0};
+    uint32_t *checksums = NULL;
+    int fd = -1;
+
+    if (0 != ftp_status_recv_request(client, scratch, &request) || false == view_to_path(path, &request.path)) {
+        return_code = FTP_RC_BAD_PATH;
+        goto return_packet;
+    }
+
+    if (false == is_logged_in(client)) {
+        return_code = FTP_RC_DENIED;
+        goto return_packet;
+    }
+
+    /* An upload in progress is what the client wants to resume, so its partial file goes first. */
+    snprintf(part_path, sizeof(part_path), "%s%s", path, FTP_PART_SUFFIX);
+    reply.state = FTP_STATUS_PARTIAL;
+    fd = openat(ftp_base.root_fd, part_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (-1 == fd && ENOENT == errno) {
+        reply.state = FTP_STATUS_COMPLETE;
+        fd = openat(ftp_base.root_fd, path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    }
+
+    if (-1 == fd) {
+        return_code = errno_to_return_code(errno);
+        goto return_packet;
+    }
+
+    struct stat info = {0};
+    if (0 != fstat(fd, &info) || false == S_ISREG(info.st_mode)) {
+        return_code = FTP_RC_NOT_FOUND;
+        goto return_packet;
+    }
+    reply.size = info.st_size;
+    reply.chunk_size = FTP_CHUNK_SZ;
+    reply.first_chunk = request.first_chunk;
+
+    /* Past the end of the file there is nothing to checksum. */
+    uint64_t total_chunks = (reply.size + FTP_CHUNK_SZ - 1) / FTP_CHUNK_SZ;
+    uint64_t chunk_count = (request.first_chunk < total_chunks) ? total_chunks - request.first_chunk : 0;
+    chunk_count = (request.chunk_count < chunk_count) ? request.chunk_count : chunk_count;
+    chunk_count = (FTP_MAX_STATUS_CHUNKS < chunk_count) ? FTP_MAX_STATUS_CHUNKS : chunk_count;
+
+    checksums = calloc(chunk_count + 1, sizeof(uint32_t));
+    if (NULL == checksums) {
+        return_code = FTP_RC_IO;
+        goto return_packet;
+    }
+
+    for (uint64_t n = 0; n < chunk_count; n++) {
+        uint64_t position = (request.first_chunk + n) * (uint64_t)FTP_CHUNK_SZ;
+        uint64_t length = (reply.size - position < FTP_CHUNK_SZ) ? reply.size - position : FTP_CHUNK_SZ;
+
+        uint64_t crc = 0;
+        return_code = checksum_range(client, fd, FTP_CHECKSUM_CRC32C, position, length, &crc);
+        if (FTP_RC_SUCCESS != return_code) {
+            goto return_packet;
+        }
+        checksums[n] = crc;
+    }
+    reply.chunk_count = chunk_count;
+
+/* Send feedback to client, then every chunk's checksum, in one go. */
+return_packet:
+    if (-1 != fd) {
+        close(fd);
+    }
+
+    reply.return_code = return_code;
+    reply.chunk_count = (FTP_RC_SUCCESS == return_code) ? reply.chunk_count : 0;
+
+    char *out = malloc(FTP_STATUS_REPLY_MAX_SZ + reply.chunk_count * FTP_CHUNK_REPLY_MAX_SZ);
+    if (NULL == out) {
+        nfree((void **)&checksums);
+        g_show_err(E_GEN_FAIL_ALLOC, "ftp_perform_status()");
+        return 0;
+    }
+
+    size_t length = ftp_status_write_reply(out, &reply);
+    for (uint32_t n = 0; n < reply.chunk_count; n++) {
+        ftp_chunk_reply_t chunk = {0};
+        chunk.index = reply.first_chunk + n;
+        chunk.crc32c = checksums[n];
+        length += ftp_chunk_write_reply(out + length, &chunk);
+    }
+    xnet_send(xnet, client, out, length);
+
+    nfree((void **)&out);
+    nfree((void **)&checksums);
+
+    printf("Socket [%d] finished performing 'ftp_perform_status()' with code [%d]\n", client->socket, return_code);
+    return 0;
+}
+
+int ftp_perform_commit(xnet_box_t *xnet, xnet_active_connection_t *client)
+{
+    int return_code = FTP_RC_SUCCESS;
+
+    printf("Socket [%d] is performing 'ftp_perform_commit()'\n", client->socket);
+
+    char scratch[FTP_COMMIT_REQUEST_MAX_SZ];
+    ftp_commit_request_t request = {0};
+    ftp_commit_reply_t reply = {0};
+    char path[FTP_MAX_PATH_LEN + 1] = {0};
+    char part_path[FTP_MAX_PATH_LEN + sizeof(FTP_PART_SUFFIX)] = {0};
+
+    if (0 != ftp_commit_recv_request(client, scratch, &request) || false == view_to_path(path, &request.path)) {
+        return_code = FTP_RC_BAD_PATH;
+        goto return_packet;
+    }
+
+    if (false == may_write(client)) {
+        return_code = FTP_RC_DENIED;
+        goto return_packet;
+    }
+
+    snprintf(part_path, sizeof(part_path), "%s%s", path, FTP_PART_SUFFIX);
+
+    /* Holds puts off until the partial file is checked and renamed. */
+    return_code = begin_upload(path, true);
+    if (FTP_RC_SUCCESS != return_code) {
+        goto return_packet;
+    }
+
+    if (FTP_COMMIT_NONE != request.algorithm) {
+        int fd = openat(ftp_base.root_fd, part_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        struct stat info = {0};
+        if (-1 == fd) {
+            return_code = errno_to_return_code(errno);
+        } else if (0 != fstat(fd, &info)) {
+            return_code = FTP_RC_IO;
+        } else if ((uint64_t)info.st_size != request.size) {
+            return_code = FTP_RC_BAD_RANGE;
+        } else {
+            uint64_t digest = 0;
+            return_code = checksum_range(client, fd, request.algorithm, 0, request.size, &digest);
+            return_code = (FTP_RC_SUCCESS == return_code && digest != request.digest) ? FTP_RC_CORRUPT : return_code;
+        }
+
+        if (-1 != fd) {
+            close(fd);
+        }
+    }
+
+    if (FTP_RC_SUCCESS == return_code) {
+        return_code = commit_part(path, part_path, request.size);
+    }
+    end_upload(path);
+
+/* Send feedback to client. */
+return_packet:
+    reply.return_code = return_code;
+    char out[FTP_COMMIT_REPLY_MAX_SZ];
+    xnet_send(xnet, client, out, ftp_commit_write_reply(out, &reply));
+
+    printf("Socket [%d] finished performing 'ftp_perform_commit()' with code [%d]\n", client->socket, return_code);
+    return 0;
+}
+
+int ftp_perform_checksum(xnet_box_t *xnet, xnet_active_connection_t *client)
+{
+    int return_code = FTP_RC_SUCCESS;
+
+    printf("Socket [%d] is performing 'ftp_perform_checksum()'\n", client->socket);
+
+    char scratch[FTP_CHECKSUM_REQUEST_MAX_SZ];
+    ftp_checksum_request_t request = {0};
+    ftp_checksum_reply_t reply = {0};
+    char path[FTP_MAX_PATH_LEN + 1] = {0};
+    int fd = -1;
+
+    if (0 != ftp_checksum_recv_request(client, scratch, &request) || false == view_to_path(path, &request.path)) {
+        return_code = FTP_RC_BAD_PATH;
+        goto return_packet;
+    }
+
+    if (false == is_logged_in(client)) {
+        return_code = FTP_RC_DENIED;
+        goto return_packet;
+    }
+
+    fd = openat(ftp_base.root_fd, path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (-1 == fd) {
+        return_code = errno_to_return_code(errno);
+        goto return_packet;
+    }
+
+    struct stat info = {0};
+    if (0 != fstat(fd, &info) || false == S_ISREG(info.st_mode)) {
+        return_code = FTP_RC_NOT_FOUND;
+        goto return_packet;
+    }
+
+    /* Ranges work as they do for gets. */
+    uint64_t size = info.st_size;
+    uint64_t length = (0 == request.length && request.offset <= size) ? size - request.offset : request.length;
+    if (request.offset > size || length > size - request.offset) {
+        return_code = FTP_RC_BAD_RANGE;
+        goto return_packet;
+    }
+    reply.offset = request.offset;
+    reply.length = length;
+
+    return_code = checksum_range(client, fd, request.algorithm, request.offset, length, &reply.digest);
+
+/* Send feedback to client. */
+return_packet:
+    if (-1 != fd) {
+        close(fd);
+    }
+
+    reply.return_code = return_code;
+    char out[FTP_CHECKSUM_REPLY_MAX_SZ];
+    xnet_send(xnet, client, out, ftp_checksum_write_reply(out, &reply));
+
+    printf("Socket [%d] finished performing 'ftp_perform_checksum()' with code [%d]\n", client->socket, return_code);
+    return 0;
+}
+
+int ftp_perform_delete(xnet_box_t *xnet, xnet_active_connection_t *client)
+{
+    int return_code = FTP_RC_SUCCESS;
+
+    printf("Socket [%d] is performing 'ftp_perform_delete()'\n", client->socket);
+
+    char scratch[FTP_DELETE_REQUEST_MAX_SZ];
+    ftp_delete_request_t request = {0};
+    ftp_delete_reply_t reply = {0};
+    char path[FTP_MAX_PATH_LEN + 1] = {0};
+    char part_path[FTP_MAX_PATH_LEN + sizeof(FTP_PART_SUFFIX)] = {0};
+
+    if (0 != ftp_delete_recv_request(client, scratch, &request) || false == view_to_path(path, &request.path)) {
+        return_code = FTP_RC_BAD_PATH;
+        goto return_packet;
+    }
+
+    if (false == may_write(client)) {
+        return_code = FTP_RC_DENIED;
+        goto return_packet;
+    }
+
+    /* A partial upload goes with its file, unless slices are still arriving. */
+    snprintf(part_path, sizeof(part_path), "%s%s", path, FTP_PART_SUFFIX);
+    pthread_mutex_lock(&ftp_base.lock);
+    if (NULL != find_upload_locked(path)) {
+        pthread_mutex_unlock(&ftp_base.lock);
+        return_code = FTP_RC_BUSY;
+        goto return_packet;
+    }
+    bool had_part = 0 == unlinkat(ftp_base.root_fd, part_path, 0);
+    pthread_mutex_unlock(&ftp_base.lock);
+
+    /* Files first. Directories have to be empty. */
+    int try_delete = unlinkat(ftp_base.root_fd, path, 0);
+    if (0 != try_delete && EISDIR == errno) {
+        try_delete = unlinkat(ftp_base.root_fd, path, AT_REMOVEDIR);
+    }
+
+    if (0 != try_delete && false == (had_part && ENOENT == errno)) {
+        return_code = errno_to_return_code(errno);
+        goto return_packet;
+    }
+
+/* Send feedback to client. */
+return_packet:
+    reply.return_code = return_code;
+    char out[FTP_DELETE_REPLY_MAX_SZ];
+    xnet_send(xnet, client, out, ftp_delete_write_reply(out, &reply));
+
+    printf("Socket [%d] finished performing 'ftp_perform_delete()' with code [%d]\n", client->socket, return_code);
+    return 0;
+}
+
+static bool is_logged_in(xnet_active_connection_t *client)
+{
+    return NULL != client->account && client->account->is_logged_in;
+}
+
+static bool may_write(xnet_active_connection_t *client)
+{
+    return is_logged_in(client) && FTP_WRITE_PERM <= client->account->perm_level;
+}
+
+static bool view_to_path(char *out, const ftp_view_t *view)
+{
+    /* Views are bounds checked by the parser. @param out only needs room for the terminator on top. */
+    if (0 == view->length || NULL != memchr(view->data, '\0', view->length)) {
+        return false;
+    }
+    memcpy(out, view->data, view->length);
+    out[view->length] = '\0';
+
+    /* Relative, and never leaving the served directory. */
+    if ('/' == out[0]) {
+        return false;
+    }
+
+    const char *component = out;
+    while (true) {
+        const char *end = strchrnul(component, '/');
+        size_t length = end - component;
+        if (0 == length || (1 == length && '.' == component[0]) || (2 == length && 0 == strncmp(component, "..", 2))) {
+            return false;
+        }
+        if ('\0' == *end) {
+            break;
+        }
+        component = end + 1;
+    }
+
+    /* Files still being received belong to their put. */
+    size_t suffix_length = strlen(FTP_PART_SUFFIX);
+    if (suffix_length <= view->length && 0 == strcmp(out + view->length - suffix_length, FTP_PART_SUFFIX)) {
+        return false;
+    }
+
+    return true;
+}
+
+static int errno_to_return_code(int error)
+{
+    switch (error)
+    {
+    case ENOENT:
+    case ENOTDIR:
+        return FTP_RC_NOT_FOUND;
+    case EEXIST:
+    case ENOTEMPTY:
+        return FTP_RC_EXISTS;
+    case EACCES:
+    case EPERM:
+    case ELOOP:
+    case EISDIR:
+        return FTP_RC_DENIED;
+    default:
+        return FTP_RC_IO;
+    }
+}
+
+static void send_match(const ftp_index_entry_t *entry, void *arg)
+{
+    ftp_search_batch_t *batch = arg;
+
+    /* The last batch goes out along with search_end, so a full one always leaves room for it. */
+    if (sizeof(batch->out) < batch->length + FTP_MATCH_REPLY_MAX_SZ + FTP_SEARCH_END_REPLY_MAX_SZ) {
+        xnet_send(batch->xnet, batch->client, batch->out, batch->length);
+        batch->length = 0;
+    }
+
+    ftp_match_reply_t match = {0};
+    match.type = entry->type;
+    match.size = entry->size;
+    match.path.data = entry->path;
+    match.path.length = entry->path_length;
+    batch->length += ftp_match_write_reply(batch->out + batch->length, &match);
+}
+
+static void finish_put(xnet_box_t *xnet, xnet_active_connection_t *client, int status, void *arg)
+{
+    ftp_put_t *put = arg;
+    int return_code = (0 == status) ? FTP_RC_SUCCESS : FTP_RC_IO;
+
+    end_upload(put->path);
+
+    /* A put of the whole file needs no separate commit. Broken puts keep what arrived for a resume. */
+    if (0 == status && 0 == put->offset && put->size == put->length) {
+        pthread_mutex_lock(&ftp_base.lock);
+        return_code = (NULL == find_upload_locked(put->path)) ? commit_part(put->path, put->part_path, put->size) : FTP_RC_BUSY;
+        pthread_mutex_unlock(&ftp_base.lock);
+    }
+
+    printf("Socket [%d] finished receiving %llu bytes of '%s' with code [%d]\n", client->socket,
+           (unsigned long long)put->length, put->path, return_code);
+
+    /* A closing connection can't be told anymore. */
+    if (E_SRV_BAD_SOCKET != status) {
+        ftp_put_reply_t reply = {0};
+        reply.return_code = return_code;
+        reply.stage = FTP_PUT_DONE;
+        reply.offset = put->offset;
+        reply.length = (0 == status) ? put->length : 0;
+        char out[FTP_PUT_REPLY_MAX_SZ];
+        xnet_send(xnet, client, out, ftp_put_write_reply(out, &reply));
+    }
+
+    nfree((void **)&put);
+}
+
+static ftp_upload_t *find_upload_locked(const char *path)
+{
+    for (ftp_upload_t *upload = ftp_base.uploads; NULL != upload; upload = upload->next) {
+        if (0 == strcmp(upload->path, path)) {
+            return upload;
+        }
+    }
+
+    return NULL;
+}
+
+static int begin_upload(const char *path, bool is_commit)
+{
+    pthread_mutex_lock(&ftp_base.lock);
+
+    /* A commit needs the file to itself. Puts only keep commits out. */
+    ftp_upload_t *upload = find_upload_locked(path);
+    if (NULL != upload && (upload->is_committing || is_commit)) {
+        pthread_mutex_unlock(&ftp_base.lock);
+        return FTP_RC_BUSY;
+    }
+
+    if (NULL == upload) {
+        upload = calloc(1, sizeof(ftp_upload_t));
+        if (NULL == upload) {
+            pthread_mutex_unlock(&ftp_base.lock);
+            return FTP_RC_IO;
+        }
+        memcpy(upload->path, path, strlen(path) + 1);
+        upload->next = ftp_base.uploads;
+        ftp_base.uploads = upload;
+    }
+    upload->streams++;
+    upload->is_committing = is_commit;
+
+    pthread_mutex_unlock(&ftp_base.lock);
+    return FTP_RC_SUCCESS;
+}
+
+static void end_upload(const char *path)
+{
+    pthread_mutex_lock(&ftp_base.lock);
+
+    for (ftp_upload_t **link = &ftp_base.uploads; NULL != *link; link = &(*link)->next) {
+        ftp_upload_t *upload = *link;
+        if (0 != strcmp(upload->path, path)) {
+            continue;
+        }
+
+        /* The last slice out forgets the upload. */
+        upload->streams--;
+        if (0 == upload->streams) {
+            *link = upload->next;
+            nfree((void **)&upload);
+        }
+        break;
+    }
+
+    pthread_mutex_unlock(&ftp_base.lock);
+}
+
+/* Callers make sure no put is writing into the partial file. */
+static int commit_part(const char *path, const char *part_path, uint64_t size)
+{
+    struct stat info = {0};
+    if (0 != fstatat(ftp_base.root_fd, part_path, &info, AT_SYMLINK_NOFOLLOW)) {
+        return errno_to_return_code(errno);
+    }
+
+    if ((uint64_t)info.st_size != size) {
+        return FTP_RC_BAD_RANGE;
+    }
+
+    if (0 != renameat(ftp_base.root_fd, part_path, ftp_base.root_fd, path)) {
+        return errno_to_return_code(errno);
+    }
+
+    return FTP_RC_SUCCESS;
+}
+
+static int open_part_file(ftp_put_t *put)
+{
+    /* Never truncated on open. Other slices, and whatever a broken put left behind, stay where they are. */
+    int fd = openat(ftp_base.root_fd, put->part_path, O_WRONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+    if (-1 == fd) {
+        return -1;
+    }
+
+    /* Sized up front, so checksums cover the whole file and slices can land in any order. */
+    struct stat info = {0};
+    if (0 != fstat(fd, &info) || ((uint64_t)info.st_size != put->size && 0 != ftruncate(fd, put->size))) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    return fd;
+}
+
+static int checksum_range(const xnet_active_connection_t *client, int fd, uint16_t algorithm, uint64_t offset, uint64_t length,
+                          uint64_t *digest)
+{
+    if (FTP_CHECKSUM_CRC32C != algorithm && FTP_CHECKSUM_XXH3 != algorithm) {
+        return FTP_RC_BAD_RANGE;
+    }
+
+    char *buf = malloc(XNET_FILE_CHUNK_SZ);
+    if (NULL == buf) {
+        return FTP_RC_IO;
+    }
+
+    /* Reads of one chunk at a time stay in cache for the checksum that follows them. */
+    posix_fadvise(fd, offset, length, POSIX_FADV_SEQUENTIAL);
+
+    uint32_t crc = 0;
+    xnet_xxh3_state_t state;
+    xnet_xxh3_reset(&state);
+
+    uint64_t end = offset + length;
+    while (offset < end) {
+        /* Large files take long enough to run into the handler's deadline. */
+        if (xnet_is_cancelled(client)) {
+            nfree((void **)&buf);
+            return FTP_RC_CANCELLED;
+        }
+
+        size_t want = (XNET_FILE_CHUNK_SZ < end - offset) ? XNET_FILE_CHUNK_SZ : end - offset;
+        ssize_t bytes_read = pread(fd, buf, want, offset);
+        if (-1 == bytes_read && EINTR == errno) {
+            continue;
+        }
+        if (0 >= bytes_read) {
+            nfree((void **)&buf);
+            return FTP_RC_IO;
+        }
+
+        if (FTP_CHECKSUM_CRC32C == algorithm) {
+            crc = xnet_crc32c(crc, buf, bytes_read);
+        } else {
+            xnet_xxh3_update(&state, buf, bytes_read);
+        }
+        offset += bytes_read;
+    }
+
+    *digest = (FTP_CHECKSUM_CRC32C == algorithm) ? crc : xnet_xxh3_digest(&state);
+    nfree((void **)&buf);
+    return FTP_RC_SUCCESS;
+}
@@ -0,0 +1,933 @@
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+#include "xnet_addon_ftp.h"
+
+ftp_index_main_t ftp_index = { .root_fd = -1, .inotify_fd = -1, .stop_fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+#define FTP_INDEX_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | \
+                              IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+static void *watcher_thread(void *arg);
+static void handle_event_locked(const struct inotify_event *event);
+static void scan_directory_locked(int dir_fd, char *path, size_t length);
+static void rescan_directory_locked(const char *path, size_t length, int64_t mtime_ns);
+static bool load_cache_locked(void);
+static int save_cache_locked(void);
+static void clear_locked(void);
+static void add_watch_locked(const char *path);
+static void drop_watches_locked(const char *path, size_t length);
+static ftp_index_entry_t *upsert_locked(const char *path, size_t length, const struct stat *info);
+static void remove_locked(const char *path, size_t length);
+static void settle_locked(void);
+static size_t find_slot(const char *path, size_t length, uint64_t hash);
+static void table_insert(ftp_index_entry_t *entry);
+static void table_remove(ftp_index_entry_t *entry);
+static size_t lower_bound(ftp_index_entry_t **array, const char *name, const char *path, bool is_upper);
+static int compare_key(const ftp_index_entry_t *entry, const char *name, const char *path);
+static int compare_by_path(const void *lhs, const void *rhs);
+static int compare_by_name(const void *lhs, const void *rhs);
+static bool is_indexed(const char *name, const struct stat *info);
+static int64_t mtime_ns(const struct stat *info);
+static double now_ms(void);
+
+int ftp_index_open(int root_fd, const char *root, const char *cache_path)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == root) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (ftp_index.is_open) {
+        return 0;
+    }
+
+    if (NULL == cache_path) {
+        cache_path = FTP_INDEX_CACHE_DEFAULT;
+    }
+
+    if (PATH_MAX <= strnlen(root, PATH_MAX) || PATH_MAX - sizeof(".tmp") < strnlen(cache_path, PATH_MAX)) {
+        err = E_GEN_FAIL_STR_LENGTH;
+        goto handle_err;
+    }
+
+    strncpy(ftp_index.root, root, PATH_MAX - 1);
+    strncpy(ftp_index.cache_path, cache_path, PATH_MAX - 1);
+    ftp_index.root_fd = root_fd;
+    ftp_index.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    ftp_index.stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (-1 == ftp_index.inotify_fd || -1 == ftp_index.stop_fd) {
+        err = E_SRV_FAIL_FILE_IO;
+        goto handle_err;
+    }
+
+    /* Watches go up before anything is read, so nothing that changes meanwhile is missed. */
+    double start = now_ms();
+    pthread_mutex_lock(&ftp_index.lock);
+    bool is_cached = load_cache_locked();
+    if (false == is_cached) {
+        clear_locked();
+
+        struct stat info = {0};
+        int dir_fd = openat(root_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (-1 != dir_fd && 0 == fstat(dir_fd, &info)) {
+            char path[FTP_MAX_PATH_LEN + 1] = {0};
+            ftp_index.root_mtime_ns = mtime_ns(&info);
+            scan_directory_locked(dir_fd, path, 0);
+        } else if (-1 != dir_fd) {
+            close(dir_fd);
+        }
+    }
+    settle_locked();
+    ftp_index.is_dirty = false == is_cached;
+
+    printf("FTP index holds %zu entries, %s in %.1f ms\n", ftp_index.table_count,
+           is_cached ? "loaded from cache" : "read from disk", now_ms() - start);
+    if (0 < ftp_index.watch_failures) {
+        printf("FTP index could not watch %zu directories. Raise fs.inotify.max_user_watches\n", ftp_index.watch_failures);
+    }
+    pthread_mutex_unlock(&ftp_index.lock);
+
+    ftp_index.is_running = true;
+
+    /* Same as the message log's flusher. Keep the watcher from catching the server's signals. */
+    sigset_t all_signals;
+    sigset_t old_signals;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+    int try_create = pthread_create(&ftp_index.watcher, NULL, watcher_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    if (0 != try_create) {
+        ftp_index.is_running = false;
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    ftp_index.is_open = true;
+    return 0;
+
+    /* Unreachable unless error is triggered. */
+handle_err:
+    pthread_mutex_lock(&ftp_index.lock);
+    clear_locked();
+    pthread_mutex_unlock(&ftp_index.lock);
+    if (-1 != ftp_index.inotify_fd) {
+        close(ftp_index.inotify_fd);
+        ftp_index.inotify_fd = -1;
+    }
+    if (-1 != ftp_index.stop_fd) {
+        close(ftp_index.stop_fd);
+        ftp_index.stop_fd = -1;
+    }
+    g_show_err(err, "ftp_index_open()");
+    return err;
+}
+
+void ftp_index_close(void)
+{
+    if (false == ftp_index.is_open) {
+        return;
+    }
+
+    uint64_t stop = 1;
+    ftp_index.is_running = false;
+    if (sizeof(stop) != write(ftp_index.stop_fd, &stop, sizeof(stop))) {
+        g_show_err(E_SRV_FAIL_FILE_IO, "ftp_index_close()");
+    }
+    pthread_join(ftp_index.watcher, NULL);
+
+    pthread_mutex_lock(&ftp_index.lock);
+    if (ftp_index.is_dirty) {
+        save_cache_locked();
+    }
+    clear_locked();
+    pthread_mutex_unlock(&ftp_index.lock);
+
+    close(ftp_index.inotify_fd);
+    close(ftp_index.stop_fd);
+    ftp_index.inotify_fd = -1;
+    ftp_index.stop_fd = -1;
+    ftp_index.root_fd = -1;
+    ftp_index.is_open = false;
+}
+
+size_t ftp_index_search(const ftp_index_query_t *query, ftp_index_visit_fn visit, void *arg, bool *has_more)
+{
+    size_t found = 0;
+    size_t pattern_length = strlen(query->pattern);
+    bool is_prefix = FTP_SEARCH_PREFIX == query->mode;
+
+    *has_more = false;
+
+    pthread_mutex_lock(&ftp_index.lock);
+    settle_locked();
+
+    /* Prefix searches run along names, where every match sits in one run. Substrings can be anywhere. */
+    ftp_index_entry_t **array = is_prefix ? ftp_index.by_name : ftp_index.by_path;
+    size_t n = is_prefix ? lower_bound(array, query->pattern, NULL, false) : 0;
+
+    /* Pages pick up right after the last path of the one before. */
+    if ('\0' != query->after[0]) {
+        const char *after_name = strrchr(query->after, '/');
+        after_name = (NULL == after_name) ? query->after : after_name + 1;
+        size_t resume = lower_bound(array, is_prefix ? after_name : NULL, query->after, true);
+        n = (resume > n) ? resume : n;
+    }
+
+    for (; n < ftp_index.sorted_count; n++) {
+        ftp_index_entry_t *entry = array[n];
+        const char *name = entry->path + entry->name_offset;
+
+        if (is_prefix && 0 != strncmp(name, query->pattern, pattern_length)) {
+            break;
+        }
+
+        if (entry->is_deleted || (false == is_prefix && NULL == strstr(name, query->pattern))) {
+            continue;
+        }
+
+        if (found == query->limit) {
+            *has_more = true;
+            break;
+        }
+
+        visit(entry, arg);
+        found++;
+    }
+
+    pthread_mutex_unlock(&ftp_index.lock);
+    return found;
+}
+
+static void *watcher_thread(void *arg)
+{
+    (void)arg;
+
+    /* inotify_event is aligned, so the buffer must be too. */
+    static uint64_t events[FTP_INDEX_EVENT_BUF_SZ / sizeof(uint64_t)];
+    double last_save = now_ms();
+
+    while (ftp_index.is_running) {
+        struct pollfd fds[2] = {
+            { .fd = ftp_index.inotify_fd, .events = POLLIN },
+            { .fd = ftp_index.stop_fd, .events = POLLIN },
+        };
+        poll(fds, 2, FTP_INDEX_SAVE_S * 1000);
+
+        if (fds[0].revents & POLLIN) {
+            ssize_t length = read(ftp_index.inotify_fd, events, sizeof(events));
+
+            pthread_mutex_lock(&ftp_index.lock);
+            for (ssize_t offset = 0; offset < length; ) {
+                const struct inotify_event *event = (const struct inotify_event *)((char *)events + offset);
+                handle_event_locked(event);
+                offset += sizeof(struct inotify_event) + event->len;
+            }
+            pthread_mutex_unlock(&ftp_index.lock);
+        }
+
+        /* A crash costs at most this much rereading on the next start. */
+        if (FTP_INDEX_SAVE_S * 1000 <= now_ms() - last_save) {
+            pthread_mutex_lock(&ftp_index.lock);
+            if (ftp_index.is_dirty) {
+                save_cache_locked();
+            }
+            pthread_mutex_unlock(&ftp_index.lock);
+            last_save = now_ms();
+        }
+    }
+
+    return NULL;
+}
+
+static void handle_event_locked(const struct inotify_event *event)
+{
+    /* Events were lost. Only reading everything again brings the index back in line. */
+    if (event->mask & IN_Q_OVERFLOW) {
+        printf("FTP index missed changes, reading the served directory again\n");
+        clear_locked();
+
+        struct stat info = {0};
+        int dir_fd = openat(ftp_index.root_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (-1 != dir_fd && 0 == fstat(dir_fd, &info)) {
+            char path[FTP_MAX_PATH_LEN + 1] = {0};
+            ftp_index.root_mtime_ns = mtime_ns(&info);
+            scan_directory_locked(dir_fd, path, 0);
+        } else if (-1 != dir_fd) {
+            close(dir_fd);
+        }
+        ftp_index.is_dirty = true;
+        return;
+    }
+
+    if (0 > event->wd || ftp_index.watch_capacity <= (size_t)event->wd || NULL == ftp_index.watches[event->wd]) {
+        return;
+    }
+
+    if (event->mask & IN_IGNORED) {
+        nfree((void **)&ftp_index.watches[event->wd]);
+        return;
+    }
+
+    if (0 == event->len) {
+        return;
+    }
+
+    const char *dir = ftp_index.watches[event->wd];
+    size_t dir_length = strlen(dir);
+    size_t name_length = strlen(event->name);
+    size_t length = (0 == dir_length) ? name_length : dir_length + 1 + name_length;
+    if (FTP_MAX_PATH_LEN < length) {
+        return;
+    }
+
+    char path[FTP_MAX_PATH_LEN + 1] = {0};
+    snprintf(path, sizeof(path), "%s%s%s", dir, (0 == dir_length) ? "" : "/", event->name);
+    ftp_index.is_dirty = true;
+
+    if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        remove_locked(path, length);
+        if (event->mask & IN_ISDIR) {
+            drop_watches_locked(path, length);
+        }
+        return;
+    }
+
+    struct stat info = {0};
+    if (0 != fstatat(ftp_index.root_fd, path, &info, AT_SYMLINK_NOFOLLOW) || false == is_indexed(event->name, &info)) {
+        return;
+    }
+
+    /* A directory may be full already, moved in from elsewhere or filled before its watch went up. */
+    if (S_ISDIR(info.st_mode) && NULL == upsert_locked(path, length, &info)) {
+        return;
+    }
+
+    if (S_ISDIR(info.st_mode)) {
+        int dir_fd = openat(ftp_index.root_fd, path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (-1 != dir_fd) {
+            scan_directory_locked(dir_fd, path, length);
+        }
+        return;
+    }
+
+    upsert_locked(path, length, &info);
+}
+
+/* @param path holds the directory's path, "" for the root, with room for FTP_MAX_PATH_LEN. Takes @param dir_fd. */
+static void scan_directory_locked(int dir_fd, char *path, size_t length)
+{
+    add_watch_locked(path);
+
+    DIR *dir = fdopendir(dir_fd);
+    if (NULL == dir) {
+        close(dir_fd);
+        return;
+    }
+
+    struct dirent *entry = NULL;
+    while (NULL != (entry = readdir(dir))) {
+        if (0 == strcmp(entry->d_name, ".") || 0 == strcmp(entry->d_name, "..")) {
+            continue;
+        }
+
+        /* Paths too long to name in a reply can't be asked for either. */
+        size_t name_length = strlen(entry->d_name);
+        size_t child_length = (0 == length) ? name_length : length + 1 + name_length;
+        if (FTP_MAX_PATH_LEN < child_length) {
+            continue;
+        }
+
+        struct stat info = {0};
+        if (0 != fstatat(dirfd(dir), entry->d_name, &info, AT_SYMLINK_NOFOLLOW) || false == is_indexed(entry->d_name, &info)) {
+            continue;
+        }
+
+        if (0 < length) {
+            path[length] = '/';
+        }
+        memcpy(path + child_length - name_length, entry->d_name, name_length + 1);
+
+        /* Directories are stat()ed before they are read, so a change made while reading shows on the next start. */
+        if (NULL != upsert_locked(path, child_length, &info) && S_ISDIR(info.st_mode)) {
+            int child_fd = openat(dirfd(dir), entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (-1 != child_fd) {
+                scan_directory_locked(child_fd, path, child_length);
+            }
+        }
+
+        path[length] = '\0';
+    }
+
+    closedir(dir);
+}
+
+/* Brings one cached directory in line with the disk. Only its own entries are read again, not its subdirectories. */
+static void rescan_directory_locked(const char *path, size_t length, int64_t cached_mtime_ns)
+{
+    add_watch_locked(path);
+
+    struct stat info = {0};
+    const char *at = (0 == length) ? "." : path;
+    if (0 != fstatat(ftp_index.root_fd, at, &info, AT_SYMLINK_NOFOLLOW) || false == S_ISDIR(info.st_mode)) {
+        remove_locked(path, length);
+        drop_watches_locked(path, length);
+        return;
+    }
+
+    if (mtime_ns(&info) == cached_mtime_ns) {
+        return;
+    }
+
+    if (0 == length) {
+        ftp_index.root_mtime_ns = mtime_ns(&info);
+    } else {
+        upsert_locked(path, length, &info);
+    }
+
+    /* Entries gone from disk, collected first since removing them reshuffles the sorted views. */
+    char prefix[FTP_MAX_PATH_LEN + 2] = {0};
+    snprintf(prefix, sizeof(prefix), "%s%s", path, (0 == length) ? "" : "/");
+    size_t prefix_length = strlen(prefix);
+
+    settle_locked();
+    size_t first = (0 == length) ? 0 : lower_bound(ftp_index.by_path, NULL, prefix, false);
+    size_t gone_count = 0;
+    char **gone = NULL;
+    for (size_t n = first; n < ftp_index.sorted_count; n++) {
+        ftp_index_entry_t *entry = ftp_index.by_path[n];
+        if (0 != strncmp(entry->path, prefix, prefix_length)) {
+            break;
+        }
+
+        struct stat child = {0};
+        bool is_child = NULL == strchr(entry->path + prefix_length, '/');
+        if (entry->is_deleted || false == is_child || 0 == fstatat(ftp_index.root_fd, entry->path, &child, AT_SYMLINK_NOFOLLOW)) {
+            continue;
+        }
+
+        char **grown = realloc(gone, (gone_count + 1) * sizeof(char *));
+        if (NULL == grown) {
+            break;
+        }
+        gone = grown;
+        gone[gone_count] = strdup(entry->path);
+        gone_count += (NULL != gone[gone_count]) ? 1 : 0;
+    }
+
+    for (size_t n = 0; n < gone_count; n++) {
+        remove_locked(gone[n], strlen(gone[n]));
+        drop_watches_locked(gone[n], strlen(gone[n]));
+        nfree((void **)&gone[n]);
+    }
+    nfree((void **)&gone);
+
+    /* Then everything on disk. Sizes are refreshed on the way, new directories are read in full. */
+    int dir_fd = openat(ftp_index.root_fd, at, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *dir = (-1 == dir_fd) ? NULL : fdopendir(dir_fd);
+    if (NULL == dir) {
+        if (-1 != dir_fd) {
+            close(dir_fd);
+        }
+        return;
+    }
+
+    char child_path[FTP_MAX_PATH_LEN + 1] = {0};
+    struct dirent *entry = NULL;
+    while (NULL != (entry = readdir(dir))) {
+        if (0 == strcmp(entry->d_name, ".") || 0 == strcmp(entry->d_name, "..")) {
+            continue;
+        }
+
+        size_t child_length = prefix_length + strlen(entry->d_name);
+        struct stat child = {0};
+        if (FTP_MAX_PATH_LEN < child_length || 0 != fstatat(dirfd(dir), entry->d_name, &child, AT_SYMLINK_NOFOLLOW) ||
+            false == is_indexed(entry->d_name, &child)) {
+            continue;
+        }
+
+        memcpy(child_path, prefix, prefix_length);
+        memcpy(child_path + prefix_length, entry->d_name, child_length - prefix_length + 1);
+        size_t slot = find_slot(child_path, child_length, xnet_xxh3(child_path, child_length));
+        bool is_known = NULL != ftp_index.table[slot];
+        if (NULL == upsert_locked(child_path, child_length, &child) || false == S_ISDIR(child.st_mode) || is_known) {
+            continue;
+        }
+
+        int child_fd = openat(dirfd(dir), entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (-1 != child_fd) {
+            scan_directory_locked(child_fd, child_path, child_length);
+        }
+    }
+
+    closedir(dir);
+}
+
+static bool load_cache_locked(void)
+{
+    FILE *file = fopen(ftp_index.cache_path, "rb");
+    if (NULL == file) {
+        return false;
+    }
+
+    char magic[sizeof(FTP_INDEX_MAGIC) - 1];
+    uint64_t count = 0;
+    bool is_valid = 1 == fread(magic, sizeof(magic), 1, file) && 0 == memcmp(magic, FTP_INDEX_MAGIC, sizeof(magic)) &&
+                    1 == fread(&ftp_index.root_mtime_ns, sizeof(int64_t), 1, file) && 1 == fread(&count, sizeof(count), 1, file);
+
+    for (uint64_t n = 0; is_valid && n < count; n++) {
+        uint16_t type = 0;
+        uint16_t length = 0;
+        struct stat info = {0};
+        int64_t mtime = 0;
+        uint64_t size = 0;
+        char path[FTP_MAX_PATH_LEN + 1] = {0};
+
+        is_valid = 1 == fread(&type, sizeof(type), 1, file) && 1 == fread(&length, sizeof(length), 1, file) &&
+                   1 == fread(&size, sizeof(size), 1, file) && 1 == fread(&mtime, sizeof(mtime), 1, file) &&
+                   0 < length && FTP_MAX_PATH_LEN >= length && 1 == fread(path, length, 1, file) &&
+                   NULL == memchr(path, '\0', length) && (FTP_MATCH_FILE == type || FTP_MATCH_DIR == type);
+
+        info.st_mode = (FTP_MATCH_DIR == type) ? S_IFDIR : S_IFREG;
+        info.st_size = size;
+        info.st_mtim.tv_sec = mtime / 1000000000;
+        info.st_mtim.tv_nsec = mtime % 1000000000;
+        is_valid = is_valid && NULL != upsert_locked(path, length, &info);
+    }
+    fclose(file);
+
+    if (false == is_valid) {
+        printf("FTP index cache '%s' is unusable, reading the served directory instead\n", ftp_index.cache_path);
+        return false;
+    }
+
+    /* Parents sort before their children, so a directory removed here takes its subtree before it is looked at. */
+    settle_locked();
+    char **dirs = calloc(ftp_index.sorted_count + 1, sizeof(char *));
+    int64_t *mtimes = calloc(ftp_index.sorted_count + 1, sizeof(int64_t));
+    size_t dir_count = 0;
+    for (size_t n = 0; NULL != dirs && NULL != mtimes && n < ftp_index.sorted_count; n++) {
+        ftp_index_entry_t *entry = ftp_index.by_path[n];
+        if (FTP_MATCH_DIR == entry->type && NULL != (dirs[dir_count] = strdup(entry->path))) {
+            mtimes[dir_count++] = entry->mtime_ns;
+        }
+    }
+
+    if (NULL == dirs || NULL == mtimes) {
+        nfree((void **)&dirs);
+        nfree((void **)&mtimes);
+        return false;
+    }
+
+    rescan_directory_locked("", 0, ftp_index.root_mtime_ns);
+    for (size_t n = 0; n < dir_count; n++) {
+        size_t length = strlen(dirs[n]);
+        if (NULL != ftp_index.table[find_slot(dirs[n], length, xnet_xxh3(dirs[n], length))]) {
+            rescan_directory_locked(dirs[n], length, mtimes[n]);
+        }
+        nfree((void **)&dirs[n]);
+    }
+    nfree((void **)&dirs);
+    nfree((void **)&mtimes);
+
+    return true;
+}
+
+static int save_cache_locked(void)
+{
+    int err = 0;
+    char tmp_path[PATH_MAX + sizeof(".tmp")] = {0};
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", ftp_index.cache_path);
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (NULL == file) {
+        err = E_SRV_FAIL_FILE_IO;
+        goto handle_err;
+    }
+
+    settle_locked();
+    uint64_t count = ftp_index.table_count;
+    bool is_written = 1 == fwrite(FTP_INDEX_MAGIC, sizeof(FTP_INDEX_MAGIC) - 1, 1, file) &&
+                      1 == fwrite(&ftp_index.root_mtime_ns, sizeof(int64_t), 1, file) && 1 == fwrite(&count, sizeof(count), 1, file);
+
+    for (size_t n = 0; is_written && n < ftp_index.sorted_count; n++) {
+        ftp_index_entry_t *entry = ftp_index.by_path[n];
+        if (entry->is_deleted) {
+            continue;
+        }
+
+        is_written = 1 == fwrite(&entry->type, sizeof(entry->type), 1, file) && 1 == fwrite(&entry->path_length, sizeof(entry->path_length), 1, file) &&
+                     1 == fwrite(&entry->size, sizeof(entry->size), 1, file) && 1 == fwrite(&entry->mtime_ns, sizeof(entry->mtime_ns), 1, file) &&
+                     1 == fwrite(entry->path, entry->path_length, 1, file);
+    }
+
+    /* The old copy stays until the new one is complete. */
+    if (0 != fclose(file) || false == is_written || 0 != rename(tmp_path, ftp_index.cache_path)) {
+        unlink(tmp_path);
+        err = E_SRV_FAIL_FILE_IO;
+        goto handle_err;
+    }
+
+    ftp_index.is_dirty = false;
+    return 0;
+
+    /* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "save_cache_locked()");
+    return err;
+}
+
+static void clear_locked(void)
+{
+    for (size_t n = 0; n < ftp_index.sorted_count; n++) {
+        nfree((void **)&ftp_index.by_path[n]);
+    }
+    for (size_t n = 0; n < ftp_index.pending_count; n++) {
+        nfree((void **)&ftp_index.pending[n]);
+    }
+    for (size_t wd = 0; wd < ftp_index.watch_capacity; wd++) {
+        if (NULL != ftp_index.watches[wd]) {
+            inotify_rm_watch(ftp_index.inotify_fd, wd);
+            nfree((void **)&ftp_index.watches[wd]);
+        }
+    }
+
+    nfree((void **)&ftp_index.table);
+    nfree((void **)&ftp_index.by_path);
+    nfree((void **)&ftp_index.by_name);
+    nfree((void **)&ftp_index.pending);
+    nfree((void **)&ftp_index.watches);
+    ftp_index.table_size = 0;
+    ftp_index.table_count = 0;
+    ftp_index.sorted_count = 0;
+    ftp_index.pending_count = 0;
+    ftp_index.pending_capacity = 0;
+    ftp_index.deleted_count = 0;
+    ftp_index.watch_capacity = 0;
+    ftp_index.watch_failures = 0;
+}
+
+static void add_watch_locked(const char *path)
+{
+    char full_path[PATH_MAX + FTP_MAX_PATH_LEN + 2] = {0};
+    snprintf(full_path, sizeof(full_path), "%s/%s", ftp_index.root, path);
+
+    int wd = inotify_add_watch(ftp_index.inotify_fd, full_path, FTP_INDEX_WATCH_MASK);
+    if (-1 == wd) {
+        ftp_index.watch_failures++;
+        return;
+    }
+
+    if (ftp_index.watch_capacity <= (size_t)wd) {
+        size_t capacity = (0 == ftp_index.watch_capacity) ? 64 : ftp_index.watch_capacity;
+        while (capacity <= (size_t)wd) {
+            capacity *= 2;
+        }
+
+        char **grown = realloc(ftp_index.watches, capacity * sizeof(char *));
+        if (NULL == grown) {
+            inotify_rm_watch(ftp_index.inotify_fd, wd);
+            ftp_index.watch_failures++;
+            return;
+        }
+        memset(grown + ftp_index.watch_capacity, 0, (capacity - ftp_index.watch_capacity) * sizeof(char *));
+        ftp_index.watches = grown;
+        ftp_index.watch_capacity = capacity;
+    }
+
+    /* The same directory watched again keeps its descriptor. */
+    nfree((void **)&ftp_index.watches[wd]);
+    ftp_index.watches[wd] = strdup(path);
+}
+
+/* A directory that moved keeps its watches. They'd report under the old path, so they go. */
+static void drop_watches_locked(const char *path, size_t length)
+{
+    for (size_t wd = 0; wd < ftp_index.watch_capacity; wd++) {
+        const char *watched = ftp_index.watches[wd];
+        if (NULL == watched || 0 != strncmp(watched, path, length) || ('\0' != watched[length] && '/' != watched[length])) {
+            continue;
+        }
+
+        inotify_rm_watch(ftp_index.inotify_fd, wd);
+        nfree((void **)&ftp_index.watches[wd]);
+    }
+}
+
+static ftp_index_entry_t *upsert_locked(const char *path, size_t length, const struct stat *info)
+{
+    uint16_t type = S_ISDIR(info->st_mode) ? FTP_MATCH_DIR : FTP_MATCH_FILE;
+    uint64_t hash = xnet_xxh3(path, length);
+
+    ftp_index_entry_t *entry = (0 == ftp_index.table_size) ? NULL : ftp_index.table[find_slot(path, length, hash)];
+    if (NULL != entry && entry->type == type) {
+        entry->size = (FTP_MATCH_FILE == type) ? (uint64_t)info->st_size : 0;
+        entry->mtime_ns = (FTP_MATCH_DIR == type) ? mtime_ns(info) : 0;
+        return entry;
+    }
+
+    /* A file replaced by a directory, or the other way around, is a new entry. */
+    if (NULL != entry) {
+        remove_locked(path, length);
+    }
+
+    if (ftp_index.pending_count == ftp_index.pending_capacity) {
+        size_t capacity = (0 == ftp_index.pending_capacity) ? 1024 : ftp_index.pending_capacity * 2;
+        ftp_index_entry_t **grown = realloc(ftp_index.pending, capacity * sizeof(ftp_index_entry_t *));
+        if (NULL == grown) {
+            return NULL;
+        }
+        ftp_index.pending = grown;
+        ftp_index.pending_capacity = capacity;
+    }
+
+    /* Kept at most half full, so probes stay short. */
+    if (ftp_index.table_size <= 2 * (ftp_index.table_count + 1)) {
+        size_t old_size = ftp_index.table_size;
+        ftp_index_entry_t **old_table = ftp_index.table;
+        size_t size = (0 == old_size) ? 1024 : old_size * 2;
+
+        ftp_index.table = calloc(size, sizeof(ftp_index_entry_t *));
+        if (NULL == ftp_index.table) {
+            ftp_index.table = old_table;
+            return NULL;
+        }
+        ftp_index.table_size = size;
+        for (size_t n = 0; n < old_size; n++) {
+            if (NULL != old_table[n]) {
+                ftp_index.table[find_slot(old_table[n]->path, old_table[n]->path_length, old_table[n]->hash)] = old_table[n];
+            }
+        }
+        nfree((void **)&old_table);
+    }
+
+    entry = calloc(1, sizeof(ftp_index_entry_t) + length + 1);
+    if (NULL == entry) {
+        return NULL;
+    }
+
+    const char *name = memrchr(path, '/', length);
+    entry->hash = hash;
+    entry->type = type;
+    entry->size = (FTP_MATCH_FILE == type) ? (uint64_t)info->st_size : 0;
+    entry->mtime_ns = (FTP_MATCH_DIR == type) ? mtime_ns(info) : 0;
+    entry->path_length = length;
+    entry->name_offset = (NULL == name) ? 0 : name - path + 1;
+    memcpy(entry->path, path, length);
+
+    table_insert(entry);
+    ftp_index.pending[ftp_index.pending_count++] = entry;
+    return entry;
+}
+
+/* Removes @param path and, when it is a directory, everything below it. */
+static void remove_locked(const char *path, size_t length)
+{
+    if (0 < length && 0 < ftp_index.table_size) {
+        ftp_index_entry_t *entry = ftp_index.table[find_slot(path, length, xnet_xxh3(path, length))];
+        if (NULL == entry) {
+            return;
+        }
+
+        table_remove(entry);
+        entry->is_deleted = true;
+        ftp_index.deleted_count++;
+        if (FTP_MATCH_DIR != entry->type) {
+            return;
+        }
+    }
+
+    char prefix[FTP_MAX_PATH_LEN + 2] = {0};
+    snprintf(prefix, sizeof(prefix), "%s/", path);
+    size_t prefix_length = length + 1;
+
+    settle_locked();
+    for (size_t n = lower_bound(ftp_index.by_path, NULL, prefix, false); n < ftp_index.sorted_count; n++) {
+        ftp_index_entry_t *entry = ftp_index.by_path[n];
+        if (0 != strncmp(entry->path, prefix, prefix_length)) {
+            break;
+        }
+
+        if (false == entry->is_deleted) {
+            table_remove(entry);
+            entry->is_deleted = true;
+            ftp_index.deleted_count++;
+        }
+    }
+}
+
+/* Merges pending entries into the sorted views and frees deleted ones, once there are enough to bother. */
+static void settle_locked(void)
+{
+    if (0 == ftp_index.pending_count && ftp_index.deleted_count * 4 <= ftp_index.sorted_count) {
+        return;
+    }
+
+    size_t live = 0;
+    for (size_t n = 0; n < ftp_index.pending_count; n++) {
+        ftp_index_entry_t *entry = ftp_index.pending[n];
+        if (entry->is_deleted) {
+            ftp_index.deleted_count--;
+            nfree((void **)&entry);
+            continue;
+        }
+        ftp_index.pending[live++] = entry;
+    }
+
+    size_t total = ftp_index.sorted_count + live;
+    ftp_index_entry_t **by_path = malloc((total + 1) * sizeof(ftp_index_entry_t *));
+    ftp_index_entry_t **by_name = malloc((total + 1) * sizeof(ftp_index_entry_t *));
+    if (NULL == by_path || NULL == by_name) {
+        /* Searches still see the old views. The pending entries wait for the next try. */
+        ftp_index.pending_count = live;
+        nfree((void **)&by_path);
+        nfree((void **)&by_name);
+        return;
+    }
+
+    ftp_index_entry_t **views[2] = {ftp_index.by_path, ftp_index.by_name};
+    ftp_index_entry_t **merged[2] = {by_path, by_name};
+    int (*compare[2])(const void *, const void *) = {compare_by_path, compare_by_name};
+    size_t count = 0;
+
+    for (int view = 0; view < 2; view++) {
+        qsort(ftp_index.pending, live, sizeof(ftp_index_entry_t *), compare[view]);
+
+        size_t old_n = 0;
+        size_t new_n = 0;
+        count = 0;
+        while (old_n < ftp_index.sorted_count || new_n < live) {
+            if (old_n < ftp_index.sorted_count && views[view][old_n]->is_deleted) {
+                old_n++;
+                continue;
+            }
+
+            bool take_old = new_n == live ||
+                            (old_n < ftp_index.sorted_count && 0 >= compare[view](&views[view][old_n], &ftp_index.pending[new_n]));
+            merged[view][count++] = take_old ? views[view][old_n++] : ftp_index.pending[new_n++];
+        }
+    }
+
+    for (size_t n = 0; n < ftp_index.sorted_count; n++) {
+        if (ftp_index.by_path[n]->is_deleted) {
+            nfree((void **)&ftp_index.by_path[n]);
+        }
+    }
+
+    nfree((void **)&ftp_index.by_path);
+    nfree((void **)&ftp_index.by_name);
+    ftp_index.by_path = by_path;
+    ftp_index.by_name = by_name;
+    ftp_index.sorted_count = count;
+    ftp_index.pending_count = 0;
+    ftp_index.deleted_count = 0;
+}
+
+/* Slot holding @param path, or the empty one where it would go. The table must not be empty. */
+static size_t find_slot(const char *path, size_t length, uint64_t hash)
+{
+    size_t mask = ftp_index.table_size - 1;
+
+    for (size_t n = hash & mask; ; n = (n + 1) & mask) {
+        ftp_index_entry_t *entry = ftp_index.table[n];
+        if (NULL == entry || (entry->hash == hash && entry->path_length == length && 0 == memcmp(entry->path, path, length))) {
+            return n;
+        }
+    }
+}
+
+static void table_insert(ftp_index_entry_t *entry)
+{
+    ftp_index.table[find_slot(entry->path, entry->path_length, entry->hash)] = entry;
+    ftp_index.table_count++;
+}
+
+static void table_remove(ftp_index_entry_t *entry)
+{
+    size_t mask = ftp_index.table_size - 1;
+    size_t hole = find_slot(entry->path, entry->path_length, entry->hash);
+    ftp_index.table[hole] = NULL;
+    ftp_index.table_count--;
+
+    /* Entries further along the probe run move back into the hole when it lies between them and their home slot. */
+    for (size_t n = (hole + 1) & mask; NULL != ftp_index.table[n]; n = (n + 1) & mask) {
+        size_t home = ftp_index.table[n]->hash & mask;
+        bool is_reachable = (hole < n) ? (hole < home && home <= n) : (hole < home || home <= n);
+        if (is_reachable) {
+            continue;
+        }
+
+        ftp_index.table[hole] = ftp_index.table[n];
+        ftp_index.table[n] = NULL;
+        hole = n;
+    }
+}
+
+/* First position in @param array at or, when @param is_upper, past the key. A NULL name compares paths only. */
+static size_t lower_bound(ftp_index_entry_t **array, const char *name, const char *path, bool is_upper)
+{
+    size_t low = 0;
+    size_t high = ftp_index.sorted_count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int order = compare_key(array[middle], name, path);
+        if (0 > order || (is_upper && 0 == order)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static int compare_key(const ftp_index_entry_t *entry, const char *name, const char *path)
+{
+    int order = (NULL == name) ? 0 : strcmp(entry->path + entry->name_offset, name);
+    return (0 != order || NULL == path) ? order : strcmp(entry->path, path);
+}
+
+static int compare_by_path(const void *lhs, const void *rhs)
+{
+    const ftp_index_entry_t *left = *(ftp_index_entry_t * const *)lhs;
+    const ftp_index_entry_t *right = *(ftp_index_entry_t * const *)rhs;
+    return strcmp(left->path, right->path);
+}
+
+static int compare_by_name(const void *lhs, const void *rhs)
+{
+    const ftp_index_entry_t *left = *(ftp_index_entry_t * const *)lhs;
+    const ftp_index_entry_t *right = *(ftp_index_entry_t * const *)rhs;
+    return compare_key(left, right->path + right->name_offset, right->path);
+}
+
+static bool is_indexed(const char *name, const struct stat *info)
+{
+    if (S_ISDIR(info->st_mode)) {
+        return true;
+    }
+
+    /* Puts in flight aren't files yet. */
+    size_t name_length = strlen(name);
+    size_t suffix_length = strlen(FTP_PART_SUFFIX);
+    bool is_part = suffix_length <= name_length && 0 == strcmp(name + name_length - suffix_length, FTP_PART_SUFFIX);
+    return S_ISREG(info->st_mode) && false == is_part;
+}
+
+static int64_t mtime_ns(const struct stat *info)
+{
+    return (int64_t)info->st_mtim.tv_sec * 1000000000 + info->st_mtim.tv_nsec;
+}
+
+static double now_ms(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
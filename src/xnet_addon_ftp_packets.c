@@ -0,0 +1,994 @@
+#include "xnet_addon_ftp_packets.h"
+
+/* Generated by tools/packetgen.py. Do not edit, run 'make packets'. */
+
+/* Inline, so schemas that don't need every helper compile without warnings. */
+static inline uint16_t get_be16(const char *src)
+{
+    uint16_t value = 0;
+    memcpy(&value, src, sizeof(value));
+    return ntohs(value);
+}
+
+static inline uint32_t get_be32(const char *src)
+{
+    uint32_t value = 0;
+    memcpy(&value, src, sizeof(value));
+    return ntohl(value);
+}
+
+static inline uint64_t get_be64(const char *src)
+{
+    uint64_t value = 0;
+    memcpy(&value, src, sizeof(value));
+    return be64toh(value);
+}
+
+static inline void put_be16(char *dst, uint16_t value)
+{
+    value = htons(value);
+    memcpy(dst, &value, sizeof(value));
+}
+
+static inline void put_be32(char *dst, uint32_t value)
+{
+    value = htonl(value);
+    memcpy(dst, &value, sizeof(value));
+}
+
+static inline void put_be64(char *dst, uint64_t value)
+{
+    value = htobe64(value);
+    memcpy(dst, &value, sizeof(value));
+}
+
+/* Views longer than their field are cut short. Empty views may have no data at all. */
+static inline size_t clamp_view(const ftp_view_t *view, size_t max_length)
+{
+    if (NULL == view->data) {
+        return 0;
+    }
+    return (max_length < view->length) ? max_length : view->length;
+}
+
+static inline void put_padded(char *dst, const ftp_view_t *view, size_t size)
+{
+    size_t length = clamp_view(view, size);
+    if (0 < length) {
+        memcpy(dst, view->data, length);
+    }
+    memset(dst + length, 0, size - length);
+}
+
+static inline int read_exact(xnet_active_connection_t *conn, char *dst, size_t length)
+{
+    while (0 < length) {
+        ssize_t bytes_read = xnet_conn_read(conn, dst, length);
+        if (-1 == bytes_read && EINTR == errno) {
+            continue;
+        }
+        if (0 >= bytes_read) {
+            return E_GEN_OUT_RANGE;
+        }
+        dst += bytes_read;
+        length -= bytes_read;
+    }
+    return 0;
+}
+
+int ftp_create_parse_request(const char *buf, size_t length, ftp_create_request_t *out)
+{
+    size_t offset = 0;
+
+    /* path */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length || (size_t)path_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->path.data = buf + offset;
+    out->path.length = path_length;
+    offset += path_length;
+
+    return 0;
+}
+
+int ftp_create_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_create_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return ftp_create_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* path */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(scratch + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, path_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += path_length;
+
+    return ftp_create_parse_request(scratch, offset, out);
+}
+
+size_t ftp_create_write_reply(char *out, const ftp_create_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, FTP_CREATE_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    return offset;
+}
+
+int ftp_mkdir_parse_request(const char *buf, size_t length, ftp_mkdir_request_t *out)
+{
+    size_t offset = 0;
+
+    /* path */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length || (size_t)path_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->path.data = buf + offset;
+    out->path.length = path_length;
+    offset += path_length;
+
+    return 0;
+}
+
+int ftp_mkdir_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_mkdir_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return ftp_mkdir_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* path */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(scratch + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, path_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += path_length;
+
+    return ftp_mkdir_parse_request(scratch, offset, out);
+}
+
+size_t ftp_mkdir_write_reply(char *out, const ftp_mkdir_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, FTP_MKDIR_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    return offset;
+}
+
+int ftp_search_parse_request(const char *buf, size_t length, ftp_search_request_t *out)
+{
+    size_t offset = 0;
+
+    /* pattern */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t pattern_length = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < pattern_length || (size_t)pattern_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->pattern.data = buf + offset;
+    out->pattern.length = pattern_length;
+    offset += pattern_length;
+
+    /* mode */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->mode = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+    if (1 != out->mode && 2 != out->mode) {
+        return E_GEN_OUT_RANGE;
+    }
+
+    /* after */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t after_length = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < after_length || (size_t)after_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->after.data = buf + offset;
+    out->after.length = after_length;
+    offset += after_length;
+
+    /* limit */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->limit = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+
+    return 0;
+}
+
+int ftp_search_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_search_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return ftp_search_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* pattern */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t pattern_length = (uint16_t)get_be16(scratch + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < pattern_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, pattern_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += pattern_length;
+
+    /* mode */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 2;
+
+    /* after */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t after_length = (uint16_t)get_be16(scratch + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < after_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, after_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += after_length;
+
+    /* limit */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 2;
+
+    return ftp_search_parse_request(scratch, offset, out);
+}
+
+size_t ftp_search_write_reply(char *out, const ftp_search_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, FTP_SEARCH_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    return offset;
+}
+
+int ftp_get_parse_request(const char *buf, size_t length, ftp_get_request_t *out)
+{
+    size_t offset = 0;
+
+    /* path */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length || (size_t)path_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->path.data = buf + offset;
+    out->path.length = path_length;
+    offset += path_length;
+
+    /* offset */
+    if (8 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->offset = (uint64_t)get_be64(buf + offset);
+    offset += 8;
+
+    /* length */
+    if (8 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->length = (uint64_t)get_be64(buf + offset);
+    offset += 8;
+
+    return 0;
+}
+
+int ftp_get_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_get_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return ftp_get_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* path */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(scratch + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, path_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += path_length;
+
+    /* offset */
+    if (0 != read_exact(conn, scratch + offset, 8)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 8;
+
+    /* length */
+    if (0 != read_exact(conn, scratch + offset, 8)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 8;
+
+    return ftp_get_parse_request(scratch, offset, out);
+}
+
+size_t ftp_get_write_reply(char *out, const ftp_get_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, FTP_GET_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    /* size */
+    put_be64(out + offset, (uint64_t)in->size);
+    offset += 8;
+
+    /* offset */
+    put_be64(out + offset, (uint64_t)in->offset);
+    offset += 8;
+
+    /* length */
+    put_be64(out + offset, (uint64_t)in->length);
+    offset += 8;
+
+    return offset;
+}
+
+int ftp_put_parse_request(const char *buf, size_t length, ftp_put_request_t *out)
+{
+    size_t offset = 0;
+
+    /* path */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length || (size_t)path_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->path.data = buf + offset;
+    out->path.length = path_length;
+    offset += path_length;
+
+    /* size */
+    if (8 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->size = (uint64_t)get_be64(buf + offset);
+    offset += 8;
+
+    /* offset */
+    if (8 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->offset = (uint64_t)get_be64(buf + offset);
+    offset += 8;
+
+    /* length */
+    if (8 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->length = (uint64_t)get_be64(buf + offset);
+    offset += 8;
+
+    return 0;
+}
+
+int ftp_put_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_put_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return ftp_put_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* path */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(scratch + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, path_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += path_length;
+
+    /* size */
+    if (0 != read_exact(conn, scratch + offset, 8)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 8;
+
+    /* offset */
+    if (0 != read_exact(conn, scratch + offset, 8)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 8;
+
+    /* length */
+    if (0 != read_exact(conn, scratch + offset, 8)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 8;
+
+    return ftp_put_parse_request(scratch, offset, out);
+}
+
+size_t ftp_put_write_reply(char *out, const ftp_put_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, FTP_PUT_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    /* stage */
+    put_be16(out + offset, (uint16_t)in->stage);
+    offset += 2;
+
+    /* offset */
+    put_be64(out + offset, (uint64_t)in->offset);
+    offset += 8;
+
+    /* length */
+    put_be64(out + offset, (uint64_t)in->length);
+    offset += 8;
+
+    return offset;
+}
+
+int ftp_delete_parse_request(const char *buf, size_t length, ftp_delete_request_t *out)
+{
+    size_t offset = 0;
+
+    /* path */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length || (size_t)path_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->path.data = buf + offset;
+    out->path.length = path_length;
+    offset += path_length;
+
+    return 0;
+}
+
+int ftp_delete_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_delete_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return ftp_delete_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* path */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(scratch + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, path_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += path_length;
+
+    return ftp_delete_parse_request(scratch, offset, out);
+}
+
+size_t ftp_delete_write_reply(char *out, const ftp_delete_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, FTP_DELETE_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    return offset;
+}
+
+int ftp_status_parse_request(const char *buf, size_t length, ftp_status_request_t *out)
+{
+    size_t offset = 0;
+
+    /* path */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length || (size_t)path_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->path.data = buf + offset;
+    out->path.length = path_length;
+    offset += path_length;
+
+    /* first_chunk */
+    if (4 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->first_chunk = (uint32_t)get_be32(buf + offset);
+    offset += 4;
+
+    /* chunk_count */
+    if (4 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->chunk_count = (uint32_t)get_be32(buf + offset);
+    offset += 4;
+
+    return 0;
+}
+
+int ftp_status_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_status_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return ftp_status_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* path */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(scratch + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, path_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += path_length;
+
+    /* first_chunk */
+    if (0 != read_exact(conn, scratch + offset, 4)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 4;
+
+    /* chunk_count */
+    if (0 != read_exact(conn, scratch + offset, 4)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 4;
+
+    return ftp_status_parse_request(scratch, offset, out);
+}
+
+size_t ftp_status_write_reply(char *out, const ftp_status_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, FTP_STATUS_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    /* state */
+    put_be16(out + offset, (uint16_t)in->state);
+    offset += 2;
+
+    /* size */
+    put_be64(out + offset, (uint64_t)in->size);
+    offset += 8;
+
+    /* chunk_size */
+    put_be32(out + offset, (uint32_t)in->chunk_size);
+    offset += 4;
+
+    /* first_chunk */
+    put_be32(out + offset, (uint32_t)in->first_chunk);
+    offset += 4;
+
+    /* chunk_count */
+    put_be32(out + offset, (uint32_t)in->chunk_count);
+    offset += 4;
+
+    return offset;
+}
+
+int ftp_commit_parse_request(const char *buf, size_t length, ftp_commit_request_t *out)
+{
+    size_t offset = 0;
+
+    /* path */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length || (size_t)path_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->path.data = buf + offset;
+    out->path.length = path_length;
+    offset += path_length;
+
+    /* size */
+    if (8 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->size = (uint64_t)get_be64(buf + offset);
+    offset += 8;
+
+    /* algorithm */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->algorithm = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+    if (0 != out->algorithm && 1 != out->algorithm && 2 != out->algorithm) {
+        return E_GEN_OUT_RANGE;
+    }
+
+    /* digest */
+    if (8 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->digest = (uint64_t)get_be64(buf + offset);
+    offset += 8;
+
+    return 0;
+}
+
+int ftp_commit_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_commit_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return ftp_commit_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* path */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(scratch + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, path_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += path_length;
+
+    /* size */
+    if (0 != read_exact(conn, scratch + offset, 8)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 8;
+
+    /* algorithm */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 2;
+
+    /* digest */
+    if (0 != read_exact(conn, scratch + offset, 8)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 8;
+
+    return ftp_commit_parse_request(scratch, offset, out);
+}
+
+size_t ftp_commit_write_reply(char *out, const ftp_commit_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, FTP_COMMIT_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    return offset;
+}
+
+int ftp_checksum_parse_request(const char *buf, size_t length, ftp_checksum_request_t *out)
+{
+    size_t offset = 0;
+
+    /* path */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length || (size_t)path_length > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->path.data = buf + offset;
+    out->path.length = path_length;
+    offset += path_length;
+
+    /* algorithm */
+    if (2 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->algorithm = (uint16_t)get_be16(buf + offset);
+    offset += 2;
+    if (1 != out->algorithm && 2 != out->algorithm) {
+        return E_GEN_OUT_RANGE;
+    }
+
+    /* offset */
+    if (8 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->offset = (uint64_t)get_be64(buf + offset);
+    offset += 8;
+
+    /* length */
+    if (8 > length - offset) {
+        return E_GEN_OUT_RANGE;
+    }
+    out->length = (uint64_t)get_be64(buf + offset);
+    offset += 8;
+
+    return 0;
+}
+
+int ftp_checksum_recv_request(xnet_active_connection_t *conn, char *scratch, ftp_checksum_request_t *out)
+{
+    /* Framed requests are already whole. Views point straight into the frame. */
+    size_t length = 0;
+    const char *payload = xnet_conn_payload(conn, &length);
+    if (NULL != payload) {
+        return ftp_checksum_parse_request(payload, length, out);
+    }
+
+    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */
+    size_t offset = 0;
+
+    /* path */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    uint16_t path_length = (uint16_t)get_be16(scratch + offset);
+    offset += 2;
+    if (FTP_MAX_PATH_LEN < path_length) {
+        return E_GEN_OUT_RANGE;
+    }
+    if (0 != read_exact(conn, scratch + offset, path_length)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += path_length;
+
+    /* algorithm */
+    if (0 != read_exact(conn, scratch + offset, 2)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 2;
+
+    /* offset */
+    if (0 != read_exact(conn, scratch + offset, 8)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 8;
+
+    /* length */
+    if (0 != read_exact(conn, scratch + offset, 8)) {
+        return E_GEN_OUT_RANGE;
+    }
+    offset += 8;
+
+    return ftp_checksum_parse_request(scratch, offset, out);
+}
+
+size_t ftp_checksum_write_reply(char *out, const ftp_checksum_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, FTP_CHECKSUM_OP);
+    offset += 2;
+
+    /* return_code */
+    put_be16(out + offset, (uint16_t)in->return_code);
+    offset += 2;
+
+    /* offset */
+    put_be64(out + offset, (uint64_t)in->offset);
+    offset += 8;
+
+    /* length */
+    put_be64(out + offset, (uint64_t)in->length);
+    offset += 8;
+
+    /* digest */
+    put_be64(out + offset, (uint64_t)in->digest);
+    offset += 8;
+
+    return offset;
+}
+
+size_t ftp_search_end_write_reply(char *out, const ftp_search_end_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, FTP_SEARCH_END_OP);
+    offset += 2;
+
+    /* page */
+    put_be16(out + offset, (uint16_t)in->page);
+    offset += 2;
+
+    /* match_count */
+    put_be32(out + offset, (uint32_t)in->match_count);
+    offset += 4;
+
+    return offset;
+}
+
+size_t ftp_chunk_write_reply(char *out, const ftp_chunk_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, FTP_CHUNK_OP);
+    offset += 2;
+
+    /* index */
+    put_be32(out + offset, (uint32_t)in->index);
+    offset += 4;
+
+    /* crc32c */
+    put_be32(out + offset, (uint32_t)in->crc32c);
+    offset += 4;
+
+    return offset;
+}
+
+size_t ftp_match_write_reply(char *out, const ftp_match_reply_t *in)
+{
+    size_t offset = 0;
+
+    put_be16(out + offset, FTP_MATCH_OP);
+    offset += 2;
+
+    /* type */
+    put_be16(out + offset, (uint16_t)in->type);
+    offset += 2;
+
+    /* size */
+    put_be64(out + offset, (uint64_t)in->size);
+    offset += 8;
+
+    /* path */
+    size_t path_length = clamp_view(&in->path, FTP_MAX_PATH_LEN);
+    put_be16(out + offset, (uint16_t)path_length);
+    offset += 2;
+    if (0 < path_length) {
+        memcpy(out + offset, in->path.data, path_length);
+    }
+    offset += path_length;
+
+    return offset;
+}
@@ -2,6 +2,9 @@
 #include "xnet_utils.h"
 #include "xnet_userbase.h"
 #include "xnet_threads.h"
+#include "xnet_buffer.h"
+#include "xnet_frame.h"
+#include "xnet_ratelimit.h"
 
 /**
  * @brief Static function that contains XNet's event listening loop.
@@ -10,6 +13,12 @@
  */
 static void xnet_listen_loop(xnet_box_t *xnet);
 
+/**
+ * @brief Static function that serves an event on a client's socket or session timer, found through @param data.
+ *        Events of clients that left since they were queued are dropped.
+ */
+static void xnet_dispatch_client(xnet_box_t *xnet, uint64_t data, uint32_t events);
+
 /**
  * @brief Static function that's responsible for allocating all necessary memory in a xnet_box_t.
  * 
@@ -126,9 +135,14 @@ int xnet_start(xnet_box_t *xnet)
     }
 
     /* Allocate space for connections. */
-    xnet->connections->clients = calloc(xnet->general->max_connections, sizeof(xnet_active_connection_t));
-    if (NULL == xnet->connections->clients) {
-        err = E_GEN_FAIL_ALLOC;
+    err = xnet_init_connections(xnet);
+    if (0 != err) {
+        goto handle_err;
+    }
+
+    /* Output queues and the mailbox other threads hand the reactor work through. */
+    err = xnet_init_outbound(xnet);
+    if (0 != err) {
         goto handle_err;
     }
 
@@ -136,8 +150,11 @@ int xnet_start(xnet_box_t *xnet)
     printf("[XNet]\nIP: %s\nPort: %ld\n", xnet->general->ip, xnet->general->port);
     xnet->general->is_running = true;
 
-    /* Initialize srand, used for session id generation. */
-    srand(time(NULL));
+    /* Prepare the table that lets dropped clients resume their session. */
+    err = xnet_init_tokens(xnet->userbase, xnet->general->max_connections * 2, XNET_TOKEN_TTL_DEFAULT);
+    if (0 != err) {
+        goto handle_err;
+    }
 
     /* Setup initial state for epoll. */
     xnet->network->epoll_fd = epoll_create1(0);
@@ -147,6 +164,33 @@ int xnet_start(xnet_box_t *xnet)
     epoll_ctl_add(xnet->network->epoll_fd, &xnet_event, xnet->network->xnet_socket, EPOLLIN);
     set_non_blocking(xnet->network->xnet_socket);
 
+    /* Poked when the mailbox gets something in it: output to write, read sides handed back, clients to hang up on. */
+    epoll_ctl_add(xnet->network->epoll_fd, &xnet->network->mail_event, xnet->network->mail_fd, EPOLLIN);
+
+    /* Wakes the reactor for requests a rate limit held back. */
+    err = xnet_init_rate_limits(xnet);
+    if (0 != err) {
+        goto handle_err;
+    }
+
+    /* Workers poke this when a slot frees up for requests paused on a full queue. */
+    err = xnet_init_overload(xnet);
+    if (0 != err) {
+        goto handle_err;
+    }
+
+    /* Looks for clients that stopped reading what they are sent. */
+    err = xnet_init_slow_sweep(xnet);
+    if (0 != err) {
+        goto handle_err;
+    }
+
+    /* Looks for handlers that overran their deadline. */
+    err = xnet_init_watchdog(xnet);
+    if (0 != err) {
+        goto handle_err;
+    }
+
     /* Create dispositions for SIGINT and SIGQUIT. */
     xnet_signal_disposition(xnet);
 
@@ -214,11 +258,21 @@ int xnet_destroy(xnet_box_t *xnet)
     /* Userbase needs special treatment due to child allocations. */
     xnet_destroy_userbase(xnet->userbase);
 
+    /* Drop queued output before the connections it belongs to. */
+    xnet_destroy_outbound(xnet);
+    xnet_destroy_rate_limits(xnet);
+    xnet_destroy_overload(xnet);
+    xnet_destroy_watchdog(xnet);
+    xnet_destroy_rx_pool(xnet);
+
     /* Free all allocations related to a XNet server. */
     nfree((void **)&xnet->general);
     nfree((void **)&xnet->network);
     nfree((void **)&xnet->thread);
     nfree((void **)&xnet->connections->clients);
+    nfree((void **)&xnet->connections->hot);
+    nfree((void **)&xnet->connections->cold);
+    nfree((void **)&xnet->connections->rate_buckets);
     nfree((void **)&xnet->connections);
     nfree((void **)&xnet);
 
@@ -239,7 +293,15 @@ static void xnet_listen_loop(xnet_box_t *xnet)
         int event_count = epoll_wait(xnet->network->epoll_fd, xnet->network->ep_events, XNET_EPOLL_MAX_EVENTS, -1);
     
         for (int i = 0; i < event_count; i++) {
-            int current_event = xnet->network->ep_events[i].data.fd;
+            uint64_t event_data = xnet->network->ep_events[i].data.u64;
+
+            /* Clients register their handle instead of the fd, see xnet_event_data(). */
+            if (0 != event_data >> 32) {
+                xnet_dispatch_client(xnet, event_data, xnet->network->ep_events[i].events);
+                continue;
+            }
+
+            int current_event = (int)event_data;
 
             /* If event triggers on listening socket, a connection is being attempted. */
             if (xnet->network->xnet_socket == current_event) {
@@ -249,20 +311,65 @@ static void xnet_listen_loop(xnet_box_t *xnet)
             } else if (xnet->network->signal_fd == current_event) {
                 xnet->general->on_terminate_signal(xnet);
 
-            /* If event triggers and was matched to a client socket, we are working with a client request. */
-            } else if (NULL != xnet_get_conn_by_socket(xnet, current_event)) {
-                xnet_active_connection_t *noisy_client = xnet_get_conn_by_socket(xnet, current_event);
-                xnet->general->on_client_send(xnet, noisy_client);
+            /* If event triggers on mail fd, other threads left connections for the reactor to act on. */
+            } else if (xnet->network->mail_fd == current_event) {
+                xnet_read_mailbox(xnet);
+
+            /* If event triggers on rate fd, requests held back by a rate limit are due. */
+            } else if (xnet->network->rate_fd == current_event) {
+                xnet_rate_resume(xnet);
 
-            /* If event triggers on any other fd within the event array, it is a session's fd. */
-            } else {
-                xnet_active_connection_t *expired_client = xnet_get_conn_by_session(xnet, current_event);
-                xnet->general->on_session_expire(xnet, expired_client);
+            /* If event triggers on room fd, the task queue has room for requests paused on it. */
+            } else if (xnet->network->room_fd == current_event) {
+                xnet_overload_resume(xnet);
+
+            /* If event triggers on slow fd, it is time to look for connections whose output stalled. */
+            } else if (xnet->network->slow_fd == current_event) {
+                xnet_sweep_slow(xnet);
+
+            /* If event triggers on watchdog fd, it is time to check running handlers against their deadline. */
+            } else if (xnet->network->watchdog_fd == current_event) {
+                xnet_watchdog_sweep(xnet);
             }
         }
     }
 }
 
+static void xnet_dispatch_client(xnet_box_t *xnet, uint64_t data, uint32_t events)
+{
+    /* Its client left earlier in this batch. Whoever has the slot now registered with another generation. */
+    xnet_active_connection_t *noisy_client = xnet_conn_from_event(xnet, data);
+    if (NULL == noisy_client) {
+        return;
+    }
+
+    /* If event triggers on a session's fd, the client sat idle for too long. */
+    if (data & XNET_EVENT_SESSION) {
+        xnet->general->on_session_expire(xnet, noisy_client);
+        return;
+    }
+
+    /* Socket has room again, push out whatever is queued. */
+    if (events & EPOLLOUT) {
+        pthread_mutex_lock(&noisy_client->io_lock);
+        xnet_flush_connection(noisy_client);
+        pthread_mutex_unlock(&noisy_client->io_lock);
+    }
+
+    /* Hangups are reported even while a worker owns the read side. Those wait for the worker.
+       Only the reactor changes is_working, so the hot entry can be read without the lock. */
+    if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && false == noisy_client->hot->is_working) {
+        xnet->general->on_client_send(xnet, noisy_client);
+    }
+
+    /* Oneshot, so register again for whatever the connection needs now. */
+    pthread_mutex_lock(&noisy_client->io_lock);
+    if (noisy_client->hot->is_active) {
+        xnet_arm_connection(xnet, noisy_client);
+    }
+    pthread_mutex_unlock(&noisy_client->io_lock);
+}
+
 static xnet_box_t *initialize_xnet_box(void)
 {
     int err = 0;
@@ -331,11 +438,33 @@ static int xnet_configure(xnet_box_t *xnet)
     /* ----------GENERAL CATEGORY---------- */
     xnet->general->is_running            = false;
     xnet->general->max_connections       = XNET_MAX_CONNECTIONS_DEFAULT;
+    xnet->general->fanout_threshold      = XNET_FANOUT_THRESHOLD_DEFAULT;
+    xnet->general->write_through         = false;
+    xnet->general->legacy_framing        = true;
+    xnet->general->rate_rule_count       = 1;
+    xnet->general->overload_policy       = XNET_OVERLOAD_PAUSE;
+    xnet->general->slow_policy           = XNET_SLOW_DISCONNECT;
+    xnet->general->slow_max_bytes        = XNET_SLOW_MAX_BYTES_DEFAULT;
+    xnet->general->slow_timeout_ms       = XNET_SLOW_TIMEOUT_MS_DEFAULT;
     xnet->general->on_connection_attempt = NULL;
     xnet->general->on_terminate_signal   = NULL;
     xnet->general->on_client_send        = NULL;
 
     /* ----------NETWORK CATEGORY---------- */
+    xnet->network->mail_fd = -1;
+    xnet->network->rate_fd  = -1;
+    xnet->network->room_fd  = -1;
+    xnet->network->slow_fd  = -1;
+    xnet->network->watchdog_fd = -1;
+
+    /* Every opcode is as important as the next until told otherwise. */
+    memset(xnet->general->priority_of, XNET_PRIORITY_NORMAL, sizeof(xnet->general->priority_of));
+
+    /* Likewise every handler gets the same time to run. */
+    for (size_t n = 0; n < XNET_MAX_FEATURES; n++) {
+        xnet->general->deadline_ms_of[n] = XNET_DEADLINE_MS_DEFAULT;
+    }
+
     /* Need the string representation of port for getaddrinfo()
      * 24 bytes is an arbitrarily chosen value for the 'stringified' port to fall
      * into. 
@@ -423,6 +552,12 @@ static int xnet_signal_disposition(xnet_box_t *xnet)
         goto handle_err;
     }
 
+    /* sendfile() and splice() have no MSG_NOSIGNAL. A peer hanging up mid-transfer must cost an EPIPE, not the server. */
+    if (SIG_ERR == signal(SIGPIPE, SIG_IGN)) {
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
     /* Modify signal's default dispositions */
     err = sigprocmask(SIG_BLOCK, &xnet->network->mask, NULL);
     if (-1 == err) {
@@ -467,6 +602,19 @@ static void xnet_default_on_connection_attempt(xnet_box_t *xnet)
         close(client_socket);
         return;
     }
+
+    /* A client whose connect callbacks can't be queued would be half set up. Better to turn it away. */
+    size_t callback_count = 0;
+    while (XNET_MAX_CALLBACKS > callback_count && NULL != xnet->general->on_client_connect[callback_count]) {
+        callback_count++;
+    }
+
+    if (xnet_work_room(xnet) < callback_count) {
+        __atomic_fetch_add(&xnet->thread->overload.refused, 1, __ATOMIC_RELAXED);
+        fprintf(stderr, "Task queue is full. Denying inbound connection.\n");
+        close(client_socket);
+        return;
+    }
     
     /* Create XNet connection for client. */
     xnet_active_connection_t *new_client = xnet_create_connection(xnet, client_socket);
@@ -477,10 +625,12 @@ static void xnet_default_on_connection_attempt(xnet_box_t *xnet)
     }
 
     /* Add client socket fd to epoll's event list. */
-    int event_status = epoll_ctl_add(xnet->network->epoll_fd, &new_client->client_event, client_socket, EPOLLIN | EPOLLONESHOT);
+    struct epoll_event client_event = {0};
+    int event_status = epoll_ctl_add_data(xnet->network->epoll_fd, &client_event, client_socket,
+                                          xnet_event_data(xnet, new_client, false), EPOLLIN | EPOLLONESHOT);
     if (-1 == event_status) {
         fprintf(stderr, "Failed to add socket fd to epoll event. Dropping connection.\n");
-        close(client_socket);
+        xnet_close_connection(xnet, new_client);
         return;
     }
 
@@ -498,15 +648,27 @@ static void xnet_default_on_connection_attempt(xnet_box_t *xnet)
         if (NULL == new_task) {
             fprintf(stderr, "Server is out of memory. Breaking out.\n");
             xnet_shutdown(xnet);
+            break;
         }
 
         /* Configure new task and submit for work. */
         new_task->task_function = xnet->general->on_client_connect[n];
         new_task->xnet = xnet;
         new_task->me = new_client;
+        new_task->handle = xnet_conn_handle(xnet, new_client);
+        new_task->priority = XNET_PRIORITY_HIGH;
         pthread_mutex_init(&new_task->task_lock, NULL);
 
-        xnet_work_push(xnet, new_task);
+        /* Room was checked above, but other threads submit jobs too. Never block the reactor on them, and never run
+           a callback on it either. The client is let go, callbacks queued already find their connection gone. */
+        if (false == xnet_work_try_push(xnet, new_task)) {
+            pthread_mutex_destroy(&new_task->task_lock);
+            nfree((void **)&new_task);
+            __atomic_fetch_add(&xnet->thread->overload.refused, 1, __ATOMIC_RELAXED);
+            fprintf(stderr, "Task queue is full. Dropping connection.\n");
+            xnet_close_connection(xnet, new_client);
+            break;
+        }
     }
 
     xnet_debug_connections(xnet);
@@ -527,40 +689,41 @@ static void xnet_default_on_terminate_signal(xnet_box_t *xnet)
 
 static void xnet_default_on_client_send(xnet_box_t *xnet, xnet_active_connection_t *me)
 {
-    short current_op = xnet_get_opcode(xnet, me->client_event.data.fd);
+    short current_op = 0;
+    enum xnet_frame_status status = XNET_FRAME_PENDING;
+    bool is_admitted = false;
+
+    /* A held request goes before anything read after it. */
+    if (me->hot->rx_held) {
+        status = xnet_rate_take_held(xnet, me, &current_op, &is_admitted);
+    } else {
+        status = xnet_read_frame(xnet, me, &current_op);
+    }
 
-    /* Check EOF */
-    if (0 == current_op) {
+    /* Partial frame, a held request that isn't due, or the client hung up. */
+    if (XNET_FRAME_PENDING == status) {
         return;
     }
 
-    /* Ensure received opcode does not exceed feature max. */
+    /* Framed requests were checked by xnet_read_frame(). Legacy ones can only be flushed. */
     if (XNET_MAX_FEATURES <= current_op) {
-        flush_buffer(me->client_event.data.fd);
+        flush_buffer(me->socket);
         fprintf(stderr, "Invalid opcode [%d] detected. Ignoring request.\n", current_op);
         return;
     }
 
-    /* If opcode is supported, call requested feature's function. */
-    if (NULL != xnet->general->perform[current_op]) {
-        /* Allocate new task. */
-        xnet_task_t *new_task = calloc(1, sizeof(xnet_task_t));
-        if (NULL == new_task) {
-            fprintf(stderr, "Server is out of memory. Breaking out.\n");
-            xnet_shutdown(xnet);
-        }
-
-        /* Configure new task and submit for work. */
-        new_task->task_function = xnet->general->perform[current_op];
-        new_task->xnet = xnet;
-        new_task->me = me;
-        pthread_mutex_init(&new_task->task_lock, NULL);
+    /* Over the limit costs a bucket check here, not a task. Requests that only waited on the queue were charged. */
+    if (false == is_admitted && false == xnet_rate_admit(xnet, me, current_op, status)) {
+        return;
+    }
 
-        xnet_work_push(xnet, new_task);
+    /* If opcode is supported, call requested feature's function. A full queue never blocks the reactor. */
+    if (NULL != xnet->general->perform[current_op]) {
+        xnet_submit_request(xnet, me, current_op, status);
     } else {
         /* Flush out any remaining data in buffer. */
         fprintf(stderr, "Unsupported opcode [%d] detected. Ignoring request.\n", current_op);
-        flush_buffer(me->client_event.data.fd);
+        flush_buffer(me->socket);
     }
     
     return;
@@ -582,12 +745,21 @@ static void xnet_default_on_session_expire(xnet_box_t *xnet, xnet_active_connect
     }
 
     /* Ensure the client is not working before closing a connection. */
-    if (false == me->is_working) {
+    if (false == me->hot->is_working) {
         flush_buffer(me->socket);
         xnet_close_connection(xnet, me);
         xnet_debug_connections(xnet);
+        return;
     }
 
+    /* Otherwise the handler is asked to stop and the client hung up on. The reactor closes the connection on the
+       hangup once the handler returns. Reading the timer keeps it from firing again meanwhile. */
+    uint64_t expirations = 0;
+    ssize_t bread = read(me->session.timer_fd, &expirations, sizeof(expirations));
+    (void)bread;
+    xnet_cancel_request(me);
+    shutdown(me->socket, SHUT_RDWR);
+
     return;
 
     /* Unreachable unless error is triggered. */
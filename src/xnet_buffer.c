@@ -0,0 +1,1350 @@
+#include "xnet_buffer.h"
+
+/**
+ * @brief Appends @param buf to @param conn's output queue, taking over one of the caller's references.
+ *        Caller must hold conn->io_lock.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+static int enqueue_locked(xnet_active_connection_t *conn, xnet_shared_buf_t *buf, size_t offset);
+
+/**
+ * @brief Appends @param node to @param conn's output queue. Caller must hold conn->io_lock.
+ */
+static void link_locked(xnet_active_connection_t *conn, xnet_outbound_t *node);
+
+/**
+ * @brief sendfile()s what the socket takes of the file at the head of @param conn's output queue, within @param budget.
+ *        Caller must hold conn->io_lock.
+ *
+ * @return int 0 once the socket is full or the budget is spent, 1 after the file went out whole.
+ *         -1 when the transfer broke and the connection was shut down.
+ */
+static int flush_file(xnet_active_connection_t *conn, size_t *budget);
+
+/**
+ * @brief Queues @param data on @param conn for the reactor. With write-through on and nothing queued, writes what
+ *        the socket takes first and only queues the rest.
+ *        Caller must hold conn->io_lock and has to wake the reactor when @param needs_flush comes back set.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+static int send_locked(xnet_box_t *xnet, xnet_active_connection_t *conn, const void *data, size_t length, bool *needs_flush);
+
+/**
+ * @brief Applies the slow consumer policy once @param conn has more unsent output than the cap allows.
+ *        Caller must hold conn->io_lock.
+ */
+static void check_backlog_locked(xnet_box_t *xnet, xnet_active_connection_t *conn);
+
+/**
+ * @brief Unlinks broadcasts @param conn hasn't started on, oldest first. All of them when @param keep is 0, otherwise
+ *        until no more than @param keep bytes are queued. Caller must hold conn->io_lock.
+ *
+ * @return uint32_t Number of broadcasts dropped.
+ */
+static uint32_t drop_broadcasts_locked(xnet_active_connection_t *conn, size_t keep);
+
+/**
+ * @brief Adds @param dropped to the count in @param conn's lagged packet, queueing one when there is none left to
+ *        update. Caller must hold conn->io_lock.
+ *
+ * @return int 0 on success, non-zero on failure.
+ */
+static int queue_lagged_locked(xnet_box_t *xnet, xnet_active_connection_t *conn, uint32_t dropped);
+
+/**
+ * @brief Drops what @param conn has queued and hangs up. The reactor closes it on the HUP, running the disconnect
+ *        callbacks with @param reason in conn->close_reason. Caller must hold conn->io_lock.
+ */
+static void evict_locked(xnet_box_t *xnet, xnet_active_connection_t *conn, enum xnet_close_reason reason);
+
+static uint64_t monotonic_ns(void);
+
+/**
+ * @brief Links a chain of connections into the mailbox and wakes the reactor if it was empty.
+ */
+static void wake_reactor(xnet_box_t *xnet, xnet_active_connection_t *chain_head, xnet_active_connection_t *chain_tail);
+
+/**
+ * @brief Hands bufs[conn->wire_format] to every connection in @param targets except @param skip and wakes the reactor
+ *        for the ones left with output. With @param write_through set, connections with nothing queued are
+ *        written to directly and only what the socket refuses is queued. Only for callers that checked
+ *        xnet->general->write_through.
+ *
+ * @return size_t Number of connections the buffer was written or queued to.
+ */
+static size_t deliver_range(xnet_box_t *xnet, const xnet_conn_handle_t *targets, size_t count,
+                            xnet_shared_buf_t *const bufs[XNET_WIRE_FORMATS], xnet_conn_handle_t skip,
+                            bool write_through);
+
+/**
+ * @brief One parallel broadcast. Workers claim chunks of the member list until none are left.
+ */
+typedef struct fanout_job {
+    int ref_count;
+    xnet_shared_buf_t *const *bufs;
+    const xnet_conn_handle_t *targets;
+    xnet_conn_handle_t skip;
+    size_t count;
+    size_t chunk_count;
+    size_t next_chunk;
+    size_t queued;
+    size_t chunks_done;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+} fanout_job_t ;
+
+/**
+ * @brief Claims and delivers chunks of @param job until every chunk has been claimed.
+ */
+static void fanout_run_chunks(xnet_box_t *xnet, fanout_job_t *job);
+
+/**
+ * @brief Pool side of a parallel broadcast. Helps with whatever chunks are left, then lets go of the job.
+ */
+static int fanout_helper(xnet_box_t *xnet, void *arg);
+
+/**
+ * @brief Drops a reference to @param job. The last reference frees it.
+ */
+static void fanout_release(fanout_job_t *job);
+
+xnet_shared_buf_t *xnet_buf_alloc(size_t length)
+{
+    int err = 0;
+
+    xnet_shared_buf_t *buf = malloc(sizeof(xnet_shared_buf_t) + length);
+    if (NULL == buf) {
+        err = E_GEN_FAIL_ALLOC;
+        goto handle_err;
+    }
+
+    buf->ref_count = 1;
+    buf->length = length;
+
+    return buf;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_buf_alloc()");
+    return NULL;
+}
+
+void xnet_buf_ref(xnet_shared_buf_t *buf)
+{
+    if (NULL == buf) {
+        return;
+    }
+
+    __atomic_add_fetch(&buf->ref_count, 1, __ATOMIC_RELAXED);
+}
+
+void xnet_buf_release(xnet_shared_buf_t *buf)
+{
+    if (NULL == buf) {
+        return;
+    }
+
+    /* Last one out frees the buffer. */
+    if (0 == __atomic_sub_fetch(&buf->ref_count, 1, __ATOMIC_ACQ_REL)) {
+        free(buf);
+    }
+}
+
+int xnet_init_outbound(xnet_box_t *xnet)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == xnet->connections->clients) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    /* Bumped to tell the reactor the mailbox has something in it. */
+    xnet->network->mail_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (-1 == xnet->network->mail_fd) {
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    xnet->network->mailbox = NULL;
+
+    for (size_t n = 0; n < xnet->general->max_connections; n++) {
+        pthread_mutex_init(&xnet->connections->clients[n].io_lock, NULL);
+    }
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_init_outbound()");
+    return err;
+}
+
+void xnet_destroy_outbound(xnet_box_t *xnet)
+{
+    /* Nothing was set up if the server never started. */
+    if (NULL == xnet || NULL == xnet->connections->clients || -1 == xnet->network->mail_fd) {
+        return;
+    }
+
+    for (size_t n = 0; n < xnet->general->max_connections; n++) {
+        xnet_active_connection_t *conn = &xnet->connections->clients[n];
+        pthread_mutex_lock(&conn->io_lock);
+        xnet_drop_output(conn);
+        xnet_compress_destroy(conn->compress);
+        conn->compress = NULL;
+        pthread_mutex_unlock(&conn->io_lock);
+        pthread_mutex_destroy(&conn->io_lock);
+    }
+
+    close(xnet->network->mail_fd);
+    xnet->network->mail_fd = -1;
+
+    if (-1 != xnet->network->slow_fd) {
+        close(xnet->network->slow_fd);
+        xnet->network->slow_fd = -1;
+    }
+}
+
+int xnet_send(xnet_box_t *xnet, xnet_active_connection_t *conn, const void *data, size_t length)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == conn) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == data) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    pthread_mutex_lock(&conn->io_lock);
+
+    if (false == conn->hot->is_active) {
+        pthread_mutex_unlock(&conn->io_lock);
+        err = E_SRV_BAD_SOCKET;
+        goto handle_err;
+    }
+
+    bool needs_flush = false;
+    err = send_locked(xnet, conn, data, length, &needs_flush);
+
+    pthread_mutex_unlock(&conn->io_lock);
+
+    if (0 != err) {
+        goto handle_err;
+    }
+
+    if (needs_flush) {
+        wake_reactor(xnet, conn, conn);
+    }
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_send()");
+    return err;
+}
+
+int xnet_send_file(xnet_box_t *xnet, xnet_active_connection_t *conn, const void *header, size_t header_length,
+                   int fd, size_t offset, size_t length)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == conn) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (0 > fd) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    if (NULL == header) {
+        close(fd);
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    xnet_outbound_t *node = malloc(sizeof(xnet_outbound_t));
+    if (NULL == node) {
+        close(fd);
+        err = E_GEN_FAIL_ALLOC;
+        goto handle_err;
+    }
+
+    node->buf = NULL;
+    node->offset = offset;
+    node->file_fd = fd;
+    node->file_end = offset + length;
+    node->is_droppable = false;
+    node->next = NULL;
+
+    pthread_mutex_lock(&conn->io_lock);
+
+    if (false == conn->hot->is_active) {
+        pthread_mutex_unlock(&conn->io_lock);
+        close(fd);
+        nfree((void **)&node);
+        err = E_SRV_BAD_SOCKET;
+        goto handle_err;
+    }
+
+    bool needs_flush = false;
+    err = send_locked(xnet, conn, header, header_length, &needs_flush);
+    if (0 != err) {
+        pthread_mutex_unlock(&conn->io_lock);
+        close(fd);
+        nfree((void **)&node);
+        goto handle_err;
+    }
+
+    /* Only the reactor sends files, as the socket makes room. The caller is free to go. */
+    if (0 < length) {
+        link_locked(conn, node);
+        node = NULL;
+        if (0 == __atomic_fetch_or(&conn->mail, XNET_MAIL_FLUSH, __ATOMIC_ACQ_REL)) {
+            conn->mail_next = NULL;
+            needs_flush = true;
+        }
+    }
+
+    pthread_mutex_unlock(&conn->io_lock);
+
+    /* Empty files are done with the header. */
+    if (NULL != node) {
+        close(fd);
+        nfree((void **)&node);
+    }
+
+    if (needs_flush) {
+        wake_reactor(xnet, conn, conn);
+    }
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_send_file()");
+    return err;
+}
+
+int xnet_switch_wire_format(xnet_box_t *xnet, xnet_active_connection_t *conn, int wire_format,
+                            const void *ack, size_t length)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == conn) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == ack) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (0 > wire_format || XNET_WIRE_FORMATS <= wire_format) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    pthread_mutex_lock(&conn->io_lock);
+
+    if (false == conn->hot->is_active) {
+        pthread_mutex_unlock(&conn->io_lock);
+        err = E_SRV_BAD_SOCKET;
+        goto handle_err;
+    }
+
+    /* Broadcasts pick their buffer under this lock too, so none of them can land between the switch and the ack. */
+    bool needs_flush = false;
+    err = send_locked(xnet, conn, ack, length, &needs_flush);
+    if (0 == err) {
+        conn->wire_format = wire_format;
+    }
+
+    pthread_mutex_unlock(&conn->io_lock);
+
+    if (0 != err) {
+        goto handle_err;
+    }
+
+    if (needs_flush) {
+        wake_reactor(xnet, conn, conn);
+    }
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_switch_wire_format()");
+    return err;
+}
+
+int xnet_switch_codec(xnet_box_t *xnet, xnet_active_connection_t *conn, int codec, const void *ack, size_t length)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == conn) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == ack) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (0 > codec || XNET_CODECS <= codec || 0 == (xnet_supported_codecs() & (1u << codec))) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    /* Set up outside the lock. Switching to the codec already in use starts its stream over. */
+    xnet_compress_ctx_t *compress = xnet_compress_create(codec);
+    if (XNET_CODEC_NONE != codec && NULL == compress) {
+        err = E_GEN_FAIL_ALLOC;
+        goto handle_err;
+    }
+
+    pthread_mutex_lock(&conn->io_lock);
+
+    if (false == conn->hot->is_active) {
+        pthread_mutex_unlock(&conn->io_lock);
+        xnet_compress_destroy(compress);
+        err = E_SRV_BAD_SOCKET;
+        goto handle_err;
+    }
+
+    /* The ack is the last thing coded the old way. Whatever is sent after it starts the new stream. */
+    bool needs_flush = false;
+    err = send_locked(xnet, conn, ack, length, &needs_flush);
+    if (0 == err) {
+        xnet_compress_destroy(conn->compress);
+        conn->compress = compress;
+        conn->codec = codec;
+        compress = NULL;
+    }
+
+    pthread_mutex_unlock(&conn->io_lock);
+
+    xnet_compress_destroy(compress);
+
+    if (0 != err) {
+        goto handle_err;
+    }
+
+    if (needs_flush) {
+        wake_reactor(xnet, conn, conn);
+    }
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_switch_codec()");
+    return err;
+}
+
+size_t xnet_broadcast(xnet_box_t *xnet, const xnet_conn_handle_t *targets, size_t count,
+                      xnet_shared_buf_t *const bufs[XNET_WIRE_FORMATS], xnet_conn_handle_t skip)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == targets || NULL == bufs) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    for (int format = 0; format < XNET_WIRE_FORMATS; format++) {
+        if (NULL == bufs[format]) {
+            err = E_GEN_NULL_PTR;
+            goto handle_err;
+        }
+    }
+
+    size_t queued = deliver_range(xnet, targets, count, bufs, skip, false);
+
+    return queued;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_broadcast()");
+    return 0;
+}
+
+size_t xnet_broadcast_parallel(xnet_box_t *xnet, const xnet_conn_handle_t *targets, size_t count,
+                               xnet_shared_buf_t *const bufs[XNET_WIRE_FORMATS], xnet_conn_handle_t skip)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == targets || NULL == bufs) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    for (int format = 0; format < XNET_WIRE_FORMATS; format++) {
+        if (NULL == bufs[format]) {
+            err = E_GEN_NULL_PTR;
+            goto handle_err;
+        }
+    }
+
+    /* Splitting a small room costs more than it saves. */
+    if (0 == xnet->general->fanout_threshold || count < xnet->general->fanout_threshold || NULL == xnet->thread) {
+        return xnet_broadcast(xnet, targets, count, bufs, skip);
+    }
+
+    fanout_job_t *job = calloc(1, sizeof(fanout_job_t));
+    if (NULL == job) {
+        return xnet_broadcast(xnet, targets, count, bufs, skip);
+    }
+
+    job->ref_count = 1;
+    job->bufs = bufs;
+    job->targets = targets;
+    job->skip = skip;
+    job->count = count;
+    job->chunk_count = (count + XNET_FANOUT_CHUNK_SZ - 1) / XNET_FANOUT_CHUNK_SZ;
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->done, NULL);
+
+    /* The caller takes chunks too, so at most one helper per remaining chunk. A full queue just means fewer helpers. */
+    size_t helpers = job->chunk_count - 1;
+    if (XNET_THREAD_COUNT - 1 < helpers) {
+        helpers = XNET_THREAD_COUNT - 1;
+    }
+    for (size_t n = 0; n < helpers; n++) {
+        __atomic_add_fetch(&job->ref_count, 1, __ATOMIC_RELAXED);
+        if (0 != xnet_submit_job(xnet, fanout_helper, job)) {
+            __atomic_sub_fetch(&job->ref_count, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+
+    fanout_run_chunks(xnet, job);
+
+    /*
+    Only chunks already claimed by running workers can be outstanding here, so this wait always ends.
+    Returning after every chunk is done keeps @param targets and @param bufs valid for as long as anyone reads them,
+    and keeps this broadcast ahead of whatever the caller sends next.
+    */
+    pthread_mutex_lock(&job->lock);
+    while (job->chunks_done < job->chunk_count) {
+        pthread_cond_wait(&job->done, &job->lock);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    size_t queued = __atomic_load_n(&job->queued, __ATOMIC_RELAXED);
+    fanout_release(job);
+
+    return queued;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_broadcast_parallel()");
+    return 0;
+}
+
+void xnet_post_mail(xnet_box_t *xnet, xnet_active_connection_t *conn, uint32_t mail)
+{
+    /* Already in the mailbox. The reactor picks the new bits up with the rest. */
+    if (0 != __atomic_fetch_or(&conn->mail, mail, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    wake_reactor(xnet, conn, conn);
+}
+
+void xnet_read_mailbox(xnet_box_t *xnet)
+{
+    /* Reset the eventfd counter before taking the list. Anything pushed after that pokes it again. */
+    uint64_t wakeups = 0;
+    ssize_t bread = read(xnet->network->mail_fd, &wakeups, sizeof(wakeups));
+    (void)bread;
+
+    xnet_active_connection_t *current = __atomic_exchange_n(&xnet->network->mailbox, NULL, __ATOMIC_ACQUIRE);
+
+    while (NULL != current) {
+        /* Once its mail is taken, producers may link the connection in again, so grab next first. */
+        xnet_active_connection_t *next = current->mail_next;
+        uint32_t mail = __atomic_exchange_n(&current->mail, 0, __ATOMIC_ACQ_REL);
+        int event_status = 0;
+
+        pthread_mutex_lock(&current->io_lock);
+        if (mail & XNET_MAIL_DONE) {
+            current->hot->is_working = false;
+        }
+
+        if (current->hot->is_active) {
+            /* Same as a peer that went away. The reactor closes it on the hangup, once no worker owns it.
+               A client that took the slot since wasn't evicted, and keeps XNET_CLOSE_PEER. */
+            if ((mail & XNET_MAIL_CLOSE) && XNET_CLOSE_PEER != current->close_reason) {
+                shutdown(current->socket, SHUT_RDWR);
+            }
+
+            xnet_flush_connection(current);
+
+            /* Leftovers wait for EPOLLOUT. Otherwise the epoll interest only changes with the read side or a hangup. */
+            if (NULL != current->out_head || (mail & (XNET_MAIL_DONE | XNET_MAIL_CLOSE))) {
+                event_status = xnet_arm_connection(xnet, current);
+            }
+        }
+
+        bool is_lost = -1 == event_status && false == current->hot->is_working;
+        pthread_mutex_unlock(&current->io_lock);
+
+        /* Nothing would ever be heard from a connection epoll no longer watches. */
+        if (is_lost) {
+            xnet_close_connection(xnet, current);
+        }
+        current = next;
+    }
+}
+
+void xnet_flush_connection(xnet_active_connection_t *conn)
+{
+    /* A large file must not keep the reactor from every other connection. */
+    size_t file_budget = XNET_FILE_BUDGET_SZ;
+
+    while (NULL != conn->out_head) {
+        if (NULL == conn->out_head->buf) {
+            if (1 != flush_file(conn, &file_budget)) {
+                return;
+            }
+            continue;
+        }
+
+        /* Gather as many queued buffers as one syscall allows, up to the next file. */
+        struct iovec iov[XNET_FLUSH_IOV_MAX];
+        size_t iov_count = 0;
+        for (xnet_outbound_t *node = conn->out_head; NULL != node && NULL != node->buf && XNET_FLUSH_IOV_MAX > iov_count; node = node->next) {
+            iov[iov_count].iov_base = node->buf->data + node->offset;
+            iov[iov_count].iov_len = node->buf->length - node->offset;
+            iov_count++;
+        }
+
+        struct msghdr msg = {0};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_count;
+
+        ssize_t sent = sendmsg(conn->socket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (-1 == sent) {
+            if (EINTR == errno) {
+                continue;
+            }
+
+            /* Full socket, try again on EPOLLOUT. */
+            if (EAGAIN == errno || EWOULDBLOCK == errno) {
+                return;
+            }
+
+            /* Peer is gone, nothing queued will ever be delivered. */
+            xnet_drop_output(conn);
+            return;
+        }
+
+        conn->out_bytes -= sent;
+        conn->out_progress_ns = monotonic_ns();
+
+        /* Retire fully written buffers and advance into a partially written one. */
+        size_t remaining = sent;
+        while (0 < remaining) {
+            xnet_outbound_t *node = conn->out_head;
+            /* A lagged packet can't be recounted once any of it is out. */
+            if (node == conn->lag_marker) {
+                conn->lag_marker = NULL;
+            }
+            size_t node_left = node->buf->length - node->offset;
+            if (remaining < node_left) {
+                node->offset += remaining;
+                break;
+            }
+
+            remaining -= node_left;
+            conn->out_head = node->next;
+            xnet_buf_release(node->buf);
+            nfree((void **)&node);
+        }
+
+        if (NULL == conn->out_head) {
+            conn->out_tail = NULL;
+        }
+    }
+}
+
+void xnet_drop_output(xnet_active_connection_t *conn)
+{
+    xnet_outbound_t *node = conn->out_head;
+    while (NULL != node) {
+        xnet_outbound_t *next = node->next;
+        if (NULL == node->buf) {
+            close(node->file_fd);
+        }
+        xnet_buf_release(node->buf);
+        nfree((void **)&node);
+        node = next;
+    }
+
+    conn->out_head = NULL;
+    conn->out_tail = NULL;
+    conn->out_bytes = 0;
+    conn->lag_marker = NULL;
+}
+
+int xnet_arm_connection(xnet_box_t *xnet, xnet_active_connection_t *conn)
+{
+    uint32_t events = EPOLLONESHOT;
+
+    /* A busy worker owns the read side. A held request has to go before anything else is read. */
+    if (false == conn->hot->is_working && false == conn->hot->rx_held) {
+        events |= EPOLLIN;
+    }
+
+    if (NULL != conn->out_head) {
+        events |= EPOLLOUT;
+    }
+
+    /* Nothing to wait for. */
+    if (EPOLLONESHOT == events) {
+        return 0;
+    }
+
+    struct epoll_event client_event = {0};
+    uint64_t client_data = xnet_event_data(xnet, conn, false);
+    return epoll_ctl_mod_data(xnet->network->epoll_fd, &client_event, conn->socket, client_data, events);
+}
+
+int xnet_set_write_through(xnet_box_t *xnet, bool write_through)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    /* Workers read it without a lock. */
+    if (xnet->general->is_running) {
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    xnet->general->write_through = write_through;
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_set_write_through()");
+    return err;
+}
+
+int xnet_set_slow_consumer_policy(xnet_box_t *xnet, enum xnet_slow_policy policy, size_t max_bytes, size_t timeout_ms)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (XNET_SLOW_DISCONNECT != policy && XNET_SLOW_DROP_OLDEST != policy && XNET_SLOW_COALESCE != policy) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    /* The sweep timer's period is set from the timeout when the server starts. */
+    if (xnet->general->is_running) {
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    xnet->general->slow_policy = policy;
+    xnet->general->slow_max_bytes = max_bytes;
+    xnet->general->slow_timeout_ms = timeout_ms;
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_set_slow_consumer_policy()");
+    return err;
+}
+
+int xnet_get_slow_stats(xnet_box_t *xnet, xnet_slow_stats_t *stats)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet || NULL == stats) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    stats->dropped = __atomic_load_n(&xnet->general->slow_stats.dropped, __ATOMIC_RELAXED);
+    stats->lagged = __atomic_load_n(&xnet->general->slow_stats.lagged, __ATOMIC_RELAXED);
+    stats->evicted = __atomic_load_n(&xnet->general->slow_stats.evicted, __ATOMIC_RELAXED);
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_get_slow_stats()");
+    return err;
+}
+
+int xnet_init_slow_sweep(xnet_box_t *xnet)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    /* Nothing to look for without a timeout. */
+    size_t timeout_ms = xnet->general->slow_timeout_ms;
+    if (0 == timeout_ms) {
+        return 0;
+    }
+
+    xnet->network->slow_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (-1 == xnet->network->slow_fd) {
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    /* Twice per timeout, so a stall is caught at most half a timeout late. */
+    size_t period_ms = timeout_ms / 2;
+    if (XNET_SLOW_SWEEP_MIN_MS > period_ms) {
+        period_ms = XNET_SLOW_SWEEP_MIN_MS;
+    }
+
+    struct itimerspec sweep = {0};
+    sweep.it_value.tv_sec = period_ms / 1000;
+    sweep.it_value.tv_nsec = (period_ms % 1000) * 1000000;
+    sweep.it_interval = sweep.it_value;
+    if (0 != timerfd_settime(xnet->network->slow_fd, 0, &sweep, NULL) ||
+        -1 == epoll_ctl_add(xnet->network->epoll_fd, &xnet->network->slow_event, xnet->network->slow_fd, EPOLLIN)) {
+        close(xnet->network->slow_fd);
+        xnet->network->slow_fd = -1;
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_init_slow_sweep()");
+    return err;
+}
+
+void xnet_sweep_slow(xnet_box_t *xnet)
+{
+    /* Reset the timerfd counter. Missed periods don't matter, every connection is looked at anyway. */
+    uint64_t expirations = 0;
+    ssize_t bread = read(xnet->network->slow_fd, &expirations, sizeof(expirations));
+    (void)bread;
+
+    uint64_t now_ns = monotonic_ns();
+    uint64_t timeout_ns = (uint64_t)xnet->general->slow_timeout_ms * 1000000;
+
+    for (size_t n = 0; n < xnet->general->max_connections; n++) {
+        xnet_active_connection_t *conn = &xnet->connections->clients[n];
+        pthread_mutex_lock(&conn->io_lock);
+        if (conn->hot->is_active && NULL != conn->out_head && XNET_CLOSE_PEER == conn->close_reason &&
+            now_ns - conn->out_progress_ns > timeout_ns) {
+            evict_locked(xnet, conn, XNET_CLOSE_SLOW_STALL);
+        }
+        pthread_mutex_unlock(&conn->io_lock);
+    }
+}
+
+static int enqueue_locked(xnet_active_connection_t *conn, xnet_shared_buf_t *buf, size_t offset)
+{
+    xnet_outbound_t *node = malloc(sizeof(xnet_outbound_t));
+    if (NULL == node) {
+        return E_GEN_FAIL_ALLOC;
+    }
+
+    node->buf = buf;
+    node->offset = offset;
+    node->file_fd = -1;
+    node->file_end = 0;
+    node->is_droppable = false;
+    node->next = NULL;
+
+    link_locked(conn, node);
+    conn->out_bytes += buf->length - offset;
+
+    return 0;
+}
+
+static void link_locked(xnet_active_connection_t *conn, xnet_outbound_t *node)
+{
+    /* The stall clock starts with the first thing queued. */
+    if (NULL == conn->out_tail) {
+        conn->out_progress_ns = monotonic_ns();
+        conn->out_head = node;
+    } else {
+        conn->out_tail->next = node;
+    }
+    conn->out_tail = node;
+}
+
+static int flush_file(xnet_active_connection_t *conn, size_t *budget)
+{
+    xnet_outbound_t *node = conn->out_head;
+
+    while (node->offset < node->file_end) {
+        if (0 == *budget) {
+            return 0;
+        }
+
+        size_t want = node->file_end - node->offset;
+        want = (XNET_FILE_CHUNK_SZ < want) ? XNET_FILE_CHUNK_SZ : want;
+        want = (*budget < want) ? *budget : want;
+
+        off_t position = (off_t)node->offset;
+        ssize_t sent = sendfile(conn->socket, node->file_fd, &position, want);
+        if (-1 == sent && EINTR == errno) {
+            continue;
+        }
+
+        /* Full socket, try again on EPOLLOUT. */
+        if (-1 == sent && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+            return 0;
+        }
+
+        /* Peer is gone, or the file failed or shrank. The peer was promised the whole file, so whatever
+           followed it would be taken for file data. Hang up, the reactor closes the connection on the HUP. */
+        if (0 >= sent) {
+            xnet_drop_output(conn);
+            shutdown(conn->socket, SHUT_RDWR);
+            return -1;
+        }
+
+        node->offset += sent;
+        *budget -= sent;
+        conn->out_progress_ns = monotonic_ns();
+    }
+
+    conn->out_head = node->next;
+    if (NULL == conn->out_head) {
+        conn->out_tail = NULL;
+    }
+    close(node->file_fd);
+    nfree((void **)&node);
+
+    return 1;
+}
+
+static int send_locked(xnet_box_t *xnet, xnet_active_connection_t *conn, const void *data, size_t length, bool *needs_flush)
+{
+    /* Evicted, waiting for the reactor to close it. Nothing more will be read off its queue. */
+    if (XNET_CLOSE_PEER != conn->close_reason) {
+        return E_SRV_BAD_SOCKET;
+    }
+
+    /* Compressed connections take the coded block instead, which can be queued as it is. */
+    xnet_shared_buf_t *block = NULL;
+    if (NULL != conn->compress && XNET_COMPRESS_MIN_SZ <= length) {
+        block = xnet_compress_block(conn->compress, data, length);
+        if (NULL == block) {
+            return E_GEN_FAIL_ALLOC;
+        }
+        data = block->data;
+        length = block->length;
+    }
+
+    /* With nothing queued ahead of us, writing directly can't reorder anything. Left to the reactor unless asked. */
+    size_t written = 0;
+    if (xnet->general->write_through && NULL == conn->out_head) {
+        while (written < length) {
+            ssize_t sent = send(conn->socket, (const char *)data + written, length - written, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (0 < sent) {
+                written += sent;
+                continue;
+            }
+
+            if (-1 == sent && EINTR == errno) {
+                continue;
+            }
+
+            /* Peer is gone. The reactor will see the hangup and close the connection. */
+            if (-1 == sent && EAGAIN != errno && EWOULDBLOCK != errno) {
+                xnet_buf_release(block);
+                return 0;
+            }
+
+            break;
+        }
+    }
+
+    /* Whatever wasn't written is for the reactor. */
+    if (written < length) {
+        size_t offset = written;
+        xnet_shared_buf_t *rest = block;
+        block = NULL;
+        if (NULL == rest) {
+            rest = xnet_buf_alloc(length - written);
+            if (NULL == rest) {
+                return E_GEN_FAIL_ALLOC;
+            }
+            memcpy(rest->data, (const char *)data + written, length - written);
+            offset = 0;
+        }
+
+        int err = enqueue_locked(conn, rest, offset);
+        if (0 != err) {
+            xnet_buf_release(rest);
+            return err;
+        }
+
+        check_backlog_locked(xnet, conn);
+        if (XNET_CLOSE_PEER != conn->close_reason) {
+            return E_SRV_BAD_SOCKET;
+        }
+
+        /* Only the first mail since the reactor last looked links the connection in. */
+        if (0 == __atomic_fetch_or(&conn->mail, XNET_MAIL_FLUSH, __ATOMIC_ACQ_REL)) {
+            conn->mail_next = NULL;
+            *needs_flush = true;
+        }
+    }
+
+    xnet_buf_release(block);
+    return 0;
+}
+
+static void check_backlog_locked(xnet_box_t *xnet, xnet_active_connection_t *conn)
+{
+    size_t max_bytes = xnet->general->slow_max_bytes;
+    if (0 == max_bytes || conn->out_bytes <= max_bytes) {
+        return;
+    }
+
+    /* A compressed stream can't lose a block without corrupting everything after it. */
+    enum xnet_slow_policy policy = xnet->general->slow_policy;
+    if (NULL != conn->compress || XNET_SLOW_DISCONNECT == policy) {
+        evict_locked(xnet, conn, XNET_CLOSE_SLOW_BACKLOG);
+        return;
+    }
+
+    uint32_t dropped = drop_broadcasts_locked(conn, (XNET_SLOW_DROP_OLDEST == policy) ? max_bytes : 0);
+    __atomic_fetch_add(&xnet->general->slow_stats.dropped, dropped, __ATOMIC_RELAXED);
+
+    if (XNET_SLOW_COALESCE == policy && 0 < dropped && 0 != queue_lagged_locked(xnet, conn, dropped)) {
+        evict_locked(xnet, conn, XNET_CLOSE_SLOW_BACKLOG);
+        return;
+    }
+
+    /* What is left was sent to it alone, or is already on its way. */
+    if (conn->out_bytes > max_bytes) {
+        evict_locked(xnet, conn, XNET_CLOSE_SLOW_BACKLOG);
+    }
+}
+
+static uint32_t drop_broadcasts_locked(xnet_active_connection_t *conn, size_t keep)
+{
+    uint32_t dropped = 0;
+    xnet_outbound_t *prev = NULL;
+    xnet_outbound_t *node = conn->out_head;
+
+    while (NULL != node && (0 == keep || conn->out_bytes > keep)) {
+        xnet_outbound_t *next = node->next;
+        if (false == node->is_droppable || 0 != node->offset) {
+            prev = node;
+            node = next;
+            continue;
+        }
+
+        if (NULL == prev) {
+            conn->out_head = next;
+        } else {
+            prev->next = next;
+        }
+        if (conn->out_tail == node) {
+            conn->out_tail = prev;
+        }
+
+        conn->out_bytes -= node->buf->length;
+        xnet_buf_release(node->buf);
+        nfree((void **)&node);
+        dropped++;
+        node = next;
+    }
+
+    return dropped;
+}
+
+static int queue_lagged_locked(xnet_box_t *xnet, xnet_active_connection_t *conn, uint32_t dropped)
+{
+    /* Still unsent, so the client hasn't seen the old count yet. */
+    if (NULL != conn->lag_marker) {
+        uint32_t count = 0;
+        memcpy(&count, conn->lag_marker->buf->data + 2, sizeof(count));
+        count = htonl(ntohl(count) + dropped);
+        memcpy(conn->lag_marker->buf->data + 2, &count, sizeof(count));
+        return 0;
+    }
+
+    xnet_shared_buf_t *buf = xnet_buf_alloc(XNET_LAGGED_SZ);
+    if (NULL == buf) {
+        return E_GEN_FAIL_ALLOC;
+    }
+
+    uint16_t lagged_op = htons(XNET_LAGGED_OP);
+    uint32_t count = htonl(dropped);
+    memcpy(buf->data, &lagged_op, sizeof(lagged_op));
+    memcpy(buf->data + 2, &count, sizeof(count));
+
+    int err = enqueue_locked(conn, buf, 0);
+    if (0 != err) {
+        xnet_buf_release(buf);
+        return err;
+    }
+
+    conn->lag_marker = conn->out_tail;
+    __atomic_fetch_add(&xnet->general->slow_stats.lagged, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static void evict_locked(xnet_box_t *xnet, xnet_active_connection_t *conn, enum xnet_close_reason reason)
+{
+    conn->close_reason = reason;
+    __atomic_fetch_add(&xnet->general->slow_stats.evicted, 1, __ATOMIC_RELAXED);
+    xnet_cancel_request(conn);
+
+    /* Nothing more goes out. The reactor hangs up on it. */
+    xnet_drop_output(conn);
+    xnet_post_mail(xnet, conn, XNET_MAIL_CLOSE);
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void wake_reactor(xnet_box_t *xnet, xnet_active_connection_t *chain_head, xnet_active_connection_t *chain_tail)
+{
+    /* The reactor only ever takes the whole list, so a plain compare and swap push can't go wrong. */
+    xnet_active_connection_t *head = __atomic_load_n(&xnet->network->mailbox, __ATOMIC_RELAXED);
+    do {
+        chain_tail->mail_next = head;
+    } while (false == __atomic_compare_exchange_n(&xnet->network->mailbox, &head, chain_head, true,
+                                                  __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    /* Whoever found the mailbox empty is waking the reactor already. */
+    if (NULL != head) {
+        return;
+    }
+
+    uint64_t poke = 1;
+    ssize_t bwritten = write(xnet->network->mail_fd, &poke, sizeof(poke));
+    (void)bwritten;
+}
+
+static size_t deliver_range(xnet_box_t *xnet, const xnet_conn_handle_t *targets, size_t count,
+                            xnet_shared_buf_t *const bufs[XNET_WIRE_FORMATS], xnet_conn_handle_t skip,
+                            bool write_through)
+{
+    /* Connections that weren't already waiting on the reactor are chained here and handed over in one go. */
+    xnet_active_connection_t *chain_head = NULL;
+    xnet_active_connection_t *chain_tail = NULL;
+    size_t queued = 0;
+
+    for (size_t n = 0; n < count; n++) {
+        xnet_active_connection_t *conn = xnet_conn_from_handle(xnet, targets[n]);
+        if (NULL == conn || skip == targets[n]) {
+            continue;
+        }
+
+        pthread_mutex_lock(&conn->io_lock);
+
+        /* Checked again under the lock, the client may have left since, and its slot gone to another one. */
+        if (false == xnet_handle_is_live(conn, targets[n]) || XNET_CLOSE_PEER != conn->close_reason) {
+            pthread_mutex_unlock(&conn->io_lock);
+            continue;
+        }
+
+        /* Compressed connections code their own copy, in line with everything else they are sent. */
+        xnet_shared_buf_t *buf = bufs[conn->wire_format];
+        if (NULL != conn->compress && XNET_COMPRESS_MIN_SZ <= buf->length) {
+            buf = xnet_compress_block(conn->compress, buf->data, buf->length);
+            if (NULL == buf) {
+                pthread_mutex_unlock(&conn->io_lock);
+                continue;
+            }
+        } else {
+            xnet_buf_ref(buf);
+        }
+
+        /* With nothing queued ahead of us, writing directly can't reorder anything. */
+        size_t written = 0;
+        if (write_through && NULL == conn->out_head) {
+            while (written < buf->length) {
+                ssize_t sent = send(conn->socket, buf->data + written, buf->length - written, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (0 < sent) {
+                    written += sent;
+                } else if (-1 == sent && EINTR == errno) {
+                    continue;
+                } else {
+                    break;
+                }
+            }
+
+            /* Peer is gone. The reactor will see the hangup and close the connection. */
+            if (written < buf->length && EAGAIN != errno && EWOULDBLOCK != errno) {
+                pthread_mutex_unlock(&conn->io_lock);
+                xnet_buf_release(buf);
+                continue;
+            }
+        }
+
+        if (written == buf->length) {
+            pthread_mutex_unlock(&conn->io_lock);
+            xnet_buf_release(buf);
+            queued++;
+            continue;
+        }
+
+        /* The queue takes over our reference. */
+        if (0 != enqueue_locked(conn, buf, written)) {
+            pthread_mutex_unlock(&conn->io_lock);
+            xnet_buf_release(buf);
+            continue;
+        }
+
+        /* Only a broadcast nothing of has been written can go without breaking the stream. */
+        conn->out_tail->is_droppable = (0 == written);
+        check_backlog_locked(xnet, conn);
+        if (XNET_CLOSE_PEER != conn->close_reason) {
+            pthread_mutex_unlock(&conn->io_lock);
+            continue;
+        }
+
+        if (0 == __atomic_fetch_or(&conn->mail, XNET_MAIL_FLUSH, __ATOMIC_ACQ_REL)) {
+            conn->mail_next = NULL;
+            if (NULL == chain_head) {
+                chain_head = conn;
+            } else {
+                chain_tail->mail_next = conn;
+            }
+            chain_tail = conn;
+        }
+
+        pthread_mutex_unlock(&conn->io_lock);
+        queued++;
+    }
+
+    if (NULL != chain_head) {
+        wake_reactor(xnet, chain_head, chain_tail);
+    }
+
+    return queued;
+}
+
+static void fanout_run_chunks(xnet_box_t *xnet, fanout_job_t *job)
+{
+    while (true) {
+        size_t chunk = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+        if (chunk >= job->chunk_count) {
+            return;
+        }
+
+        size_t first = chunk * XNET_FANOUT_CHUNK_SZ;
+        size_t length = job->count - first;
+        if (XNET_FANOUT_CHUNK_SZ < length) {
+            length = XNET_FANOUT_CHUNK_SZ;
+        }
+
+        size_t queued = deliver_range(xnet, job->targets + first, length, job->bufs, job->skip,
+                                      xnet->general->write_through);
+        __atomic_add_fetch(&job->queued, queued, __ATOMIC_RELAXED);
+
+        pthread_mutex_lock(&job->lock);
+        job->chunks_done++;
+        if (job->chunks_done == job->chunk_count) {
+            pthread_cond_signal(&job->done);
+        }
+        pthread_mutex_unlock(&job->lock);
+    }
+}
+
+static int fanout_helper(xnet_box_t *xnet, void *arg)
+{
+    fanout_job_t *job = arg;
+
+    /* Helpers that start late find every chunk claimed and leave straight away. */
+    fanout_run_chunks(xnet, job);
+    fanout_release(job);
+    return 0;
+}
+
+static void fanout_release(fanout_job_t *job)
+{
+    if (0 != __atomic_sub_fetch(&job->ref_count, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    pthread_mutex_destroy(&job->lock);
+    pthread_cond_destroy(&job->done);
+    nfree((void **)&job);
+}
@@ -0,0 +1,551 @@
+#include <string.h>
+#include <endian.h>
+#include <pthread.h>
+
+#include "xnet_checksum.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define XNET_CHECKSUM_X86
+#include <immintrin.h>
+#endif
+
+#define CRC32C_POLY             0x82F63B78u // Reflected.
+#define CRC32C_LANE_SZ          1024        // Bytes per lane when three lanes of CRC run side by side.
+
+#define XXH_PRIME32_1           0x9E3779B1u
+#define XXH_PRIME32_2           0x85EBCA77u
+#define XXH_PRIME32_3           0xC2B2AE3Du
+#define XXH_PRIME64_1           0x9E3779B185EBCA87ull
+#define XXH_PRIME64_2           0xC2B2AE3D27D4EB4Full
+#define XXH_PRIME64_3           0x165667B19E3779F9ull
+#define XXH_PRIME64_4           0x85EBCA77C2B2AE63ull
+#define XXH_PRIME64_5           0x27D4EB2F165667C5ull
+#define XXH_PRIME_MX1           0x165667919E3779F9ull
+#define XXH_PRIME_MX2           0x9FB21C651E98DF25ull
+
+#define XXH3_SECRET_SZ          192
+#define XXH3_SECRET_STEP        8           // Secret bytes each stripe moves along by.
+#define XXH3_BLOCK_STRIPES      ((XXH3_SECRET_SZ - XNET_XXH3_STRIPE_SZ) / XXH3_SECRET_STEP)
+#define XXH3_SCRAMBLE_AT        (XXH3_SECRET_SZ - XNET_XXH3_STRIPE_SZ)
+#define XXH3_LAST_STRIPE_AT     (XXH3_SCRAMBLE_AT - 7)
+#define XXH3_MERGE_AT           11
+#define XXH3_MIDSIZE_MAX        240
+
+/* The reference implementation's default secret. */
+static const unsigned char xxh3_secret[XXH3_SECRET_SZ] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+/* Slicing-by-8 tables. [0] is the classic byte at a time table, [n] the same byte n positions further back. */
+static uint32_t crc32c_table[8][256];
+/* Advances a raw CRC over CRC32C_LANE_SZ zero bytes, a byte of the CRC at a time. */
+static uint32_t crc32c_shift_table[4][256];
+
+typedef uint32_t (*crc32c_kernel_t)(uint32_t crc, const unsigned char *data, size_t length);
+typedef void (*xxh3_accumulate_kernel_t)(uint64_t *acc, const unsigned char *data, const unsigned char *secret, size_t stripes);
+typedef void (*xxh3_scramble_kernel_t)(uint64_t *acc, const unsigned char *secret);
+
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+static unsigned int kernels_supported = 0;
+static crc32c_kernel_t crc32c_kernel = NULL;
+static xxh3_accumulate_kernel_t xxh3_accumulate_kernel = NULL;
+static xxh3_scramble_kernel_t xxh3_scramble_kernel = NULL;
+
+static void init_kernels(void);
+static void pick_kernels(unsigned int kernels);
+static uint32_t crc32c_portable(uint32_t crc, const unsigned char *data, size_t length);
+static void xxh3_accumulate_portable(uint64_t *acc, const unsigned char *data, const unsigned char *secret, size_t stripes);
+static void xxh3_scramble_portable(uint64_t *acc, const unsigned char *secret);
+#ifdef XNET_CHECKSUM_X86
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *data, size_t length);
+static void xxh3_accumulate_avx2(uint64_t *acc, const unsigned char *data, const unsigned char *secret, size_t stripes);
+static void xxh3_scramble_avx2(uint64_t *acc, const unsigned char *secret);
+#endif
+static uint64_t xxh3_short(const unsigned char *data, size_t length);
+static uint64_t xxh3_merge(const uint64_t *acc, uint64_t start);
+static void xxh3_consume(uint64_t *acc, size_t *block_stripes, const unsigned char *data, size_t stripes);
+static void xxh3_init_acc(uint64_t *acc);
+
+unsigned int xnet_checksum_supported(void)
+{
+    pthread_once(&kernels_once, init_kernels);
+    return kernels_supported;
+}
+
+void xnet_checksum_select(unsigned int kernels)
+{
+    pthread_once(&kernels_once, init_kernels);
+    pick_kernels(kernels & kernels_supported);
+}
+
+uint32_t xnet_crc32c(uint32_t crc, const void *data, size_t length)
+{
+    pthread_once(&kernels_once, init_kernels);
+    return ~crc32c_kernel(~crc, data, length);
+}
+
+uint64_t xnet_xxh3(const void *data, size_t length)
+{
+    pthread_once(&kernels_once, init_kernels);
+
+    const unsigned char *bytes = data;
+    if (XXH3_MIDSIZE_MAX >= length) {
+        return xxh3_short(bytes, length);
+    }
+
+    uint64_t acc[8];
+    xxh3_init_acc(acc);
+
+    /* Whole blocks, then the stripes left over. The last stripe ends exactly where the input does, whatever overlaps. */
+    size_t block_length = XXH3_BLOCK_STRIPES * XNET_XXH3_STRIPE_SZ;
+    size_t blocks = (length - 1) / block_length;
+    for (size_t n = 0; n < blocks; n++) {
+        xxh3_accumulate_kernel(acc, bytes + n * block_length, xxh3_secret, XXH3_BLOCK_STRIPES);
+        xxh3_scramble_kernel(acc, xxh3_secret + XXH3_SCRAMBLE_AT);
+    }
+
+    size_t stripes = ((length - 1) - blocks * block_length) / XNET_XXH3_STRIPE_SZ;
+    xxh3_accumulate_kernel(acc, bytes + blocks * block_length, xxh3_secret, stripes);
+    xxh3_accumulate_kernel(acc, bytes + length - XNET_XXH3_STRIPE_SZ, xxh3_secret + XXH3_LAST_STRIPE_AT, 1);
+
+    return xxh3_merge(acc, length * XXH_PRIME64_1);
+}
+
+void xnet_xxh3_reset(xnet_xxh3_state_t *state)
+{
+    pthread_once(&kernels_once, init_kernels);
+
+    memset(state, 0, sizeof(xnet_xxh3_state_t));
+    xxh3_init_acc(state->acc);
+}
+
+void xnet_xxh3_update(xnet_xxh3_state_t *state, const void *data, size_t length)
+{
+    const unsigned char *bytes = data;
+    state->total_length += length;
+
+    if (XNET_XXH3_BUFFER_SZ - state->buffered >= length) {
+        memcpy(state->buffer + state->buffered, bytes, length);
+        state->buffered += length;
+        return;
+    }
+
+    size_t buffer_stripes = XNET_XXH3_BUFFER_SZ / XNET_XXH3_STRIPE_SZ;
+    if (0 < state->buffered) {
+        size_t fill = XNET_XXH3_BUFFER_SZ - state->buffered;
+        memcpy(state->buffer + state->buffered, bytes, fill);
+        bytes += fill;
+        length -= fill;
+        xxh3_consume(state->acc, &state->block_stripes, state->buffer, buffer_stripes);
+        state->buffered = 0;
+    }
+
+    /* Something always stays behind, since the digest needs the last stripe as it is. */
+    if (XNET_XXH3_BUFFER_SZ < length) {
+        size_t stripes = (length - 1) / XNET_XXH3_STRIPE_SZ;
+        xxh3_consume(state->acc, &state->block_stripes, bytes, stripes);
+        bytes += stripes * XNET_XXH3_STRIPE_SZ;
+        length -= stripes * XNET_XXH3_STRIPE_SZ;
+        memcpy(state->buffer + XNET_XXH3_BUFFER_SZ - XNET_XXH3_STRIPE_SZ, bytes - XNET_XXH3_STRIPE_SZ, XNET_XXH3_STRIPE_SZ);
+    }
+
+    memcpy(state->buffer, bytes, length);
+    state->buffered = length;
+}
+
+uint64_t xnet_xxh3_digest(const xnet_xxh3_state_t *state)
+{
+    if (XXH3_MIDSIZE_MAX >= state->total_length) {
+        return xxh3_short(state->buffer, state->total_length);
+    }
+
+    uint64_t acc[8];
+    size_t block_stripes = state->block_stripes;
+    memcpy(acc, state->acc, sizeof(acc));
+
+    /* The last stripe may reach back into what was consumed already. The end of the buffer still holds it. */
+    unsigned char last_stripe[XNET_XXH3_STRIPE_SZ];
+    const unsigned char *last = state->buffer + state->buffered - XNET_XXH3_STRIPE_SZ;
+    if (XNET_XXH3_STRIPE_SZ <= state->buffered) {
+        xxh3_consume(acc, &block_stripes, state->buffer, (state->buffered - 1) / XNET_XXH3_STRIPE_SZ);
+    } else {
+        size_t catch_up = XNET_XXH3_STRIPE_SZ - state->buffered;
+        memcpy(last_stripe, state->buffer + XNET_XXH3_BUFFER_SZ - catch_up, catch_up);
+        memcpy(last_stripe + catch_up, state->buffer, state->buffered);
+        last = last_stripe;
+    }
+    xxh3_accumulate_kernel(acc, last, xxh3_secret + XXH3_LAST_STRIPE_AT, 1);
+
+    return xxh3_merge(acc, state->total_length * XXH_PRIME64_1);
+}
+
+static void init_kernels(void)
+{
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = n;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0 - (crc & 1)));
+        }
+        crc32c_table[0][n] = crc;
+    }
+
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int slice = 1; slice < 8; slice++) {
+            uint32_t previous = crc32c_table[slice - 1][n];
+            crc32c_table[slice][n] = (previous >> 8) ^ crc32c_table[0][previous & 0xFF];
+        }
+    }
+
+    /* CRC is linear, so a lane's CRC moves past the lanes after it bit by bit. */
+    uint32_t shifted_bits[32];
+    for (int bit = 0; bit < 32; bit++) {
+        uint32_t crc = 1u << bit;
+        for (size_t n = 0; n < CRC32C_LANE_SZ; n++) {
+            crc = (crc >> 8) ^ crc32c_table[0][crc & 0xFF];
+        }
+        shifted_bits[bit] = crc;
+    }
+
+    for (int byte = 0; byte < 4; byte++) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t crc = 0;
+            for (int bit = 0; bit < 8; bit++) {
+                crc ^= (n & (1u << bit)) ? shifted_bits[byte * 8 + bit] : 0;
+            }
+            crc32c_shift_table[byte][n] = crc;
+        }
+    }
+
+#ifdef XNET_CHECKSUM_X86
+    __builtin_cpu_init();
+    kernels_supported |= __builtin_cpu_supports("sse4.2") ? XNET_CHECKSUM_SSE42 : 0;
+    kernels_supported |= __builtin_cpu_supports("avx2") ? XNET_CHECKSUM_AVX2 : 0;
+#endif
+
+    pick_kernels(kernels_supported);
+}
+
+static void pick_kernels(unsigned int kernels)
+{
+    crc32c_kernel = crc32c_portable;
+    xxh3_accumulate_kernel = xxh3_accumulate_portable;
+    xxh3_scramble_kernel = xxh3_scramble_portable;
+
+#ifdef XNET_CHECKSUM_X86
+    if (kernels & XNET_CHECKSUM_SSE42) {
+        crc32c_kernel = crc32c_sse42;
+    }
+
+    if (kernels & XNET_CHECKSUM_AVX2) {
+        xxh3_accumulate_kernel = xxh3_accumulate_avx2;
+        xxh3_scramble_kernel = xxh3_scramble_avx2;
+    }
+#else
+    (void)kernels;
+#endif
+}
+
+static uint32_t read32(const unsigned char *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return le32toh(value);
+}
+
+static uint64_t read64(const unsigned char *data)
+{
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return le64toh(value);
+}
+
+static uint32_t crc32c_portable(uint32_t crc, const unsigned char *data, size_t length)
+{
+    while (8 <= length) {
+        uint32_t low = crc ^ read32(data);
+        crc = crc32c_table[7][low & 0xFF] ^ crc32c_table[6][(low >> 8) & 0xFF] ^
+              crc32c_table[5][(low >> 16) & 0xFF] ^ crc32c_table[4][low >> 24] ^
+              crc32c_table[3][data[4]] ^ crc32c_table[2][data[5]] ^
+              crc32c_table[1][data[6]] ^ crc32c_table[0][data[7]];
+        data += 8;
+        length -= 8;
+    }
+
+    while (0 < length--) {
+        crc = crc32c_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#ifdef XNET_CHECKSUM_X86
+static uint32_t crc32c_lane_shift(uint32_t crc)
+{
+    return crc32c_shift_table[0][crc & 0xFF] ^ crc32c_shift_table[1][(crc >> 8) & 0xFF] ^
+           crc32c_shift_table[2][(crc >> 16) & 0xFF] ^ crc32c_shift_table[3][crc >> 24];
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *data, size_t length)
+{
+    uint64_t value;
+    uint64_t crc0 = crc;
+
+    /* crc32 takes three cycles and issues every one, so three independent lanes keep it busy. */
+    while (3 * CRC32C_LANE_SZ <= length) {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        for (size_t n = 0; n < CRC32C_LANE_SZ; n += 8) {
+            memcpy(&value, data + n, 8);
+            crc0 = _mm_crc32_u64(crc0, value);
+            memcpy(&value, data + CRC32C_LANE_SZ + n, 8);
+            crc1 = _mm_crc32_u64(crc1, value);
+            memcpy(&value, data + 2 * CRC32C_LANE_SZ + n, 8);
+            crc2 = _mm_crc32_u64(crc2, value);
+        }
+        crc0 = crc32c_lane_shift(crc32c_lane_shift(crc0) ^ crc1) ^ crc2;
+        data += 3 * CRC32C_LANE_SZ;
+        length -= 3 * CRC32C_LANE_SZ;
+    }
+
+    while (8 <= length) {
+        memcpy(&value, data, 8);
+        crc0 = _mm_crc32_u64(crc0, value);
+        data += 8;
+        length -= 8;
+    }
+
+    uint32_t tail = crc0;
+    while (0 < length--) {
+        tail = _mm_crc32_u8(tail, *data++);
+    }
+
+    return tail;
+}
+#endif
+
+static uint64_t mul128_fold64(uint64_t a, uint64_t b)
+{
+    uint64_t a_low = a & 0xFFFFFFFF;
+    uint64_t a_high = a >> 32;
+    uint64_t b_low = b & 0xFFFFFFFF;
+    uint64_t b_high = b >> 32;
+
+    uint64_t low_low = a_low * b_low;
+    uint64_t high_low = a_high * b_low;
+    uint64_t low_high = a_low * b_high;
+    uint64_t high_high = a_high * b_high;
+
+    uint64_t cross = (low_low >> 32) + (high_low & 0xFFFFFFFF) + low_high;
+    uint64_t high = (high_low >> 32) + (cross >> 32) + high_high;
+    uint64_t low = (cross << 32) | (low_low & 0xFFFFFFFF);
+
+    return low ^ high;
+}
+
+static uint64_t rotl64(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t xxh64_avalanche(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static uint64_t xxh3_avalanche(uint64_t hash)
+{
+    hash ^= hash >> 37;
+    hash *= XXH_PRIME_MX1;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static uint64_t xxh3_mix16(const unsigned char *data, const unsigned char *secret)
+{
+    return mul128_fold64(read64(data) ^ read64(secret), read64(data + 8) ^ read64(secret + 8));
+}
+
+static uint64_t xxh3_short(const unsigned char *data, size_t length)
+{
+    const unsigned char *secret = xxh3_secret;
+
+    if (0 == length) {
+        return xxh64_avalanche(read64(secret + 56) ^ read64(secret + 64));
+    }
+
+    if (3 >= length) {
+        uint32_t combined = ((uint32_t)data[0] << 16) | ((uint32_t)data[length >> 1] << 24) |
+                            (uint32_t)data[length - 1] | ((uint32_t)length << 8);
+        return xxh64_avalanche(combined ^ (uint64_t)(read32(secret) ^ read32(secret + 4)));
+    }
+
+    if (8 >= length) {
+        uint64_t input = read32(data + length - 4) + ((uint64_t)read32(data) << 32);
+        uint64_t hash = input ^ (read64(secret + 8) ^ read64(secret + 16));
+        hash ^= rotl64(hash, 49) ^ rotl64(hash, 24);
+        hash *= XXH_PRIME_MX2;
+        hash ^= (hash >> 35) + length;
+        hash *= XXH_PRIME_MX2;
+        return hash ^ (hash >> 28);
+    }
+
+    if (16 >= length) {
+        uint64_t low = read64(data) ^ (read64(secret + 24) ^ read64(secret + 32));
+        uint64_t high = read64(data + length - 8) ^ (read64(secret + 40) ^ read64(secret + 48));
+        return xxh3_avalanche(length + __builtin_bswap64(low) + high + mul128_fold64(low, high));
+    }
+
+    uint64_t acc = length * XXH_PRIME64_1;
+
+    /* Pairs from both ends, working inwards. */
+    if (128 >= length) {
+        if (32 < length) {
+            if (64 < length) {
+                if (96 < length) {
+                    acc += xxh3_mix16(data + 48, secret + 96);
+                    acc += xxh3_mix16(data + length - 64, secret + 112);
+                }
+                acc += xxh3_mix16(data + 32, secret + 64);
+                acc += xxh3_mix16(data + length - 48, secret + 80);
+            }
+            acc += xxh3_mix16(data + 16, secret + 32);
+            acc += xxh3_mix16(data + length - 32, secret + 48);
+        }
+        acc += xxh3_mix16(data, secret);
+        acc += xxh3_mix16(data + length - 16, secret + 16);
+        return xxh3_avalanche(acc);
+    }
+
+    for (size_t n = 0; n < 8; n++) {
+        acc += xxh3_mix16(data + 16 * n, secret + 16 * n);
+    }
+    acc = xxh3_avalanche(acc);
+
+    for (size_t n = 8; n < length / 16; n++) {
+        acc += xxh3_mix16(data + 16 * n, secret + 16 * (n - 8) + 3);
+    }
+    acc += xxh3_mix16(data + length - 16, secret + 136 - 17);
+
+    return xxh3_avalanche(acc);
+}
+
+static void xxh3_init_acc(uint64_t *acc)
+{
+    acc[0] = XXH_PRIME32_3;
+    acc[1] = XXH_PRIME64_1;
+    acc[2] = XXH_PRIME64_2;
+    acc[3] = XXH_PRIME64_3;
+    acc[4] = XXH_PRIME64_4;
+    acc[5] = XXH_PRIME32_2;
+    acc[6] = XXH_PRIME64_5;
+    acc[7] = XXH_PRIME32_1;
+}
+
+static uint64_t xxh3_merge(const uint64_t *acc, uint64_t start)
+{
+    const unsigned char *secret = xxh3_secret + XXH3_MERGE_AT;
+
+    for (size_t n = 0; n < 4; n++) {
+        start += mul128_fold64(acc[2 * n] ^ read64(secret + 16 * n), acc[2 * n + 1] ^ read64(secret + 16 * n + 8));
+    }
+
+    return xxh3_avalanche(start);
+}
+
+/* Feeds whole stripes to the accumulators, scrambling them whenever a block fills. */
+static void xxh3_consume(uint64_t *acc, size_t *block_stripes, const unsigned char *data, size_t stripes)
+{
+    while (XXH3_BLOCK_STRIPES - *block_stripes <= stripes) {
+        size_t fill = XXH3_BLOCK_STRIPES - *block_stripes;
+        xxh3_accumulate_kernel(acc, data, xxh3_secret + *block_stripes * XXH3_SECRET_STEP, fill);
+        xxh3_scramble_kernel(acc, xxh3_secret + XXH3_SCRAMBLE_AT);
+        data += fill * XNET_XXH3_STRIPE_SZ;
+        stripes -= fill;
+        *block_stripes = 0;
+    }
+
+    xxh3_accumulate_kernel(acc, data, xxh3_secret + *block_stripes * XXH3_SECRET_STEP, stripes);
+    *block_stripes += stripes;
+}
+
+static void xxh3_accumulate_portable(uint64_t *acc, const unsigned char *data, const unsigned char *secret, size_t stripes)
+{
+    for (size_t stripe = 0; stripe < stripes; stripe++) {
+        for (size_t n = 0; n < 8; n++) {
+            uint64_t value = read64(data + 8 * n);
+            uint64_t keyed = value ^ read64(secret + 8 * n);
+            acc[n ^ 1] += value;
+            acc[n] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+        }
+        data += XNET_XXH3_STRIPE_SZ;
+        secret += XXH3_SECRET_STEP;
+    }
+}
+
+static void xxh3_scramble_portable(uint64_t *acc, const unsigned char *secret)
+{
+    for (size_t n = 0; n < 8; n++) {
+        uint64_t value = acc[n] ^ (acc[n] >> 47);
+        acc[n] = (value ^ read64(secret + 8 * n)) * XXH_PRIME32_1;
+    }
+}
+
+#ifdef XNET_CHECKSUM_X86
+/* Only 32x32 bit multiplies are needed, which is what makes XXH3 suit AVX2 where XXH64 doesn't. */
+__attribute__((target("avx2")))
+static void xxh3_accumulate_avx2(uint64_t *acc, const unsigned char *data, const unsigned char *secret, size_t stripes)
+{
+    __m256i acc_low = _mm256_loadu_si256((const __m256i *)acc);
+    __m256i acc_high = _mm256_loadu_si256((const __m256i *)(acc + 4));
+
+    for (size_t stripe = 0; stripe < stripes; stripe++) {
+        __m256i value = _mm256_loadu_si256((const __m256i *)data);
+        __m256i keyed = _mm256_xor_si256(value, _mm256_loadu_si256((const __m256i *)secret));
+        __m256i product = _mm256_mul_epu32(keyed, _mm256_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+        acc_low = _mm256_add_epi64(acc_low, _mm256_add_epi64(product, _mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2))));
+
+        value = _mm256_loadu_si256((const __m256i *)(data + 32));
+        keyed = _mm256_xor_si256(value, _mm256_loadu_si256((const __m256i *)(secret + 32)));
+        product = _mm256_mul_epu32(keyed, _mm256_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+        acc_high = _mm256_add_epi64(acc_high, _mm256_add_epi64(product, _mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2))));
+
+        data += XNET_XXH3_STRIPE_SZ;
+        secret += XXH3_SECRET_STEP;
+    }
+
+    _mm256_storeu_si256((__m256i *)acc, acc_low);
+    _mm256_storeu_si256((__m256i *)(acc + 4), acc_high);
+}
+
+__attribute__((target("avx2")))
+static void xxh3_scramble_avx2(uint64_t *acc, const unsigned char *secret)
+{
+    const __m256i prime = _mm256_set1_epi32((int)XXH_PRIME32_1);
+
+    for (size_t n = 0; n < 2; n++) {
+        __m256i value = _mm256_loadu_si256((const __m256i *)(acc + 4 * n));
+        value = _mm256_xor_si256(value, _mm256_srli_epi64(value, 47));
+        value = _mm256_xor_si256(value, _mm256_loadu_si256((const __m256i *)(secret + 32 * n)));
+        __m256i low = _mm256_mul_epu32(value, prime);
+        __m256i high = _mm256_mul_epu32(_mm256_shuffle_epi32(value, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+        _mm256_storeu_si256((__m256i *)(acc + 4 * n), _mm256_add_epi64(low, _mm256_slli_epi64(high, 32)));
+    }
+}
+#endif
@@ -0,0 +1,516 @@
+#include "xnet_compress.h"
+#include "xnet_buffer.h"
+
+#define LZ_HASH_SIZE (1u << XNET_LZ_HASH_BITS)
+
+/**
+ * @brief Codes @param length bytes of @param data into @param out, which has room for the worst case.
+ *
+ * @return size_t Bytes written to @param out.
+ */
+static size_t lz_compress(xnet_compress_ctx_t *ctx, const unsigned char *data, size_t length, unsigned char *out);
+
+/**
+ * @brief Decodes one LZ block of @param length bytes into exactly @param raw_length bytes of @param out.
+ *
+ * @return int 0 on success. -1 when the block is malformed.
+ */
+static int lz_decompress(xnet_decompress_ctx_t *ctx, const unsigned char *in, size_t length, unsigned char *out, size_t raw_length);
+
+/**
+ * @brief Writes a token with @param literal_length and the literals that follow it.
+ *        The token's match nibble is left at 0 for the caller to fill in.
+ *
+ * @return unsigned char* Just past what was written.
+ */
+static unsigned char *lz_put_literals(unsigned char *out, const unsigned char *literals, size_t literal_length);
+
+/**
+ * @brief Writes the continuation bytes of a length whose nibble was 15. @param length is what is left after the 15.
+ *
+ * @return unsigned char* Just past what was written.
+ */
+static unsigned char *lz_put_length(unsigned char *out, size_t length);
+
+/**
+ * @brief Reads the continuation bytes of a length whose nibble was 15 and adds them to @param length.
+ *
+ * @return int 0 on success. -1 when the block ends first.
+ */
+static int lz_get_length(const unsigned char **in, const unsigned char *end, size_t *length);
+
+#ifdef XNET_WITH_ZLIB
+/**
+ * @brief Codes @param length bytes of @param data into @param out and flushes them to a byte boundary.
+ *
+ * @return size_t Bytes written to @param out. 0 on failure.
+ */
+static size_t zlib_compress(xnet_compress_ctx_t *ctx, const unsigned char *data, size_t length,
+                            unsigned char *out, size_t capacity);
+#endif
+
+unsigned int xnet_supported_codecs(void)
+{
+    unsigned int codecs = (1u << XNET_CODEC_NONE) | (1u << XNET_CODEC_LZ);
+#ifdef XNET_WITH_ZLIB
+    codecs |= 1u << XNET_CODEC_ZLIB;
+#endif
+    return codecs;
+}
+
+xnet_compress_ctx_t *xnet_compress_create(int codec)
+{
+    int err = 0;
+
+    if (0 > codec || XNET_CODECS <= codec || 0 == (xnet_supported_codecs() & (1u << codec))) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    /* Nothing to keep for an uncompressed connection. */
+    if (XNET_CODEC_NONE == codec) {
+        return NULL;
+    }
+
+    xnet_compress_ctx_t *ctx = calloc(1, sizeof(xnet_compress_ctx_t));
+    if (NULL == ctx) {
+        err = E_GEN_FAIL_ALLOC;
+        goto handle_err;
+    }
+    ctx->codec = codec;
+
+    if (XNET_CODEC_LZ == codec) {
+        ctx->window = malloc(2 * XNET_LZ_WINDOW_SZ);
+        ctx->table = calloc(LZ_HASH_SIZE, sizeof(uint16_t));
+        if (NULL == ctx->window || NULL == ctx->table) {
+            xnet_compress_destroy(ctx);
+            err = E_GEN_FAIL_ALLOC;
+            goto handle_err;
+        }
+    }
+
+#ifdef XNET_WITH_ZLIB
+    if (XNET_CODEC_ZLIB == codec) {
+        /* Raw deflate, the block header already says how long everything is. */
+        int status = deflateInit2(&ctx->zlib, XNET_ZLIB_LEVEL, Z_DEFLATED, -XNET_ZLIB_WINDOW_BITS,
+                                  XNET_ZLIB_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+        if (Z_OK != status) {
+            ctx->codec = XNET_CODEC_NONE;
+            xnet_compress_destroy(ctx);
+            err = E_GEN_FAIL_ALLOC;
+            goto handle_err;
+        }
+    }
+#endif
+
+    return ctx;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_compress_create()");
+    return NULL;
+}
+
+void xnet_compress_destroy(xnet_compress_ctx_t *ctx)
+{
+    if (NULL == ctx) {
+        return;
+    }
+
+#ifdef XNET_WITH_ZLIB
+    if (XNET_CODEC_ZLIB == ctx->codec) {
+        deflateEnd(&ctx->zlib);
+    }
+#endif
+
+    nfree((void **)&ctx->window);
+    nfree((void **)&ctx->table);
+    nfree((void **)&ctx);
+}
+
+xnet_shared_buf_t *xnet_compress_block(xnet_compress_ctx_t *ctx, const void *data, size_t length)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == ctx || NULL == data) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (ctx->is_broken) {
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    if (UINT32_MAX < length) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    /* Room for the worst case is set aside first, so running out of memory never leaves the stream half coded. */
+    size_t bound = length + length / 255 + 16;
+#ifdef XNET_WITH_ZLIB
+    if (XNET_CODEC_ZLIB == ctx->codec) {
+        bound = deflateBound(&ctx->zlib, length) + 64;
+    }
+#endif
+
+    xnet_shared_buf_t *block = xnet_buf_alloc(XNET_COMPRESSED_HEADER_SZ + bound);
+    if (NULL == block) {
+        err = E_GEN_FAIL_ALLOC;
+        goto handle_err;
+    }
+
+    unsigned char *out = (unsigned char *)block->data + XNET_COMPRESSED_HEADER_SZ;
+    size_t coded = 0;
+    if (XNET_CODEC_LZ == ctx->codec) {
+        coded = lz_compress(ctx, data, length, out);
+    }
+#ifdef XNET_WITH_ZLIB
+    if (XNET_CODEC_ZLIB == ctx->codec) {
+        coded = zlib_compress(ctx, data, length, out, bound);
+        if (0 == coded) {
+            ctx->is_broken = true;
+            xnet_buf_release(block);
+            err = E_GEN_NON_ZERO;
+            goto handle_err;
+        }
+    }
+#endif
+
+    uint16_t opcode = htons(XNET_COMPRESSED_OP);
+    uint32_t coded_length = htonl(coded);
+    uint32_t raw_length = htonl(length);
+    memcpy(block->data, &opcode, sizeof(opcode));
+    memcpy(block->data + sizeof(opcode), &coded_length, sizeof(coded_length));
+    memcpy(block->data + sizeof(opcode) + sizeof(coded_length), &raw_length, sizeof(raw_length));
+    block->length = XNET_COMPRESSED_HEADER_SZ + coded;
+
+    return block;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_compress_block()");
+    return NULL;
+}
+
+xnet_decompress_ctx_t *xnet_decompress_create(int codec)
+{
+    int err = 0;
+
+    if (0 > codec || XNET_CODECS <= codec || 0 == (xnet_supported_codecs() & (1u << codec))) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    if (XNET_CODEC_NONE == codec) {
+        return NULL;
+    }
+
+    xnet_decompress_ctx_t *ctx = calloc(1, sizeof(xnet_decompress_ctx_t));
+    if (NULL == ctx) {
+        err = E_GEN_FAIL_ALLOC;
+        goto handle_err;
+    }
+    ctx->codec = codec;
+
+    if (XNET_CODEC_LZ == codec) {
+        ctx->history = malloc(XNET_LZ_WINDOW_SZ);
+        if (NULL == ctx->history) {
+            xnet_decompress_destroy(ctx);
+            err = E_GEN_FAIL_ALLOC;
+            goto handle_err;
+        }
+    }
+
+#ifdef XNET_WITH_ZLIB
+    /* Any window up to deflate's largest decodes what a smaller one coded. */
+    if (XNET_CODEC_ZLIB == codec && Z_OK != inflateInit2(&ctx->zlib, -15)) {
+        ctx->codec = XNET_CODEC_NONE;
+        xnet_decompress_destroy(ctx);
+        err = E_GEN_FAIL_ALLOC;
+        goto handle_err;
+    }
+#endif
+
+    return ctx;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_decompress_create()");
+    return NULL;
+}
+
+void xnet_decompress_destroy(xnet_decompress_ctx_t *ctx)
+{
+    if (NULL == ctx) {
+        return;
+    }
+
+#ifdef XNET_WITH_ZLIB
+    if (XNET_CODEC_ZLIB == ctx->codec) {
+        inflateEnd(&ctx->zlib);
+    }
+#endif
+
+    nfree((void **)&ctx->history);
+    nfree((void **)&ctx);
+}
+
+ssize_t xnet_decompress_block(xnet_decompress_ctx_t *ctx, const void *block, size_t length, void *out, size_t capacity)
+{
+    if (NULL == ctx || NULL == block || NULL == out || XNET_COMPRESSED_HEADER_SZ > length) {
+        return -1;
+    }
+
+    const unsigned char *header = block;
+    uint16_t opcode = 0;
+    uint32_t coded_length = 0;
+    uint32_t raw_length = 0;
+    memcpy(&opcode, header, sizeof(opcode));
+    memcpy(&coded_length, header + sizeof(opcode), sizeof(coded_length));
+    memcpy(&raw_length, header + sizeof(opcode) + sizeof(coded_length), sizeof(raw_length));
+    coded_length = ntohl(coded_length);
+    raw_length = ntohl(raw_length);
+
+    if (XNET_COMPRESSED_OP != ntohs(opcode) || length - XNET_COMPRESSED_HEADER_SZ < coded_length || capacity < raw_length) {
+        return -1;
+    }
+
+    const unsigned char *in = header + XNET_COMPRESSED_HEADER_SZ;
+    if (XNET_CODEC_LZ == ctx->codec && 0 != lz_decompress(ctx, in, coded_length, out, raw_length)) {
+        return -1;
+    }
+
+#ifdef XNET_WITH_ZLIB
+    if (XNET_CODEC_ZLIB == ctx->codec) {
+        ctx->zlib.next_in = (Bytef *)in;
+        ctx->zlib.avail_in = coded_length;
+        ctx->zlib.next_out = out;
+        ctx->zlib.avail_out = raw_length;
+
+        int status = inflate(&ctx->zlib, Z_SYNC_FLUSH);
+        if ((Z_OK != status && Z_BUF_ERROR != status) || 0 != ctx->zlib.avail_in || 0 != ctx->zlib.avail_out) {
+            return -1;
+        }
+    }
+#endif
+
+    return raw_length;
+}
+
+static size_t lz_compress(xnet_compress_ctx_t *ctx, const unsigned char *data, size_t length, unsigned char *out)
+{
+    unsigned char *window = ctx->window;
+    unsigned char *cursor = out;
+    size_t anchor = ctx->window_fill;
+
+    while (0 < length) {
+        size_t piece = (XNET_LZ_WINDOW_SZ < length) ? XNET_LZ_WINDOW_SZ : length;
+
+        /* Slide the window so only the last XNET_LZ_WINDOW_SZ bytes stay behind the new piece. */
+        if (2 * XNET_LZ_WINDOW_SZ < ctx->window_fill + piece) {
+            size_t shift = ctx->window_fill - XNET_LZ_WINDOW_SZ;
+
+            /* Literals about to slide out are written now, the decoder never needs them as history. */
+            if (anchor < shift) {
+                cursor = lz_put_literals(cursor, window + anchor, ctx->window_fill - anchor);
+                *cursor++ = 0;
+                *cursor++ = 0;
+                anchor = ctx->window_fill;
+            }
+
+            memmove(window, window + shift, XNET_LZ_WINDOW_SZ);
+            for (size_t n = 0; n < LZ_HASH_SIZE; n++) {
+                ctx->table[n] = (shift < ctx->table[n]) ? ctx->table[n] - shift : 0;
+            }
+            ctx->window_fill -= shift;
+            anchor -= shift;
+        }
+
+        memcpy(window + ctx->window_fill, data, piece);
+        size_t position = ctx->window_fill;
+        size_t end = ctx->window_fill + piece;
+        size_t misses = 0;
+
+        while (position + XNET_LZ_MIN_MATCH <= end) {
+            uint32_t sample = 0;
+            memcpy(&sample, window + position, sizeof(sample));
+            size_t slot = (sample * 2654435761u) >> (32 - XNET_LZ_HASH_BITS);
+            size_t candidate = ctx->table[slot];
+            ctx->table[slot] = position + 1;
+
+            bool is_match = false;
+            if (0 != candidate) {
+                candidate--;
+                is_match = XNET_LZ_WINDOW_SZ >= position - candidate && 0 == memcmp(window + candidate, &sample, sizeof(sample));
+            }
+
+            if (false == is_match) {
+                /* Skip ahead faster through data that doesn't compress. */
+                position += 1 + (misses++ >> 5);
+                continue;
+            }
+
+            size_t match_length = XNET_LZ_MIN_MATCH;
+            while (position + match_length < end && window[candidate + match_length] == window[position + match_length]) {
+                match_length++;
+            }
+
+            unsigned char *token = cursor;
+            cursor = lz_put_literals(cursor, window + anchor, position - anchor);
+            size_t offset = position - candidate;
+            *cursor++ = (unsigned char)(offset >> 8);
+            *cursor++ = (unsigned char)offset;
+
+            size_t extra = match_length - XNET_LZ_MIN_MATCH;
+            *token |= (15 > extra) ? extra : 15;
+            if (15 <= extra) {
+                cursor = lz_put_length(cursor, extra - 15);
+            }
+
+            position += match_length;
+            anchor = position;
+            misses = 0;
+        }
+
+        ctx->window_fill = end;
+        data += piece;
+        length -= piece;
+    }
+
+    /* Whatever didn't match ends the block as literals. */
+    if (anchor < ctx->window_fill) {
+        cursor = lz_put_literals(cursor, window + anchor, ctx->window_fill - anchor);
+    }
+
+    return cursor - out;
+}
+
+static int lz_decompress(xnet_decompress_ctx_t *ctx, const unsigned char *in, size_t length, unsigned char *out, size_t raw_length)
+{
+    const unsigned char *end = in + length;
+    size_t produced = 0;
+
+    while (in < end) {
+        unsigned char token = *in++;
+
+        size_t literal_length = token >> 4;
+        if (15 == literal_length && 0 != lz_get_length(&in, end, &literal_length)) {
+            return -1;
+        }
+        if ((size_t)(end - in) < literal_length || raw_length - produced < literal_length) {
+            return -1;
+        }
+        memcpy(out + produced, in, literal_length);
+        in += literal_length;
+        produced += literal_length;
+
+        if (in == end) {
+            break;
+        }
+
+        if (2 > end - in) {
+            return -1;
+        }
+        size_t offset = ((size_t)in[0] << 8) | in[1];
+        in += 2;
+
+        if (0 == offset) {
+            continue;
+        }
+
+        size_t match_length = (token & 15) + XNET_LZ_MIN_MATCH;
+        if (15 == (token & 15) && 0 != lz_get_length(&in, end, &match_length)) {
+            return -1;
+        }
+
+        /* Matches may reach back into earlier blocks, but never past the window. */
+        size_t reach = produced + ((XNET_LZ_WINDOW_SZ < ctx->total_out) ? XNET_LZ_WINDOW_SZ : ctx->total_out);
+        if (XNET_LZ_WINDOW_SZ < offset || reach < offset || raw_length - produced < match_length) {
+            return -1;
+        }
+
+        if (offset <= produced && offset >= match_length) {
+            memcpy(out + produced, out + produced - offset, match_length);
+            produced += match_length;
+            continue;
+        }
+
+        /* Byte by byte, the match overlaps what it produces or starts in an earlier block. */
+        for (size_t n = 0; n < match_length; n++, produced++) {
+            if (offset <= produced) {
+                out[produced] = out[produced - offset];
+            } else {
+                out[produced] = ctx->history[(ctx->total_out - (offset - produced)) & (XNET_LZ_WINDOW_SZ - 1)];
+            }
+        }
+    }
+
+    if (produced != raw_length) {
+        return -1;
+    }
+
+    /* Keep the tail of the block for the ones after it. */
+    size_t keep_from = (XNET_LZ_WINDOW_SZ < raw_length) ? raw_length - XNET_LZ_WINDOW_SZ : 0;
+    for (size_t n = keep_from; n < raw_length; n++) {
+        ctx->history[(ctx->total_out + n) & (XNET_LZ_WINDOW_SZ - 1)] = out[n];
+    }
+    ctx->total_out += raw_length;
+
+    return 0;
+}
+
+static unsigned char *lz_put_literals(unsigned char *out, const unsigned char *literals, size_t literal_length)
+{
+    *out++ = (unsigned char)(((15 > literal_length) ? literal_length : 15) << 4);
+    if (15 <= literal_length) {
+        out = lz_put_length(out, literal_length - 15);
+    }
+
+    memcpy(out, literals, literal_length);
+    return out + literal_length;
+}
+
+static unsigned char *lz_put_length(unsigned char *out, size_t length)
+{
+    while (255 <= length) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = (unsigned char)length;
+    return out;
+}
+
+static int lz_get_length(const unsigned char **in, const unsigned char *end, size_t *length)
+{
+    unsigned char byte = 255;
+    while (255 == byte) {
+        if (*in >= end) {
+            return -1;
+        }
+        byte = *(*in)++;
+        *length += byte;
+    }
+    return 0;
+}
+
+#ifdef XNET_WITH_ZLIB
+static size_t zlib_compress(xnet_compress_ctx_t *ctx, const unsigned char *data, size_t length,
+                            unsigned char *out, size_t capacity)
+{
+    ctx->zlib.next_in = (Bytef *)data;
+    ctx->zlib.avail_in = length;
+    ctx->zlib.next_out = out;
+    ctx->zlib.avail_out = capacity;
+
+    /* A sync flush ends the block on a byte boundary without resetting the dictionary. */
+    int status = deflate(&ctx->zlib, Z_SYNC_FLUSH);
+    if ((Z_OK != status && Z_BUF_ERROR != status) || 0 != ctx->zlib.avail_in || 0 == ctx->zlib.avail_out) {
+        return 0;
+    }
+
+    return capacity - ctx->zlib.avail_out;
+}
+#endif
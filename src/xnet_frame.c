@@ -0,0 +1,504 @@
+#include "xnet_frame.h"
+
+/**
+ * @brief read() on @param conn's socket that retries on EINTR.
+ *
+ * @return ssize_t Bytes read. 0 on EOF. -1 on failure, including a socket with nothing left to read.
+ */
+static ssize_t read_socket(xnet_active_connection_t *conn, void *buf, size_t length);
+
+/**
+ * @brief Throws away up to @param length bytes of @param conn's socket without copying them out. Retries on EINTR.
+ *
+ * @return ssize_t Bytes dropped. -1 on failure, see read_socket().
+ */
+static ssize_t discard_socket(xnet_active_connection_t *conn, size_t length);
+
+/**
+ * @brief Finds room for a @param length byte payload of @param conn. Its inline buffer when the payload fits,
+ *        otherwise a buffer of the smallest rx pool class that does.
+ *
+ * @return char* NULL when the server is out of memory.
+ */
+static char *borrow_buffer(xnet_box_t *xnet, xnet_active_connection_t *conn, size_t length);
+
+/**
+ * @brief Gives @param conn's payload buffer back to the rx pool, unless it is the inline one.
+ */
+static void return_buffer(xnet_box_t *xnet, xnet_active_connection_t *conn);
+
+/**
+ * @return size_t The rx pool class buffers for a @param length byte payload come from.
+ */
+static size_t pool_class_of(size_t length);
+
+/**
+ * @brief Moves what the socket has of @param conn's file into the sink, within XNET_FILE_BUDGET_SZ bytes.
+ *
+ * @return int 0 once the sink is done with the socket, 1 when it waits for more data.
+ *         -1 when the socket hung up or failed, with errno set.
+ */
+static int pump_file_sink(xnet_box_t *xnet, xnet_active_connection_t *conn);
+
+/**
+ * @brief Closes @param conn after its peer hung up or its socket failed.
+ */
+static void drop_connection(xnet_box_t *xnet, xnet_active_connection_t *conn);
+
+enum xnet_frame_status xnet_read_frame(xnet_box_t *xnet, xnet_active_connection_t *conn, short *opcode)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == conn || NULL == opcode) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    while (true) {
+        /* A file being received goes before anything sent after it. */
+        if (NULL != conn->rx_sink) {
+            int pumped = pump_file_sink(xnet, conn);
+            if (-1 == pumped) {
+                goto read_stalled;
+            }
+            if (1 == pumped) {
+                return XNET_FRAME_PENDING;
+            }
+            continue;
+        }
+
+        /* Whatever is left of a rejected frame goes first. */
+        while (0 < conn->rx_skip) {
+            ssize_t bytes_read = discard_socket(conn, conn->rx_skip);
+            if (0 >= bytes_read) {
+                goto read_stalled;
+            }
+            conn->rx_skip -= bytes_read;
+        }
+
+        /* The opcode alone tells framed and legacy requests apart, so never read past it before knowing which. */
+        if (XNET_FRAME_HEADER_SZ > conn->rx_have) {
+            size_t want = (sizeof(uint16_t) > conn->rx_have) ? sizeof(uint16_t) - conn->rx_have : XNET_FRAME_HEADER_SZ - conn->rx_have;
+            ssize_t bytes_read = read_socket(conn, conn->rx_header + conn->rx_have, want);
+            if (0 >= bytes_read) {
+                goto read_stalled;
+            }
+            conn->rx_have += bytes_read;
+
+            if (sizeof(uint16_t) > conn->rx_have) {
+                continue;
+            }
+
+            uint16_t raw_op = 0;
+            memcpy(&raw_op, conn->rx_header, sizeof(raw_op));
+            raw_op = ntohs(raw_op);
+
+            if (0 == (XNET_FRAME_FLAG & raw_op)) {
+                conn->rx_have = 0;
+
+                /* Without a length there is no telling where the request ends. */
+                if (false == xnet->general->legacy_framing) {
+                    fprintf(stderr, "Unframed request [%d] refused. Ignoring request.\n", raw_op);
+                    flush_buffer(conn->socket);
+                    return XNET_FRAME_PENDING;
+                }
+
+                *opcode = raw_op;
+                return XNET_FRAME_LEGACY;
+            }
+
+            if (XNET_FRAME_HEADER_SZ > conn->rx_have) {
+                continue;
+            }
+
+            uint32_t length = 0;
+            memcpy(&length, conn->rx_header + sizeof(uint16_t), sizeof(length));
+            conn->rx_length = ntohl(length);
+
+            /* Size and opcode are checked before any of the payload is read. */
+            size_t frame_op = raw_op & ~XNET_FRAME_FLAG;
+            bool is_supported = XNET_MAX_FEATURES > frame_op && NULL != xnet->general->perform[frame_op];
+            if (XNET_MAX_FRAME_SZ < conn->rx_length || false == is_supported) {
+                fprintf(stderr, "Frame [%zu] with %zu bytes refused. Skipping it.\n", frame_op, conn->rx_length);
+                conn->rx_skip = conn->rx_length;
+                conn->rx_have = 0;
+                continue;
+            }
+
+            conn->rx_payload = borrow_buffer(xnet, conn, conn->rx_length);
+            if (NULL == conn->rx_payload) {
+                fprintf(stderr, "Server is out of memory. Skipping frame [%zu].\n", frame_op);
+                conn->rx_skip = conn->rx_length;
+                conn->rx_have = 0;
+                continue;
+            }
+        }
+
+        /* Take the payload in as few reads as the socket allows. */
+        size_t payload_have = conn->rx_have - XNET_FRAME_HEADER_SZ;
+        while (payload_have < conn->rx_length) {
+            ssize_t bytes_read = read_socket(conn, conn->rx_payload + payload_have, conn->rx_length - payload_have);
+            if (0 >= bytes_read) {
+                goto read_stalled;
+            }
+            payload_have += bytes_read;
+            conn->rx_have += bytes_read;
+        }
+
+        uint16_t raw_op = 0;
+        memcpy(&raw_op, conn->rx_header, sizeof(raw_op));
+        *opcode = ntohs(raw_op) & ~XNET_FRAME_FLAG;
+
+        conn->rx_have = 0;
+        conn->rx_offset = 0;
+        conn->rx_framed = true;
+        return XNET_FRAME_READY;
+    }
+
+/* Socket ran dry, hung up or failed. Partial frames are kept for the next EPOLLIN. */
+read_stalled:
+    if (EAGAIN == errno || EWOULDBLOCK == errno) {
+        return XNET_FRAME_PENDING;
+    }
+
+    drop_connection(xnet, conn);
+    return XNET_FRAME_PENDING;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_read_frame()");
+    return XNET_FRAME_PENDING;
+}
+
+int xnet_receive_file(xnet_box_t *xnet, xnet_active_connection_t *conn, int fd, size_t offset, size_t length,
+                      void (*on_done)(xnet_box_t *xnet, xnet_active_connection_t *conn, int status, void *arg),
+                      void *arg)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == conn || NULL == on_done) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (0 > fd || 0 == length || NULL != conn->rx_sink) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    xnet_file_sink_t *sink = &conn->cold->rx_sink;
+    if (0 != pipe2(sink->pipe_fds, O_NONBLOCK | O_CLOEXEC)) {
+        err = E_SRV_FAIL_FILE_IO;
+        goto handle_err;
+    }
+
+    sink->fd = fd;
+    sink->offset = offset;
+    sink->left = length;
+    sink->in_pipe = 0;
+    sink->on_done = on_done;
+    sink->arg = arg;
+    conn->rx_sink = sink;
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    if (0 <= fd) {
+        close(fd);
+    }
+    g_show_err(err, "xnet_receive_file()");
+    return err;
+}
+
+void xnet_close_file_sink(xnet_box_t *xnet, xnet_active_connection_t *conn, int status)
+{
+    xnet_file_sink_t *sink = conn->rx_sink;
+    if (NULL == sink) {
+        return;
+    }
+
+    close(sink->fd);
+    close(sink->pipe_fds[0]);
+    close(sink->pipe_fds[1]);
+
+    /* Closed before on_done runs, so on_done may start the next transfer. */
+    void (*on_done)(xnet_box_t *, xnet_active_connection_t *, int, void *) = sink->on_done;
+    void *arg = sink->arg;
+    memset(sink, 0, sizeof(xnet_file_sink_t));
+    conn->rx_sink = NULL;
+
+    on_done(xnet, conn, status, arg);
+}
+
+ssize_t xnet_conn_read(xnet_active_connection_t *conn, void *buf, size_t length)
+{
+    if (false == conn->rx_framed) {
+        return read(conn->socket, buf, length);
+    }
+
+    size_t left = conn->rx_length - conn->rx_offset;
+    if (length > left) {
+        length = left;
+    }
+
+    if (0 < length) {
+        memcpy(buf, conn->rx_payload + conn->rx_offset, length);
+        conn->rx_offset += length;
+    }
+
+    return length;
+}
+
+const char *xnet_conn_payload(xnet_active_connection_t *conn, size_t *length)
+{
+    if (false == conn->rx_framed) {
+        *length = 0;
+        return NULL;
+    }
+
+    const char *payload = conn->rx_payload + conn->rx_offset;
+
+    *length = conn->rx_length - conn->rx_offset;
+    conn->rx_offset = conn->rx_length;
+
+    return payload;
+}
+
+void xnet_release_frame(xnet_box_t *xnet, xnet_active_connection_t *conn)
+{
+    return_buffer(xnet, conn);
+    conn->rx_length = 0;
+    conn->rx_offset = 0;
+    conn->rx_framed = false;
+}
+
+int xnet_get_rx_pool_stats(xnet_box_t *xnet, xnet_rx_pool_stats_t *stats)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet || NULL == stats) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    xnet_rx_pool_t *pool = &xnet->connections->rx_pool;
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+    stats->inline_frames = __atomic_load_n(&pool->stats.inline_frames, __ATOMIC_RELAXED);
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_get_rx_pool_stats()");
+    return err;
+}
+
+void xnet_destroy_rx_pool(xnet_box_t *xnet)
+{
+    /* The pool is set up along with the connections, by xnet_start(). */
+    if (NULL == xnet->connections->clients) {
+        return;
+    }
+
+    /* Frames still held when the server stopped go back first. */
+    for (size_t n = 0; n < xnet->general->max_connections; n++) {
+        return_buffer(xnet, &xnet->connections->clients[n]);
+    }
+
+    xnet_rx_pool_t *pool = &xnet->connections->rx_pool;
+    for (size_t class = 0; class < XNET_RX_POOL_CLASSES; class++) {
+        while (NULL != pool->idle[class]) {
+            void *buf = pool->idle[class];
+            memcpy(&pool->idle[class], buf, sizeof(void *));
+            free(buf);
+        }
+        pool->idle_count[class] = 0;
+    }
+    pool->stats.idle_bytes = 0;
+    pthread_mutex_destroy(&pool->lock);
+}
+
+static ssize_t read_socket(xnet_active_connection_t *conn, void *buf, size_t length)
+{
+    ssize_t bytes_read = read(conn->socket, buf, length);
+    while (-1 == bytes_read && EINTR == errno) {
+        bytes_read = read(conn->socket, buf, length);
+    }
+
+    /* EOF looks like any other failure to the caller. */
+    if (0 == bytes_read) {
+        errno = ECONNRESET;
+    }
+
+    return bytes_read;
+}
+
+static ssize_t discard_socket(xnet_active_connection_t *conn, size_t length)
+{
+    /* TCP drops truncated bytes in the kernel, so nothing needs a buffer for them. */
+    ssize_t bytes_read = recv(conn->socket, NULL, length, MSG_TRUNC | MSG_DONTWAIT);
+    while (-1 == bytes_read && EINTR == errno) {
+        bytes_read = recv(conn->socket, NULL, length, MSG_TRUNC | MSG_DONTWAIT);
+    }
+
+    if (0 == bytes_read) {
+        errno = ECONNRESET;
+    }
+
+    return bytes_read;
+}
+
+static char *borrow_buffer(xnet_box_t *xnet, xnet_active_connection_t *conn, size_t length)
+{
+    /* Most requests are a few dozen bytes and never leave the connection. */
+    if (XNET_RX_INLINE_SZ >= length) {
+        __atomic_fetch_add(&xnet->connections->rx_pool.stats.inline_frames, 1, __ATOMIC_RELAXED);
+        return conn->rx_inline;
+    }
+
+    xnet_rx_pool_t *pool = &xnet->connections->rx_pool;
+    size_t class = pool_class_of(length);
+    pthread_mutex_lock(&pool->lock);
+    char *buf = pool->idle[class];
+    if (NULL != buf) {
+        memcpy(&pool->idle[class], buf, sizeof(void *));
+        pool->idle_count[class]--;
+        pool->stats.idle_bytes -= (size_t)XNET_RX_POOL_MIN_SZ << (2 * class);
+        pool->stats.reused++;
+        pool->stats.lent++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (NULL != buf) {
+        return buf;
+    }
+
+    buf = malloc((size_t)XNET_RX_POOL_MIN_SZ << (2 * class));
+    if (NULL == buf) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.allocated++;
+    pool->stats.lent++;
+    pthread_mutex_unlock(&pool->lock);
+    return buf;
+}
+
+static void return_buffer(xnet_box_t *xnet, xnet_active_connection_t *conn)
+{
+    char *buf = conn->rx_payload;
+    conn->rx_payload = NULL;
+    if (NULL == buf || conn->rx_inline == buf) {
+        return;
+    }
+
+    /* Borrowed for rx_length, which stays put until the frame is released. */
+    xnet_rx_pool_t *pool = &xnet->connections->rx_pool;
+    size_t class = pool_class_of(conn->rx_length);
+    size_t size = (size_t)XNET_RX_POOL_MIN_SZ << (2 * class);
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.lent--;
+    if (XNET_RX_POOL_KEEP_SZ / size > pool->idle_count[class]) {
+        memcpy(buf, &pool->idle[class], sizeof(void *));
+        pool->idle[class] = buf;
+        pool->idle_count[class]++;
+        pool->stats.idle_bytes += size;
+        buf = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    free(buf);
+}
+
+static size_t pool_class_of(size_t length)
+{
+    size_t class = 0;
+    while (XNET_RX_POOL_CLASSES - 1 > class && ((size_t)XNET_RX_POOL_MIN_SZ << (2 * class)) < length) {
+        class++;
+    }
+    return class;
+}
+
+static int pump_file_sink(xnet_box_t *xnet, xnet_active_connection_t *conn)
+{
+    xnet_file_sink_t *sink = conn->rx_sink;
+    size_t budget = XNET_FILE_BUDGET_SZ;
+
+    while (0 < sink->left || 0 < sink->in_pipe) {
+        /* Socket into the pipe. The pipe holds at most a chunk, and nothing past the file may be taken. */
+        size_t want = XNET_FILE_CHUNK_SZ - sink->in_pipe;
+        want = (sink->left < want) ? sink->left : want;
+        if (0 < want && 0 < budget) {
+            ssize_t taken = splice(conn->socket, NULL, sink->pipe_fds[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (0 == taken) {
+                errno = ECONNRESET;
+                return -1;
+            }
+            if (-1 == taken && EINTR != errno && EAGAIN != errno && EWOULDBLOCK != errno) {
+                return -1;
+            }
+            if (0 < taken) {
+                sink->left -= taken;
+                sink->in_pipe += taken;
+                budget -= ((size_t)taken < budget) ? (size_t)taken : budget;
+            }
+        }
+
+        /* Nothing in flight and nothing to take. Wait for EPOLLIN. */
+        if (0 == sink->in_pipe) {
+            return 1;
+        }
+
+        /* Pipe into the file, at the sink's own position. */
+        loff_t position = (loff_t)sink->offset;
+        ssize_t written = splice(sink->pipe_fds[0], NULL, sink->fd, &position, sink->in_pipe, SPLICE_F_MOVE);
+        if (-1 == written && EINTR == errno) {
+            continue;
+        }
+
+        /* The data has nowhere to go. Skip what the socket still owes so the requests after it stay intact. */
+        if (0 >= written) {
+            conn->rx_skip += sink->left;
+            xnet_close_file_sink(xnet, conn, E_SRV_FAIL_FILE_IO);
+            return 0;
+        }
+        sink->in_pipe -= written;
+        sink->offset += written;
+
+        /* Out of budget. Level triggered EPOLLIN brings the reactor back for the rest. */
+        if (0 == budget && 0 == sink->in_pipe && 0 < sink->left) {
+            return 1;
+        }
+    }
+
+    xnet_close_file_sink(xnet, conn, 0);
+    return 0;
+}
+
+static void drop_connection(xnet_box_t *xnet, xnet_active_connection_t *conn)
+{
+    int close_status = xnet_close_connection(xnet, conn);
+    if (0 != close_status) {
+        g_show_err(E_GEN_NON_ZERO, "xnet_read_frame()");
+        return;
+    }
+
+    xnet_debug_connections(xnet);
+}
@@ -0,0 +1,470 @@
+#include "xnet_ratelimit.h"
+#include "xnet_buffer.h"
+
+/**
+ * @brief Tops @param bucket up at @param rule's rate for the time passed since its last refill.
+ *
+ * @return uint64_t Nanoseconds until the bucket holds a whole request. 0 when it already does.
+ */
+static uint64_t refill(const xnet_rate_rule_t *rule, xnet_rate_bucket_t *bucket, uint64_t now_ns);
+
+/**
+ * @brief Makes sure the rate timer fires no later than @param at_ns.
+ */
+static void schedule_wake(xnet_box_t *xnet, uint64_t at_ns);
+
+/**
+ * @brief Adds @param conn to the held heap, by its rx_resume_ns.
+ */
+static void heap_push(xnet_box_t *xnet, xnet_active_connection_t *conn);
+
+/**
+ * @brief Takes @param conn out of the held heap, wherever it sits in it.
+ */
+static void heap_remove(xnet_box_t *xnet, xnet_active_connection_t *conn);
+
+/**
+ * @brief Moves the connection at @param index of the held heap up, then down, until it is in order.
+ */
+static void heap_fix(xnet_box_t *xnet, size_t index);
+
+/**
+ * @brief Takes @param conn out of the paused line.
+ */
+static void paused_remove(xnet_box_t *xnet, xnet_active_connection_t *conn);
+
+/**
+ * @brief Dispatches @param conn's held request as if it had just been read, and reads on once it is done.
+ */
+static void resume_conn(xnet_box_t *xnet, xnet_active_connection_t *conn);
+
+static uint64_t monotonic_ns(void);
+
+int xnet_set_rate_limit(xnet_box_t *xnet, size_t opcode, uint32_t rate, uint32_t burst, enum xnet_rate_policy policy)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (XNET_RATE_ANY_OP < opcode || (0 < rate && 0 == burst)) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    if (XNET_RATE_REJECT != policy && XNET_RATE_DELAY != policy) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    /* Buckets are sized by their rule, so rules can't change under a running reactor. */
+    if (xnet->general->is_running) {
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    /* Slot 0 is the limit on every request. Opcodes get theirs on first use. */
+    size_t slot = 0;
+    if (XNET_RATE_ANY_OP != opcode) {
+        slot = xnet->general->rate_rule_of[opcode];
+    }
+
+    if (XNET_RATE_ANY_OP != opcode && 0 == slot) {
+        if (0 == rate) {
+            return 0;
+        }
+
+        if (XNET_RATE_MAX_RULES <= xnet->general->rate_rule_count) {
+            err = E_GEN_OUT_RANGE;
+            goto handle_err;
+        }
+
+        slot = xnet->general->rate_rule_count++;
+        xnet->general->rate_rule_of[opcode] = slot;
+    }
+
+    xnet_rate_rule_t *rule = &xnet->general->rate_rules[slot];
+    rule->rate = rate;
+    rule->burst = burst;
+    rule->policy = policy;
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_set_rate_limit()");
+    return err;
+}
+
+int xnet_get_rate_stats(xnet_box_t *xnet, size_t opcode, xnet_rate_stats_t *stats)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet || NULL == stats) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (XNET_RATE_ANY_OP < opcode) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    size_t slot = (XNET_RATE_ANY_OP == opcode) ? 0 : xnet->general->rate_rule_of[opcode];
+    if (XNET_RATE_ANY_OP != opcode && 0 == slot) {
+        return E_GEN_OUT_RANGE;
+    }
+
+    xnet_rate_stats_t *counters = &xnet->general->rate_rules[slot].stats;
+    stats->admitted = __atomic_load_n(&counters->admitted, __ATOMIC_RELAXED);
+    stats->rejected = __atomic_load_n(&counters->rejected, __ATOMIC_RELAXED);
+    stats->delayed = __atomic_load_n(&counters->delayed, __ATOMIC_RELAXED);
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_get_rate_stats()");
+    return err;
+}
+
+int xnet_init_rate_limits(xnet_box_t *xnet)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    /* Same clock as the buckets, so a wake time can be handed over as it is. */
+    xnet->network->rate_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (-1 == xnet->network->rate_fd) {
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    if (-1 == epoll_ctl_add(xnet->network->epoll_fd, &xnet->network->rate_event, xnet->network->rate_fd, EPOLLIN)) {
+        close(xnet->network->rate_fd);
+        xnet->network->rate_fd = -1;
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    /* Every connection may be held at once. */
+    xnet->network->held_heap = calloc(xnet->general->max_connections, sizeof(xnet_active_connection_t *));
+    if (NULL == xnet->network->held_heap) {
+        close(xnet->network->rate_fd);
+        xnet->network->rate_fd = -1;
+        err = E_GEN_FAIL_ALLOC;
+        goto handle_err;
+    }
+
+    xnet->network->held_count = 0;
+    xnet->network->rate_wake_ns = 0;
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_init_rate_limits()");
+    return err;
+}
+
+void xnet_destroy_rate_limits(xnet_box_t *xnet)
+{
+    if (NULL == xnet || -1 == xnet->network->rate_fd) {
+        return;
+    }
+
+    close(xnet->network->rate_fd);
+    xnet->network->rate_fd = -1;
+    nfree((void **)&xnet->network->held_heap);
+    xnet->network->held_count = 0;
+}
+
+bool xnet_rate_admit(xnet_box_t *xnet, xnet_active_connection_t *conn, short opcode, enum xnet_frame_status status)
+{
+    xnet_rate_rule_t *rules = xnet->general->rate_rules;
+    size_t slots[2] = {0, xnet->general->rate_rule_of[opcode]};
+    size_t slot_count = (0 == slots[1]) ? 1 : 2;
+    uint64_t now_ns = monotonic_ns();
+
+    /* The request needs room in every bucket it is charged to. The one it waits on longest decides its fate. */
+    uint64_t wait_ns = 0;
+    size_t worst = 0;
+    for (size_t n = 0; n < slot_count; n++) {
+        if (0 == rules[slots[n]].rate) {
+            continue;
+        }
+
+        uint64_t slot_wait_ns = refill(&rules[slots[n]], &conn->rate_buckets[slots[n]], now_ns);
+        if (slot_wait_ns > wait_ns) {
+            wait_ns = slot_wait_ns;
+            worst = slots[n];
+        }
+    }
+
+    if (0 == wait_ns) {
+        for (size_t n = 0; n < slot_count; n++) {
+            if (0 == rules[slots[n]].rate) {
+                continue;
+            }
+
+            conn->rate_buckets[slots[n]].tokens -= XNET_RATE_TOKEN;
+            __atomic_fetch_add(&rules[slots[n]].stats.admitted, 1, __ATOMIC_RELAXED);
+        }
+        return true;
+    }
+
+    /* Held requests keep their place. The connection isn't read again until the rate timer hands this one back. */
+    if (XNET_RATE_DELAY == rules[worst].policy) {
+        __atomic_fetch_add(&rules[worst].stats.delayed, 1, __ATOMIC_RELAXED);
+        conn->hot->rx_held = true;
+        conn->cold->rx_held_op = opcode;
+        conn->cold->rx_held_status = status;
+        conn->cold->rx_resume_ns = now_ns + wait_ns;
+        heap_push(xnet, conn);
+        schedule_wake(xnet, conn->cold->rx_resume_ns);
+        return false;
+    }
+
+    __atomic_fetch_add(&rules[worst].stats.rejected, 1, __ATOMIC_RELAXED);
+
+    /* Framed payloads were read already. Legacy ones can only be flushed. */
+    if (XNET_FRAME_READY == status) {
+        xnet_release_frame(xnet, conn);
+    } else {
+        flush_buffer(conn->socket);
+    }
+
+    /* Tells the client when a retry would fit, rounded up to whole milliseconds. */
+    uint16_t throttle_op = htons(XNET_THROTTLE_OP);
+    uint16_t refused_op = htons(opcode);
+    uint32_t retry_ms = htonl((wait_ns + 999999) / 1000000);
+    char out[XNET_THROTTLE_SZ];
+    memcpy(out, &throttle_op, sizeof(throttle_op));
+    memcpy(out + 2, &refused_op, sizeof(refused_op));
+    memcpy(out + 4, &retry_ms, sizeof(retry_ms));
+    xnet_send(xnet, conn, out, sizeof(out));
+
+    return false;
+}
+
+enum xnet_frame_status xnet_rate_take_held(xnet_box_t *xnet, xnet_active_connection_t *conn, short *opcode,
+                                           bool *is_admitted)
+{
+    /* Hangups and output wake the reactor for this connection early. The request still waits its turn. */
+    if (false == conn->hot->rx_held || conn->cold->rx_resume_ns > monotonic_ns()) {
+        return XNET_FRAME_PENDING;
+    }
+
+    if (0 != conn->cold->rx_held_slot) {
+        heap_remove(xnet, conn);
+    }
+    if (conn->cold->rx_is_paused) {
+        paused_remove(xnet, conn);
+    }
+    conn->hot->rx_held = false;
+    *opcode = conn->cold->rx_held_op;
+    *is_admitted = conn->cold->rx_held_admitted;
+    conn->cold->rx_held_admitted = false;
+    return conn->cold->rx_held_status;
+}
+
+void xnet_drop_held(xnet_box_t *xnet, xnet_active_connection_t *conn)
+{
+    if (0 != conn->cold->rx_held_slot) {
+        heap_remove(xnet, conn);
+    }
+    if (conn->cold->rx_is_paused) {
+        paused_remove(xnet, conn);
+    }
+    conn->hot->rx_held = false;
+    conn->cold->rx_held_admitted = false;
+}
+
+void xnet_pause_request(xnet_box_t *xnet, xnet_active_connection_t *conn, short opcode, enum xnet_frame_status status)
+{
+    /* Due as soon as it gets a slot. It already passed the rate limits. */
+    conn->hot->rx_held = true;
+    conn->cold->rx_held_op = opcode;
+    conn->cold->rx_held_status = status;
+    conn->cold->rx_resume_ns = 0;
+    conn->cold->rx_held_admitted = true;
+
+    conn->cold->rx_is_paused = true;
+    conn->cold->rx_paused_prev = xnet->network->paused_tail;
+    conn->cold->rx_paused_next = NULL;
+    if (NULL == xnet->network->paused_tail) {
+        xnet->network->paused_head = conn;
+    } else {
+        xnet->network->paused_tail->cold->rx_paused_next = conn;
+    }
+    xnet->network->paused_tail = conn;
+}
+
+bool xnet_resume_paused(xnet_box_t *xnet, size_t count)
+{
+    /* Out of line before dispatch, so one that has to wait again goes to the back. */
+    for (size_t n = 0; n < count && NULL != xnet->network->paused_head; n++) {
+        xnet_active_connection_t *conn = xnet->network->paused_head;
+        paused_remove(xnet, conn);
+        resume_conn(xnet, conn);
+    }
+
+    return NULL != xnet->network->paused_head;
+}
+
+void xnet_rate_resume(xnet_box_t *xnet)
+{
+    /* Reset the timerfd counter. The top of the heap says who is due. */
+    uint64_t expirations = 0;
+    ssize_t bread = read(xnet->network->rate_fd, &expirations, sizeof(expirations));
+    (void)bread;
+
+    /* A request held again on dispatch is due later than now, so this ends. */
+    xnet->network->rate_wake_ns = 0;
+    xnet_active_connection_t **heap = xnet->network->held_heap;
+    uint64_t now_ns = monotonic_ns();
+    while (0 < xnet->network->held_count && heap[0]->cold->rx_resume_ns <= now_ns) {
+        xnet_active_connection_t *conn = heap[0];
+        heap_remove(xnet, conn);
+        resume_conn(xnet, conn);
+    }
+
+    if (0 < xnet->network->held_count) {
+        schedule_wake(xnet, heap[0]->cold->rx_resume_ns);
+    }
+}
+
+static void resume_conn(xnet_box_t *xnet, xnet_active_connection_t *conn)
+{
+    /* Dispatched as if it had just been read. Reading resumes once it is done. */
+    xnet->general->on_client_send(xnet, conn);
+
+    pthread_mutex_lock(&conn->io_lock);
+    if (conn->hot->is_active) {
+        xnet_arm_connection(xnet, conn);
+    }
+    pthread_mutex_unlock(&conn->io_lock);
+}
+
+static void paused_remove(xnet_box_t *xnet, xnet_active_connection_t *conn)
+{
+    xnet_conn_cold_t *cold = conn->cold;
+    if (NULL == cold->rx_paused_prev) {
+        xnet->network->paused_head = cold->rx_paused_next;
+    } else {
+        cold->rx_paused_prev->cold->rx_paused_next = cold->rx_paused_next;
+    }
+    if (NULL == cold->rx_paused_next) {
+        xnet->network->paused_tail = cold->rx_paused_prev;
+    } else {
+        cold->rx_paused_next->cold->rx_paused_prev = cold->rx_paused_prev;
+    }
+
+    cold->rx_is_paused = false;
+    cold->rx_paused_prev = NULL;
+    cold->rx_paused_next = NULL;
+}
+
+static void heap_push(xnet_box_t *xnet, xnet_active_connection_t *conn)
+{
+    size_t index = xnet->network->held_count++;
+    xnet->network->held_heap[index] = conn;
+    conn->cold->rx_held_slot = index + 1;
+    heap_fix(xnet, index);
+}
+
+static void heap_remove(xnet_box_t *xnet, xnet_active_connection_t *conn)
+{
+    xnet_active_connection_t **heap = xnet->network->held_heap;
+    size_t index = conn->cold->rx_held_slot - 1;
+    conn->cold->rx_held_slot = 0;
+
+    /* The last connection fills the gap and finds its place from there. */
+    size_t last = --xnet->network->held_count;
+    if (index != last) {
+        heap[index] = heap[last];
+        heap[index]->cold->rx_held_slot = index + 1;
+        heap_fix(xnet, index);
+    }
+}
+
+static void heap_fix(xnet_box_t *xnet, size_t index)
+{
+    xnet_active_connection_t **heap = xnet->network->held_heap;
+    size_t count = xnet->network->held_count;
+    xnet_active_connection_t *conn = heap[index];
+    uint64_t resume_ns = conn->cold->rx_resume_ns;
+
+    while (0 < index && heap[(index - 1) / 2]->cold->rx_resume_ns > resume_ns) {
+        heap[index] = heap[(index - 1) / 2];
+        heap[index]->cold->rx_held_slot = index + 1;
+        index = (index - 1) / 2;
+    }
+
+    while (2 * index + 1 < count) {
+        size_t child = 2 * index + 1;
+        if (child + 1 < count && heap[child + 1]->cold->rx_resume_ns < heap[child]->cold->rx_resume_ns) {
+            child++;
+        }
+        if (heap[child]->cold->rx_resume_ns >= resume_ns) {
+            break;
+        }
+        heap[index] = heap[child];
+        heap[index]->cold->rx_held_slot = index + 1;
+        index = child;
+    }
+
+    heap[index] = conn;
+    conn->cold->rx_held_slot = index + 1;
+}
+
+static uint64_t refill(const xnet_rate_rule_t *rule, xnet_rate_bucket_t *bucket, uint64_t now_ns)
+{
+    uint64_t full = (uint64_t)rule->burst * XNET_RATE_TOKEN;
+
+    /* Tokens earned per nanosecond are rate / 1000. Capping first keeps the product from overflowing. */
+    if (0 == bucket->refilled_ns || (full - bucket->tokens) * 1000 / rule->rate <= now_ns - bucket->refilled_ns) {
+        bucket->tokens = full;
+    } else {
+        bucket->tokens += (now_ns - bucket->refilled_ns) * rule->rate / 1000;
+    }
+    bucket->refilled_ns = now_ns;
+
+    if (XNET_RATE_TOKEN <= bucket->tokens) {
+        return 0;
+    }
+
+    return ((XNET_RATE_TOKEN - bucket->tokens) * 1000 + rule->rate - 1) / rule->rate;
+}
+
+static void schedule_wake(xnet_box_t *xnet, uint64_t at_ns)
+{
+    if (0 != xnet->network->rate_wake_ns && xnet->network->rate_wake_ns <= at_ns) {
+        return;
+    }
+
+    struct itimerspec wake = {0};
+    wake.it_value.tv_sec = at_ns / 1000000000;
+    wake.it_value.tv_nsec = at_ns % 1000000000;
+    if (0 != timerfd_settime(xnet->network->rate_fd, TFD_TIMER_ABSTIME, &wake, NULL)) {
+        g_show_err(E_GEN_NON_ZERO, "schedule_wake()");
+        return;
+    }
+
+    xnet->network->rate_wake_ns = at_ns;
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
@@ -1,13 +1,74 @@
 #include "xnet_threads.h"
+#include "xnet_buffer.h"
+#include "xnet_frame.h"
+#include "xnet_ratelimit.h"
 
 static void task_decrement_ref_count(xnet_task_t *task);
 
+static void queue_insert_locked(xnet_box_t *xnet, xnet_task_t *task);
+
+/**
+ * @brief Takes the next task across the priority classes. The queue must not be empty.
+ */
+static xnet_task_t *queue_take_locked(xnet_box_t *xnet);
+
+/**
+ * @brief Picks the task of the next flow in @param class's round that hasn't used up its share of worker time.
+ *        The class must not be empty.
+ */
+static xnet_task_t *flow_take_locked(xnet_box_t *xnet, int class);
+
+/**
+ * @brief Takes @param task out of its flow and its class.
+ */
+static void task_unlink_locked(xnet_box_t *xnet, xnet_task_t *task);
+
+/**
+ * @brief Pops the next task, charging @param cost_ns of worker time to @param charged first. NULL charges nothing.
+ *        @param running, when given, is the calling worker's entry for the watchdog. It is filled in for requests.
+ *        Tasks whose client left while they waited are dropped on the way and counted as stale.
+ */
+static xnet_task_t *work_pop(xnet_box_t *xnet, xnet_running_task_t *running, xnet_task_flow_t *charged, uint64_t cost_ns);
+
+/**
+ * @brief Counts a run of @param cost_ns of a request for @param opcode against its deadline.
+ */
+static void record_run(xnet_box_t *xnet, short opcode, uint64_t cost_ns);
+
+/**
+ * @brief Swaps the newest queued request of the lowest class below @param task's for @param task.
+ *
+ * @return xnet_task_t* The request dropped from the queue. NULL when nothing matters less.
+ */
+static xnet_task_t *shed_locked(xnet_box_t *xnet, xnet_task_t *task);
+
+/**
+ * @brief Drops the request @param conn sent for @param opcode, payload included, and tells the client the server
+ *        is busy. The reactor must own the connection's read side.
+ */
+static void refuse_request(xnet_box_t *xnet, xnet_active_connection_t *conn, short opcode);
+
+static void free_task(xnet_task_t *task);
+
+static uint64_t monotonic_ns(void);
+
+/* Share of the workers each class gets while every class has work queued. */
+static const int class_weight[XNET_PRIORITY_CLASSES] = {8, 4, 1};
+
 void xnet_create_pool(xnet_box_t *xnet)
 {
     pthread_mutex_init(&xnet->thread->main_lock, NULL);
     pthread_cond_init(&xnet->thread->main_condition, NULL);
-    xnet->thread->queue_head = 0;
     xnet->thread->queue_size = 0;
+    memset(xnet->thread->flow_head, 0, sizeof(xnet->thread->flow_head));
+    memset(xnet->thread->flow_tail, 0, sizeof(xnet->thread->flow_tail));
+    memset(xnet->thread->oldest, 0, sizeof(xnet->thread->oldest));
+    memset(xnet->thread->newest, 0, sizeof(xnet->thread->newest));
+    memset(xnet->thread->class_size, 0, sizeof(xnet->thread->class_size));
+    memset(xnet->thread->class_credit, 0, sizeof(xnet->thread->class_credit));
+    memset(xnet->thread->shared_flow, 0, sizeof(xnet->thread->shared_flow));
+    memset(xnet->thread->running, 0, sizeof(xnet->thread->running));
+    xnet->thread->worker_count = 0;
     xnet->thread->shutdown = false;
 
     /* Spawn threads */
@@ -21,6 +82,10 @@ void xnet_create_pool(xnet_box_t *xnet)
 void *xnet_thread_worker(void *arg)
 {
     xnet_box_t *xnet = arg;
+    xnet_task_flow_t *charged = NULL;
+    uint64_t cost_ns = 0;
+    size_t worker = __atomic_fetch_add(&xnet->thread->worker_count, 1, __ATOMIC_RELAXED);
+    xnet_running_task_t *running = &xnet->thread->running[worker];
 
     while (true) {
         /* Allow shutdown when tasks available. */
@@ -28,19 +93,26 @@ void *xnet_thread_worker(void *arg)
             return NULL;
         }
 
-        /* Pop task and call it. */
-        xnet_task_t *task = xnet_work_pop(xnet);
+        /* Pop task and call it. What the last one cost its flow is settled under the same lock. */
+        xnet_task_t *task = work_pop(xnet, running, charged, cost_ns);
         if (NULL == task) {
             return NULL;
         }
-        task->me->is_working = true;
-        task->task_function(task->xnet, task->me);
-        task->me->is_working = false;
 
-        /* Reset client's file descriptor. */
-        int event_status = epoll_ctl_mod(xnet->network->epoll_fd, &task->me->client_event, task->me->socket, EPOLLIN | EPOLLONESHOT);
-        if (-1 == event_status) {
-            close(task->me->socket);
+        uint64_t started_ns = monotonic_ns();
+        if (NULL != task->job_function) {
+            task->job_function(task->xnet, task->arg);
+        } else {
+            task->task_function(task->xnet, task->me);
+        }
+        charged = task->flow;
+        cost_ns = monotonic_ns() - started_ns;
+
+        /* Hand the read side back. Unread payload goes with the frame, the reactor registers the socket again. */
+        if (task->is_request) {
+            record_run(xnet, task->opcode, cost_ns);
+            xnet_release_frame(xnet, task->me);
+            xnet_post_mail(xnet, task->me, XNET_MAIL_DONE);
         }
 
         /* Vulnerable reference decrement. */
@@ -49,72 +121,552 @@ void *xnet_thread_worker(void *arg)
     return NULL;
 }
 
-void xnet_work_push(xnet_box_t *xnet, xnet_task_t *task)
+bool xnet_work_try_push(xnet_box_t *xnet, xnet_task_t *task)
 {
     pthread_mutex_lock(&xnet->thread->main_lock);
 
-    /* If the queue is full, wait. */
-    while (XNET_THREAD_MAX_TASKS == xnet->thread->queue_size) {
-        pthread_cond_wait(&xnet->thread->main_condition, &xnet->thread->main_lock);
+    /* Full queue or a pool on its way out, don't wait around. */
+    if (XNET_THREAD_MAX_TASKS == xnet->thread->queue_size || xnet->thread->shutdown) {
+        pthread_mutex_unlock(&xnet->thread->main_lock);
+        return false;
+    }
 
-        /* Allow shutdown when worker is idle. */
-        if (xnet->thread->shutdown) {
-            pthread_mutex_unlock(&xnet->thread->main_lock);
-            return;
-        }
+    queue_insert_locked(xnet, task);
+    pthread_mutex_unlock(&xnet->thread->main_lock);
+    return true;
+}
+
+int xnet_submit_job(xnet_box_t *xnet, int (*job_function)(xnet_box_t *xnet, void *arg), void *arg)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet || NULL == job_function) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
     }
 
-    /* This is a newly alloc'd task. Update its task count. */
-    task->task_count = 0;
+    /* Allocate new task. */
+    xnet_task_t *new_task = calloc(1, sizeof(xnet_task_t));
+    if (NULL == new_task) {
+        err = E_GEN_FAIL_ALLOC;
+        goto handle_err;
+    }
 
-    /* Find the next available index, and insert task. Update size appropriately. */
-    size_t next_task = (xnet->thread->queue_head + xnet->thread->queue_size) % XNET_THREAD_MAX_TASKS;
-    xnet->thread->task_queue[next_task] = task;
-    xnet->thread->queue_size++;
+    /* Configure new task and submit for work. */
+    new_task->job_function = job_function;
+    new_task->arg = arg;
+    new_task->xnet = xnet;
+    new_task->priority = XNET_PRIORITY_NORMAL;
+    pthread_mutex_init(&new_task->task_lock, NULL);
 
-    /* Signal condition for newly added task. */
-    pthread_cond_signal(&xnet->thread->main_condition);
-    pthread_mutex_unlock(&xnet->thread->main_lock);
+    if (false == xnet_work_try_push(xnet, new_task)) {
+        pthread_mutex_destroy(&new_task->task_lock);
+        nfree((void **)&new_task);
+        return E_GEN_OUT_RANGE;
+    }
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_submit_job()");
+    return err;
 }
 
 xnet_task_t *xnet_work_pop(xnet_box_t *xnet)
+{
+    return work_pop(xnet, NULL, NULL, 0);
+}
+
+void xnet_reset_flows(xnet_box_t *xnet, xnet_active_connection_t *conn)
 {
     pthread_mutex_lock(&xnet->thread->main_lock);
+    for (int class = 0; class < XNET_PRIORITY_CLASSES; class++) {
+        conn->flows[class].deficit_ns = 0;
+    }
+    pthread_mutex_unlock(&xnet->thread->main_lock);
+}
 
-    /* If the queue is empty, wait. This is where workers halt on start. */
-    while (0 == xnet->thread->queue_size) {
-        pthread_cond_wait(&xnet->thread->main_condition, &xnet->thread->main_lock);
-        /* Allow shutdown when worker is idle. */
-        if (xnet->thread->shutdown) {
-            pthread_mutex_unlock(&xnet->thread->main_lock);
-            return NULL;
+static xnet_task_t *work_pop(xnet_box_t *xnet, xnet_running_task_t *running, xnet_task_flow_t *charged, uint64_t cost_ns)
+{
+    pthread_mutex_lock(&xnet->thread->main_lock);
+
+    /* Whatever this worker ran last is done. The watchdog must not act on it anymore. */
+    if (NULL != running) {
+        running->conn = NULL;
+    }
+
+    /* Long tasks leave their flow in debt, up to a point. A connection can't be shut out for ever by one task. */
+    if (NULL != charged) {
+        int64_t floor_ns = -(int64_t)XNET_FAIR_MAX_DEBT * XNET_FAIR_QUANTUM_US * 1000;
+        charged->deficit_ns -= (int64_t)cost_ns;
+        if (charged->deficit_ns < floor_ns) {
+            charged->deficit_ns = floor_ns;
         }
     }
 
-    /* Grab the top-most task. */
-    xnet_task_t *task = xnet->thread->task_queue[xnet->thread->queue_head];
+    xnet_task_t *task = NULL;
+    while (NULL == task) {
+        /* If the queue is empty, wait. This is where workers halt on start. */
+        while (0 == xnet->thread->queue_size) {
+            pthread_cond_wait(&xnet->thread->main_condition, &xnet->thread->main_lock);
+            /* Allow shutdown when worker is idle. */
+            if (xnet->thread->shutdown) {
+                pthread_mutex_unlock(&xnet->thread->main_lock);
+                return NULL;
+            }
+        }
+
+        /* Grab the task whose class is up next. */
+        task = queue_take_locked(xnet);
+
+        /* Its client left while it waited, and the slot may hold another one by now. Nobody is left to serve, and
+           the watchdog entry and cancel flag below belong to whoever has the slot. */
+        if (NULL != task->me && false == xnet_handle_is_live(task->me, task->handle)) {
+            __atomic_fetch_add(&xnet->thread->stale, 1, __ATOMIC_RELAXED);
+            free_task(task);
+            task = NULL;
+        }
+    }
     task->task_count++;
 
-    /* Inform queue of removed task. */
-    size_t next_task = (xnet->thread->queue_head + 1) % XNET_THREAD_MAX_TASKS; 
-    xnet->thread->queue_head = next_task;
-    xnet->thread->queue_size--;
+    /* The watchdog times requests from here. A cancellation meant for the connection's last request is void. */
+    if (NULL != running && task->is_request) {
+        uint32_t deadline_ms = xnet->general->deadline_ms_of[task->opcode];
+        running->conn = task->me;
+        running->opcode = task->opcode;
+        running->started_ns = monotonic_ns();
+        running->deadline_ns = (0 == deadline_ms) ? 0 : running->started_ns + (uint64_t)deadline_ms * 1000000;
+        running->is_cancelled = false;
+        running->is_abandoned = false;
+        __atomic_store_n(&task->me->cancel_requested, false, __ATOMIC_RELAXED);
+    }
 
     /* Signal condition for removed task. */
     pthread_cond_signal(&xnet->thread->main_condition);
 
     pthread_mutex_unlock(&xnet->thread->main_lock);
-    
+
+    /* A slot just freed up. Whoever takes the count wakes the reactor for the requests waiting on one. */
+    if (0 < __atomic_load_n(&xnet->thread->paused_count, __ATOMIC_RELAXED) &&
+        0 < __atomic_exchange_n(&xnet->thread->paused_count, 0, __ATOMIC_RELAXED)) {
+        uint64_t wake = 1;
+        ssize_t bwrite = write(xnet->network->room_fd, &wake, sizeof(wake));
+        (void)bwrite;
+    }
+
     return task;
 }
 
+size_t xnet_work_room(xnet_box_t *xnet)
+{
+    pthread_mutex_lock(&xnet->thread->main_lock);
+    size_t room = XNET_THREAD_MAX_TASKS - xnet->thread->queue_size;
+    pthread_mutex_unlock(&xnet->thread->main_lock);
+
+    return room;
+}
+
+void xnet_submit_request(xnet_box_t *xnet, xnet_active_connection_t *conn, short opcode, enum xnet_frame_status status)
+{
+    /* Allocate new task. */
+    xnet_task_t *new_task = calloc(1, sizeof(xnet_task_t));
+    if (NULL == new_task) {
+        fprintf(stderr, "Server is out of memory. Refusing request [%d].\n", opcode);
+        refuse_request(xnet, conn, opcode);
+        return;
+    }
+
+    /* Configure new task. */
+    new_task->task_function = xnet->general->perform[opcode];
+    new_task->xnet = xnet;
+    new_task->me = conn;
+    new_task->handle = xnet_conn_handle(xnet, conn);
+    new_task->is_request = true;
+    new_task->opcode = opcode;
+    new_task->priority = xnet->general->priority_of[opcode];
+    pthread_mutex_init(&new_task->task_lock, NULL);
+
+    /* The worker owns the read side until its XNET_MAIL_DONE is read, which can't be before this returns. */
+    conn->hot->is_working = true;
+
+    xnet_task_t *shed = NULL;
+    bool is_queued = false;
+    pthread_mutex_lock(&xnet->thread->main_lock);
+    if (false == xnet->thread->shutdown && XNET_THREAD_MAX_TASKS > xnet->thread->queue_size) {
+        queue_insert_locked(xnet, new_task);
+        is_queued = true;
+    } else if (false == xnet->thread->shutdown && XNET_OVERLOAD_SHED == xnet->general->overload_policy) {
+        shed = shed_locked(xnet, new_task);
+        is_queued = NULL != shed;
+    }
+    pthread_mutex_unlock(&xnet->thread->main_lock);
+
+    /* The dropped request never reached a worker, so its read side goes back to the reactor. */
+    if (NULL != shed) {
+        __atomic_fetch_add(&xnet->thread->overload.shed, 1, __ATOMIC_RELAXED);
+        xnet_active_connection_t *victim = shed->me;
+        victim->hot->is_working = false;
+        refuse_request(xnet, victim, shed->opcode);
+        free_task(shed);
+
+        pthread_mutex_lock(&victim->io_lock);
+        if (victim->hot->is_active) {
+            xnet_arm_connection(xnet, victim);
+        }
+        pthread_mutex_unlock(&victim->io_lock);
+    }
+
+    if (is_queued) {
+        return;
+    }
+
+    conn->hot->is_working = false;
+    free_task(new_task);
+
+    /* Held like a rate limited request, but due as soon as a worker frees a slot. */
+    if (XNET_OVERLOAD_PAUSE == xnet->general->overload_policy) {
+        __atomic_fetch_add(&xnet->thread->overload.paused, 1, __ATOMIC_RELAXED);
+        xnet_pause_request(xnet, conn, opcode, status);
+        __atomic_fetch_add(&xnet->thread->paused_count, 1, __ATOMIC_RELAXED);
+
+        /* A slot may have freed up before the count went up, with no worker left to notice. */
+        if (0 < xnet_work_room(xnet)) {
+            uint64_t wake = 1;
+            ssize_t bwrite = write(xnet->network->room_fd, &wake, sizeof(wake));
+            (void)bwrite;
+        }
+        return;
+    }
+
+    __atomic_fetch_add(&xnet->thread->overload.rejected, 1, __ATOMIC_RELAXED);
+    refuse_request(xnet, conn, opcode);
+}
+
+int xnet_set_overload_policy(xnet_box_t *xnet, enum xnet_overload_policy policy)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (XNET_OVERLOAD_PAUSE != policy && XNET_OVERLOAD_REJECT != policy && XNET_OVERLOAD_SHED != policy) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    xnet->general->overload_policy = policy;
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_set_overload_policy()");
+    return err;
+}
+
+int xnet_set_priority(xnet_box_t *xnet, size_t opcode, enum xnet_priority priority)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (XNET_MAX_FEATURES <= opcode || XNET_PRIORITY_CLASSES <= (unsigned int)priority) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    xnet->general->priority_of[opcode] = priority;
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_set_priority()");
+    return err;
+}
+
+int xnet_set_deadline(xnet_box_t *xnet, size_t opcode, uint32_t deadline_ms)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (XNET_MAX_FEATURES <= opcode) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    /* Workers read deadlines without a lock. */
+    if (xnet->general->is_running) {
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    xnet->general->deadline_ms_of[opcode] = deadline_ms;
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_set_deadline()");
+    return err;
+}
+
+int xnet_get_deadline_stats(xnet_box_t *xnet, size_t opcode, xnet_deadline_stats_t *stats)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet || NULL == stats) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (XNET_MAX_FEATURES <= opcode) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    xnet_deadline_stats_t *counters = &xnet->general->deadline_stats[opcode];
+    stats->runs = __atomic_load_n(&counters->runs, __ATOMIC_RELAXED);
+    stats->run_total_ns = __atomic_load_n(&counters->run_total_ns, __ATOMIC_RELAXED);
+    stats->run_max_ns = __atomic_load_n(&counters->run_max_ns, __ATOMIC_RELAXED);
+    stats->cancelled = __atomic_load_n(&counters->cancelled, __ATOMIC_RELAXED);
+    stats->abandoned = __atomic_load_n(&counters->abandoned, __ATOMIC_RELAXED);
+    for (int band = 0; band < XNET_BUDGET_BANDS; band++) {
+        stats->budget_used[band] = __atomic_load_n(&counters->budget_used[band], __ATOMIC_RELAXED);
+    }
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_get_deadline_stats()");
+    return err;
+}
+
+bool xnet_is_cancelled(const xnet_active_connection_t *conn)
+{
+    return __atomic_load_n(&conn->cancel_requested, __ATOMIC_RELAXED);
+}
+
+void xnet_cancel_request(xnet_active_connection_t *conn)
+{
+    __atomic_store_n(&conn->cancel_requested, true, __ATOMIC_RELAXED);
+}
+
+int xnet_init_watchdog(xnet_box_t *xnet)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    xnet->network->watchdog_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (-1 == xnet->network->watchdog_fd) {
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    struct itimerspec period = {0};
+    period.it_value.tv_sec = XNET_WATCHDOG_MS / 1000;
+    period.it_value.tv_nsec = (XNET_WATCHDOG_MS % 1000) * 1000000;
+    period.it_interval = period.it_value;
+    if (0 != timerfd_settime(xnet->network->watchdog_fd, 0, &period, NULL) ||
+        -1 == epoll_ctl_add(xnet->network->epoll_fd, &xnet->network->watchdog_event, xnet->network->watchdog_fd, EPOLLIN)) {
+        close(xnet->network->watchdog_fd);
+        xnet->network->watchdog_fd = -1;
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_init_watchdog()");
+    return err;
+}
+
+void xnet_destroy_watchdog(xnet_box_t *xnet)
+{
+    if (NULL == xnet || -1 == xnet->network->watchdog_fd) {
+        return;
+    }
+
+    close(xnet->network->watchdog_fd);
+    xnet->network->watchdog_fd = -1;
+}
+
+void xnet_watchdog_sweep(xnet_box_t *xnet)
+{
+    /* Reset the timerfd counter. Every running request is looked at whatever the count. */
+    uint64_t expirations = 0;
+    ssize_t bread = read(xnet->network->watchdog_fd, &expirations, sizeof(expirations));
+    (void)bread;
+
+    uint64_t now_ns = monotonic_ns();
+
+    /* Workers replace their entry under the same lock, so a connection found here is still being served. */
+    pthread_mutex_lock(&xnet->thread->main_lock);
+    for (size_t n = 0; n < XNET_THREAD_COUNT; n++) {
+        xnet_running_task_t *running = &xnet->thread->running[n];
+        if (NULL == running->conn || 0 == running->deadline_ns || now_ns <= running->deadline_ns) {
+            continue;
+        }
+
+        xnet_deadline_stats_t *stats = &xnet->general->deadline_stats[running->opcode];
+        if (false == running->is_cancelled) {
+            running->is_cancelled = true;
+            xnet_cancel_request(running->conn);
+            __atomic_fetch_add(&stats->cancelled, 1, __ATOMIC_RELAXED);
+            fprintf(stderr, "Socket [%d] overran the deadline of opcode [%d]. Cancelling.\n",
+                    running->conn->socket, running->opcode);
+            continue;
+        }
+
+        /* Still at it a sweep later and after as long again. The worker can't be taken back, but its client can stop
+           waiting. The reactor closes the connection on the hangup once the handler returns. */
+        if (false == running->is_abandoned && now_ns - running->deadline_ns > running->deadline_ns - running->started_ns) {
+            running->is_abandoned = true;
+            shutdown(running->conn->socket, SHUT_RDWR);
+            __atomic_fetch_add(&stats->abandoned, 1, __ATOMIC_RELAXED);
+            fprintf(stderr, "Socket [%d] is still stuck on opcode [%d]. Hanging up.\n",
+                    running->conn->socket, running->opcode);
+        }
+    }
+    pthread_mutex_unlock(&xnet->thread->main_lock);
+}
+
+uint64_t xnet_get_stale_tasks(xnet_box_t *xnet)
+{
+    return __atomic_load_n(&xnet->thread->stale, __ATOMIC_RELAXED);
+}
+
+void xnet_get_overload_stats(xnet_box_t *xnet, xnet_overload_stats_t *stats)
+{
+    xnet_overload_stats_t *counters = &xnet->thread->overload;
+    stats->rejected = __atomic_load_n(&counters->rejected, __ATOMIC_RELAXED);
+    stats->paused = __atomic_load_n(&counters->paused, __ATOMIC_RELAXED);
+    stats->shed = __atomic_load_n(&counters->shed, __ATOMIC_RELAXED);
+    stats->refused = __atomic_load_n(&counters->refused, __ATOMIC_RELAXED);
+}
+
+int xnet_get_sched_stats(xnet_box_t *xnet, enum xnet_priority priority, xnet_sched_stats_t *stats)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet || NULL == stats) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (XNET_PRIORITY_CLASSES <= (unsigned int)priority) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    xnet_sched_stats_t *counters = &xnet->thread->sched[priority];
+    stats->dispatched = __atomic_load_n(&counters->dispatched, __ATOMIC_RELAXED);
+    stats->aged = __atomic_load_n(&counters->aged, __ATOMIC_RELAXED);
+    stats->wait_total_ns = __atomic_load_n(&counters->wait_total_ns, __ATOMIC_RELAXED);
+    stats->wait_max_ns = __atomic_load_n(&counters->wait_max_ns, __ATOMIC_RELAXED);
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_get_sched_stats()");
+    return err;
+}
+
+int xnet_init_overload(xnet_box_t *xnet)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == xnet) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    xnet->network->room_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (-1 == xnet->network->room_fd) {
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    if (-1 == epoll_ctl_add(xnet->network->epoll_fd, &xnet->network->room_event, xnet->network->room_fd, EPOLLIN)) {
+        close(xnet->network->room_fd);
+        xnet->network->room_fd = -1;
+        err = E_GEN_NON_ZERO;
+        goto handle_err;
+    }
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_init_overload()");
+    return err;
+}
+
+void xnet_destroy_overload(xnet_box_t *xnet)
+{
+    if (NULL == xnet || -1 == xnet->network->room_fd) {
+        return;
+    }
+
+    close(xnet->network->room_fd);
+    xnet->network->room_fd = -1;
+}
+
+void xnet_overload_resume(xnet_box_t *xnet)
+{
+    /* Reset the eventfd counter. The paused line says who goes next. */
+    uint64_t wakeups = 0;
+    ssize_t bread = read(xnet->network->room_fd, &wakeups, sizeof(wakeups));
+    (void)bread;
+
+    /* As many as there are free slots. The rest keep their place. */
+    while (xnet_resume_paused(xnet, xnet_work_room(xnet))) {
+        /* Have the next worker to free a slot wake the reactor. One may have freed up before it knew to. */
+        __atomic_fetch_add(&xnet->thread->paused_count, 1, __ATOMIC_SEQ_CST);
+        if (0 == xnet_work_room(xnet)) {
+            break;
+        }
+    }
+}
+
 void xnet_destroy_pool(xnet_box_t *xnet)
 {
     if (NULL == xnet) {
         return;
     }
 
+    /* Handlers that check for it wrap up instead of holding the join up. */
+    pthread_mutex_lock(&xnet->thread->main_lock);
     xnet->thread->shutdown = true;
+    for (size_t n = 0; n < XNET_THREAD_COUNT; n++) {
+        if (NULL != xnet->thread->running[n].conn) {
+            xnet_cancel_request(xnet->thread->running[n].conn);
+        }
+    }
+    pthread_mutex_unlock(&xnet->thread->main_lock);
     pthread_cond_broadcast(&xnet->thread->main_condition);
 
     /* Join threads */
@@ -139,4 +691,268 @@ static void task_decrement_ref_count(xnet_task_t *task)
         return;
     }
     pthread_mutex_unlock(&task->task_lock);
-}
\ No newline at end of file
+}
+
+static xnet_task_t *shed_locked(xnet_box_t *xnet, xnet_task_t *task)
+{
+    /* Newest first, so the requests that waited longest keep their place. */
+    for (int class = XNET_PRIORITY_CLASSES - 1; class > task->priority; class--) {
+        for (xnet_task_t *queued = xnet->thread->newest[class]; NULL != queued; queued = queued->older) {
+            if (false == queued->is_request) {
+                continue;
+            }
+
+            /* Then queue the new task in its own class. */
+            task_unlink_locked(xnet, queued);
+            queue_insert_locked(xnet, task);
+
+            return queued;
+        }
+    }
+
+    return NULL;
+}
+
+static void refuse_request(xnet_box_t *xnet, xnet_active_connection_t *conn, short opcode)
+{
+    /* Framed payloads were read already. Legacy ones can only be flushed. */
+    if (conn->rx_framed) {
+        xnet_release_frame(xnet, conn);
+    } else {
+        flush_buffer(conn->socket);
+    }
+
+    uint16_t busy_op = htons(XNET_BUSY_OP);
+    uint16_t refused_op = htons(opcode);
+    char out[XNET_BUSY_SZ];
+    memcpy(out, &busy_op, sizeof(busy_op));
+    memcpy(out + 2, &refused_op, sizeof(refused_op));
+    xnet_send(xnet, conn, out, sizeof(out));
+}
+
+static void record_run(xnet_box_t *xnet, short opcode, uint64_t cost_ns)
+{
+    xnet_deadline_stats_t *stats = &xnet->general->deadline_stats[opcode];
+    __atomic_fetch_add(&stats->runs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->run_total_ns, cost_ns, __ATOMIC_RELAXED);
+    if (cost_ns > __atomic_load_n(&stats->run_max_ns, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&stats->run_max_ns, cost_ns, __ATOMIC_RELAXED);
+    }
+
+    uint32_t deadline_ms = xnet->general->deadline_ms_of[opcode];
+    if (0 == deadline_ms) {
+        return;
+    }
+
+    /* Quarters of the deadline used. The first two make up the lowest band, anything past the deadline the last. */
+    uint64_t quarters = cost_ns * 4 / ((uint64_t)deadline_ms * 1000000);
+    int band = (2 > quarters) ? 0 : (int)quarters - 1;
+    band = (XNET_BUDGET_BANDS - 1 < band) ? XNET_BUDGET_BANDS - 1 : band;
+    __atomic_fetch_add(&stats->budget_used[band], 1, __ATOMIC_RELAXED);
+}
+
+static void free_task(xnet_task_t *task)
+{
+    pthread_mutex_destroy(&task->task_lock);
+    nfree((void **)&task);
+}
+
+static void queue_insert_locked(xnet_box_t *xnet, xnet_task_t *task)
+{
+    /* This is a newly alloc'd task. Update its task count. */
+    task->task_count = 0;
+
+    task->queued_ns = monotonic_ns();
+
+    /* Queue the task behind the rest of its connection's, and its connection in the class's round. */
+    int class = task->priority;
+    xnet_task_flow_t *flow = (NULL != task->me) ? &task->me->flows[class] : &xnet->thread->shared_flow[class];
+    task->flow = flow;
+    task->flow_next = NULL;
+    if (NULL == flow->tail) {
+        flow->head = task;
+    } else {
+        flow->tail->flow_next = task;
+    }
+    flow->tail = task;
+
+    if (false == flow->is_listed) {
+        flow->is_listed = true;
+        flow->next = NULL;
+        if (NULL == xnet->thread->flow_tail[class]) {
+            xnet->thread->flow_head[class] = flow;
+        } else {
+            xnet->thread->flow_tail[class]->next = flow;
+        }
+        xnet->thread->flow_tail[class] = flow;
+    }
+
+    /* And behind every task of its class, for aging. */
+    task->newer = NULL;
+    task->older = xnet->thread->newest[class];
+    if (NULL == task->older) {
+        xnet->thread->oldest[class] = task;
+    } else {
+        task->older->newer = task;
+    }
+    xnet->thread->newest[class] = task;
+
+    xnet->thread->class_size[class]++;
+    xnet->thread->queue_size++;
+
+    /* Signal condition for newly added task. */
+    pthread_cond_signal(&xnet->thread->main_condition);
+}
+
+static xnet_task_t *queue_take_locked(xnet_box_t *xnet)
+{
+    uint64_t now_ns = monotonic_ns();
+    int pick = -1;
+    bool is_aged = false;
+
+    /* Starvation guard. A task that waited too long goes first, the longest waiting one if there are several. */
+    for (int class = 0; class < XNET_PRIORITY_CLASSES; class++) {
+        xnet_task_t *oldest = xnet->thread->oldest[class];
+        if (NULL == oldest) {
+            continue;
+        }
+
+        if (oldest->queued_ns + (uint64_t)XNET_PRIORITY_AGING_MS * 1000000 <= now_ns &&
+            (-1 == pick || oldest->queued_ns < xnet->thread->oldest[pick]->queued_ns)) {
+            pick = class;
+            is_aged = true;
+        }
+    }
+
+    /* Smooth weighted round robin over the classes with work. Spreads a lower class's turns out instead of
+       bunching them, so no class waits on a whole round of another. */
+    if (-1 == pick) {
+        int total_weight = 0;
+        for (int class = 0; class < XNET_PRIORITY_CLASSES; class++) {
+            if (0 == xnet->thread->class_size[class]) {
+                continue;
+            }
+
+            xnet->thread->class_credit[class] += class_weight[class];
+            total_weight += class_weight[class];
+            if (-1 == pick || xnet->thread->class_credit[class] > xnet->thread->class_credit[pick]) {
+                pick = class;
+            }
+        }
+        xnet->thread->class_credit[pick] -= total_weight;
+    }
+
+    /* An aged task is the oldest of its flow too, so it can go without waiting for the flow's turn. */
+    xnet_task_t *task = is_aged ? xnet->thread->oldest[pick] : flow_take_locked(xnet, pick);
+    task_unlink_locked(xnet, task);
+
+    /* An emptied class starts over next time it has work. */
+    if (0 == xnet->thread->class_size[pick]) {
+        xnet->thread->class_credit[pick] = 0;
+    }
+
+    xnet_sched_stats_t *stats = &xnet->thread->sched[pick];
+    uint64_t wait_ns = now_ns - task->queued_ns;
+    __atomic_fetch_add(&stats->dispatched, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats->wait_total_ns, wait_ns, __ATOMIC_RELAXED);
+    if (wait_ns > __atomic_load_n(&stats->wait_max_ns, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&stats->wait_max_ns, wait_ns, __ATOMIC_RELAXED);
+    }
+    if (is_aged && XNET_PRIORITY_HIGH != pick) {
+        __atomic_fetch_add(&stats->aged, 1, __ATOMIC_RELAXED);
+    }
+
+    return task;
+}
+
+static xnet_task_t *flow_take_locked(xnet_box_t *xnet, int class)
+{
+    int64_t quantum_ns = (int64_t)XNET_FAIR_QUANTUM_US * 1000;
+
+    while (true) {
+        xnet_task_flow_t *flow = xnet->thread->flow_head[class];
+
+        /* Step past the flow. It rejoins the round at the back if it has work left. */
+        xnet->thread->flow_head[class] = flow->next;
+        if (NULL == flow->next) {
+            xnet->thread->flow_tail[class] = NULL;
+        }
+        flow->is_listed = false;
+
+        /* Emptied by aging or shedding since it joined. */
+        if (NULL == flow->head) {
+            if (0 < flow->deficit_ns) {
+                flow->deficit_ns = 0;
+            }
+            continue;
+        }
+
+        /* Every turn earns a quantum. At most one is banked, so a quiet spell doesn't buy a burst. A flow still
+           paying off a long task waits out the turn. */
+        flow->deficit_ns += quantum_ns;
+        if (flow->deficit_ns > quantum_ns) {
+            flow->deficit_ns = quantum_ns;
+        }
+        xnet_task_t *task = (0 < flow->deficit_ns) ? flow->head : NULL;
+
+        /* One task per turn, so a flow's queued tasks interleave with everyone else's. Credit isn't kept while
+           there is nothing to spend it on. */
+        if (NULL != task && NULL == task->flow_next) {
+            flow->deficit_ns = 0;
+        } else {
+            flow->is_listed = true;
+            flow->next = NULL;
+            if (NULL == xnet->thread->flow_tail[class]) {
+                xnet->thread->flow_head[class] = flow;
+            } else {
+                xnet->thread->flow_tail[class]->next = flow;
+            }
+            xnet->thread->flow_tail[class] = flow;
+        }
+
+        if (NULL != task) {
+            return task;
+        }
+    }
+}
+
+static void task_unlink_locked(xnet_box_t *xnet, xnet_task_t *task)
+{
+    /* Out of its flow. Usually the head, only shedding takes from further back. */
+    xnet_task_flow_t *flow = task->flow;
+    xnet_task_t *prev = NULL;
+    for (xnet_task_t *at = flow->head; at != task; at = at->flow_next) {
+        prev = at;
+    }
+    if (NULL == prev) {
+        flow->head = task->flow_next;
+    } else {
+        prev->flow_next = task->flow_next;
+    }
+    if (flow->tail == task) {
+        flow->tail = prev;
+    }
+
+    /* Out of its class's arrival order. */
+    int class = task->priority;
+    if (NULL == task->older) {
+        xnet->thread->oldest[class] = task->newer;
+    } else {
+        task->older->newer = task->newer;
+    }
+    if (NULL == task->newer) {
+        xnet->thread->newest[class] = task->older;
+    } else {
+        task->newer->older = task->older;
+    }
+
+    xnet->thread->class_size[class]--;
+    xnet->thread->queue_size--;
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
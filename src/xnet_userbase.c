@@ -4,6 +4,16 @@ static void free_all_entries(xnet_user_t *user_entry);
 
 static int xnet_hash_user(xnet_user_t *user);
 
+enum token_slot_state { TOKEN_EMPTY = 0, TOKEN_LIVE, TOKEN_TOMBSTONE };
+
+static time_t token_clock(void);
+static xnet_session_token_t *token_lookup(xnet_token_table_t *table, const unsigned char *token);
+static xnet_session_token_t *token_free_slot(xnet_token_table_t *table, const unsigned char *token);
+static int token_rebuild(xnet_token_table_t *table, size_t capacity);
+static void token_revoke_locked(xnet_token_table_t *table, xnet_user_t *user);
+static bool token_is_expired(xnet_session_token_t *entry, time_t now);
+static void token_expire_locked(xnet_token_table_t *table, xnet_session_token_t *entry);
+
 int xnet_create_user(xnet_userbase_group_t *base, char *user, char *pass, int new_perm)
 {
     int err = 0;
@@ -57,8 +67,9 @@ int xnet_create_user(xnet_userbase_group_t *base, char *user, char *pass, int ne
     }
 
     /* Configure node. */
-    current->username = strndup(user, XNET_MAX_USERNAME_LEN);
-    current->password = strndup(pass, XNET_MAX_PASSWD_LEN);
+    /* Lengths were checked above. calloc() left room for the terminators. */
+    memcpy(current->username, user, user_len);
+    memcpy(current->password, pass, pass_len);
     current->perm_level = new_perm;
     current->prev = prev;
     current->next = NULL; 
@@ -107,6 +118,9 @@ int xnet_delete_user(xnet_userbase_group_t *base, char *user)
         goto handle_err;
     }
 
+    /* Tokens hold a pointer to their user, drop it before the user goes away. */
+    xnet_revoke_token(base, current);
+
     /* If the head node is the one being argued, assign the head to the next node. 
        If not head node, tell the parent node to link to the next node. 
     */
@@ -117,9 +131,6 @@ int xnet_delete_user(xnet_userbase_group_t *base, char *user)
     }
 
     /* Release the selected node's memory. */
-    nfree((void **)&current->username);
-    nfree((void **)&current->password);
-    nfree((void **)&current->hashed_pass);
     nfree((void **)&current);
 
     /* Keep track of how many nodes there are. */
@@ -154,7 +165,7 @@ int xnet_login_user(xnet_userbase_group_t *base, char *user, char *pass, xnet_ac
     }
 
     /* Ensure connection object is active. */
-    if (false == conn->is_active) {
+    if (false == conn->hot->is_active) {
         err = E_GEN_OUT_RANGE;
         goto handle_err;
     }
@@ -186,11 +197,18 @@ int xnet_login_user(xnet_userbase_group_t *base, char *user, char *pass, xnet_ac
         goto handle_err;
     }
 
-    /* After passing all checks, accept login. */
+    /* After passing all checks, accept login. Lookups recheck the account under io_lock, see chat_perform_whisper(). */
+    pthread_mutex_lock(&conn->io_lock);
     conn->account = current;
+    pthread_mutex_unlock(&conn->io_lock);
     conn->account->is_logged_in = true;
     printf("%s has logged in. Assigned to socket [%d]\n", conn->account->username, conn->socket);
 
+    /* A missing token only costs the client a full login on reconnect, so it isn't fatal. */
+    if (0 != xnet_issue_token(base, current)) {
+        fprintf(stderr, "Failed to issue a session token for %s.\n", current->username);
+    }
+
 	return err;
 
 /* Unreachable unless error is triggered. */
@@ -199,12 +217,12 @@ handle_err:
     return err;
 }
 
-int xnet_logout_user(xnet_active_connection_t *conn)
+int xnet_logout_user(xnet_userbase_group_t *base, xnet_active_connection_t *conn)
 {
     int err = 0;
 
     /* NULL Check */
-    if (NULL == conn) {
+    if (NULL == base || NULL == conn) {
         err = E_GEN_NULL_PTR;
         goto handle_err;
     }
@@ -215,15 +233,20 @@ int xnet_logout_user(xnet_active_connection_t *conn)
     }
 
     /* Make sure connection object is active. */
-    if (false == conn->is_active) {
+    if (false == conn->hot->is_active) {
         err = E_GEN_NULL_PTR;
         goto handle_err;
     }
 
+    /* Logging out on purpose ends the session, so its token can't bring it back. */
+    xnet_revoke_token(base, conn->account);
+
     /* Perform logout */
     conn->account->is_logged_in = false;
     printf("%s has logged out.\n", conn->account->username);
+    pthread_mutex_lock(&conn->io_lock);
     conn->account = NULL;
+    pthread_mutex_unlock(&conn->io_lock);
 
     return err;
 
@@ -233,6 +256,38 @@ handle_err:
     return err;
 }
 
+int xnet_suspend_user(xnet_userbase_group_t *base, xnet_active_connection_t *conn)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == base || NULL == conn) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == conn->account) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    /* Give the client a window in which it can reconnect with its token instead of logging in again. */
+    xnet_park_token(base, conn->account);
+
+    conn->account->is_logged_in = false;
+    printf("%s has logged out.\n", conn->account->username);
+    pthread_mutex_lock(&conn->io_lock);
+    conn->account = NULL;
+    pthread_mutex_unlock(&conn->io_lock);
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_suspend_user()");
+    return err;
+}
+
 xnet_user_t *xnet_user_exists(xnet_userbase_group_t *base, char *user)
 {
     int err = 0;
@@ -386,6 +441,12 @@ void xnet_destroy_userbase(xnet_userbase_group_t *base)
 
     /* Release memory for every node before releasing main base. */
     free_all_entries(base->head);
+
+    /* The token table only exists once the server has been started. */
+    if (NULL != base->tokens.entries) {
+        nfree((void **)&base->tokens.entries);
+        pthread_mutex_destroy(&base->tokens.lock);
+    }
     nfree((void **)&base);
 
 	return;
@@ -400,9 +461,6 @@ static void free_all_entries(xnet_user_t *user_entry)
 {
     if (NULL != user_entry) {
         free_all_entries(user_entry->next);
-        nfree((void **)&user_entry->username);
-        nfree((void **)&user_entry->password);
-        nfree((void **)&user_entry->hashed_pass);
         nfree((void **)&user_entry);
     }
 }
@@ -417,27 +475,451 @@ static int xnet_hash_user(xnet_user_t *user)
         goto handle_err;
     }
 
-    if (NULL == user->password) {
+    size_t pass_length = strnlen(user->password, XNET_MAX_PASSWD_LEN);
+
+    /* Encryption method. Simple, but proof of concept.*/
+    for (size_t i = 0; i < pass_length; i++) {
+        user->hashed_pass[i] = user->password[i] + 1;
+    }
+
+	return err;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_hash_user()");
+    return err;
+}
+
+int xnet_init_tokens(xnet_userbase_group_t *base, size_t capacity, size_t ttl)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == base) {
         err = E_GEN_NULL_PTR;
         goto handle_err;
     }
 
-    size_t pass_length = strnlen(user->password, XNET_MAX_PASSWD_LEN);
-    user->hashed_pass = strndup(user->password, pass_length);
-    if (NULL == user->hashed_pass) {
+    /* Probing relies on masking, so capacity must be a power of two. */
+    size_t real_capacity = XNET_TOKEN_TABLE_MIN;
+    while (real_capacity < capacity) {
+        real_capacity <<= 1;
+    }
+
+    base->tokens.entries = calloc(real_capacity, sizeof(xnet_session_token_t));
+    if (NULL == base->tokens.entries) {
+        err = E_GEN_FAIL_ALLOC;
+        goto handle_err;
+    }
+
+    base->tokens.capacity = real_capacity;
+    base->tokens.count = 0;
+    base->tokens.used = 0;
+    base->tokens.ttl = ttl;
+    pthread_mutex_init(&base->tokens.lock, NULL);
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_init_tokens()");
+    return err;
+}
+
+int xnet_issue_token(xnet_userbase_group_t *base, xnet_user_t *user)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == base) {
         err = E_GEN_NULL_PTR;
         goto handle_err;
     }
 
-    /* Encryption method. Simple, but proof of concept.*/
-    for (size_t i = 0; i < pass_length; i++) {
-        user->hashed_pass[i] = user->password[i] + 1;
+    if (NULL == user) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
     }
 
-	return err;
+    xnet_token_table_t *table = &base->tokens;
+    if (NULL == table->entries) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    pthread_mutex_lock(&table->lock);
+
+    /* A user only ever owns one token. */
+    token_revoke_locked(table, user);
+
+    /* Keep load under 3/4. Dropping tombstones and expired tokens usually suffices, otherwise grow. */
+    if ((table->used + 1) * 4 > table->capacity * 3) {
+        size_t new_capacity = table->capacity;
+        if ((table->count + 1) * 4 > table->capacity * 3 / 2) {
+            new_capacity <<= 1;
+        }
+
+        err = token_rebuild(table, new_capacity);
+        if (0 != err) {
+            pthread_mutex_unlock(&table->lock);
+            goto handle_err;
+        }
+    }
+
+    /* 128 random bits make a collision practically impossible, but never hand out a duplicate. */
+    unsigned char new_token[XNET_TOKEN_LEN];
+    do {
+        err = xnet_random_bytes(new_token, sizeof(new_token));
+        if (0 != err) {
+            pthread_mutex_unlock(&table->lock);
+            goto handle_err;
+        }
+    } while (NULL != token_lookup(table, new_token));
+
+    xnet_session_token_t *slot = token_free_slot(table, new_token);
+    if (TOKEN_EMPTY == slot->state) {
+        table->used++;
+    }
+
+    memcpy(slot->token, new_token, XNET_TOKEN_LEN);
+    slot->state = TOKEN_LIVE;
+    slot->expires = 0;
+    slot->account = user;
+    slot->resume_data_len = 0;
+    table->count++;
+
+    memcpy(user->token, new_token, XNET_TOKEN_LEN);
+    user->has_token = true;
+
+    pthread_mutex_unlock(&table->lock);
+
+    return 0;
 
 /* Unreachable unless error is triggered. */
 handle_err:
-    g_show_err(err, "xnet_hash_user()");
+    g_show_err(err, "xnet_issue_token()");
+    return err;
+}
+
+void xnet_revoke_token(xnet_userbase_group_t *base, xnet_user_t *user)
+{
+    /* NULL Check */
+    if (NULL == base || NULL == user || NULL == base->tokens.entries) {
+        return;
+    }
+
+    pthread_mutex_lock(&base->tokens.lock);
+    token_revoke_locked(&base->tokens, user);
+    pthread_mutex_unlock(&base->tokens.lock);
+}
+
+int xnet_park_token(xnet_userbase_group_t *base, xnet_user_t *user)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == base) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == user) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    /* The token table only exists once the server has been started. */
+    if (NULL == base->tokens.entries) {
+        return 0;
+    }
+
+    /* has_token and token change under the table's lock, like the entries. */
+    pthread_mutex_lock(&base->tokens.lock);
+    xnet_session_token_t *entry = NULL;
+    if (user->has_token) {
+        entry = token_lookup(&base->tokens, user->token);
+    }
+    if (NULL != entry) {
+        /* A countdown that already ran out isn't started over. */
+        time_t now = token_clock();
+        if (token_is_expired(entry, now)) {
+            token_expire_locked(&base->tokens, entry);
+        } else {
+            entry->expires = now + base->tokens.ttl;
+        }
+    }
+    pthread_mutex_unlock(&base->tokens.lock);
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_park_token()");
+    return err;
+}
+
+int xnet_set_token_resume_data(xnet_userbase_group_t *base, xnet_user_t *user, const char *data, size_t length)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == base) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == user) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == data && 0 != length) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (XNET_TOKEN_RESUME_DATA_LEN < length) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    if (NULL == base->tokens.entries) {
+        err = E_SRV_TOKEN_INVALID;
+        goto handle_err;
+    }
+
+    pthread_mutex_lock(&base->tokens.lock);
+    xnet_session_token_t *entry = NULL;
+    if (user->has_token) {
+        entry = token_lookup(&base->tokens, user->token);
+    }
+    if (NULL != entry && token_is_expired(entry, token_clock())) {
+        token_expire_locked(&base->tokens, entry);
+        entry = NULL;
+    }
+    if (NULL != entry) {
+        memcpy(entry->resume_data, data, length);
+        entry->resume_data_len = length;
+    }
+    pthread_mutex_unlock(&base->tokens.lock);
+
+    if (NULL == entry) {
+        err = E_SRV_TOKEN_INVALID;
+        goto handle_err;
+    }
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_set_token_resume_data()");
+    return err;
+}
+
+int xnet_resume_user(xnet_userbase_group_t *base, const unsigned char *token, xnet_active_connection_t *conn,
+                     char *resume_data, size_t *resume_length)
+{
+    int err = 0;
+
+    /* NULL Check */
+    if (NULL == base) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == token) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    if (NULL == conn) {
+        err = E_GEN_NULL_PTR;
+        goto handle_err;
+    }
+
+    /* Same rules as a regular login, the connection must be active and not yet bound to an account. */
+    if (false == conn->hot->is_active || NULL != conn->account) {
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    if (NULL == base->tokens.entries) {
+        err = E_SRV_TOKEN_INVALID;
+        goto handle_err;
+    }
+
+    pthread_mutex_lock(&base->tokens.lock);
+
+    xnet_session_token_t *entry = token_lookup(&base->tokens, token);
+    if (NULL == entry) {
+        pthread_mutex_unlock(&base->tokens.lock);
+        err = E_SRV_TOKEN_INVALID;
+        goto handle_err;
+    }
+
+    /* An unparked token means its connection hasn't been torn down yet. */
+    if (0 == entry->expires || true == entry->account->is_logged_in) {
+        pthread_mutex_unlock(&base->tokens.lock);
+        err = E_GEN_OUT_RANGE;
+        goto handle_err;
+    }
+
+    if (token_is_expired(entry, token_clock())) {
+        token_expire_locked(&base->tokens, entry);
+        pthread_mutex_unlock(&base->tokens.lock);
+        err = E_SRV_TOKEN_EXPIRED;
+        goto handle_err;
+    }
+
+    /* Tokens are single use. Consume it before releasing the lock so a replay can't race us. */
+    xnet_user_t *user = entry->account;
+    if (NULL != resume_data) {
+        memcpy(resume_data, entry->resume_data, entry->resume_data_len);
+    }
+    if (NULL != resume_length) {
+        *resume_length = entry->resume_data_len;
+    }
+    token_revoke_locked(&base->tokens, user);
+
+    pthread_mutex_unlock(&base->tokens.lock);
+
+    /* Token accepted, perform the login. */
+    pthread_mutex_lock(&conn->io_lock);
+    conn->account = user;
+    pthread_mutex_unlock(&conn->io_lock);
+    conn->account->is_logged_in = true;
+    printf("%s has resumed their session. Assigned to socket [%d]\n", conn->account->username, conn->socket);
+
+    /* Hand out the replacement token. */
+    if (0 != xnet_issue_token(base, user)) {
+        fprintf(stderr, "Failed to issue a session token for %s.\n", user->username);
+    }
+
+    return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_resume_user()");
     return err;
-}
\ No newline at end of file
+}
+
+static time_t token_clock(void)
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+static xnet_session_token_t *token_lookup(xnet_token_table_t *table, const unsigned char *token)
+{
+    /* Tokens are uniformly random, so their leading bytes are already a perfect hash. */
+    size_t hash = 0;
+    memcpy(&hash, token, sizeof(hash));
+
+    time_t now = token_clock();
+    size_t mask = table->capacity - 1;
+    for (size_t n = 0; n < table->capacity; n++) {
+        xnet_session_token_t *slot = &table->entries[(hash + n) & mask];
+
+        /* An empty slot terminates the probe sequence. */
+        if (TOKEN_EMPTY == slot->state) {
+            return NULL;
+        }
+
+        if (TOKEN_LIVE != slot->state) {
+            continue;
+        }
+
+        /* The caller decides what an expired match means. Expired tokens merely passed by are cleared. */
+        if (0 == memcmp(slot->token, token, XNET_TOKEN_LEN)) {
+            return slot;
+        }
+        if (token_is_expired(slot, now)) {
+            token_expire_locked(table, slot);
+        }
+    }
+
+    return NULL;
+}
+
+static xnet_session_token_t *token_free_slot(xnet_token_table_t *table, const unsigned char *token)
+{
+    size_t hash = 0;
+    memcpy(&hash, token, sizeof(hash));
+
+    /* Load is capped at 3/4, so a free slot always exists. */
+    size_t mask = table->capacity - 1;
+    size_t n = hash & mask;
+    while (TOKEN_LIVE == table->entries[n].state) {
+        n = (n + 1) & mask;
+    }
+
+    return &table->entries[n];
+}
+
+static int token_rebuild(xnet_token_table_t *table, size_t capacity)
+{
+    xnet_session_token_t *old_entries = table->entries;
+    size_t old_capacity = table->capacity;
+
+    xnet_session_token_t *new_entries = calloc(capacity, sizeof(xnet_session_token_t));
+    if (NULL == new_entries) {
+        return E_GEN_FAIL_ALLOC;
+    }
+
+    table->entries = new_entries;
+    table->capacity = capacity;
+    table->count = 0;
+    table->used = 0;
+
+    /* Reinsert survivors. Tombstones and expired tokens are left behind. */
+    time_t now = token_clock();
+    for (size_t n = 0; n < old_capacity; n++) {
+        xnet_session_token_t *old_slot = &old_entries[n];
+        if (TOKEN_LIVE != old_slot->state) {
+            continue;
+        }
+
+        if (token_is_expired(old_slot, now)) {
+            old_slot->account->has_token = false;
+            continue;
+        }
+
+        *token_free_slot(table, old_slot->token) = *old_slot;
+        table->count++;
+        table->used++;
+    }
+
+    nfree((void **)&old_entries);
+    return 0;
+}
+
+static void token_revoke_locked(xnet_token_table_t *table, xnet_user_t *user)
+{
+    if (false == user->has_token) {
+        return;
+    }
+
+    xnet_session_token_t *entry = token_lookup(table, user->token);
+    if (NULL != entry && user == entry->account) {
+        entry->state = TOKEN_TOMBSTONE;
+        entry->account = NULL;
+        table->count--;
+    }
+
+    user->has_token = false;
+}
+
+static bool token_is_expired(xnet_session_token_t *entry, time_t now)
+{
+    /* 0 means the token's connection is still alive. */
+    return 0 != entry->expires && now >= entry->expires;
+}
+
+static void token_expire_locked(xnet_token_table_t *table, xnet_session_token_t *entry)
+{
+    entry->account->has_token = false;
+    entry->account = NULL;
+    entry->state = TOKEN_TOMBSTONE;
+    table->count--;
+}
@@ -1,6 +1,11 @@
 #include "xnet_utils.h"
 #include "xnet_threads.h"
+#include "xnet_buffer.h"
+#include "xnet_frame.h"
+#include "xnet_compress.h"
+#include "xnet_ratelimit.h"
 #include <fcntl.h>
+#include <sys/random.h>
 
 /* 
 xnet_session_is_valid(size_t session_id, user)
@@ -55,6 +60,77 @@ void nfree(void **ptr)
 	*ptr = NULL;
 }
 
+int xnet_random_bytes(void *buf, size_t len)
+{
+	int err = 0;
+
+	/* NULL Check */
+	if (NULL == buf) {
+		err = E_GEN_NULL_PTR;
+		goto handle_err;
+	}
+
+	/* getrandom() may return short for large requests or be interrupted, keep pulling until satisfied. */
+	size_t filled = 0;
+	while (filled < len) {
+		ssize_t got = getrandom((char *)buf + filled, len - filled, 0);
+		if (-1 == got) {
+			if (EINTR == errno) {
+				continue;
+			}
+			err = E_SRV_FAIL_RANDOM;
+			goto handle_err;
+		}
+		filled += got;
+	}
+
+	return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_random_bytes()");
+    return err;
+}
+
+int xnet_init_connections(xnet_box_t *xnet)
+{
+	int err = 0;
+
+	/* Null Check */
+	if (NULL == xnet) {
+		err = E_GEN_NULL_PTR;
+		goto handle_err;
+	}
+
+	size_t max = xnet->general->max_connections;
+	size_t rule_count = xnet->general->rate_rule_count;
+	xnet_connection_group_t *group = xnet->connections;
+	pthread_mutex_init(&group->rx_pool.lock, NULL);
+	group->clients = calloc(max, sizeof(xnet_active_connection_t));
+	group->hot = calloc(max, sizeof(xnet_conn_hot_t));
+	group->cold = calloc(max, sizeof(xnet_conn_cold_t));
+	group->rate_buckets = calloc(max * rule_count, sizeof(xnet_rate_bucket_t));
+	if (NULL == group->clients || NULL == group->hot || NULL == group->cold || NULL == group->rate_buckets) {
+		err = E_GEN_FAIL_ALLOC;
+		goto handle_err;
+	}
+
+	for (size_t n = 0; n < max; n++) {
+		group->hot[n].socket = -1;
+		group->hot[n].timer_fd = -1;
+		group->clients[n].hot = &group->hot[n];
+		group->clients[n].cold = &group->cold[n];
+		group->clients[n].rate_buckets = &group->rate_buckets[n * rule_count];
+	}
+
+	return 0;
+
+/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_init_connections()");
+    return err;
+}
+
 xnet_active_connection_t *xnet_get_conn_by_session(xnet_box_t *xnet, int timer_fd)
 {
 	int err = 0;
@@ -65,15 +141,15 @@ xnet_active_connection_t *xnet_get_conn_by_session(xnet_box_t *xnet, int timer_f
 		goto handle_err;
 	}
 
-	/* Loop through all active connections and find potential match. */
-	xnet_active_connection_t *needle = NULL;
+	/* Free slots hold -1, so only a live session can match. */
+	xnet_conn_hot_t *hot = xnet->connections->hot;
 	for (size_t n = 0; n < xnet->general->max_connections; n++) {
-		if (timer_fd == xnet->connections->clients[n].session.timer_fd) {
-			needle = &xnet->connections->clients[n];
+		if (timer_fd == hot[n].timer_fd) {
+			return &xnet->connections->clients[n];
 		}
 	}
 
-	return needle;
+	return NULL;
 
 /* Unreachable unless error is triggered. */
 handle_err:
@@ -91,15 +167,15 @@ xnet_active_connection_t *xnet_get_conn_by_socket(xnet_box_t *xnet, int socket)
 		goto handle_err;
 	}
 
-	/* Loop through all active connections and find potential match. */
-	xnet_active_connection_t *needle = NULL;
+	/* Free slots hold -1, so a recycled fd can't match the client that had it before. */
+	xnet_conn_hot_t *hot = xnet->connections->hot;
 	for (size_t n = 0; n < xnet->general->max_connections; n++) {
-		if (socket == xnet->connections->clients[n].socket) {
-			needle = &xnet->connections->clients[n];
+		if (socket == hot[n].socket) {
+			return &xnet->connections->clients[n];
 		}
 	}
 
-	return needle;
+	return NULL;
 
 /* Unreachable unless error is triggered. */
 handle_err:
@@ -130,9 +206,11 @@ xnet_active_connection_t *xnet_create_connection(xnet_box_t *xnet, int socket)
 
 	/* Start at first client, and step through until one is inactive. */
 	xnet_active_connection_t *new_client = NULL;
+	xnet_conn_hot_t *hot = NULL;
 	for (size_t n = 0; n < xnet->general->max_connections; n++) {
-		if (false == xnet->connections->clients[n].is_active) {
+		if (-1 == xnet->connections->hot[n].socket) {
 			new_client = &xnet->connections->clients[n];
+			hot = &xnet->connections->hot[n];
 			break;
 		}
 	}
@@ -159,17 +237,17 @@ xnet_active_connection_t *xnet_create_connection(xnet_box_t *xnet, int socket)
 		goto handle_err;
 	}
 
-	if (0 != clock_gettime(CLOCK_MONOTONIC, &new_client->session.t_data)) {
-		err = E_GEN_NON_ZERO;
-		goto handle_err;
-	}
-
-	xnet_begin_session(xnet, new_client);
-
-	new_client->is_active = true;
 	new_client->socket = socket;
+	hot->is_active = true;
+	hot->socket = socket;
+	hot->timer_fd = new_client->session.timer_fd;
 	xnet->connections->connection_count++;
 
+	/* A new client, handles of the last one in this slot go stale for good. Its events carry the new generation. */
+	__atomic_add_fetch(&hot->generation, 1, __ATOMIC_RELEASE);
+
+	xnet_begin_session(xnet, new_client);
+
 	return new_client;
 
 /* Unreachable unless error is triggered. */
@@ -178,6 +256,48 @@ handle_err:
     return NULL;
 }
 
+xnet_conn_handle_t xnet_conn_handle(xnet_box_t *xnet, const xnet_active_connection_t *conn)
+{
+	size_t slot = conn - xnet->connections->clients;
+	return ((xnet_conn_handle_t)__atomic_load_n(&conn->hot->generation, __ATOMIC_ACQUIRE) << 32) | slot;
+}
+
+xnet_active_connection_t *xnet_conn_from_handle(xnet_box_t *xnet, xnet_conn_handle_t handle)
+{
+	size_t slot = handle & 0xFFFFFFFF;
+	if (xnet->general->max_connections <= slot) {
+		return NULL;
+	}
+
+	xnet_active_connection_t *conn = &xnet->connections->clients[slot];
+	return xnet_handle_is_live(conn, handle) ? conn : NULL;
+}
+
+bool xnet_handle_is_live(const xnet_active_connection_t *conn, xnet_conn_handle_t handle)
+{
+	return (uint32_t)(handle >> 32) == __atomic_load_n(&conn->hot->generation, __ATOMIC_ACQUIRE);
+}
+
+uint64_t xnet_event_data(xnet_box_t *xnet, const xnet_active_connection_t *conn, bool is_session)
+{
+	return xnet_conn_handle(xnet, conn) | (is_session ? XNET_EVENT_SESSION : 0);
+}
+
+xnet_active_connection_t *xnet_conn_from_event(xnet_box_t *xnet, uint64_t data)
+{
+	size_t slot = (uint32_t)data & ~XNET_EVENT_SESSION;
+	if (xnet->general->max_connections <= slot) {
+		return NULL;
+	}
+
+	/* The generation only changes on the reactor, which is who asks. */
+	if ((uint32_t)(data >> 32) != xnet->connections->hot[slot].generation) {
+		return NULL;
+	}
+
+	return &xnet->connections->clients[slot];
+}
+
 int xnet_close_connection(xnet_box_t *xnet, xnet_active_connection_t *client)
 {
 	int err = 0;
@@ -206,14 +326,40 @@ int xnet_close_connection(xnet_box_t *xnet, xnet_active_connection_t *client)
 		xnet->general->on_client_disconnect[n](xnet, client);
     }
 
+	/* Their token stays redeemable for a while, see xnet_suspend_user(). */
+	if (NULL != client->account) {
+		xnet_suspend_user(xnet->userbase, client);
+	}
+
+	/* Retire the connection before its fds are released so no worker can write to a recycled fd.
+	   Anything still queued can't be delivered anymore. */
+	pthread_mutex_lock(&client->io_lock);
+	xnet_drop_output(client);
+	xnet_compress_destroy(client->compress);
+	client->compress = NULL;
+	client->codec = XNET_CODEC_NONE;
+	client->hot->is_working = false;
+	client->hot->is_active = false;
+	client->close_reason = XNET_CLOSE_PEER;
+	__atomic_add_fetch(&client->hot->generation, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&client->io_lock);
+
+	/* Out of the lookups before the fds can be handed to anyone else. */
+	client->hot->socket = -1;
+	client->hot->timer_fd = -1;
 	close(client->socket);
 	close(client->session.timer_fd);
-	xnet_logout_user(client);
-	memset(&client->session.t_content, 0, sizeof(struct itimerspec));
-	memset(&client->session.t_data, 0, sizeof(struct timespec));
-	memset(&client->session.session_event, 0, sizeof(struct epoll_event));
-	memset(&client->client_event, 0, sizeof(struct epoll_event));
-	client->is_active = false;
+	memset(client->cold->addon_data, 0, sizeof(client->cold->addon_data));
+	client->wire_format = XNET_WIRE_FIXED;
+	xnet_close_file_sink(xnet, client, E_SRV_BAD_SOCKET);
+	xnet_release_frame(xnet, client);
+	client->rx_have = 0;
+	client->rx_skip = 0;
+	xnet_drop_held(xnet, client);
+	if (NULL != client->rate_buckets) {
+		memset(client->rate_buckets, 0, xnet->general->rate_rule_count * sizeof(xnet_rate_bucket_t));
+	}
+	xnet_reset_flows(xnet, client);
 	client->session.id = 0;
 	xnet->connections->connection_count--;
 
@@ -237,11 +383,11 @@ void xnet_debug_connections(xnet_box_t *xnet)
 	printf("Max Connections: %ld\n", xnet->general->max_connections);
 	printf("Active Connections: %ld\n", xnet->connections->connection_count);
 	for (size_t n = 0; n < xnet->general->max_connections; n++) {
-		if (true == xnet->connections->clients[n].is_active) {
+		if (true == xnet->connections->hot[n].is_active) {
 			printf("---------------\n");
 			printf("Connection #: %ld\n", n+1);
 			printf("Index position: %ld\n", n);
-			printf("Active: %d\n", xnet->connections->clients[n].is_active);
+			printf("Active: %d\n", xnet->connections->hot[n].is_active);
 			printf("Socket: %d\n", xnet->connections->clients[n].socket);
 			printf("Session: %d (%d)\n", xnet->connections->clients[n].session.id, xnet->connections->clients[n].session.timer_fd);
 			printf("---------------\n");
@@ -251,47 +397,33 @@ void xnet_debug_connections(xnet_box_t *xnet)
 	return;
 }
 
-short xnet_get_opcode(xnet_box_t *xnet, int client_fd)
+int epoll_ctl_add(int epoll_fd, struct epoll_event *an_event, int fd, uint32_t event_list)
 {
-	int err = 0;
-
-	/* NULL Check */
-	if (NULL == xnet) {
-		err = E_GEN_NULL_PTR;
-		goto handle_err;
-	}
-
-	/* Do a partial read on buffer. */
-	ssize_t bytes_read = read(client_fd, &err, sizeof(short));
-	
-	/* EOF Check for client disconnect. */
-	if (0 == bytes_read) {
-		xnet_active_connection_t *this_client = xnet_get_conn_by_socket(xnet, client_fd);
-		if (NULL == this_client) {
-			err = E_GEN_NULL_PTR;
-			goto handle_err;
-		}
-
-		int close_status = xnet_close_connection(xnet, this_client);
-		if (0 != close_status) {
-			err = E_GEN_NON_ZERO;
-			goto handle_err;
-		}
+    if (NULL == an_event) {
+        fprintf(stderr, "No event given.\n");
+        return -1;
+    }
 
-		xnet_debug_connections(xnet);
-	}
+    an_event->events = event_list;
+    an_event->data.u64 = (uint32_t)fd;
+    int result = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, an_event);
+    return result;
+}
 
-	/* Network to host byte order. */
-	return ntohs(err);
+int epoll_ctl_mod(int epoll_fd, struct epoll_event *an_event, int fd, uint32_t event_list)
+{
+	if (NULL == an_event) {
+		fprintf(stderr, "No event given.\n");
+		return -1;
+    }
 
-	/* Unreachable unless error is triggered. */
-handle_err:
-    g_show_err(err, "xnet_get_opcode()");
-	err = 0;
-    return err;
+    an_event->events = event_list;
+    an_event->data.u64 = (uint32_t)fd;
+    int result = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, an_event);
+    return result;
 }
 
-int epoll_ctl_add(int epoll_fd, struct epoll_event *an_event, int fd, uint32_t event_list)
+int epoll_ctl_add_data(int epoll_fd, struct epoll_event *an_event, int fd, uint64_t data, uint32_t event_list)
 {
     if (NULL == an_event) {
         fprintf(stderr, "No event given.\n");
@@ -299,25 +431,25 @@ int epoll_ctl_add(int epoll_fd, struct epoll_event *an_event, int fd, uint32_t e
     }
 
     an_event->events = event_list;
-    an_event->data.fd = fd;
+    an_event->data.u64 = data;
     int result = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, an_event);
     return result;
 }
 
-int epoll_ctl_mod(int epoll_fd, struct epoll_event *an_event, int fd, uint32_t event_list)
+int epoll_ctl_mod_data(int epoll_fd, struct epoll_event *an_event, int fd, uint64_t data, uint32_t event_list)
 {
-	if (NULL == an_event) {
-		fprintf(stderr, "No event given.\n");
-		return -1;
+    if (NULL == an_event) {
+        fprintf(stderr, "No event given.\n");
+        return -1;
     }
 
     an_event->events = event_list;
-    an_event->data.fd = fd;
+    an_event->data.u64 = data;
     int result = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, an_event);
     return result;
 }
 
-int xnet_insert_feature(xnet_box_t *xnet, size_t opcode, int (*new_perform)(xnet_box_t *xnet, xnet_active_connection_t *client))
+int xnet_insert_feature(xnet_box_t *xnet, size_t opcode, enum xnet_priority priority, int (*new_perform)(xnet_box_t *xnet, xnet_active_connection_t *client))
 {
 	int err = -1;
 
@@ -333,15 +465,16 @@ int xnet_insert_feature(xnet_box_t *xnet, size_t opcode, int (*new_perform)(xnet
 	}
 
 	/* Is opcode within range? */
-	if (XNET_MAX_FEATURES <= opcode) {
+	if (XNET_MAX_FEATURES <= opcode || XNET_PRIORITY_CLASSES <= (unsigned int)priority) {
 		err = E_GEN_OUT_RANGE;
 		goto handle_err;
 	}
 
 	/* Check if opcode is in use to avoid collisions. */
 	if (NULL == xnet->general->perform[opcode]) {
-		/* Associate valid opcode with addon function. */
+		/* Associate valid opcode with addon function, and its requests with a scheduling class. */
 		xnet->general->perform[opcode] = new_perform;
+		xnet->general->priority_of[opcode] = priority;
 		err = 0;
 	}
 
@@ -430,13 +563,37 @@ handle_err:
     return err;
 }
 
+int xnet_reserve_addon_slot(xnet_box_t *xnet)
+{
+	int err = 0;
+
+	/* NULL Check */
+	if (NULL == xnet) {
+		err = E_GEN_NULL_PTR;
+		goto handle_err;
+	}
+
+	/* Are there slots left? */
+	if (XNET_MAX_ADDON_SLOTS <= xnet->general->addon_slot_count) {
+		err = E_GEN_OUT_RANGE;
+		goto handle_err;
+	}
+
+	return xnet->general->addon_slot_count++;
+
+	/* Unreachable unless error is triggered. */
+handle_err:
+    g_show_err(err, "xnet_reserve_addon_slot()");
+    return -1;
+}
+
 void flush_buffer(int fd)
 {
-	char packet_trash[XNET_MAX_PACKET_BUF_SZ] = {0};
-    ssize_t bytes_read = read(fd, packet_trash, XNET_MAX_PACKET_BUF_SZ);
-    while (0 < bytes_read) {
-        bytes_read = read(fd, packet_trash, XNET_MAX_PACKET_BUF_SZ);
-    }
+	/* TCP drops truncated bytes in the kernel, so they are never copied out. */
+	ssize_t bytes_read = recv(fd, NULL, XNET_MAX_FRAME_SZ, MSG_TRUNC | MSG_DONTWAIT);
+	while (0 < bytes_read) {
+		bytes_read = recv(fd, NULL, XNET_MAX_FRAME_SZ, MSG_TRUNC | MSG_DONTWAIT);
+	}
 }
 
 static int xnet_new_session(xnet_active_connection_t *client)
@@ -448,7 +605,13 @@ static int xnet_new_session(xnet_active_connection_t *client)
 		goto handle_err;
 	}
 
-	client->session.id = rand() / 100;
+	/* Session ids are handed out to clients, so they must not be predictable. */
+	unsigned int new_id = 0;
+	err = xnet_random_bytes(&new_id, sizeof(new_id));
+	if (0 != err) {
+		goto handle_err;
+	}
+	client->session.id = new_id & INT_MAX;
 	
 	return 0;
 
@@ -462,16 +625,26 @@ static int xnet_begin_session(xnet_box_t *xnet, xnet_active_connection_t *client
 {
 	int err = 0;
 
+	struct timespec now = {0};
+	if (0 != clock_gettime(CLOCK_MONOTONIC, &now)) {
+		err = E_GEN_NON_ZERO;
+		goto handle_err;
+	}
+
 	size_t interval = xnet->general->connection_timeout;
-	client->session.t_content.it_value.tv_sec = client->session.t_data.tv_sec + interval;
-	client->session.t_content.it_interval.tv_sec = interval;
+	struct itimerspec expiry = {0};
+	expiry.it_value.tv_sec = now.tv_sec + interval;
+	expiry.it_interval.tv_sec = interval;
 
-	err = timerfd_settime(client->session.timer_fd, TFD_TIMER_ABSTIME, &client->session.t_content, NULL);
+	err = timerfd_settime(client->session.timer_fd, TFD_TIMER_ABSTIME, &expiry, NULL);
 	if (0 != err) {
 		err = E_GEN_NON_ZERO;
 		goto handle_err;
 	}
-	epoll_ctl_add(xnet->network->epoll_fd, &client->session.session_event, client->session.timer_fd, EPOLLIN);
+
+	struct epoll_event session_event = {0};
+	epoll_ctl_add_data(xnet->network->epoll_fd, &session_event, client->session.timer_fd,
+	                   xnet_event_data(xnet, client, true), EPOLLIN);
 
 	return err;
 
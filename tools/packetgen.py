@@ -0,0 +1,712 @@
+#!/usr/bin/env python3
+"""
+Generates packet parsers and serializers from a packet schema.
+
+usage: packetgen.py SCHEMA --header H_FILE --source C_FILE --python PY_FILE
+
+See schema/chat_packets.schema for the schema syntax. The C side gets, per packet:
+    <prefix>_parse_<name>_request()  single pass over a contiguous buffer, string fields become views into it
+    <prefix>_recv_<name>_request()   pulls the request off a connection, framed or legacy, then parses it
+    <prefix>_write_<name>_reply()    writes the reply straight into an output buffer
+The Python side gets one packet builder class per packet.
+"""
+import argparse
+import os
+import sys
+
+INT_TYPES = {
+    # type: (C type, size, struct format, min, max)
+    "i16": ("int16_t", 2, "h", -(1 << 15), (1 << 15) - 1),
+    "u16": ("uint16_t", 2, "H", 0, (1 << 16) - 1),
+    "i32": ("int32_t", 4, "i", -(1 << 31), (1 << 31) - 1),
+    "u32": ("uint32_t", 4, "I", 0, (1 << 32) - 1),
+    "u64": ("uint64_t", 8, "Q", 0, (1 << 64) - 1),
+}
+PREFIX_TYPES = ("i32", "u16", "u8")
+PREFIX_SIZES = {"i32": 4, "u16": 2, "u8": 1}
+PREFIX_FORMATS = {"i32": "i", "u16": "H", "u8": "B"}
+
+
+class SchemaError(Exception):
+    pass
+
+
+class Field:
+    def __init__(self, kind, name, int_type=None, enum=None, size=None, prefix=None, max_len=None, padded=False):
+        self.kind = kind
+        self.name = name
+        self.int_type = int_type
+        self.enum = enum or []
+        self.size = size
+        self.prefix = prefix
+        self.max_len = max_len
+        self.padded = padded
+
+
+class Packet:
+    def __init__(self, name, opcode, cls):
+        self.name = name
+        self.opcode = opcode
+        self.cls = cls
+        self.python_attrs = []
+        self.request = []
+        self.reply = []
+
+
+class Schema:
+    def __init__(self):
+        self.prefix = None
+        self.consts = []
+        self.packets = []
+
+    def value_of(self, token):
+        for name, value, _ in self.consts:
+            if name == token:
+                return value
+        try:
+            return int(token, 0)
+        except ValueError:
+            raise SchemaError(f"unknown constant '{token}'")
+
+
+def parse_field(schema, words, line_no):
+    kind = words[0]
+    if kind in INT_TYPES:
+        if 2 > len(words):
+            raise SchemaError(f"line {line_no}: {kind} needs a name")
+        enum = []
+        if 2 < len(words):
+            if "enum" != words[2]:
+                raise SchemaError(f"line {line_no}: expected 'enum'")
+            for pair in words[3:]:
+                label, _, value = pair.partition("=")
+                enum.append((label, int(value, 0)))
+        return Field("int", words[1], int_type=kind, enum=enum)
+
+    if "bytes" == kind:
+        if 3 != len(words):
+            raise SchemaError(f"line {line_no}: bytes NAME SIZE")
+        schema.value_of(words[2])
+        return Field("bytes", words[1], size=words[2])
+
+    if "string" == kind:
+        if len(words) not in (4, 5) or words[2] not in PREFIX_TYPES:
+            raise SchemaError(f"line {line_no}: string NAME i32|u16|u8 MAX [padded]")
+        padded = 5 == len(words)
+        if padded and "padded" != words[4]:
+            raise SchemaError(f"line {line_no}: expected 'padded'")
+        schema.value_of(words[3])
+        return Field("string", words[1], prefix=words[2], max_len=words[3], padded=padded)
+
+    raise SchemaError(f"line {line_no}: unknown field type '{kind}'")
+
+
+def parse_schema(path):
+    schema = Schema()
+    packet = None
+    section = None
+
+    with open(path) as schema_file:
+        for line_no, line in enumerate(schema_file, 1):
+            words = line.split("#", 1)[0].split()
+            if not words:
+                continue
+
+            keyword = words[0]
+            if "prefix" == keyword:
+                schema.prefix = words[1]
+            elif keyword in ("const", "extern"):
+                schema.consts.append((words[1], int(words[2], 0), "extern" == keyword))
+            elif "packet" == keyword:
+                packet = Packet(words[1], int(words[2], 0), words[3])
+                schema.packets.append(packet)
+                section = None
+            elif "python" == keyword:
+                if packet is None:
+                    raise SchemaError(f"line {line_no}: python outside a packet")
+                attr, _, value = " ".join(words[1:]).partition("=")
+                packet.python_attrs.append((attr.strip(), value.strip()))
+            elif keyword in ("request", "reply"):
+                if packet is None:
+                    raise SchemaError(f"line {line_no}: {keyword} outside a packet")
+                section = packet.request if "request" == keyword else packet.reply
+            else:
+                if section is None:
+                    raise SchemaError(f"line {line_no}: field outside a request or reply")
+                section.append(parse_field(schema, words, line_no))
+
+    if schema.prefix is None:
+        raise SchemaError("missing 'prefix'")
+    return schema
+
+
+# ---------------------------------------------------------------- C
+
+def c_size_expr(fields, leading=0):
+    parts = [str(leading)] if leading else []
+    for field in fields:
+        if "int" == field.kind:
+            parts.append(str(INT_TYPES[field.int_type][1]))
+        elif "bytes" == field.kind:
+            parts.append(field.size)
+        else:
+            parts.append(str(PREFIX_SIZES[field.prefix]))
+            parts.append(field.max_len)
+    return "(" + " + ".join(parts or ["0"]) + ")"
+
+
+def c_get(size, ptr):
+    return {1: f"(uint8_t)({ptr})[0]", 2: f"get_be16({ptr})", 4: f"get_be32({ptr})", 8: f"get_be64({ptr})"}[size]
+
+
+def c_put(size, ptr, value):
+    return {1: f"({ptr})[0] = (char){value}", 2: f"put_be16({ptr}, {value})",
+            4: f"put_be32({ptr}, {value})", 8: f"put_be64({ptr}, {value})"}[size]
+
+
+def c_prefix_type(prefix):
+    return {"i32": "int32_t", "u16": "uint16_t", "u8": "uint8_t"}[prefix]
+
+
+def gen_header(schema, out_name, schema_name):
+    p = schema.prefix
+    guard = os.path.basename(out_name).upper().replace(".", "_")
+    lines = [
+        "/**",
+        f" * @file        {os.path.basename(out_name)}",
+        " * @author      Kameryn Gaige Knight",
+        f" * @brief       Generated from {schema_name} by tools/packetgen.py. Do not edit, run 'make packets'.",
+        " * @version     1.0",
+        " * @date        2026-10-19",
+        " *",
+        " * @copyright   Copyright (c) 2022 Kameryn Gaige Knight",
+        " * License      MIT",
+        " */",
+        f"#ifndef {guard}",
+        f"#define {guard}",
+        "",
+        "#ifdef __cplusplus",
+        'extern "C" {',
+        "#endif",
+        "",
+        "#include <stdint.h>",
+        "#include <endian.h>",
+        "",
+        '#include "xnet_base.h"',
+        '#include "xnet_frame.h"',
+        "",
+    ]
+
+    own = [(name, value) for name, value, is_extern in schema.consts if not is_extern]
+    if own:
+        lines.append("/* Constants */")
+        for name, value in own:
+            lines.append(f"#define {name} {value}")
+        lines.append("")
+
+    lines.append("/* Opcodes */")
+    for packet in schema.packets:
+        lines.append(f"#define {p.upper()}_{packet.name.upper()}_OP {packet.opcode}")
+    lines.append("")
+
+    enums = [(packet, field) for packet in schema.packets for field in packet.request + packet.reply if field.enum]
+    if enums:
+        lines.append("/* Enumerated field values */")
+        for packet, field in enums:
+            for label, value in field.enum:
+                lines.append(f"#define {p.upper()}_{packet.name.upper()}_{label.upper()} {value}")
+        lines.append("")
+
+    lines += [
+        "/* Points into the buffer a packet was parsed from. Not NUL terminated. */",
+        f"typedef struct {p}_view {{",
+        "    const char *data;",
+        "    size_t length;",
+        f"}} {p}_view_t ;",
+        "",
+    ]
+
+    for packet in schema.packets:
+        base = f"{p}_{packet.name}"
+        for section, fields in (("request", packet.request), ("reply", packet.reply)):
+            if not fields and "request" == section:
+                continue
+            lines.append(f"typedef struct {base}_{section} {{")
+            for field in fields:
+                if "int" == field.kind:
+                    lines.append(f"    {INT_TYPES[field.int_type][0]} {field.name};")
+                else:
+                    lines.append(f"    {p}_view_t {field.name};")
+            lines.append(f"}} {base}_{section}_t ;")
+            leading = 2 if "reply" == section else 0
+            lines.append(f"#define {base.upper()}_{section.upper()}_MAX_SZ {c_size_expr(fields, leading)}")
+            lines.append("")
+
+    for packet in schema.packets:
+        base = f"{p}_{packet.name}"
+        if packet.request:
+            lines += [
+                "/**",
+                f" * @brief Validates a {packet.name} request in @param buf in one pass. Views in @param out point into @param buf.",
+                " *",
+                " * @return int 0 on success. E_GEN_OUT_RANGE when the request is malformed.",
+                " */",
+                f"int {base}_parse_request(const char *buf, size_t length, {base}_request_t *out);",
+                "",
+                "/**",
+                f" * @brief Takes the {packet.name} request @param conn is being served for and parses it.",
+                " *        Framed requests are parsed in place. Legacy ones are read into @param scratch first.",
+                " *",
+                f" * @param scratch Room for {base.upper()}_REQUEST_MAX_SZ bytes. Views may point into it.",
+                " * @return int 0 on success. Non-zero when the request is malformed or incomplete.",
+                " */",
+                f"int {base}_recv_request(xnet_active_connection_t *conn, char *scratch, {base}_request_t *out);",
+                "",
+            ]
+        lines += [
+            "/**",
+            f" * @brief Writes a {packet.name} reply to @param out.",
+            " *",
+            f" * @param out Room for {base.upper()}_REPLY_MAX_SZ bytes.",
+            " * @return size_t Bytes written.",
+            " */",
+            f"size_t {base}_write_reply(char *out, const {base}_reply_t *in);",
+            "",
+        ]
+
+    lines += [
+        "#ifdef __cplusplus",
+        "}",
+        "#endif",
+        "",
+        "#endif // KAMERYN GAIGE KNIGHT",
+        "",
+    ]
+    return "\n".join(lines)
+
+
+def gen_parse(p, packet):
+    base = f"{p}_{packet.name}"
+    lines = [
+        f"int {base}_parse_request(const char *buf, size_t length, {base}_request_t *out)",
+        "{",
+        "    size_t offset = 0;",
+        "",
+    ]
+    for field in packet.request:
+        lines.append(f"    /* {field.name} */")
+        if "int" == field.kind:
+            c_type, size, _, _, _ = INT_TYPES[field.int_type]
+            lines += [
+                f"    if ({size} > length - offset) {{",
+                "        return E_GEN_OUT_RANGE;",
+                "    }",
+                f"    out->{field.name} = ({c_type}){c_get(size, 'buf + offset')};",
+                f"    offset += {size};",
+            ]
+            if field.enum:
+                checks = " && ".join(f"{value} != out->{field.name}" for _, value in field.enum)
+                lines += [
+                    f"    if ({checks}) {{",
+                    "        return E_GEN_OUT_RANGE;",
+                    "    }",
+                ]
+        elif "bytes" == field.kind:
+            lines += [
+                f"    if ({field.size} > length - offset) {{",
+                "        return E_GEN_OUT_RANGE;",
+                "    }",
+                f"    out->{field.name}.data = buf + offset;",
+                f"    out->{field.name}.length = {field.size};",
+                f"    offset += {field.size};",
+            ]
+        else:
+            size = PREFIX_SIZES[field.prefix]
+            taken = field.max_len if field.padded else f"{field.name}_length"
+            lines += [
+                f"    if ({size} > length - offset) {{",
+                "        return E_GEN_OUT_RANGE;",
+                "    }",
+                f"    {c_prefix_type(field.prefix)} {field.name}_length = ({c_prefix_type(field.prefix)}){c_get(size, 'buf + offset')};",
+                f"    offset += {size};",
+                f"    if ({'0 > ' + field.name + '_length || ' if 'i32' == field.prefix else ''}{field.max_len} < {field.name}_length || (size_t){taken} > length - offset) {{",
+                "        return E_GEN_OUT_RANGE;",
+                "    }",
+                f"    out->{field.name}.data = buf + offset;",
+                f"    out->{field.name}.length = {field.name}_length;",
+                f"    offset += {taken};",
+            ]
+        lines.append("")
+    lines += [
+        "    return 0;",
+        "}",
+        "",
+    ]
+    return lines
+
+
+def gen_recv(p, packet):
+    base = f"{p}_{packet.name}"
+    lines = [
+        f"int {base}_recv_request(xnet_active_connection_t *conn, char *scratch, {base}_request_t *out)",
+        "{",
+        "    /* Framed requests are already whole. Views point straight into the frame. */",
+        "    size_t length = 0;",
+        "    const char *payload = xnet_conn_payload(conn, &length);",
+        "    if (NULL != payload) {",
+        f"        return {base}_parse_request(payload, length, out);",
+        "    }",
+        "",
+        "    /* Legacy requests carry no length, so read exactly what the layout says, field by field. */",
+        "    size_t offset = 0;",
+        "",
+    ]
+    for field in packet.request:
+        lines.append(f"    /* {field.name} */")
+        if "int" == field.kind:
+            size = INT_TYPES[field.int_type][1]
+            lines += [
+                f"    if (0 != read_exact(conn, scratch + offset, {size})) {{",
+                "        return E_GEN_OUT_RANGE;",
+                "    }",
+                f"    offset += {size};",
+            ]
+        elif "bytes" == field.kind:
+            lines += [
+                f"    if (0 != read_exact(conn, scratch + offset, {field.size})) {{",
+                "        return E_GEN_OUT_RANGE;",
+                "    }",
+                f"    offset += {field.size};",
+            ]
+        else:
+            size = PREFIX_SIZES[field.prefix]
+            c_type = c_prefix_type(field.prefix)
+            taken = field.max_len if field.padded else f"{field.name}_length"
+            lines += [
+                f"    if (0 != read_exact(conn, scratch + offset, {size})) {{",
+                "        return E_GEN_OUT_RANGE;",
+                "    }",
+                f"    {c_type} {field.name}_length = ({c_type}){c_get(size, 'scratch + offset')};",
+                f"    offset += {size};",
+                f"    if ({'0 > ' + field.name + '_length || ' if 'i32' == field.prefix else ''}{field.max_len} < {field.name}_length) {{",
+                "        return E_GEN_OUT_RANGE;",
+                "    }",
+                f"    if (0 != read_exact(conn, scratch + offset, {taken})) {{",
+                "        return E_GEN_OUT_RANGE;",
+                "    }",
+                f"    offset += {taken};",
+            ]
+        lines.append("")
+    lines += [
+        f"    return {base}_parse_request(scratch, offset, out);",
+        "}",
+        "",
+    ]
+    return lines
+
+
+def gen_write(p, packet):
+    base = f"{p}_{packet.name}"
+    lines = [
+        f"size_t {base}_write_reply(char *out, const {base}_reply_t *in)",
+        "{",
+        "    size_t offset = 0;",
+        "",
+        f"    put_be16(out + offset, {p.upper()}_{packet.name.upper()}_OP);",
+        "    offset += 2;",
+        "",
+    ]
+    for field in packet.reply:
+        lines.append(f"    /* {field.name} */")
+        if "int" == field.kind:
+            size = INT_TYPES[field.int_type][1]
+            cast = {2: "uint16_t", 4: "uint32_t", 8: "uint64_t"}[size]
+            lines += [
+                f"    {c_put(size, 'out + offset', f'({cast})in->' + field.name)};",
+                f"    offset += {size};",
+            ]
+        elif "bytes" == field.kind:
+            lines += [
+                f"    put_padded(out + offset, &in->{field.name}, {field.size});",
+                f"    offset += {field.size};",
+            ]
+        else:
+            size = PREFIX_SIZES[field.prefix]
+            cast = {1: "uint8_t", 2: "uint16_t", 4: "uint32_t"}[size]
+            lines += [
+                f"    size_t {field.name}_length = clamp_view(&in->{field.name}, {field.max_len});",
+                f"    {c_put(size, 'out + offset', f'({cast}){field.name}_length')};",
+                f"    offset += {size};",
+            ]
+            if field.padded:
+                lines += [
+                    f"    put_padded(out + offset, &in->{field.name}, {field.max_len});",
+                    f"    offset += {field.max_len};",
+                ]
+            else:
+                lines += [
+                    f"    if (0 < {field.name}_length) {{",
+                    f"        memcpy(out + offset, in->{field.name}.data, {field.name}_length);",
+                    "    }",
+                    f"    offset += {field.name}_length;",
+                ]
+        lines.append("")
+    lines += [
+        "    return offset;",
+        "}",
+        "",
+    ]
+    return lines
+
+
+def gen_source(schema, header_name):
+    p = schema.prefix
+    lines = [
+        f'#include "{os.path.basename(header_name)}"',
+        "",
+        "/* Generated by tools/packetgen.py. Do not edit, run 'make packets'. */",
+        "",
+    ]
+
+    externs = [(name, value) for name, value, is_extern in schema.consts if is_extern]
+    if externs:
+        lines.append("/* The client was generated with these values. Fails to compile if XNet disagrees. */")
+        for name, value in externs:
+            lines.append(f"typedef char {p}_check_{name.lower()}[({name} == {value}) ? 1 : -1];")
+        lines.append("")
+
+    lines += [
+        "/* Inline, so schemas that don't need every helper compile without warnings. */",
+        "static inline uint16_t get_be16(const char *src)",
+        "{",
+        "    uint16_t value = 0;",
+        "    memcpy(&value, src, sizeof(value));",
+        "    return ntohs(value);",
+        "}",
+        "",
+        "static inline uint32_t get_be32(const char *src)",
+        "{",
+        "    uint32_t value = 0;",
+        "    memcpy(&value, src, sizeof(value));",
+        "    return ntohl(value);",
+        "}",
+        "",
+        "static inline uint64_t get_be64(const char *src)",
+        "{",
+        "    uint64_t value = 0;",
+        "    memcpy(&value, src, sizeof(value));",
+        "    return be64toh(value);",
+        "}",
+        "",
+        "static inline void put_be16(char *dst, uint16_t value)",
+        "{",
+        "    value = htons(value);",
+        "    memcpy(dst, &value, sizeof(value));",
+        "}",
+        "",
+        "static inline void put_be32(char *dst, uint32_t value)",
+        "{",
+        "    value = htonl(value);",
+        "    memcpy(dst, &value, sizeof(value));",
+        "}",
+        "",
+        "static inline void put_be64(char *dst, uint64_t value)",
+        "{",
+        "    value = htobe64(value);",
+        "    memcpy(dst, &value, sizeof(value));",
+        "}",
+        "",
+        "/* Views longer than their field are cut short. Empty views may have no data at all. */",
+        f"static inline size_t clamp_view(const {p}_view_t *view, size_t max_length)",
+        "{",
+        "    if (NULL == view->data) {",
+        "        return 0;",
+        "    }",
+        "    return (max_length < view->length) ? max_length : view->length;",
+        "}",
+        "",
+        f"static inline void put_padded(char *dst, const {p}_view_t *view, size_t size)",
+        "{",
+        "    size_t length = clamp_view(view, size);",
+        "    if (0 < length) {",
+        "        memcpy(dst, view->data, length);",
+        "    }",
+        "    memset(dst + length, 0, size - length);",
+        "}",
+        "",
+        "static inline int read_exact(xnet_active_connection_t *conn, char *dst, size_t length)",
+        "{",
+        "    while (0 < length) {",
+        "        ssize_t bytes_read = xnet_conn_read(conn, dst, length);",
+        "        if (-1 == bytes_read && EINTR == errno) {",
+        "            continue;",
+        "        }",
+        "        if (0 >= bytes_read) {",
+        "            return E_GEN_OUT_RANGE;",
+        "        }",
+        "        dst += bytes_read;",
+        "        length -= bytes_read;",
+        "    }",
+        "    return 0;",
+        "}",
+        "",
+    ]
+
+    for packet in schema.packets:
+        if packet.request:
+            lines += gen_parse(p, packet)
+            lines += gen_recv(p, packet)
+        lines += gen_write(p, packet)
+
+    while lines and "" == lines[-1]:
+        lines.pop()
+    return "\n".join(lines) + "\n"
+
+
+# ---------------------------------------------------------------- Python
+
+def py_enum_attr(field):
+    return f"{field.name}s"
+
+
+def py_reply_format(schema, packet):
+    parts = ["!h"]
+    for field in packet.reply:
+        if "int" == field.kind:
+            parts.append(INT_TYPES[field.int_type][2])
+        elif "bytes" == field.kind:
+            parts.append(f"{schema.value_of(field.size)}s")
+        elif field.padded:
+            parts.append(f"{PREFIX_FORMATS[field.prefix]}{schema.value_of(field.max_len)}s")
+        else:
+            return None
+    return "".join(parts)
+
+
+def gen_python(schema, schema_name):
+    lines = [
+        f"# Generated from {schema_name} by tools/packetgen.py. Do not edit, run 'make packets'.",
+        "import struct",
+        "from abc import ABC, abstractmethod",
+        "",
+    ]
+    for name, value, _ in schema.consts:
+        lines.append(f"{name} = {value}")
+    lines += [
+        "",
+        "FRAME_FLAG = 0x8000",
+        "",
+        "def frame_packet(packet):",
+        "    # Framed requests carry [opcode | FRAME_FLAG][payload length] ahead of the same payload.",
+        '    opcode = struct.unpack("!H", packet[:2])[0]',
+        '    return struct.pack("!HI", opcode | FRAME_FLAG, len(packet) - 2) + packet[2:]',
+        "",
+        "class BasePacket(ABC):",
+        "    opcode : int",
+        "    ",
+        "    @abstractmethod",
+        "    def construct(self):",
+        "        raise NotImplementedError",
+    ]
+
+    for packet in schema.packets:
+        cls = packet.cls
+        lines += ["", "", f"class {cls}(BasePacket):", f"    opcode = {packet.opcode}"]
+        for attr, value in packet.python_attrs:
+            lines.append(f"    {attr} = {value}")
+        for field in packet.reply:
+            if field.enum:
+                pairs = ", ".join(f'"{label}": {value}' for label, value in field.enum)
+                lines.append(f"    {py_enum_attr(field)} = {{{pairs}}}")
+        for field in packet.request:
+            if field.enum:
+                pairs = ", ".join(f'"{label}": {value}' for label, value in field.enum)
+                lines.append(f"    {py_enum_attr(field)} = {{{pairs}}}")
+            elif "bytes" == field.kind:
+                lines.append(f"    {field.name}_len = {field.size}")
+            elif "string" == field.kind:
+                lines.append(f"    max_{field.name}_len = {field.max_len}")
+        reply_format = py_reply_format(schema, packet)
+        if reply_format:
+            lines.append(f'    reply_format = "{reply_format}"')
+
+        names = [field.name for field in packet.request]
+        lines += ["", f"    def __init__(self{''.join(', ' + name for name in names)}):"]
+        for field in packet.request:
+            if field.enum:
+                lines.append(f"        self.{field.name} = {cls}.{py_enum_attr(field)}.get({field.name}, {field.name})")
+            else:
+                lines.append(f"        self.{field.name} = {field.name}")
+        if not names:
+            lines.append("        pass")
+
+        lines += ["", "    def construct(self):"]
+        format_parts = ["!H"]
+        values = [f"{cls}.opcode"]
+        for field in packet.request:
+            if "int" == field.kind:
+                _, _, fmt, low, high = INT_TYPES[field.int_type]
+                if field.enum:
+                    lines += [f"        if self.{field.name} not in {cls}.{py_enum_attr(field)}.values():", "            return"]
+                else:
+                    lines += [f"        if not {low} <= self.{field.name} <= {high}:", "            return"]
+                format_parts.append(fmt)
+                values.append(f"self.{field.name}")
+            elif "bytes" == field.kind:
+                lines += [f"        if self.{field.name} is None or len(self.{field.name}) != {cls}.{field.name}_len:", "            return"]
+                format_parts.append(f"{{{cls}.{field.name}_len}}s")
+                values.append(f"self.{field.name}")
+            else:
+                lines += [
+                    f'        {field.name} = self.{field.name}.encode("utf-8")',
+                    f"        if len({field.name}) > {cls}.max_{field.name}_len:",
+                    "            return",
+                ]
+                format_parts.append(PREFIX_FORMATS[field.prefix])
+                format_parts.append(f"{{{cls}.max_{field.name}_len}}s" if field.padded else f"{{len({field.name})}}s")
+                values += [f"len({field.name})", field.name]
+        lines += [
+            "",
+            f'        format = f"{"".join(format_parts)}"',
+            f"        packet = struct.pack(format, {', '.join(values)})",
+            "        return packet",
+        ]
+
+    return "\n".join(lines) + "\n"
+
+
+def write_if_changed(path, content):
+    try:
+        with open(path) as existing:
+            if existing.read() == content:
+                return
+    except FileNotFoundError:
+        pass
+    with open(path, "w") as out:
+        out.write(content)
+    print(f"packetgen: wrote {path}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate packet parsers and serializers from a schema.")
+    parser.add_argument("schema")
+    parser.add_argument("--header", required=True)
+    parser.add_argument("--source", required=True)
+    parser.add_argument("--python", required=True)
+    args = parser.parse_args()
+
+    try:
+        schema = parse_schema(args.schema)
+    except SchemaError as e:
+        print(f"packetgen: {args.schema}: {e}", file=sys.stderr)
+        return 1
+
+    schema_name = os.path.relpath(args.schema).replace(os.sep, "/")
+    write_if_changed(args.header, gen_header(schema, args.header, schema_name))
+    write_if_changed(args.source, gen_source(schema, args.header))
+    write_if_changed(args.python, gen_python(schema, schema_name))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())